@@ -0,0 +1,128 @@
+#include "benchmark_runner.hpp"
+#include "../ConvolutionalNeuralNetwork/code/matrix.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static std::string escape_json(const std::string& value)
+{
+	std::string result = "";
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+		{
+			result += '\\';
+		}
+		result += c;
+	}
+	return result;
+}
+
+benchmark_runner::benchmark_runner(double min_time_ms, size_t max_iterations)
+	:min_time_ms(min_time_ms),
+	max_iterations(max_iterations)
+{
+	if (max_iterations == 0)
+	{
+		throw std::invalid_argument("the max iterations must be greater than 0");
+	}
+}
+
+const benchmark_result& benchmark_runner::run(
+	const std::string& suite,
+	const std::string& name,
+	bool on_gpu,
+	const std::string& shape,
+	size_t items_per_run,
+	const std::function<void()>& function)
+{
+	//warm up
+	function();
+	if (on_gpu)
+	{
+		gpu_sync_current_stream();
+	}
+
+	benchmark_result result;
+	result.suite = suite;
+	result.name = name;
+	result.device = on_gpu ? "gpu" : "cpu";
+	result.shape = shape;
+	result.min_ms = 0;
+
+	double total_ms = 0;
+	while (result.iterations < max_iterations && total_ms < min_time_ms)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		function();
+		if (on_gpu)
+		{
+			gpu_sync_current_stream();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		const double curr_ms = std::chrono::duration<double, std::milli>(end - start).count();
+		result.min_ms = result.iterations == 0 ? curr_ms : std::min(result.min_ms, curr_ms);
+		total_ms += curr_ms;
+		result.iterations++;
+	}
+
+	result.mean_ms = total_ms / (double)result.iterations;
+	if (items_per_run != 0 && result.mean_ms > 0)
+	{
+		result.items_per_second = (double)items_per_run / (result.mean_ms / 1000.0);
+	}
+
+	add(result);
+	return results.back();
+}
+
+void benchmark_runner::add(const benchmark_result& result)
+{
+	results.push_back(result);
+	std::cout
+		<< result.suite << " " << result.name << " (" << result.device << ", " << result.shape << "): "
+		<< result.mean_ms << "ms" << std::endl;
+}
+
+const std::vector<benchmark_result>& benchmark_runner::get_results() const
+{
+	return results;
+}
+
+std::string benchmark_runner::to_json() const
+{
+	std::stringstream json;
+	json << "{\n";
+	json << "  \"time\": \"" << escape_json(get_current_time_str()) << "\",\n";
+	json << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const benchmark_result& curr = results[i];
+		json << "    {"
+			<< "\"suite\": \"" << escape_json(curr.suite) << "\", "
+			<< "\"name\": \"" << escape_json(curr.name) << "\", "
+			<< "\"device\": \"" << escape_json(curr.device) << "\", "
+			<< "\"shape\": \"" << escape_json(curr.shape) << "\", "
+			<< "\"iterations\": " << curr.iterations << ", "
+			<< "\"mean_ms\": " << curr.mean_ms << ", "
+			<< "\"min_ms\": " << curr.min_ms << ", "
+			<< "\"items_per_second\": " << curr.items_per_second
+			<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	json << "  ]\n";
+	json << "}\n";
+	return json.str();
+}
+
+void benchmark_runner::write_json(const std::string& file_path) const
+{
+	std::ofstream file(file_path, std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Could not open file " + file_path);
+	}
+	file << to_json();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+struct benchmark_result {
+	//the group of the benchmark (for example "matrix" or "layer")
+	std::string suite;
+	std::string name;
+	//"cpu" or "gpu"
+	std::string device;
+	//a short description of the sizes, for example "256x1024"
+	std::string shape;
+	size_t iterations = 0;
+	double mean_ms = 0;
+	double min_ms = 0;
+	//the items one run processes per second (for example samples), 0 if it is not set
+	double items_per_second = 0;
+};
+
+/*
+	times functions and collects the results as json
+
+	every function is called once to warm up (allocations, loading the kernels, ...)
+	and then repeated until it ran for at least the min time or the max iterations are reached.
+	on the gpu the current stream is synchronized after every call,
+	so the time contains the kernels and not only launching them
+*/
+class benchmark_runner {
+private:
+	double min_time_ms;
+	size_t max_iterations;
+	std::vector<benchmark_result> results;
+public:
+	benchmark_runner(double min_time_ms, size_t max_iterations);
+
+	//items_per_run is the number of items one call processes (0 if it does not matter)
+	const benchmark_result& run(
+		const std::string& suite,
+		const std::string& name,
+		bool on_gpu,
+		const std::string& shape,
+		size_t items_per_run,
+		const std::function<void()>& function);
+	//a result that was measured outside of the runner (for example a whole epoch)
+	void add(const benchmark_result& result);
+
+	const std::vector<benchmark_result>& get_results() const;
+
+	//one object with the time of the run and an array of all results
+	std::string to_json() const;
+	void write_json(const std::string& file_path) const;
+};
@@ -0,0 +1,278 @@
+#include <filesystem>
+#include <iostream>
+#include "benchmark_runner.hpp"
+#include "../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+#include "../ConvolutionalNeuralNetwork/code/idx_file.hpp"
+
+/*
+	benchmarks for the matrix operations, the layers and the training of the mnist network
+
+	usage: CNN_Benchmark [output json] [mnist data directory]
+	every benchmark runs on the cpu and (if there is one) on the gpu
+*/
+
+static std::string shape_str(size_t a, size_t b)
+{
+	return std::to_string(a) + "x" + std::to_string(b);
+}
+
+static std::string shape_str(vector3 format)
+{
+	return std::to_string(format.x) + "x" + std::to_string(format.y) + "x" + std::to_string(format.z);
+}
+
+static matrix random_matrix(vector3 format)
+{
+	matrix m(format);
+	m.apply_noise(1);
+	return m;
+}
+
+static void set_gpu_mode(bool on_gpu, std::vector<matrix*> matrices)
+{
+	if (!on_gpu)
+	{
+		return;
+	}
+	for (matrix* m : matrices)
+	{
+		m->enable_gpu_mode();
+	}
+}
+
+static void matrix_benchmarks(benchmark_runner& runner, bool on_gpu)
+{
+	//input width, output width
+	const std::vector<std::pair<size_t, size_t>> fc_shapes = {
+		{ 64, 64 }, { 784, 128 }, { 1024, 1024 }, { 4096, 1024 } };
+	for (const auto& shape : fc_shapes)
+	{
+		const size_t in = shape.first;
+		const size_t out = shape.second;
+		matrix weights = random_matrix(vector3(in, out, (size_t)1));
+		matrix input = random_matrix(vector3((size_t)1, in, (size_t)1));
+		matrix activations = random_matrix(vector3((size_t)1, out, (size_t)1));
+		matrix error = random_matrix(vector3((size_t)1, out, (size_t)1));
+		matrix passing_error(vector3((size_t)1, in, (size_t)1));
+		matrix weight_deltas(weights.get_format());
+		matrix bias_deltas(activations.get_format());
+		matrix momentum(weights.get_format());
+		set_gpu_mode(on_gpu, {
+			&weights, &input, &activations, &error, &passing_error, &weight_deltas, &bias_deltas, &momentum });
+
+		runner.run("matrix", "dot_product_flat", on_gpu, shape_str(in, out), 1, [&]() {
+			matrix::dot_product_flat(weights, input, activations);
+		});
+		runner.run("matrix", "fully_connected_backprop", on_gpu, shape_str(in, out), 1, [&]() {
+			matrix::fully_connected_backprop(
+				activations, weights, input, error, &passing_error, weight_deltas, bias_deltas, e_activation_t::leaky_relu_fn);
+		});
+		runner.run("matrix", "apply_deltas", on_gpu, shape_str(in, out), 0, [&]() {
+			weights.apply_deltas(weight_deltas, momentum, 1, 0.0001f);
+		});
+	}
+
+	//input size, depth, kernel size, kernel count, stride
+	struct conv_shape_t { size_t size, depth, kernel_size, kernel_count, stride; };
+	const std::vector<conv_shape_t> conv_shapes = {
+		{ 28, 1, 4, 4, 2 }, { 28, 1, 5, 16, 1 }, { 32, 3, 3, 32, 1 }, { 64, 16, 3, 32, 1 } };
+	for (const conv_shape_t& shape : conv_shapes)
+	{
+		const size_t out = convolution_output_size(shape.size, shape.kernel_size, shape.stride);
+		matrix input = random_matrix(vector3(shape.size, shape.size, shape.depth));
+		std::vector<matrix> kernels;
+		for (size_t i = 0; i < shape.kernel_count; i++)
+		{
+			kernels.push_back(random_matrix(vector3(shape.kernel_size, shape.kernel_size, shape.depth)));
+		}
+		matrix output(vector3(out, out, shape.kernel_count));
+		set_gpu_mode(on_gpu, { &input, &output });
+		for (matrix& kernel : kernels)
+		{
+			set_gpu_mode(on_gpu, { &kernel });
+		}
+
+		const std::string name =
+			shape_str(input.get_format()) + " k" + std::to_string(shape.kernel_size) +
+			" n" + std::to_string(shape.kernel_count) + " s" + std::to_string(shape.stride);
+		runner.run("matrix", "cross_correlation", on_gpu, name, 1, [&]() {
+			matrix::cross_correlation(input, kernels, output, shape.stride);
+		});
+	}
+
+	//input size, depth, kernel size (the stride is the kernel size)
+	const std::vector<vector3> pooling_shapes = {
+		vector3(28, 28, 1), vector3(24, 24, 16), vector3(64, 64, 32) };
+	for (const vector3& format : pooling_shapes)
+	{
+		const size_t kernel_size = 2;
+		matrix input = random_matrix(format);
+		matrix output(vector3(format.x / kernel_size, format.y / kernel_size, format.z));
+		set_gpu_mode(on_gpu, { &input, &output });
+
+		runner.run("matrix", "pooling", on_gpu, shape_str(format) + " k2", 1, [&]() {
+			matrix::pooling(input, output, kernel_size, kernel_size, e_pooling_type_t::max_pooling);
+		});
+	}
+}
+
+static void layer_benchmark(
+	benchmark_runner& runner,
+	bool on_gpu,
+	const std::string& name,
+	layer& l,
+	vector3 input_format)
+{
+	l.set_input_format(input_format);
+	//pooling layers have no parameters
+	if (l.get_layer_type() != e_layer_type_t::pooling)
+	{
+		l.apply_noise(0.1f);
+	}
+	matrix input = random_matrix(input_format);
+	matrix passing_error(input_format);
+	l.get_error_p()->apply_noise(1);
+	if (on_gpu)
+	{
+		l.enable_gpu_mode();
+		set_gpu_mode(on_gpu, { &input, &passing_error });
+	}
+
+	const std::string shape = shape_str(input_format) + " -> " + shape_str(l.get_activations_readonly().get_format());
+	runner.run("layer", name + "_forward", on_gpu, shape, 1, [&]() {
+		l.forward_propagation(input);
+	});
+	runner.run("layer", name + "_backward", on_gpu, shape, 1, [&]() {
+		l.back_propagation(input, &passing_error);
+	});
+}
+
+static void layer_benchmarks(benchmark_runner& runner, bool on_gpu)
+{
+	const std::vector<std::pair<size_t, size_t>> fc_shapes = { { 784, 128 }, { 1024, 1024 } };
+	for (const auto& shape : fc_shapes)
+	{
+		fully_connected_layer l(shape.second, e_activation_t::leaky_relu_fn);
+		layer_benchmark(runner, on_gpu, "fully_connected", l, vector3((size_t)1, shape.first, (size_t)1));
+	}
+
+	const std::vector<vector3> conv_inputs = { vector3(28, 28, 1), vector3(32, 32, 16) };
+	for (const vector3& format : conv_inputs)
+	{
+		convolutional_layer l(16, 3, 1, e_activation_t::leaky_relu_fn);
+		layer_benchmark(runner, on_gpu, "convolutional", l, format);
+	}
+
+	const std::vector<vector3> pooling_inputs = { vector3(28, 28, 1), vector3(32, 32, 16) };
+	for (const vector3& format : pooling_inputs)
+	{
+		pooling_layer l(2, 2, e_pooling_type_t::max_pooling);
+		layer_benchmark(runner, on_gpu, "pooling", l, format);
+	}
+}
+
+//the network of the mnist digit overlord
+static neural_network mnist_network()
+{
+	neural_network nn;
+	nn.set_input_format(vector3(28, 28, 1));
+	nn.add_convolutional_layer(4, 4, 2, e_activation_t::leaky_relu_fn);
+	nn.add_fully_connected_layer(20, e_activation_t::leaky_relu_fn);
+	nn.add_fully_connected_layer(vector3(1, 10, 1), e_activation_t::softmax_fn);
+	nn.xavier_initialization();
+	return nn;
+}
+
+static void mnist_benchmarks(benchmark_runner& runner, bool on_gpu, const std::string& data_dir)
+{
+	const std::filesystem::path dir(data_dir);
+	const std::filesystem::path files[] = {
+		dir / "train-images.idx3-ubyte",
+		dir / "train-labels.idx1-ubyte",
+		dir / "t10k-images.idx3-ubyte",
+		dir / "t10k-labels.idx1-ubyte" };
+	for (const auto& file : files)
+	{
+		if (!std::filesystem::exists(file))
+		{
+			std::cout << "skipping the mnist benchmarks, " << file.string() << " does not exist" << std::endl;
+			return;
+		}
+	}
+
+	idx_file training_data(files[0].string());
+	idx_file training_labels(files[1].string());
+	idx_file test_data(files[2].string());
+	idx_file test_labels(files[3].string());
+	data_space ds_training(training_data, training_labels, 10);
+	data_space ds_test(test_data, test_labels, 10);
+
+	neural_network nn = mnist_network();
+	if (on_gpu)
+	{
+		ds_training.copy_to_gpu();
+		ds_test.copy_to_gpu();
+		nn.enable_gpu_mode();
+	}
+
+	const size_t batch_size = 100;
+	const size_t epochs = 1;
+	const std::string shape = "28x28x1 batch " + std::to_string(batch_size);
+
+	//one epoch takes long enough that it is only measured once
+	auto start = std::chrono::high_resolution_clock::now();
+	nn.learn_on_ds(ds_training, epochs, batch_size, 0.001f, false);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	benchmark_result training;
+	training.suite = "mnist";
+	training.name = "training_epochs";
+	training.device = on_gpu ? "gpu" : "cpu";
+	training.shape = shape;
+	training.iterations = epochs;
+	training.mean_ms = std::chrono::duration<double, std::milli>(end - start).count() / (double)epochs;
+	training.min_ms = training.mean_ms;
+	training.items_per_second = 1000.0 / training.mean_ms;
+	runner.add(training);
+
+	runner.run("mnist", "inference_samples", on_gpu, shape, ds_test.get_item_count(), [&]() {
+		nn.evaluate(ds_test, batch_size);
+	});
+}
+
+int main(int argc, char* argv[])
+{
+	const std::string output_path = argc > 1 ? argv[1] : "benchmark_results.json";
+	const std::string mnist_dir = argc > 2 ? argv[2] : "../models/mnist_digit_images/data/digit_recognition";
+
+	int device_count = 0;
+	const bool gpu_available = cudaGetDeviceCount(&device_count) == cudaSuccess && device_count > 0;
+	if (!gpu_available)
+	{
+		std::cout << "no gpu found, only the cpu is benchmarked" << std::endl;
+	}
+
+	benchmark_runner runner(200, 1000);
+	try
+	{
+		for (bool on_gpu : { false, true })
+		{
+			if (on_gpu && !gpu_available)
+			{
+				continue;
+			}
+			matrix_benchmarks(runner, on_gpu);
+			layer_benchmarks(runner, on_gpu);
+			mnist_benchmarks(runner, on_gpu, mnist_dir);
+		}
+		runner.write_json(output_path);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::cout << "results written to " << output_path << std::endl;
+	return 0;
+}
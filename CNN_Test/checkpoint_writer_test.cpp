@@ -0,0 +1,82 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+#include "../ConvolutionalNeuralNetwork/code/checkpoint_writer.hpp"
+#include <cstdio>
+#include <fstream>
+#include "test_util.hpp"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(checkpoint_writer_test)
+	{
+	private:
+		static bool file_exists(const std::string& path)
+		{
+			std::ifstream file(path);
+			return file.good();
+		}
+	public:
+
+		TEST_METHOD(checkpoint_is_a_snapshot_test)
+		{
+			neural_network nn = create_conv_test_nn();
+			neural_network original(nn);
+			std::string path;
+			{
+				checkpoint_writer writer("checkpoint_snapshot_test", 1);
+				path = nn.save_checkpoint(writer);
+				//the parameters change before the checkpoint is written
+				nn.mutate(0.5f);
+				writer.wait();
+				Assert::IsTrue(file_exists(path));
+				Assert::IsFalse(file_exists(path + ".tmp"));
+			}
+
+			{
+				neural_network loaded(path);
+				Assert::IsTrue(loaded.equal_parameter(original));
+				Assert::IsFalse(loaded.equal_parameter(nn));
+			}
+			std::remove(path.c_str());
+		}
+		TEST_METHOD(rolling_checkpoints_test)
+		{
+			neural_network nn = create_conv_test_nn();
+			std::vector<std::string> paths;
+			{
+				checkpoint_writer writer("checkpoint_rolling_test", 2);
+				for (int i = 0; i < 4; i++)
+				{
+					paths.push_back(nn.save_checkpoint(writer));
+					nn.mutate(0.5f);
+				}
+				writer.wait();
+				Assert::AreEqual((size_t)0, writer.get_pending_count());
+
+				//only the two newest checkpoints are kept
+				const std::vector<std::string> kept = writer.get_checkpoint_paths();
+				Assert::AreEqual((size_t)2, kept.size());
+				Assert::AreEqual(paths[2], kept[0]);
+				Assert::AreEqual(paths[3], kept[1]);
+			}
+			Assert::IsFalse(file_exists(paths[0]));
+			Assert::IsFalse(file_exists(paths[1]));
+			Assert::IsTrue(file_exists(paths[2]));
+			Assert::IsTrue(file_exists(paths[3]));
+
+			for (const std::string& curr : paths)
+			{
+				std::remove(curr.c_str());
+			}
+		}
+		TEST_METHOD(checkpoint_needs_snapshot_test)
+		{
+			Assert::ExpectException<std::invalid_argument>([]() { checkpoint_writer writer("checkpoint_invalid_test", 0); });
+
+			checkpoint_writer writer("checkpoint_invalid_test", 1);
+			model_writer not_a_snapshot;
+			Assert::ExpectException<std::invalid_argument>([&]() { writer.submit(std::move(not_a_snapshot)); });
+		}
+	};
+}
@@ -0,0 +1,72 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/compact_buffer.hpp"
+#include "../ConvolutionalNeuralNetwork/code/precision.hpp"
+#include <cmath>
+#include <limits>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(compact_buffer_test)
+	{
+	public:
+
+		TEST_METHOD(fp16_conversion_test)
+		{
+			Assert::AreEqual((uint16_t)0x3c00, float_to_fp16(1.0f));
+			Assert::AreEqual((uint16_t)0xc000, float_to_fp16(-2.0f));
+			Assert::AreEqual((uint16_t)0x7bff, float_to_fp16(65504.0f));
+			//too big for fp16
+			Assert::AreEqual((uint16_t)0x7c00, float_to_fp16(70000.0f));
+			//the smallest subnormal value
+			Assert::AreEqual((uint16_t)0x0001, float_to_fp16(5.9604645e-8f));
+			Assert::AreEqual(5.9604645e-8f, fp16_to_float(0x0001));
+
+			Assert::AreEqual(1.0f, fp16_to_float(0x3c00));
+			Assert::AreEqual(0.5f, fp16_to_float(float_to_fp16(0.5f)));
+			Assert::IsTrue(std::isnan(fp16_to_float(float_to_fp16(std::numeric_limits<float>::quiet_NaN()))));
+
+			//1 + 2^-11 is exactly between 1 and the next fp16 value, it rounds to the even one
+			Assert::AreEqual(1.0f, round_to_precision(fp16_precision, 1.00048828125f));
+			Assert::AreEqual(0.1f, round_to_precision(fp16_precision, 0.1f), 0.0001f);
+		}
+		TEST_METHOD(bf16_conversion_test)
+		{
+			Assert::AreEqual((uint16_t)0x3f80, float_to_bf16(1.0f));
+			Assert::AreEqual(1.0f, bf16_to_float(0x3f80));
+			//bf16 has the range of float
+			Assert::AreEqual(1e30f, round_to_precision(bf16_precision, 1e30f), 1e28f);
+			Assert::AreEqual(3.140625f, round_to_precision(bf16_precision, 3.14159f));
+			Assert::AreEqual(0.3f, round_to_precision(fp32_precision, 0.3f));
+		}
+		TEST_METHOD(set_and_get_test)
+		{
+			compact_buffer buffer(4, fp16_precision);
+			Assert::AreEqual((size_t)4, buffer.item_count());
+			Assert::AreEqual((size_t)8, buffer.byte_size());
+
+			float values[2] = { 0.25f, -3.0f };
+			buffer.set(values, 1, 2);
+
+			float result[4] = { 9, 9, 9, 9 };
+			buffer.get(result, 0, 4);
+			Assert::AreEqual(0.0f, result[0]);
+			Assert::AreEqual(0.25f, result[1]);
+			Assert::AreEqual(-3.0f, result[2]);
+			Assert::AreEqual(0.0f, result[3]);
+
+			compact_buffer copy(buffer);
+			buffer.set_all_zero();
+			copy.get(result, 2, 1);
+			Assert::AreEqual(-3.0f, result[0]);
+			buffer.get(result, 2, 1);
+			Assert::AreEqual(0.0f, result[0]);
+		}
+		TEST_METHOD(fp32_is_not_compact_test)
+		{
+			Assert::ExpectException<std::invalid_argument>([]() {
+				compact_buffer buffer(4, fp32_precision);
+			});
+		}
+	};
+}
@@ -0,0 +1,196 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/conv_engine.hpp"
+#include <vector>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(conv_engine_test)
+	{
+	private:
+		static conv_shape create_shape(
+			size_t input_width,
+			size_t input_height,
+			size_t input_depth,
+			size_t kernel_size,
+			size_t kernel_count,
+			size_t stride)
+		{
+			conv_shape shape;
+			shape.input_width = input_width;
+			shape.input_height = input_height;
+			shape.input_depth = input_depth;
+			shape.kernel_size = kernel_size;
+			shape.kernel_count = kernel_count;
+			shape.stride = stride;
+			shape.output_width = (input_width - kernel_size) / stride + 1;
+			shape.output_height = (input_height - kernel_size) / stride + 1;
+			return shape;
+		}
+
+		//deterministic values between -1 and 1
+		static std::vector<float> create_values(size_t count, size_t seed)
+		{
+			std::vector<float> values(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				values[i] = (float)((i * 7 + seed * 13) % 17) / 8.0f - 1.0f;
+			}
+			return values;
+		}
+
+		//compares the forward and backward pass of a strategy with the direct one
+		static void compare_with_direct(const conv_shape& shape, e_conv_strategy_t strategy)
+		{
+			std::vector<float> input = create_values(shape.input_width * shape.input_height * shape.input_depth, 1);
+			std::vector<std::vector<float>> kernels;
+			std::vector<const float*> kernel_ptrs;
+			for (size_t i = 0; i < shape.kernel_count; i++)
+			{
+				kernels.push_back(create_values(shape.patch_size(), i + 2));
+			}
+			for (const auto& kernel : kernels)
+			{
+				kernel_ptrs.push_back(kernel.data());
+			}
+
+			const size_t output_count = shape.output_positions() * shape.kernel_count;
+			std::vector<float> expected_output(output_count);
+			std::vector<float> output(output_count);
+			conv_forward(shape, direct_conv, input.data(), kernel_ptrs.data(), expected_output.data());
+			conv_forward(shape, strategy, input.data(), kernel_ptrs.data(), output.data());
+
+			for (size_t i = 0; i < output_count; i++)
+			{
+				Assert::AreEqual(expected_output[i], output[i], 0.0001f);
+			}
+
+			std::vector<float> delta = create_values(output_count, 5);
+			std::vector<std::vector<float>> expected_deltas(shape.kernel_count, std::vector<float>(shape.patch_size()));
+			std::vector<std::vector<float>> deltas(shape.kernel_count, std::vector<float>(shape.patch_size()));
+			std::vector<float*> expected_delta_ptrs;
+			std::vector<float*> delta_ptrs;
+			for (size_t i = 0; i < shape.kernel_count; i++)
+			{
+				expected_delta_ptrs.push_back(expected_deltas[i].data());
+				delta_ptrs.push_back(deltas[i].data());
+			}
+			std::vector<float> expected_passing_error(input.size());
+			std::vector<float> passing_error(input.size());
+
+			conv_backward(shape, direct_conv, input.data(), kernel_ptrs.data(), delta.data(), expected_delta_ptrs.data(), expected_passing_error.data());
+			conv_backward(shape, strategy, input.data(), kernel_ptrs.data(), delta.data(), delta_ptrs.data(), passing_error.data());
+
+			for (size_t i = 0; i < shape.kernel_count; i++)
+			{
+				for (size_t j = 0; j < shape.patch_size(); j++)
+				{
+					Assert::AreEqual(expected_deltas[i][j], deltas[i][j], 0.0001f);
+				}
+			}
+			for (size_t i = 0; i < input.size(); i++)
+			{
+				Assert::AreEqual(expected_passing_error[i], passing_error[i], 0.0001f);
+			}
+		}
+		//compares the forward pass of a fixed kernel with the direct one
+		static void compare_fixed_with_direct(const conv_shape& shape, e_fixed_kernel_t fixed_kernel)
+		{
+			std::vector<float> input = create_values(shape.input_width * shape.input_height * shape.input_depth, 1);
+			std::vector<std::vector<float>> kernels;
+			std::vector<const float*> kernel_ptrs;
+			for (size_t i = 0; i < shape.kernel_count; i++)
+			{
+				kernels.push_back(create_values(shape.patch_size(), i + 2));
+			}
+			for (const auto& kernel : kernels)
+			{
+				kernel_ptrs.push_back(kernel.data());
+			}
+
+			const size_t output_count = shape.output_positions() * shape.kernel_count;
+			std::vector<float> expected_output(output_count);
+			std::vector<float> output(output_count, 1.0f);
+			conv_forward(shape, direct_conv, input.data(), kernel_ptrs.data(), expected_output.data());
+			conv_forward_fixed(shape, fixed_kernel, input.data(), kernel_ptrs.data(), output.data());
+
+			for (size_t i = 0; i < output_count; i++)
+			{
+				Assert::AreEqual(expected_output[i], output[i], 0.0001f);
+			}
+		}
+	public:
+
+		TEST_METHOD(strategy_selection_test)
+		{
+			Assert::AreEqual((int)direct_conv, (int)conv_select_strategy(create_shape(3, 3, 1, 2, 1, 1)));
+			Assert::AreEqual((int)winograd_conv, (int)conv_select_strategy(create_shape(28, 28, 1, 3, 4, 1)));
+			Assert::AreEqual((int)im2col_conv, (int)conv_select_strategy(create_shape(28, 28, 1, 3, 4, 2)));
+			Assert::AreEqual((int)im2col_conv, (int)conv_select_strategy(create_shape(28, 28, 1, 5, 4, 1)));
+		}
+		TEST_METHOD(im2col_matches_direct_test)
+		{
+			compare_with_direct(create_shape(9, 7, 3, 3, 4, 2), im2col_conv);
+			compare_with_direct(create_shape(12, 12, 2, 4, 3, 1), im2col_conv);
+		}
+		TEST_METHOD(winograd_matches_direct_test)
+		{
+			//an even and an odd output width
+			compare_with_direct(create_shape(10, 10, 3, 3, 2, 1), winograd_conv);
+			compare_with_direct(create_shape(9, 11, 2, 3, 3, 1), winograd_conv);
+		}
+		TEST_METHOD(fixed_kernel_selection_test)
+		{
+			Assert::AreEqual((int)kernel_1x1_s1, (int)conv_select_fixed_kernel(1, 1));
+			Assert::AreEqual((int)kernel_3x3_s2, (int)conv_select_fixed_kernel(3, 2));
+			Assert::AreEqual((int)kernel_5x5_s1, (int)conv_select_fixed_kernel(5, 1));
+			Assert::AreEqual((int)generic_kernel, (int)conv_select_fixed_kernel(4, 2));
+			Assert::AreEqual((int)generic_kernel, (int)conv_select_fixed_kernel(2, 2));
+			Assert::AreEqual((int)kernel_2x2_s2, (int)pooling_select_fixed_kernel(2, 2));
+			Assert::AreEqual((int)generic_kernel, (int)pooling_select_fixed_kernel(3, 2));
+		}
+		TEST_METHOD(fixed_kernel_matches_direct_test)
+		{
+			//small outputs use the fixed direct strategy
+			compare_fixed_with_direct(create_shape(4, 4, 3, 1, 2, 1), kernel_1x1_s1);
+			compare_fixed_with_direct(create_shape(6, 5, 2, 3, 3, 1), kernel_3x3_s1);
+			compare_fixed_with_direct(create_shape(9, 7, 2, 3, 2, 2), kernel_3x3_s2);
+			compare_fixed_with_direct(create_shape(8, 8, 2, 5, 2, 1), kernel_5x5_s1);
+			compare_fixed_with_direct(create_shape(11, 9, 1, 5, 3, 2), kernel_5x5_s2);
+			//bigger outputs use the fixed im2col gather or winograd
+			compare_fixed_with_direct(create_shape(6, 5, 3, 1, 2, 1), kernel_1x1_s1);
+			compare_fixed_with_direct(create_shape(9, 7, 2, 3, 3, 1), kernel_3x3_s1);
+			compare_fixed_with_direct(create_shape(10, 9, 2, 3, 2, 2), kernel_3x3_s2);
+			compare_fixed_with_direct(create_shape(9, 9, 2, 5, 2, 1), kernel_5x5_s1);
+			compare_fixed_with_direct(create_shape(11, 12, 1, 5, 3, 2), kernel_5x5_s2);
+			//mnist sized inputs
+			compare_fixed_with_direct(create_shape(28, 28, 1, 5, 4, 1), kernel_5x5_s1);
+			compare_fixed_with_direct(create_shape(28, 28, 1, 3, 4, 1), kernel_3x3_s1);
+			compare_fixed_with_direct(create_shape(12, 12, 4, 1, 3, 1), kernel_1x1_s1);
+			//the generic kernel uses the strategy of the shape
+			compare_fixed_with_direct(create_shape(12, 12, 2, 4, 3, 1), generic_kernel);
+		}
+		TEST_METHOD(fixed_kernel_invalid_shape_test)
+		{
+			conv_shape shape = create_shape(9, 9, 1, 3, 1, 2);
+			std::vector<float> input(81);
+			std::vector<float> kernel(9);
+			const float* kernel_ptr = kernel.data();
+			std::vector<float> output(shape.output_positions());
+			Assert::ExpectException<std::invalid_argument>([&]() {
+				conv_forward_fixed(shape, kernel_3x3_s1, input.data(), &kernel_ptr, output.data());
+			});
+		}
+		TEST_METHOD(winograd_invalid_shape_test)
+		{
+			conv_shape shape = create_shape(9, 9, 1, 3, 1, 2);
+			std::vector<float> input(81);
+			std::vector<float> kernel(9);
+			const float* kernel_ptr = kernel.data();
+			std::vector<float> output(shape.output_positions());
+			Assert::ExpectException<std::invalid_argument>([&]() {
+				conv_forward(shape, winograd_conv, input.data(), &kernel_ptr, output.data());
+			});
+		}
+	};
+}
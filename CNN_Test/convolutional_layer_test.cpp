@@ -153,5 +153,63 @@ namespace CNNTest
 				ACTIVATION[sigmoid_fn](17.0f),
 				layer.get_activations_readonly().get_at_host(vector3(1, 1)));
 		}
+		TEST_METHOD(back_propagation_test)
+		{
+			convolutional_layer layer(1, 2, 1, e_activation_t::leaky_relu_fn);
+			layer.set_input_format(vector3(3, 3, 1));
+			layer.set_all_parameters(0);
+
+			/* kernel
+				+ - + - +
+				| 1 | 2 |
+				+ - + - +
+				| 3 | 4 |
+				+ - + - +
+			*/
+			matrix& kernel = layer.get_kernel_weights()[0];
+			kernel.set_at_host(vector3(0, 0), 1);
+			kernel.set_at_host(vector3(1, 0), 2);
+			kernel.set_at_host(vector3(0, 1), 3);
+			kernel.set_at_host(vector3(1, 1), 4);
+
+			//input(x, y) = 1 + x + 3y
+			//every activation is positive, so the leaky relu derivative is 1
+			matrix input(vector3(3, 3, 1));
+			for (size_t i = 0; i < input.item_count(); i++)
+			{
+				input.set_at_flat_host(i, (float)i + 1);
+			}
+			layer.forward_propagation(input);
+
+			matrix* error = layer.get_error_p();
+			error->set_all(0);
+			error->set_at_host(vector3(0, 0), 1);
+			error->set_at_host(vector3(1, 1), 2);
+
+			matrix passing_error(input.get_format());
+			layer.back_propagation(input, &passing_error);
+
+			//full convolution of the error with the flipped kernel
+			Assert::IsTrue(matrix::are_equal(passing_error,
+				matrix(vector3(3, 3, 1), std::vector<float> {
+				1, 2, 0,
+					3, 6, 4,
+					0, 6, 8
+			})));
+
+			//with no momentum and a learning rate of 10 every parameter changes by its delta
+			//kernel delta(i, j) = input(i, j) + 2 * input(i + 1, j + 1)
+			layer.apply_deltas(1, 10);
+			Assert::AreEqual(1.0f - 11.0f, kernel.get_at_host(vector3(0, 0)), 0.0001f);
+			Assert::AreEqual(2.0f - 14.0f, kernel.get_at_host(vector3(1, 0)), 0.0001f);
+			Assert::AreEqual(3.0f - 20.0f, kernel.get_at_host(vector3(0, 1)), 0.0001f);
+			Assert::AreEqual(4.0f - 23.0f, kernel.get_at_host(vector3(1, 1)), 0.0001f);
+
+			//the biases are not shared, every output gets its own error
+			const matrix& biases = layer.get_kernel_biases_readonly();
+			Assert::AreEqual(-1.0f, biases.get_at_host(vector3(0, 0)), 0.0001f);
+			Assert::AreEqual(0.0f, biases.get_at_host(vector3(1, 0)), 0.0001f);
+			Assert::AreEqual(-2.0f, biases.get_at_host(vector3(1, 1)), 0.0001f);
+		}
 	};
 }
\ No newline at end of file
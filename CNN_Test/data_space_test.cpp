@@ -1,5 +1,9 @@
 #include "CppUnitTest.h"
 #include "../ConvolutionalNeuralNetwork/code/data_space.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace CNNTest
@@ -130,5 +134,269 @@ namespace CNNTest
 			Assert::IsTrue(matrix::are_equal(m, expected_data));
 			Assert::IsTrue(matrix::are_equal(l, expected_label));
 		}
+		TEST_METHOD(get_batch_test)
+		{
+			matrix data_format(vector3(1, 2, 1));
+			matrix label_format(vector3(1, 1, 1));
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 3; i++)
+			{
+				data_format.set_all((float)i);
+				data.push_back(data_format);
+				label_format.set_all((float)i + 0.5f);
+				label.push_back(label_format);
+			}
+
+			data_space ds(
+				data_format.get_format(),
+				label_format.get_format(),
+				data,
+				label);
+
+			matrix data_batch(vector3(2, 2, 1));
+			matrix label_batch(vector3(1, 2, 1));
+			ds.get_batch(data_batch, &label_batch, 1);
+
+			Assert::IsTrue(matrix::are_equal(data_batch,
+				matrix(vector3(2, 2, 1), std::vector<float> { 1, 1, 2, 2 })));
+			Assert::IsTrue(matrix::are_equal(label_batch,
+				matrix(vector3(1, 2, 1), std::vector<float> { 1.5f, 2.5f })));
+		}
+		TEST_METHOD(compact_storage_test)
+		{
+			matrix data_format(vector3(1, 2, 1));
+			matrix label_format(vector3(1, 1, 1));
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 3; i++)
+			{
+				data_format.set_all((float)i);
+				data.push_back(data_format);
+				label_format.set_all((float)i + 0.5f);
+				label.push_back(label_format);
+			}
+
+			data_space ds(
+				data_format.get_format(),
+				label_format.get_format(),
+				data,
+				label);
+			size_t fp32_size = ds.byte_size();
+
+			ds.set_storage_precision(fp16_precision);
+			Assert::AreEqual(fp32_size / 2, ds.byte_size());
+
+			matrix m(data_format.get_format());
+			matrix l(label_format.get_format());
+			ds.observe_data_at_idx(m, 2);
+			ds.observe_label_at_idx(l, 2);
+			Assert::IsTrue(matrix::are_equal(m, data[2]));
+			Assert::IsTrue(matrix::are_equal(l, label[2]));
+			//the matrix got a copy of the data
+			Assert::IsTrue(m.is_owning_data());
+
+			matrix data_batch(vector3(2, 2, 1));
+			matrix label_batch(vector3(1, 2, 1));
+			ds.get_batch(data_batch, &label_batch, 1);
+			Assert::IsTrue(matrix::are_equal(data_batch,
+				matrix(vector3(2, 2, 1), std::vector<float> { 1, 1, 2, 2 })));
+			Assert::IsTrue(matrix::are_equal(label_batch,
+				matrix(vector3(1, 2, 1), std::vector<float> { 1.5f, 2.5f })));
+
+			ds.set_storage_precision(fp32_precision);
+			Assert::AreEqual(fp32_size, ds.byte_size());
+			ds.observe_label_at_idx(l, 1);
+			Assert::IsTrue(matrix::are_equal(l, label[1]));
+		}
+		TEST_METHOD(streaming_data_space_test)
+		{
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 10; i++)
+			{
+				data.push_back(matrix(vector3(2, 1, 1), std::vector<float> { (float)i, (float)i }));
+				label.push_back(matrix(vector3(1, 1, 1), std::vector<float> { (float)i + 0.5f }));
+			}
+			data_space source(vector3(2, 1, 1), vector3(1, 1, 1), data, label);
+			std::vector<std::string> paths = source.save_shards("streaming_data_space_test", 4);
+			Assert::AreEqual((size_t)3, paths.size());
+
+			{
+				data_space ds(paths);
+				Assert::AreEqual((size_t)10, ds.get_item_count());
+
+				matrix m(vector3(2, 1, 1));
+				matrix l(vector3(1, 1, 1));
+				for (size_t i = 0; i < 10; i++)
+				{
+					ds.observe_data_at_idx(m, i);
+					ds.observe_label_at_idx(l, i);
+					Assert::IsTrue(matrix::are_equal(m, data[i]));
+					Assert::IsTrue(matrix::are_equal(l, label[i]));
+				}
+
+				//a batch over the border of two shards
+				matrix data_batch(vector3(2, 3, 1));
+				ds.get_batch(data_batch, nullptr, 3);
+				Assert::IsTrue(matrix::are_equal(data_batch,
+					matrix(vector3(2, 3, 1), std::vector<float> { 3, 3, 4, 4, 5, 5 })));
+
+				Assert::ExpectException<std::runtime_error>([&]() { ds.set_data(m, 0); });
+
+				//every item is still there once and the items of a shard stay together
+				ds.shuffle();
+				std::vector<bool> seen(10, false);
+				size_t previous_shard = 10;
+				size_t shard_changes = 0;
+				for (size_t i = 0; i < 10; i++)
+				{
+					ds.observe_data_at_idx(m, i);
+					ds.observe_label_at_idx(l, i);
+					const size_t item = (size_t)m.get_at_flat_host(0);
+					Assert::AreEqual(m.get_at_flat_host(0) + 0.5f, l.get_at_flat_host(0));
+					Assert::IsFalse(seen[item]);
+					seen[item] = true;
+					if (item / 4 != previous_shard)
+					{
+						shard_changes++;
+						previous_shard = item / 4;
+					}
+				}
+				Assert::AreEqual((size_t)3, shard_changes);
+			}
+
+			for (const std::string& path : paths)
+			{
+				std::remove(path.c_str());
+			}
+		}
+		TEST_METHOD(streaming_compact_data_space_test)
+		{
+			std::vector<matrix> data;
+			for (int i = 0; i < 6; i++)
+			{
+				data.push_back(matrix(vector3(1, 1, 1), std::vector<float> { (float)i }));
+			}
+			data_space source(vector3(1, 1, 1), data);
+			std::vector<std::string> paths = source.save_shards("streaming_compact_data_space_test", 4);
+
+			{
+				data_space ds(paths);
+				ds.set_storage_precision(fp16_precision);
+
+				matrix m(vector3(1, 1, 1));
+				for (size_t i = 0; i < 6; i++)
+				{
+					ds.observe_data_at_idx(m, i);
+					Assert::AreEqual((float)i, m.get_at_flat_host(0));
+				}
+				Assert::AreEqual(fp16_precision, ds.get_storage_precision());
+			}
+
+			for (const std::string& path : paths)
+			{
+				std::remove(path.c_str());
+			}
+		}
+		TEST_METHOD(concurrent_read_and_shuffle_test)
+		{
+			std::vector<matrix> data;
+			std::vector<matrix> labels;
+			for (int i = 0; i < 64; i++)
+			{
+				data.push_back(matrix(vector3(1, 1, 1), std::vector<float> { (float)i }));
+				labels.push_back(matrix(vector3(1, 1, 1), std::vector<float> { (float)(2 * i) }));
+			}
+			data_space ds(vector3(1, 1, 1), vector3(1, 1, 1), data, labels);
+
+			//a batch is read under one lock, so its data and label always belong together
+			std::atomic<bool> mismatch = false;
+			auto read_all = [&]() {
+				matrix data_batch(vector3(1, 1, 1));
+				matrix label_batch(vector3(1, 1, 1));
+				for (int repeat = 0; repeat < 50; repeat++)
+				{
+					for (size_t i = 0; i < ds.get_item_count(); i++)
+					{
+						ds.get_batch(data_batch, &label_batch, i);
+						if (label_batch.get_at_flat_host(0) != 2 * data_batch.get_at_flat_host(0))
+						{
+							mismatch = true;
+						}
+					}
+				}
+			};
+
+			std::vector<std::thread> readers;
+			for (int i = 0; i < 4; i++)
+			{
+				readers.emplace_back(read_all);
+			}
+			for (int i = 0; i < 20; i++)
+			{
+				ds.shuffle();
+			}
+			for (auto& curr : readers)
+			{
+				curr.join();
+			}
+			Assert::IsFalse(mismatch);
+
+			//the order is still a permutation of all items
+			std::vector<bool> seen(ds.get_item_count(), false);
+			matrix m(vector3(1, 1, 1));
+			for (size_t i = 0; i < ds.get_item_count(); i++)
+			{
+				ds.observe_data_at_idx(m, i);
+				seen[(size_t)m.get_at_flat_host(0)] = true;
+			}
+			Assert::IsTrue(std::find(seen.begin(), seen.end(), false) == seen.end());
+		}
+		TEST_METHOD(non_zero_mask_follows_the_order_test)
+		{
+			//the data of item i is i, so only item 0 is zero
+			std::vector<matrix> data;
+			std::vector<matrix> labels;
+			for (int i = 0; i < 6; i++)
+			{
+				matrix curr_data(vector3(2, 1, 1));
+				curr_data.set_at_flat_host(1, (float)i);
+				matrix curr_label(vector3(1, 1, 1));
+				curr_label.set_at_flat_host(0, 1);
+				data.push_back(curr_data);
+				labels.push_back(curr_label);
+			}
+			data_space ds(vector3(2, 1, 1), vector3(1, 1, 1), data, labels);
+
+			Assert::IsFalse(ds.item_has_non_zero_data(0));
+			for (size_t i = 1; i < ds.get_item_count(); i++)
+			{
+				Assert::IsTrue(ds.item_has_non_zero_data(i));
+			}
+
+			//the label does not count
+			ds.set_data(matrix(vector3(2, 1, 1)), 3);
+			Assert::IsFalse(ds.item_has_non_zero_data(3));
+
+			ds.shuffle();
+			matrix m(vector3(2, 1, 1));
+			for (size_t i = 0; i < ds.get_item_count(); i++)
+			{
+				ds.observe_data_at_idx(m, i);
+				Assert::AreEqual(m.contains_non_zero_items(), ds.item_has_non_zero_data(i));
+			}
+
+			//the compact table gets its own mask
+			ds.set_storage_precision(fp16_precision);
+			size_t zero_items = 0;
+			for (size_t i = 0; i < ds.get_item_count(); i++)
+			{
+				zero_items += ds.item_has_non_zero_data(i) ? 0 : 1;
+			}
+			Assert::AreEqual((size_t)2, zero_items);
+		}
 	};
 }
\ No newline at end of file
@@ -67,5 +67,91 @@ namespace CNNTest
 			Assert::AreEqual(41.0f, fc_layer.get_activations_readonly().get_at_flat_host(1));
 			Assert::AreEqual(41.0f, fc_layer.get_activations_readonly().get_at_flat_host(2));
 		}
+		TEST_METHOD(batch_propagation_matches_single_propagation)
+		{
+			vector3 input_format(1, 4, 1);
+			const size_t batch_size = 3;
+
+			fully_connected_layer single_layer(2, sigmoid_fn);
+			single_layer.set_input_format(input_format);
+			single_layer.apply_noise(1);
+
+			fully_connected_layer batch_layer(single_layer);
+			batch_layer.set_batch_size(batch_size);
+
+			matrix input_batch(vector3(input_format.item_count(), batch_size, 1));
+			input_batch.apply_noise(1);
+			matrix expected_batch(vector3(2, batch_size, 1));
+			expected_batch.apply_noise(1);
+
+			batch_layer.forward_propagation_batch(input_batch);
+			batch_layer.set_error_for_last_layer_batch(expected_batch);
+			batch_layer.back_propagation_batch(input_batch, nullptr);
+			batch_layer.apply_deltas(batch_size, 0.1f);
+
+			matrix input(input_format);
+			matrix expected(vector3(1, 2, 1));
+			for (size_t i = 0; i < batch_size; i++)
+			{
+				for (size_t j = 0; j < input.item_count(); j++)
+				{
+					input.set_at_flat_host(j, input_batch.get_at_flat_host(i * input.item_count() + j));
+				}
+				for (size_t j = 0; j < expected.item_count(); j++)
+				{
+					expected.set_at_flat_host(j, expected_batch.get_at_flat_host(i * expected.item_count() + j));
+				}
+
+				single_layer.forward_propagation(input);
+				single_layer.set_error_for_last_layer(expected);
+				single_layer.back_propagation(input, nullptr);
+			}
+			single_layer.apply_deltas(batch_size, 0.1f);
+
+			Assert::IsTrue(single_layer.equal_parameter(batch_layer));
+		}
+		TEST_METHOD(softmax_forward_and_cross_entropy_error_test)
+		{
+			fully_connected_layer fc_layer(3, softmax_fn);
+			fc_layer.set_input_format(vector3(1, 1, 1));
+			Assert::IsTrue(fc_layer.get_cost_function() == cross_entropy_cost);
+			fc_layer.get_weights_ref().set_all(0);
+			//large values would overflow without subtracting the maximum
+			fc_layer.get_biases_ref().set_at_flat_host(0, 1000);
+			fc_layer.get_biases_ref().set_at_flat_host(1, 1000 + logf(3));
+			fc_layer.get_biases_ref().set_at_flat_host(2, -1000);
+
+			matrix input(vector3(1, 1, 1));
+			fc_layer.forward_propagation(input);
+			const matrix& output = fc_layer.get_activations_readonly();
+			Assert::AreEqual(0.25f, output.get_at_flat_host(0), 0.00001f);
+			Assert::AreEqual(0.75f, output.get_at_flat_host(1), 0.00001f);
+			Assert::AreEqual(0.0f, output.get_at_flat_host(2), 0.00001f);
+
+			matrix expected(vector3(1, 3, 1));
+			expected.set_at_flat_host(1, 1);
+			matrix cost(vector3(1, 1, 1));
+			fc_layer.set_error_for_last_layer(expected, &cost);
+			//the gradient of the values before the softmax
+			Assert::AreEqual(0.25f, fc_layer.get_error().get_at_flat_host(0), 0.00001f);
+			Assert::AreEqual(-0.25f, fc_layer.get_error().get_at_flat_host(1), 0.00001f);
+			Assert::AreEqual(-logf(0.75f), cost.get_at_flat_host(0), 0.00001f);
+
+			//the output of every item of a batch is normalized on its own
+			fully_connected_layer batch_layer(fc_layer);
+			batch_layer.set_batch_size(2);
+			matrix input_batch(vector3(1, 2, 1));
+			input_batch.set_at_flat_host(1, 5);
+			batch_layer.forward_propagation_batch(input_batch);
+			for (size_t row = 0; row < 2; row++)
+			{
+				float sum = 0;
+				for (size_t i = 0; i < 3; i++)
+				{
+					sum += batch_layer.get_batch_activations_readonly().get_at_flat_host(row * 3 + i);
+				}
+				Assert::AreEqual(1.0f, sum, 0.00001f);
+			}
+		}
 	};
 }
\ No newline at end of file
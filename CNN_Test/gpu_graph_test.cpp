@@ -0,0 +1,22 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/gpu_graph.hpp"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(gpu_graph_test)
+	{
+	public:
+
+		TEST_METHOD(graph_not_captured_test)
+		{
+			gpu_graph graph;
+			Assert::IsFalse(graph.is_captured());
+			Assert::ExpectException<std::runtime_error>([&]() { graph.launch(nullptr); });
+
+			//resetting a graph that was never captured does nothing
+			graph.reset();
+			Assert::IsFalse(graph.is_captured());
+		}
+	};
+}
\ No newline at end of file
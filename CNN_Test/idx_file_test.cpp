@@ -0,0 +1,87 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/idx_file.hpp"
+#include "../ConvolutionalNeuralNetwork/code/data_space.hpp"
+#include <cstdio>
+#include <fstream>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	//writes an unsigned byte idx file with big endian dimensions
+	static void write_idx_file(
+		const std::string& path,
+		const std::vector<uint32_t>& dimensions,
+		const std::vector<uint8_t>& values)
+	{
+		std::ofstream file(path, std::ios::out | std::ios::binary);
+		const uint8_t magic[4] = { 0, 0, IDX_UNSIGNED_BYTE_TYPE, (uint8_t)dimensions.size() };
+		file.write((const char*)magic, sizeof(magic));
+		for (uint32_t curr : dimensions)
+		{
+			const uint8_t bytes[4] = {
+				(uint8_t)(curr >> 24),
+				(uint8_t)(curr >> 16),
+				(uint8_t)(curr >> 8),
+				(uint8_t)curr };
+			file.write((const char*)bytes, sizeof(bytes));
+		}
+		file.write((const char*)values.data(), values.size());
+	}
+
+	TEST_CLASS(idx_file_test)
+	{
+	public:
+
+		TEST_METHOD(idx_header_test)
+		{
+			//two images with 2 rows and 3 columns
+			write_idx_file("idx_header_test.idx", { 2, 2, 3 }, { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 });
+			{
+				idx_file file("idx_header_test.idx");
+				Assert::AreEqual((size_t)2, file.get_item_count());
+				Assert::IsTrue(vector3(3, 2, 1) == file.get_item_format());
+				Assert::AreEqual((uint8_t)6, file.get_item(1)[0]);
+				Assert::AreEqual((uint8_t)11, file.get_item(1)[5]);
+				Assert::ExpectException<std::out_of_range>([&]() { file.get_item(2); });
+			}
+			std::remove("idx_header_test.idx");
+		}
+		TEST_METHOD(idx_too_small_test)
+		{
+			write_idx_file("idx_too_small_test.idx", { 2, 2, 3 }, { 0, 1, 2 });
+			Assert::ExpectException<std::runtime_error>([]() { idx_file file("idx_too_small_test.idx"); });
+			std::remove("idx_too_small_test.idx");
+		}
+		TEST_METHOD(idx_data_space_test)
+		{
+			write_idx_file("idx_data_space_test_data.idx", { 3, 1, 2 }, { 0, 255, 51, 102, 255, 0 });
+			write_idx_file("idx_data_space_test_label.idx", { 3 }, { 2, 0, 1 });
+			{
+				idx_file data_file("idx_data_space_test_data.idx");
+				idx_file label_file("idx_data_space_test_label.idx");
+				data_space ds(data_file, label_file, 3);
+
+				Assert::AreEqual((size_t)3, ds.get_item_count());
+				Assert::IsTrue(vector3(2, 1, 1) == ds.get_data_format());
+				Assert::IsTrue(vector3(1, 3, 1) == ds.get_label_format());
+
+				matrix data(vector3(2, 1, 1));
+				matrix label(vector3(1, 3, 1));
+				ds.observe_data_at_idx(data, 1);
+				ds.observe_label_at_idx(label, 1);
+				Assert::AreEqual(0.2f, data.get_at_flat_host(0), 0.0001f);
+				Assert::AreEqual(0.4f, data.get_at_flat_host(1), 0.0001f);
+				Assert::AreEqual(1.0f, label.get_at_flat_host(0));
+				Assert::AreEqual(0.0f, label.get_at_flat_host(2));
+
+				ds.observe_label_at_idx(label, 0);
+				Assert::AreEqual(1.0f, label.get_at_flat_host(2));
+
+				//a label has to be a valid class
+				Assert::ExpectException<std::invalid_argument>([&]() { data_space too_few(data_file, label_file, 2); });
+			}
+			std::remove("idx_data_space_test_data.idx");
+			std::remove("idx_data_space_test_label.idx");
+		}
+	};
+}
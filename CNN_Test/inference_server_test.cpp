@@ -0,0 +1,104 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/inference_server.hpp"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(inference_server_test)
+	{
+	public:
+
+		TEST_METHOD(inference_server_matches_forward_propagation_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(4, 1, 1));
+			nn.add_fully_connected_layer(5, e_activation_t::sigmoid_fn);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+
+			std::vector<matrix> inputs;
+			std::vector<matrix> expected;
+			for (int i = 0; i < 40; i++)
+			{
+				matrix input(vector3(4, 1, 1));
+				input.apply_noise(1);
+				nn.forward_propagation(input);
+				inputs.push_back(input);
+				expected.push_back(nn.get_output_readonly());
+			}
+
+			inference_server server(nn, 2, 8, std::chrono::microseconds(2000));
+			std::vector<std::future<matrix>> outputs;
+			for (const matrix& input : inputs)
+			{
+				outputs.push_back(server.submit(input));
+			}
+			for (size_t i = 0; i < outputs.size(); i++)
+			{
+				matrix output = outputs[i].get();
+				Assert::AreEqual(expected[i].get_at_flat_host(0), output.get_at_flat_host(0), 0.0001f);
+				Assert::AreEqual(expected[i].get_at_flat_host(1), output.get_at_flat_host(1), 0.0001f);
+			}
+
+			inference_server::statistics stats = server.get_statistics();
+			Assert::AreEqual((size_t)40, stats.request_count);
+			//the requests were submitted faster than the wait time, so they were batched
+			Assert::IsTrue(stats.batch_count < 40);
+			Assert::IsTrue(stats.average_batch_size <= 8.0f);
+			Assert::IsTrue(stats.p50_latency_ms <= stats.p99_latency_ms);
+		}
+		TEST_METHOD(inference_server_workers_survive_concurrent_load_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(2, 1, 1));
+			nn.add_fully_connected_layer(1, e_activation_t::sigmoid_fn);
+
+			//idle workers wait for the same deadline, the ones that find the queue empty afterwards have to keep waiting
+			const auto max_wait = std::chrono::milliseconds(100);
+			inference_server server(nn, 4, 1, max_wait);
+			for (int round = 0; round < 5; round++)
+			{
+				std::vector<std::future<matrix>> outputs;
+				for (int i = 0; i < 20; i++)
+				{
+					outputs.push_back(server.submit(matrix(vector3(2, 1, 1))));
+				}
+				for (std::future<matrix>& output : outputs)
+				{
+					Assert::AreEqual((size_t)1, output.get().item_count());
+				}
+			}
+			//a worker that returned an empty batch would have stopped after its deadline
+			std::this_thread::sleep_for(max_wait * 3);
+			Assert::AreEqual((size_t)4, server.get_statistics().running_workers);
+
+			std::vector<std::future<matrix>> outputs;
+			for (int i = 0; i < 8; i++)
+			{
+				outputs.push_back(server.submit(matrix(vector3(2, 1, 1))));
+			}
+			for (std::future<matrix>& output : outputs)
+			{
+				Assert::AreEqual((size_t)1, output.get().item_count());
+			}
+			Assert::AreEqual((size_t)108, server.get_statistics().request_count);
+			Assert::AreEqual((size_t)4, server.get_statistics().running_workers);
+		}
+		TEST_METHOD(inference_server_stop_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(2, 1, 1));
+			nn.add_fully_connected_layer(1, e_activation_t::sigmoid_fn);
+
+			inference_server server(nn, 1, 4, std::chrono::microseconds(100));
+			Assert::ExpectException<std::invalid_argument>([&]() { server.submit(matrix(vector3(3, 1, 1))); });
+
+			std::future<matrix> output = server.submit(matrix(vector3(2, 1, 1)));
+			server.stop();
+			//queued requests are still answered
+			Assert::AreEqual((size_t)1, output.get().item_count());
+			Assert::ExpectException<std::runtime_error>([&]() { server.submit(matrix(vector3(2, 1, 1))); });
+			Assert::AreEqual((size_t)0, server.get_statistics().running_workers);
+		}
+	};
+}
@@ -20,5 +20,56 @@ namespace CNNTest
 			Assert::AreEqual(1.0f, relu(1.0f));
 			Assert::AreEqual(0.0f, relu(-1.0f));
 		}
+		TEST_METHOD(derivative_from_activation_test)
+		{
+			const float inputs[] = { -2.0f, -0.5f, 0.5f, 3.0f };
+			for (int fn = 0; fn < 3; fn++)
+			{
+				for (float x : inputs)
+				{
+					Assert::AreEqual(
+						DERIVATIVE[fn](x),
+						DERIVATIVE_FROM_ACTIVATION[fn](ACTIVATION[fn](x)),
+						0.00001f);
+				}
+			}
+		}
+		TEST_METHOD(augment_item_test)
+		{
+			const float image[] = {
+				0.0f, 0.0f, 0.0f,
+				0.0f, 1.0f, 0.5f,
+				0.0f, 0.0f, 0.0f };
+
+			//without transforms the item is not changed
+			augmentation_settings settings;
+			for (uint32_t y = 0; y < 3; y++)
+			{
+				for (uint32_t x = 0; x < 3; x++)
+				{
+					Assert::AreEqual(image[y * 3 + x], augment_item(settings, image, 3, 3, 0, x, y, 0));
+				}
+			}
+
+			settings.seed = 7;
+			settings.max_shift = 1;
+			settings.max_rotation = 0.2f;
+			settings.elastic_amplitude = 0.5f;
+			settings.noise = 0.1f;
+			bool changed = false;
+			for (uint32_t y = 0; y < 3; y++)
+			{
+				for (uint32_t x = 0; x < 3; x++)
+				{
+					const float value = augment_item(settings, image, 3, 3, 4, x, y, 0);
+					//the values only depend on the seed and the item
+					Assert::AreEqual(value, augment_item(settings, image, 3, 3, 4, x, y, 0));
+					//the filtered values stay in the range of the image (plus the noise)
+					Assert::IsTrue(value >= -0.1f && value <= 1.1f);
+					changed = changed || value != image[y * 3 + x];
+				}
+			}
+			Assert::IsTrue(changed);
+		}
 	};
 }
@@ -7,6 +7,20 @@ namespace CNNTest
 {
 	TEST_CLASS(matrix_test)
 	{
+	private:
+		//the backends that use the cuda libraries, only the compiled in ones are tested
+		static std::vector<e_gpu_backend_t> library_backends()
+		{
+			std::vector<e_gpu_backend_t> backends;
+			for (e_gpu_backend_t backend : { cublas_backend, cudnn_backend })
+			{
+				if (gpu_backend_available(backend))
+				{
+					backends.push_back(backend);
+				}
+			}
+			return backends;
+		}
 	public:
 
 		TEST_METHOD(creating_matrix)
@@ -463,5 +477,566 @@ namespace CNNTest
 
 			Assert::IsTrue(m.contains_non_zero_items());
 		}
+		TEST_METHOD(dot_product_batch)
+		{
+			matrix weights(vector3(3, 2, 1), std::vector<float> {
+				1, 2, 3,
+					4, 5, 6
+			});
+			matrix input_batch(vector3(3, 2, 1), std::vector<float> {
+				1, 0, 1,
+					2, 1, 0
+			});
+			matrix result_batch(vector3(2, 2, 1));
+
+			matrix::dot_product_batch(weights, input_batch, result_batch);
+
+			//first item:  1*1 + 2*0 + 3*1 = 4,  4*1 + 5*0 + 6*1 = 10
+			//second item: 1*2 + 2*1 + 3*0 = 4,  4*2 + 5*1 + 6*0 = 13
+			Assert::AreEqual(4.0f, result_batch.get_at_flat_host(0));
+			Assert::AreEqual(10.0f, result_batch.get_at_flat_host(1));
+			Assert::AreEqual(4.0f, result_batch.get_at_flat_host(2));
+			Assert::AreEqual(13.0f, result_batch.get_at_flat_host(3));
+		}
+		TEST_METHOD(add_flat_batch)
+		{
+			matrix batch(vector3(2, 3, 1), std::vector<float> {
+				1, 2,
+					3, 4,
+					5, 6
+			});
+			matrix flat(vector3(1, 2, 1), std::vector<float> { 10, 20 });
+			matrix result(vector3(2, 3, 1));
+
+			matrix::add_flat_batch(batch, flat, result);
+
+			Assert::IsTrue(matrix::are_equal(result,
+				matrix(vector3(2, 3, 1), std::vector<float> {
+				11, 22,
+					13, 24,
+					15, 26
+			})));
+		}
+		TEST_METHOD(fully_connected_backprop_passing_error_is_summed)
+		{
+			//the activations are positive, so the leaky relu derivative is 1
+			matrix activations(vector3(1, 2, 1), std::vector<float> { 1, 1 });
+			matrix error(vector3(1, 2, 1), std::vector<float> { 1, 1 });
+			matrix input(vector3(1, 2, 1), std::vector<float> { 2, 3 });
+			matrix weights(vector3(2, 2, 1), std::vector<float> {
+				1, 2,
+					3, 4
+			});
+			matrix passing_error(vector3(1, 2, 1));
+			matrix weight_deltas(weights.get_format());
+			matrix bias_deltas(activations.get_format());
+
+			matrix::fully_connected_backprop(
+				activations,
+				weights,
+				input,
+				error,
+				&passing_error,
+				weight_deltas,
+				bias_deltas,
+				leaky_relu_fn);
+
+			//every input gets the error of all neurons it is connected to
+			Assert::AreEqual(4.0f, passing_error.get_at_flat_host(0));
+			Assert::AreEqual(6.0f, passing_error.get_at_flat_host(1));
+
+			Assert::IsTrue(matrix::are_equal(weight_deltas,
+				matrix(vector3(2, 2, 1), std::vector<float> {
+				2, 3,
+					2, 3
+			})));
+			Assert::AreEqual(1.0f, bias_deltas.get_at_flat_host(0));
+			Assert::AreEqual(1.0f, bias_deltas.get_at_flat_host(1));
+		}
+		TEST_METHOD(dot_product_flat_with_remainder_test)
+		{
+			//the width is not a multiple of the vector width
+			//so the remaining items have to be handled separately
+			const size_t width = 37;
+			matrix weights(vector3(width, 2, 1));
+			matrix input(vector3(width, 1, 1));
+			matrix result(vector3(2, 1, 1));
+
+			float expected_first = 0;
+			float expected_second = 0;
+			for (size_t i = 0; i < width; i++)
+			{
+				weights.set_at_flat_host(i, (float)i);
+				weights.set_at_flat_host(width + i, 1.0f);
+				input.set_at_flat_host(i, 2.0f);
+				expected_first += (float)i * 2.0f;
+				expected_second += 2.0f;
+			}
+
+			matrix::dot_product_flat(weights, input, result);
+
+			Assert::AreEqual(expected_first, result.get_at_flat_host(0));
+			Assert::AreEqual(expected_second, result.get_at_flat_host(1));
+		}
+		TEST_METHOD(dot_product_bias_activate_matches_two_passes_test)
+		{
+			matrix weights(vector3(37, 5, 1));
+			weights.apply_noise(1);
+			matrix input(vector3(37, 1, 1));
+			input.apply_noise(1);
+			matrix biases(vector3(5, 1, 1));
+			biases.apply_noise(1);
+
+			for (e_activation_t fn : { sigmoid_fn, relu_fn, leaky_relu_fn, softmax_fn })
+			{
+				matrix expected(vector3(5, 1, 1));
+				matrix::dot_product_flat(weights, input, expected);
+				matrix::add_bias_and_activate(expected, biases, fn);
+
+				matrix result(vector3(5, 1, 1));
+				matrix::dot_product_bias_activate(weights, input, biases, result, fn);
+				Assert::IsTrue(matrix::are_equal(expected, result));
+
+				matrix gpu_weights(weights);
+				matrix gpu_input(input);
+				matrix gpu_biases(biases);
+				matrix gpu_result(vector3(5, 1, 1));
+				gpu_weights.enable_gpu_mode();
+				gpu_input.enable_gpu_mode();
+				gpu_biases.enable_gpu_mode();
+				gpu_result.enable_gpu_mode();
+				matrix::dot_product_bias_activate(gpu_weights, gpu_input, gpu_biases, gpu_result, fn);
+				gpu_result.sync_device_and_host();
+				Assert::IsTrue(matrix::are_equal(expected, gpu_result, 0.0001f));
+			}
+		}
+		TEST_METHOD(dot_product_batch_bias_activate_matches_two_passes_test)
+		{
+			matrix weights(vector3(37, 5, 1));
+			weights.apply_noise(1);
+			matrix input_batch(vector3(37, 3, 1));
+			input_batch.apply_noise(1);
+			matrix biases(vector3(5, 1, 1));
+			biases.apply_noise(1);
+
+			for (e_activation_t fn : { sigmoid_fn, relu_fn, leaky_relu_fn, softmax_fn })
+			{
+				matrix expected(vector3(5, 3, 1));
+				matrix::dot_product_batch(weights, input_batch, expected);
+				matrix::add_bias_and_activate_batch(expected, biases, fn);
+
+				matrix result(vector3(5, 3, 1));
+				matrix::dot_product_batch_bias_activate(weights, input_batch, biases, result, fn);
+				Assert::IsTrue(matrix::are_equal(expected, result));
+
+				matrix gpu_weights(weights);
+				matrix gpu_input_batch(input_batch);
+				matrix gpu_biases(biases);
+				matrix gpu_result(vector3(5, 3, 1));
+				gpu_weights.enable_gpu_mode();
+				gpu_input_batch.enable_gpu_mode();
+				gpu_biases.enable_gpu_mode();
+				gpu_result.enable_gpu_mode();
+				matrix::dot_product_batch_bias_activate(gpu_weights, gpu_input_batch, gpu_biases, gpu_result, fn);
+				gpu_result.sync_device_and_host();
+				Assert::IsTrue(matrix::are_equal(expected, gpu_result, 0.0001f));
+			}
+		}
+		TEST_METHOD(cross_correlation_bias_activate_matches_two_passes_test)
+		{
+			//the direct (3x3 outputs), the im2col (5x5 kernels) and the winograd (3x3 kernels) strategy
+			struct conv_case { size_t input_width; size_t kernel_size; size_t stride; };
+			for (conv_case curr_case : { conv_case{ 7, 3, 2 }, conv_case{ 12, 5, 1 }, conv_case{ 12, 3, 1 } })
+			{
+				const size_t output_width = (curr_case.input_width - curr_case.kernel_size) / curr_case.stride + 1;
+				const e_fixed_kernel_t fixed_kernel = conv_select_fixed_kernel(curr_case.kernel_size, curr_case.stride);
+
+				matrix input(vector3(curr_case.input_width, curr_case.input_width, 2));
+				input.apply_noise(1);
+				std::vector<matrix> kernels;
+				for (size_t i = 0; i < 3; i++)
+				{
+					kernels.emplace_back(vector3(curr_case.kernel_size, curr_case.kernel_size, 2));
+					kernels.back().apply_noise(1);
+				}
+				matrix biases(vector3(output_width, output_width, 3));
+				biases.apply_noise(1);
+
+				for (e_activation_t fn : { sigmoid_fn, relu_fn, leaky_relu_fn, softmax_fn })
+				{
+					matrix expected(vector3(output_width, output_width, 3));
+					matrix::cross_correlation(input, kernels, expected, curr_case.stride, fixed_kernel);
+					matrix::add_bias_and_activate(expected, biases, fn);
+
+					matrix result(vector3(output_width, output_width, 3));
+					matrix::cross_correlation_bias_activate(input, kernels, biases, result, curr_case.stride, fixed_kernel, fn);
+					Assert::IsTrue(matrix::are_equal(expected, result, 0.00001f));
+
+					matrix gpu_input(input);
+					std::vector<matrix> gpu_kernels(kernels);
+					matrix gpu_biases(biases);
+					matrix gpu_result(vector3(output_width, output_width, 3));
+					gpu_input.enable_gpu_mode();
+					for (matrix& kernel : gpu_kernels)
+					{
+						kernel.enable_gpu_mode();
+					}
+					gpu_biases.enable_gpu_mode();
+					gpu_result.enable_gpu_mode();
+					matrix::cross_correlation_bias_activate(gpu_input, gpu_kernels, gpu_biases, gpu_result, curr_case.stride, fixed_kernel, fn);
+					gpu_result.sync_device_and_host();
+					Assert::IsTrue(matrix::are_equal(expected, gpu_result, 0.0001f));
+				}
+			}
+		}
+		TEST_METHOD(dot_product_backends_match_native_backend_test)
+		{
+			matrix weights(vector3(37, 5, 1));
+			weights.apply_noise(1);
+			matrix input(vector3(37, 1, 1));
+			input.apply_noise(1);
+			matrix input_batch(vector3(37, 3, 1));
+			input_batch.apply_noise(1);
+			matrix biases(vector3(5, 1, 1));
+			biases.apply_noise(1);
+
+			struct dot_results { matrix flat; matrix activated; matrix batch; matrix batch_activated; };
+			auto run_on_backend = [&](e_gpu_backend_t backend)
+			{
+				gpu_stream_guard guard(gpu_get_current_stream(), backend);
+
+				matrix gpu_weights(weights);
+				matrix gpu_input(input);
+				matrix gpu_input_batch(input_batch);
+				matrix gpu_biases(biases);
+				gpu_weights.enable_gpu_mode();
+				gpu_input.enable_gpu_mode();
+				gpu_input_batch.enable_gpu_mode();
+				gpu_biases.enable_gpu_mode();
+
+				dot_results results{
+					matrix(vector3(5, 1, 1)),
+					matrix(vector3(5, 1, 1)),
+					matrix(vector3(5, 3, 1)),
+					matrix(vector3(5, 3, 1)) };
+				for (matrix* result : { &results.flat, &results.activated, &results.batch, &results.batch_activated })
+				{
+					result->enable_gpu_mode();
+				}
+
+				matrix::dot_product_flat(gpu_weights, gpu_input, results.flat);
+				matrix::dot_product_bias_activate(gpu_weights, gpu_input, gpu_biases, results.activated, sigmoid_fn);
+				matrix::dot_product_batch(gpu_weights, gpu_input_batch, results.batch);
+				matrix::dot_product_batch_bias_activate(gpu_weights, gpu_input_batch, gpu_biases, results.batch_activated, softmax_fn);
+
+				for (matrix* result : { &results.flat, &results.activated, &results.batch, &results.batch_activated })
+				{
+					result->sync_device_and_host();
+				}
+				return results;
+			};
+
+			dot_results expected = run_on_backend(native_backend);
+			for (e_gpu_backend_t backend : library_backends())
+			{
+				dot_results results = run_on_backend(backend);
+				Assert::IsTrue(matrix::are_equal(expected.flat, results.flat, 0.0001f));
+				Assert::IsTrue(matrix::are_equal(expected.activated, results.activated, 0.0001f));
+				Assert::IsTrue(matrix::are_equal(expected.batch, results.batch, 0.0001f));
+				Assert::IsTrue(matrix::are_equal(expected.batch_activated, results.batch_activated, 0.0001f));
+			}
+			Assert::IsTrue(gpu_get_current_backend() == native_backend);
+		}
+		TEST_METHOD(fully_connected_backprop_backends_match_native_backend_test)
+		{
+			matrix weights(vector3(37, 5, 1));
+			weights.apply_noise(1);
+			matrix activations(vector3(5, 1, 1));
+			activations.apply_noise(0.1f, 0.9f);
+			matrix input(vector3(37, 1, 1));
+			input.apply_noise(1);
+			matrix error(vector3(5, 1, 1));
+			error.apply_noise(1);
+			matrix activations_batch(vector3(5, 3, 1));
+			activations_batch.apply_noise(0.1f, 0.9f);
+			matrix input_batch(vector3(37, 3, 1));
+			input_batch.apply_noise(1);
+			matrix error_batch(vector3(5, 3, 1));
+			error_batch.apply_noise(1);
+
+			//the deltas are added to, so they do not start at zero
+			matrix start_weight_deltas(weights.get_format());
+			start_weight_deltas.apply_noise(1);
+			matrix start_bias_deltas(vector3(5, 1, 1));
+			start_bias_deltas.apply_noise(1);
+
+			struct backprop_results { matrix passing_error; matrix weight_deltas; matrix bias_deltas; };
+			auto run_on_backend = [&](e_gpu_backend_t backend, bool batch)
+			{
+				gpu_stream_guard guard(gpu_get_current_stream(), backend);
+
+				matrix gpu_weights(weights);
+				matrix gpu_activations(batch ? activations_batch : activations);
+				matrix gpu_input(batch ? input_batch : input);
+				matrix gpu_error(batch ? error_batch : error);
+				backprop_results results{
+					matrix(gpu_input.get_format()),
+					matrix(start_weight_deltas),
+					matrix(start_bias_deltas) };
+				for (matrix* m : { &gpu_weights, &gpu_activations, &gpu_input, &gpu_error, &results.passing_error, &results.weight_deltas, &results.bias_deltas })
+				{
+					m->enable_gpu_mode();
+				}
+
+				if (batch)
+				{
+					matrix::fully_connected_backprop_batch(
+						gpu_activations, gpu_weights, gpu_input, gpu_error,
+						&results.passing_error, results.weight_deltas, results.bias_deltas, sigmoid_fn);
+				}
+				else
+				{
+					matrix::fully_connected_backprop(
+						gpu_activations, gpu_weights, gpu_input, gpu_error,
+						&results.passing_error, results.weight_deltas, results.bias_deltas, sigmoid_fn);
+				}
+
+				for (matrix* result : { &results.passing_error, &results.weight_deltas, &results.bias_deltas })
+				{
+					result->sync_device_and_host();
+				}
+				return results;
+			};
+
+			for (bool batch : { false, true })
+			{
+				backprop_results expected = run_on_backend(native_backend, batch);
+				for (e_gpu_backend_t backend : library_backends())
+				{
+					backprop_results results = run_on_backend(backend, batch);
+					Assert::IsTrue(matrix::are_equal(expected.passing_error, results.passing_error, 0.0001f));
+					Assert::IsTrue(matrix::are_equal(expected.weight_deltas, results.weight_deltas, 0.0001f));
+					Assert::IsTrue(matrix::are_equal(expected.bias_deltas, results.bias_deltas, 0.0001f));
+				}
+			}
+			Assert::IsTrue(gpu_get_current_backend() == native_backend);
+		}
+		TEST_METHOD(cross_correlation_backends_match_native_backend_test)
+		{
+			//the direct (3x3 outputs), the im2col (5x5 kernels) and the winograd (3x3 kernels) strategy
+			struct conv_case { size_t input_width; size_t kernel_size; size_t stride; };
+			for (conv_case curr_case : { conv_case{ 7, 3, 2 }, conv_case{ 12, 5, 1 }, conv_case{ 12, 3, 1 } })
+			{
+				const size_t output_width = (curr_case.input_width - curr_case.kernel_size) / curr_case.stride + 1;
+				const e_fixed_kernel_t fixed_kernel = conv_select_fixed_kernel(curr_case.kernel_size, curr_case.stride);
+				const vector3 output_format(output_width, output_width, 3);
+
+				matrix input(vector3(curr_case.input_width, curr_case.input_width, 2));
+				input.apply_noise(1);
+				std::vector<matrix> kernels;
+				for (size_t i = 0; i < 3; i++)
+				{
+					kernels.emplace_back(vector3(curr_case.kernel_size, curr_case.kernel_size, 2));
+					kernels.back().apply_noise(1);
+				}
+				matrix biases(output_format);
+				biases.apply_noise(1);
+
+				struct conv_results { matrix output; matrix activated; matrix changed_kernels_output; };
+				auto run_on_backend = [&](e_gpu_backend_t backend)
+				{
+					gpu_stream_guard guard(gpu_get_current_stream(), backend);
+
+					matrix gpu_input(input);
+					std::vector<matrix> gpu_kernels(kernels);
+					matrix gpu_biases(biases);
+					gpu_input.enable_gpu_mode();
+					for (matrix& kernel : gpu_kernels)
+					{
+						kernel.enable_gpu_mode();
+					}
+					gpu_biases.enable_gpu_mode();
+
+					conv_results results{ matrix(output_format), matrix(output_format), matrix(output_format) };
+					for (matrix* result : { &results.output, &results.activated, &results.changed_kernels_output })
+					{
+						result->enable_gpu_mode();
+					}
+
+					matrix::cross_correlation(gpu_input, gpu_kernels, results.output, curr_case.stride, fixed_kernel);
+					matrix::cross_correlation_bias_activate(gpu_input, gpu_kernels, gpu_biases, results.activated, curr_case.stride, fixed_kernel, relu_fn);
+
+					//the same layer with new kernel values has to use the new values
+					for (size_t i = 0; i < gpu_kernels.size(); i++)
+					{
+						gpu_kernels[i].set_all(0.25f * (float)(i + 1));
+					}
+					matrix::cross_correlation(gpu_input, gpu_kernels, results.changed_kernels_output, curr_case.stride, fixed_kernel);
+
+					for (matrix* result : { &results.output, &results.activated, &results.changed_kernels_output })
+					{
+						result->sync_device_and_host();
+					}
+					return results;
+				};
+
+				conv_results expected = run_on_backend(native_backend);
+				for (e_gpu_backend_t backend : library_backends())
+				{
+					conv_results results = run_on_backend(backend);
+					Assert::IsTrue(matrix::are_equal(expected.output, results.output, 0.0001f));
+					Assert::IsTrue(matrix::are_equal(expected.activated, results.activated, 0.0001f));
+					Assert::IsTrue(matrix::are_equal(expected.changed_kernels_output, results.changed_kernels_output, 0.0001f));
+				}
+			}
+			Assert::IsTrue(gpu_get_current_backend() == native_backend);
+		}
+		TEST_METHOD(host_span_test)
+		{
+			matrix m(vector3(2, 2, 1), std::vector<float> { 1, 2, 3, 4 });
+
+			float sum = 0;
+			for (float value : m.host_span_readonly())
+			{
+				sum += value;
+			}
+			Assert::AreEqual(10.0f, sum);
+
+			data_span<float> span = m.host_span();
+			Assert::AreEqual((size_t)4, span.size);
+			span[3] = 5;
+			Assert::AreEqual(5.0f, m.get_at_host(vector3(1, 1, 0)));
+		}
+		TEST_METHOD(add_bias_and_activate_batch_test)
+		{
+			matrix batch(vector3(2, 2, 1), std::vector<float> { -3, 1, 2, -4 });
+			matrix biases(vector3(2, 1, 1), std::vector<float> { 1, 2 });
+
+			matrix::add_bias_and_activate_batch(batch, biases, relu_fn);
+
+			Assert::AreEqual(0.0f, batch.get_at_flat_host(0));
+			Assert::AreEqual(3.0f, batch.get_at_flat_host(1));
+			Assert::AreEqual(3.0f, batch.get_at_flat_host(2));
+			Assert::AreEqual(0.0f, batch.get_at_flat_host(3));
+		}
+		TEST_METHOD(set_rows_from_matrix_rows_test)
+		{
+			matrix table(vector3(3, 3, 1), std::vector<float> { 1, 2, 3, 4, 5, 6, 7, 8, 9 });
+			matrix batch(vector3(2, 2, 1));
+			const uint32_t row_indices[] = { 2, 0 };
+
+			//the last two items of the rows 2 and 0
+			batch.set_rows_from_matrix_rows(table, row_indices, 1, 2);
+
+			Assert::AreEqual(8.0f, batch.get_at_flat_host(0));
+			Assert::AreEqual(9.0f, batch.get_at_flat_host(1));
+			Assert::AreEqual(2.0f, batch.get_at_flat_host(2));
+			Assert::AreEqual(3.0f, batch.get_at_flat_host(3));
+		}
+		TEST_METHOD(set_layout_test)
+		{
+			//two positions with a depth of 2
+			matrix planar(vector3(2, 1, 2), std::vector<float> { 1, 2, 3, 4 });
+			matrix interleaved(planar);
+			interleaved.set_layout(hwc_layout);
+
+			Assert::IsTrue(interleaved.get_layout() == hwc_layout);
+			Assert::AreEqual(1.0f, interleaved.get_at_flat_host(0));
+			Assert::AreEqual(3.0f, interleaved.get_at_flat_host(1));
+			Assert::AreEqual(2.0f, interleaved.get_at_flat_host(2));
+			Assert::AreEqual(4.0f, interleaved.get_at_flat_host(3));
+			//the positions do not change
+			Assert::AreEqual(3.0f, interleaved.get_at_host(vector3(0, 0, 1)));
+			Assert::IsTrue(matrix::are_equal(planar, interleaved));
+
+			matrix converted(planar.get_format());
+			matrix::convert_layout(interleaved, converted);
+			Assert::IsTrue(converted.get_layout() == chw_layout);
+			Assert::AreEqual(2.0f, converted.get_at_flat_host(1));
+		}
+		TEST_METHOD(gpu_set_all_and_noise_test)
+		{
+			matrix m(vector3(100, 3, 1));
+			m.enable_gpu_mode();
+			m.set_all(2);
+			m.apply_noise(0.5f);
+
+			//the host got the same noise as the device, so nothing has to be copied
+			Assert::IsTrue(m.is_device_and_host_synced());
+			std::vector<float> device_values(m.item_count());
+			m.set_device_only(true);
+			m.copy_values_to_host(device_values.data());
+			for (size_t i = 0; i < m.item_count(); i++)
+			{
+				Assert::IsTrue(device_values[i] >= 1.5f && device_values[i] <= 2.5f);
+			}
+
+			m.set_device_only(false);
+			for (size_t i = 0; i < m.item_count(); i++)
+			{
+				Assert::AreEqual(device_values[i], m.get_at_flat_host(i));
+			}
+		}
+		TEST_METHOD(device_only_test)
+		{
+			matrix m(vector3(4, 2, 1), std::vector<float> { 1, 2, 3, 4, 5, 6, 7, 8 });
+			const matrix expected(m);
+			m.enable_gpu_mode();
+			m.set_device_only(true);
+
+			Assert::IsTrue(m.is_device_only());
+			Assert::IsFalse(m.has_host_data());
+			Assert::IsTrue(m.is_initialized());
+			Assert::IsTrue(m.device_data_is_updated());
+			Assert::IsFalse(m.host_data_is_updated());
+			Assert::IsTrue(matrix::are_equal(expected, m));
+
+			//copies of a device only matrix stay on the device
+			matrix copy(m);
+			Assert::IsTrue(copy.is_device_only());
+			Assert::IsTrue(matrix::are_equal(expected, copy));
+
+			//a row of the device data can be observed
+			matrix row(vector3(4, 1, 1));
+			row.enable_gpu_mode();
+			row.observe_row(m, 1);
+			Assert::IsTrue(row.device_data_is_updated());
+
+			//syncing brings the host data back
+			m.sync_device_and_host();
+			Assert::IsTrue(m.has_host_data());
+			Assert::AreEqual(6.0f, m.get_at_flat_host(5));
+		}
+
+		TEST_METHOD(device_only_host_access_test)
+		{
+			matrix m(vector3(4, 2, 1), std::vector<float> { 1, 2, 3, 4, 5, 6, 7, 8 });
+			m.enable_gpu_mode();
+			m.set_device_only(true);
+
+			//reading the host data of a device only matrix throws instead of reading null
+			Assert::ExpectException<std::runtime_error>([&m]() { m.get_at_flat_host(0); });
+			Assert::ExpectException<std::runtime_error>([&m]() { m.get_at_host(vector3(0, 0, 0)); });
+
+			//mutating brings the host data back first
+			m.mutate(1.0f);
+			Assert::IsTrue(m.has_host_data());
+			int changed = 0;
+			for (size_t i = 0; i < m.item_count(); i++)
+			{
+				if (m.get_at_flat_host(i) != (float)(i + 1))
+				{
+					changed++;
+				}
+			}
+			Assert::AreEqual(1, changed);
+
+			m.set_device_only(true);
+			m.set_at_flat_host(2, 10.0f);
+			Assert::IsTrue(m.has_host_data());
+			Assert::AreEqual(10.0f, m.get_at_flat_host(2));
+			m.sync_device_and_host();
+			Assert::AreEqual(10.0f, m.get_at_flat_host(2));
+		}
 	};
 }
\ No newline at end of file
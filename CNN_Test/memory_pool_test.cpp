@@ -0,0 +1,110 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/memory_pool.hpp"
+#include "../ConvolutionalNeuralNetwork/code/matrix.hpp"
+#include <cstdlib>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(memory_pool_test)
+	{
+	private:
+		static void* test_allocate(size_t byte_count)
+		{
+			return std::malloc(byte_count);
+		}
+		static void test_free(void* ptr)
+		{
+			std::free(ptr);
+		}
+	public:
+
+		TEST_METHOD(round_size_test)
+		{
+			Assert::AreEqual((size_t)512, memory_pool::round_size(1));
+			Assert::AreEqual((size_t)512, memory_pool::round_size(512));
+			Assert::AreEqual((size_t)1024, memory_pool::round_size(513));
+			Assert::AreEqual((size_t)(2 << 20), memory_pool::round_size((1 << 20) + 1));
+		}
+		TEST_METHOD(freed_block_is_reused_test)
+		{
+			memory_pool pool(test_allocate, test_free, 1 << 20);
+
+			void* first = pool.allocate(100);
+			Assert::AreEqual((size_t)512, pool.get_used_bytes());
+			pool.free(first);
+			Assert::AreEqual((size_t)0, pool.get_used_bytes());
+			Assert::AreEqual((size_t)512, pool.get_cached_bytes());
+
+			//same rounded size
+			void* second = pool.allocate(200);
+			Assert::IsTrue(first == second);
+			Assert::AreEqual((size_t)0, pool.get_cached_bytes());
+			pool.free(second);
+
+			pool.release_cached();
+			Assert::AreEqual((size_t)0, pool.get_cached_bytes());
+		}
+		TEST_METHOD(max_cached_bytes_test)
+		{
+			memory_pool pool(test_allocate, test_free, 512);
+
+			void* first = pool.allocate(512);
+			void* second = pool.allocate(512);
+			pool.free(first);
+			//does not fit into the cache anymore
+			pool.free(second);
+			Assert::AreEqual((size_t)512, pool.get_cached_bytes());
+		}
+		TEST_METHOD(free_unknown_pointer_test)
+		{
+			memory_pool pool(test_allocate, test_free, 512);
+			int value = 0;
+			Assert::ExpectException<std::invalid_argument>([&]() {
+				pool.free(&value);
+			});
+		}
+		TEST_METHOD(contains_test)
+		{
+			memory_pool pool(test_allocate, test_free, 1 << 20);
+			int value = 0;
+
+			void* block = pool.allocate(100);
+			Assert::IsTrue(pool.contains(block));
+			Assert::IsFalse(pool.contains(&value));
+			//a cached block is not handed out
+			pool.free(block);
+			Assert::IsFalse(pool.contains(block));
+		}
+		TEST_METHOD(matrix_uses_current_allocator_test)
+		{
+			caching_matrix_allocator allocator;
+			set_matrix_allocator(&allocator);
+			{
+				matrix m(vector3(4, 4, 1));
+				Assert::AreEqual((size_t)512, allocator.get_host_pool().get_used_bytes());
+				//the data is returned to the allocator it came from
+				set_matrix_allocator(nullptr);
+			}
+			Assert::AreEqual((size_t)0, allocator.get_host_pool().get_used_bytes());
+			Assert::AreEqual((size_t)512, allocator.get_host_pool().get_cached_bytes());
+		}
+		TEST_METHOD(shared_block_allocator_test)
+		{
+			shared_block_matrix_allocator allocator(64);
+			float* a = allocator.allocate_host(16);
+			float* b = allocator.allocate_host(64);
+			//every allocation starts at the same item
+			Assert::IsTrue(a == b);
+			Assert::AreEqual((size_t)0, (size_t)a % (arena_matrix_allocator::ITEM_ALIGNMENT * sizeof(float)));
+			Assert::IsFalse(allocator.has_device_block());
+			Assert::ExpectException<std::runtime_error>([&]() { allocator.allocate_host(65); });
+
+			matrix m(vector3(4, 4, 1));
+			m.set_all(2);
+			m.move_to_allocator(allocator);
+			Assert::IsTrue(m.get_allocator() == &allocator);
+			Assert::AreEqual(2.0f, a[15]);
+		}
+	};
+}
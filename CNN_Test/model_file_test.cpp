@@ -0,0 +1,130 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+#include "../ConvolutionalNeuralNetwork/code/model_file.hpp"
+#include <cstdio>
+#include <fstream>
+#include "test_util.hpp"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(model_file_test)
+	{
+	public:
+
+		TEST_METHOD(writer_reader_round_trip_test)
+		{
+			const std::string file_name = "model_file_round_trip_test.model";
+			const float values[] = { 1.5f, -2, 3 };
+			const int8_t bytes[] = { -1, 2, -3, 4, 5 };
+			{
+				model_writer writer;
+				writer.write_u32(7);
+				writer.write_f32(0.25f);
+				writer.write_vector3(vector3(3, 1, 1));
+				writer.add_tensor(float32_tensor, vector3(3, 1, 1), values);
+				writer.add_tensor(int8_tensor, vector3(5, 1, 1), bytes);
+				writer.save(file_name);
+			}
+
+			Assert::IsTrue(mapped_model_file::is_model_file(file_name));
+			{
+				mapped_model_file file(file_name);
+				Assert::AreEqual(MODEL_FILE_VERSION, file.get_version());
+				Assert::AreEqual((size_t)2, file.get_tensor_count());
+				Assert::AreEqual((size_t)0, file.get_byte_size() % MODEL_FILE_ALIGNMENT);
+
+				model_reader reader(file);
+				Assert::AreEqual((uint32_t)7, reader.read_u32());
+				Assert::AreEqual(0.25f, reader.read_f32());
+				Assert::IsTrue(vector3(3, 1, 1) == reader.read_vector3());
+
+				vector3 format;
+				const float* mapped_values = (const float*)reader.next_tensor(float32_tensor, format);
+				Assert::IsTrue(vector3(3, 1, 1) == format);
+				Assert::AreEqual((size_t)0, (size_t)mapped_values % MODEL_FILE_ALIGNMENT);
+				Assert::AreEqual(-2.0f, mapped_values[1]);
+
+				//the tensors have to be read with the type they were written with
+				Assert::ExpectException<std::runtime_error>([&]() { reader.next_tensor(float32_tensor, format); });
+			}
+			std::remove(file_name.c_str());
+		}
+		TEST_METHOD(invalid_model_file_test)
+		{
+			const std::string file_name = "model_file_invalid_test.model";
+			{
+				std::ofstream out(file_name, std::ios::out | std::ios::binary);
+				out.write(MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC));
+				const uint32_t future_version = MODEL_FILE_VERSION + 1;
+				out.write((const char*)&future_version, sizeof(future_version));
+			}
+			Assert::IsTrue(mapped_model_file::is_model_file(file_name));
+			//the header is truncated
+			Assert::ExpectException<std::runtime_error>([&]() { mapped_model_file file(file_name); });
+			std::remove(file_name.c_str());
+
+			Assert::IsFalse(mapped_model_file::is_model_file(file_name));
+		}
+		TEST_METHOD(nn_save_and_map_test)
+		{
+			const std::string file_name = "model_file_nn_test.model";
+			neural_network nn = create_conv_test_nn();
+			nn.save_to_file(file_name);
+
+			{
+				neural_network loaded(file_name);
+				Assert::IsTrue(loaded.is_memory_mapped());
+				Assert::IsTrue(loaded.nn_equal_format(nn));
+				Assert::IsTrue(loaded.equal_parameter(nn));
+
+				matrix input(vector3(6, 6, 2));
+				input.apply_noise(1);
+				nn.forward_propagation(input);
+				loaded.forward_propagation(input);
+				Assert::IsTrue(matrix::are_equal(nn.get_output_readonly(), loaded.get_output_readonly()));
+
+				//the pages are copy on write, changing the parameters does not change the file
+				loaded.apply_noise(0.5f);
+				Assert::IsFalse(loaded.equal_parameter(nn));
+			}
+
+			neural_network reloaded(file_name);
+			Assert::IsTrue(reloaded.equal_parameter(nn));
+
+			//a mapped network can be saved into the file it was loaded from
+			reloaded.mutate(0.5f);
+			neural_network changed(reloaded);
+			reloaded.save_to_file(file_name);
+			Assert::IsFalse(reloaded.is_memory_mapped());
+
+			{
+				neural_network saved(file_name);
+				Assert::IsTrue(saved.equal_parameter(changed));
+			}
+			std::remove(file_name.c_str());
+		}
+		TEST_METHOD(mapped_nn_can_learn_test)
+		{
+			const std::string file_name = "model_file_learn_test.model";
+			neural_network nn = create_conv_test_nn();
+			nn.save_to_file(file_name);
+
+			{
+				neural_network loaded(file_name);
+				loaded.use_flat_parameters(true);
+				Assert::IsTrue(loaded.equal_parameter(nn));
+
+				matrix input(vector3(6, 6, 2));
+				input.apply_noise(1);
+				matrix label(vector3(1, 5, 1));
+				label.set_all(1);
+				loaded.back_propagation(input, label);
+				loaded.apply_deltas(1, 0.1f);
+				Assert::IsFalse(loaded.equal_parameter(nn));
+			}
+
+			std::remove(file_name.c_str());
+		}
+	};
+}
@@ -111,5 +111,530 @@ namespace CNNTest
 			Assert::AreEqual(true, nn.equal_parameter(copy));
 			Assert::AreEqual(true, nn.nn_equal_format(copy));
 		}
+		TEST_METHOD(nn_backend_selection_test)
+		{
+			neural_network nn;
+			Assert::IsTrue(nn.get_gpu_backend() == native_backend);
+
+			for (e_gpu_backend_t backend : { native_backend, cublas_backend, cudnn_backend })
+			{
+				if (gpu_backend_available(backend))
+				{
+					nn.set_gpu_backend(backend);
+					Assert::IsTrue(nn.get_gpu_backend() == backend);
+				}
+				else
+				{
+					Assert::ExpectException<std::invalid_argument>([&nn, backend]() { nn.set_gpu_backend(backend); });
+				}
+			}
+
+			neural_network copy(nn);
+			Assert::IsTrue(copy.get_gpu_backend() == nn.get_gpu_backend());
+		}
+		TEST_METHOD(nn_parallel_learning_matches_sequential_learning)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(1, 4, 1));
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.apply_noise(1);
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 10; i++)
+			{
+				matrix d(vector3(1, 4, 1));
+				d.apply_noise(1);
+				data.push_back(d);
+				matrix l(vector3(1, 2, 1));
+				l.apply_noise(1);
+				label.push_back(l);
+			}
+			//one epoch, so the data spaces are only shuffled after training
+			data_space ds(vector3(1, 4, 1), vector3(1, 2, 1), data, label);
+			data_space parallel_ds(vector3(1, 4, 1), vector3(1, 2, 1), data, label);
+
+			neural_network parallel_nn(nn);
+
+			nn.learn_on_ds(ds, 1, 4, 0.1f, false);
+			parallel_nn.learn_on_ds_parallel(parallel_ds, 1, 4, 0.1f, false, 3);
+
+			Assert::IsTrue(nn.equal_parameter(parallel_nn));
+		}
+		TEST_METHOD(nn_parallel_conv_learning_matches_sequential_learning)
+		{
+			//the workers read the kernels of the network, they only have their own deltas
+			neural_network nn;
+			nn.set_input_format(vector3(6, 6, 1));
+			nn.add_convolutional_layer(2, 3, 1, e_activation_t::leaky_relu_fn);
+			nn.add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.apply_noise(1);
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 8; i++)
+			{
+				matrix d(vector3(6, 6, 1));
+				d.apply_noise(1);
+				data.push_back(d);
+				matrix l(vector3(1, 2, 1));
+				l.apply_noise(1);
+				label.push_back(l);
+			}
+			data_space ds(vector3(6, 6, 1), vector3(1, 2, 1), data, label);
+			data_space parallel_ds(vector3(6, 6, 1), vector3(1, 2, 1), data, label);
+
+			neural_network parallel_nn(nn);
+
+			nn.learn_on_ds(ds, 1, 4, 0.1f, false);
+			parallel_nn.learn_on_ds_parallel(parallel_ds, 1, 4, 0.1f, false, 2);
+
+			Assert::IsTrue(nn.equal_parameter(parallel_nn));
+		}
+		TEST_METHOD(nn_conv_pooling_learning_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(6, 6, 1));
+			nn.add_convolutional_layer(2, 3, 1, e_activation_t::leaky_relu_fn);
+			nn.add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			//pooling layers have no parameters, so they are skipped
+			nn.xavier_initialization();
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 4; i++)
+			{
+				matrix d(vector3(6, 6, 1));
+				d.apply_noise(1);
+				data.push_back(d);
+				matrix l(vector3(1, 2, 1));
+				l.apply_noise(1);
+				label.push_back(l);
+			}
+			data_space ds(vector3(6, 6, 1), vector3(1, 2, 1), data, label);
+
+			neural_network before(nn);
+			nn.learn_on_ds(ds, 1, 2, 0.1f, false);
+
+			Assert::IsTrue(nn.nn_equal_format(before));
+			Assert::IsFalse(nn.equal_parameter(before));
+		}
+		TEST_METHOD(nn_flat_parameters_match_layer_parameters_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(6, 6, 1));
+			nn.add_convolutional_layer(2, 3, 1, e_activation_t::leaky_relu_fn);
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+
+			neural_network flat(nn);
+			flat.use_flat_parameters(true);
+			Assert::IsTrue(flat.is_using_flat_parameters());
+			Assert::IsTrue(flat.equal_parameter(nn));
+
+			matrix data(vector3(6, 6, 1));
+			data.apply_noise(1);
+			matrix label(vector3(1, 3, 1));
+			label.apply_noise(1);
+
+			for (int i = 0; i < 3; i++)
+			{
+				nn.forward_propagation(data);
+				nn.back_propagation(data, label);
+				nn.apply_deltas(1, 0.1f);
+
+				flat.forward_propagation(data);
+				flat.back_propagation(data, label);
+				flat.apply_deltas(1, 0.1f);
+			}
+			Assert::IsTrue(flat.equal_parameter(nn));
+
+			//the copy has its own buffers, so the parameters are copied at once
+			neural_network other(flat);
+			other.apply_noise(1);
+			Assert::IsFalse(other.equal_parameter(flat));
+			other.set_parameters(flat);
+			Assert::IsTrue(other.equal_parameter(flat));
+
+			flat.use_flat_parameters(false);
+			Assert::IsTrue(flat.equal_parameter(nn));
+		}
+		TEST_METHOD(nn_adam_flat_matches_layer_parameters_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(6, 6, 1));
+			nn.add_convolutional_layer(2, 3, 1, e_activation_t::leaky_relu_fn);
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+			nn.set_optimizer(optimizer::adam());
+
+			neural_network flat(nn);
+			flat.use_flat_parameters(true);
+			neural_network start(nn);
+
+			matrix data(vector3(6, 6, 1));
+			data.apply_noise(1);
+			matrix label(vector3(1, 3, 1));
+			label.apply_noise(1);
+
+			for (int i = 0; i < 3; i++)
+			{
+				nn.forward_propagation(data);
+				nn.back_propagation(data, label);
+				nn.apply_deltas(1, 0.01f);
+
+				flat.forward_propagation(data);
+				flat.back_propagation(data, label);
+				flat.apply_deltas(1, 0.01f);
+			}
+			Assert::AreEqual((size_t)3, nn.get_optimizer().get_step_count());
+			Assert::IsFalse(nn.equal_parameter(start));
+			Assert::IsTrue(flat.equal_parameter(nn));
+		}
+		TEST_METHOD(nn_evaluate_matches_item_by_item_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(3, 1, 1));
+			nn.add_fully_connected_layer(4, e_activation_t::sigmoid_fn);
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+
+			std::vector<matrix> data;
+			std::vector<matrix> labels;
+			for (int i = 0; i < 7; i++)
+			{
+				matrix curr_data(vector3(3, 1, 1));
+				curr_data.apply_noise(1);
+				matrix curr_label(vector3(1, 3, 1));
+				curr_label.set_at_flat_host(i % 3, 1);
+				data.push_back(curr_data);
+				labels.push_back(curr_label);
+			}
+			data_space ds(vector3(3, 1, 1), vector3(1, 3, 1), data, labels);
+
+			size_t correct = 0;
+			float cost = 0;
+			for (size_t i = 0; i < data.size(); i++)
+			{
+				nn.forward_propagation(data[i]);
+				const matrix& output = nn.get_output_readonly();
+				size_t max_idx = 0;
+				for (size_t j = 0; j < 3; j++)
+				{
+					const float diff = output.get_at_flat_host(j) - labels[i].get_at_flat_host(j);
+					cost += diff * diff;
+					if (output.get_at_flat_host(j) > output.get_at_flat_host(max_idx))
+					{
+						max_idx = j;
+					}
+				}
+				correct += max_idx == i % 3 ? 1 : 0;
+			}
+
+			//the last batch only has one item
+			test_result result = nn.evaluate(ds, 3);
+			Assert::AreEqual((size_t)7, result.data_count);
+			Assert::AreEqual((float)correct / 7.0f, result.accuracy, 0.0001f);
+			Assert::AreEqual(cost / 7.0f, result.avg_cost, 0.0001f);
+		}
+		TEST_METHOD(nn_instance_shares_parameters_test)
+		{
+			std::shared_ptr<neural_network> source = std::make_shared<neural_network>();
+			source->set_input_format(vector3(6, 6, 1));
+			source->add_convolutional_layer(2, 3, 1, e_activation_t::relu_fn);
+			source->add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+			source->add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			source->xavier_initialization();
+
+			matrix input(vector3(6, 6, 1));
+			input.apply_noise(1);
+
+			std::shared_ptr<const neural_network> parameters = source;
+			neural_network instance(parameters);
+			neural_network instance_copy(instance);
+			Assert::IsTrue(instance.is_instance());
+			Assert::IsTrue(instance_copy.is_instance());
+			Assert::IsTrue(instance.is_inference_only());
+
+			source->forward_propagation(input);
+			instance.forward_propagation(input);
+			instance_copy.forward_propagation(input);
+			Assert::IsTrue(source->get_output_readonly() == instance.get_output_readonly());
+			Assert::IsTrue(source->get_output_readonly() == instance_copy.get_output_readonly());
+
+			//the instances read the parameters of the source, they are not copied
+			source->set_all_parameters(0.5f);
+			source->forward_propagation(input);
+			instance.forward_propagation(input);
+			Assert::IsTrue(source->get_output_readonly() == instance.get_output_readonly());
+
+			Assert::ExpectException<std::runtime_error>([&]() { instance.set_all_parameters(0); });
+			Assert::ExpectException<std::runtime_error>([&]() { instance.set_inference_only(false); });
+		}
+		TEST_METHOD(nn_graph_training_matches_training_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(1, 4, 1));
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.apply_noise(1);
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 10; i++)
+			{
+				matrix d(vector3(1, 4, 1));
+				d.apply_noise(1);
+				data.push_back(d);
+				matrix l(vector3(1, 2, 1));
+				l.apply_noise(1);
+				label.push_back(l);
+			}
+			data_space ds(vector3(1, 4, 1), vector3(1, 2, 1), data, label);
+			data_space graph_ds(vector3(1, 4, 1), vector3(1, 2, 1), data, label);
+
+			neural_network graph_nn(nn);
+			graph_nn.set_graph_training(true);
+			Assert::IsTrue(graph_nn.is_graph_training());
+			Assert::IsFalse(nn.is_graph_training());
+
+			neural_network graph_copy(graph_nn);
+			Assert::IsTrue(graph_copy.is_graph_training());
+
+			//on the cpu there is nothing to capture, the step is run as usual
+			nn.learn_on_ds(ds, 1, 4, 0.1f, false);
+			graph_nn.learn_on_ds(graph_ds, 1, 4, 0.1f, false);
+
+			Assert::IsTrue(nn.equal_parameter(graph_nn));
+		}
+		TEST_METHOD(nn_graph_training_gpu_matches_training_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(1, 4, 1));
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.apply_noise(1);
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 12; i++)
+			{
+				matrix d(vector3(1, 4, 1));
+				d.apply_noise(1);
+				data.push_back(d);
+				matrix l(vector3(1, 2, 1));
+				l.apply_noise(1);
+				label.push_back(l);
+			}
+			data_space ds(vector3(1, 4, 1), vector3(1, 2, 1), data, label);
+			data_space graph_ds(vector3(1, 4, 1), vector3(1, 2, 1), data, label);
+
+			neural_network graph_nn(nn);
+			graph_nn.set_graph_training(true);
+			nn.enable_gpu_mode();
+			graph_nn.enable_gpu_mode();
+
+			//6 batches per epoch, every graph warms up on its first batch, is captured on the next one and replayed after that
+			nn.learn_on_ds(ds, 2, 2, 0.1f, false);
+			graph_nn.learn_on_ds(graph_ds, 2, 2, 0.1f, false);
+			nn.sync_device_and_host();
+			graph_nn.sync_device_and_host();
+
+			Assert::IsTrue(nn.equal_parameter(graph_nn));
+			Assert::AreEqual(nn.get_optimizer().get_step_count(), graph_nn.get_optimizer().get_step_count());
+		}
+		TEST_METHOD(nn_inference_plan_matches_network_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(6, 6, 1));
+			nn.add_convolutional_layer(2, 3, 1, e_activation_t::relu_fn);
+			nn.add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+			nn.add_fully_connected_layer(8, e_activation_t::sigmoid_fn);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+
+			neural_network plan(nn);
+			plan.compile_inference_plan();
+			Assert::IsTrue(plan.has_inference_plan());
+			Assert::IsTrue(plan.is_inference_only());
+			Assert::IsTrue(plan.nn_equal_format(nn));
+			Assert::AreEqual((size_t)0, nn.get_plan_activation_item_count());
+			//conv 4x4x2 and fc 8 share a block, pooling 2x2x2 and fc 2 the other one
+			Assert::AreEqual((size_t)(32 + 8), plan.get_plan_activation_item_count());
+
+			neural_network plan_copy(plan);
+			Assert::IsTrue(plan_copy.has_inference_plan());
+
+			for (int i = 0; i < 3; i++)
+			{
+				matrix input(vector3(6, 6, 1));
+				input.apply_noise(1);
+				nn.forward_propagation(input);
+				plan.forward_propagation(input);
+				plan_copy.forward_propagation(input);
+				Assert::IsTrue(nn.get_output_readonly() == plan.get_output_readonly());
+				Assert::IsTrue(nn.get_output_readonly() == plan_copy.get_output_readonly());
+			}
+
+			matrix input(vector3(6, 6, 1));
+			matrix label(vector3(1, 2, 1));
+			Assert::ExpectException<std::runtime_error>([&]() { plan.back_propagation(input, label); });
+			Assert::ExpectException<std::runtime_error>([&]() { plan.apply_deltas(1, 0.1f); });
+			Assert::ExpectException<std::runtime_error>([&]() { plan.add_fully_connected_layer(2, e_activation_t::sigmoid_fn); });
+			Assert::ExpectException<std::runtime_error>([&]() { plan.set_inference_only(false); });
+		}
+		TEST_METHOD(nn_inference_plan_batch_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(1, 4, 1));
+			nn.add_fully_connected_layer(6, e_activation_t::sigmoid_fn);
+			nn.add_fully_connected_layer(5, e_activation_t::relu_fn);
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.apply_noise(1);
+
+			neural_network plan(nn);
+			plan.compile_inference_plan();
+			nn.set_batch_size(4);
+			plan.set_batch_size(4);
+			//6 and 3 items share a block, 5 items are in the other one
+			Assert::AreEqual((size_t)(6 + 5 + (6 + 5) * 4), plan.get_plan_activation_item_count());
+
+			matrix input_batch(vector3(4, 4, 1));
+			input_batch.apply_noise(1);
+			nn.forward_propagation_batch(input_batch);
+			plan.forward_propagation_batch(input_batch);
+			Assert::IsTrue(nn.get_batch_output_readonly() == plan.get_batch_output_readonly());
+
+			//a new batch size gets new blocks
+			plan.set_batch_size(2);
+			Assert::AreEqual((size_t)(6 + 5 + (6 + 5) * 2), plan.get_plan_activation_item_count());
+		}
+		TEST_METHOD(nn_interleaved_layout_matches_planar_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(8, 8, 2));
+			nn.add_convolutional_layer(3, 3, 1, e_activation_t::relu_fn);
+			nn.add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+			nn.add_convolutional_layer(2, 2, 1, e_activation_t::sigmoid_fn);
+			nn.add_pooling_layer(2, 1, e_pooling_type_t::average_pooling);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+
+			neural_network interleaved(nn);
+			interleaved.set_tensor_layout(hwc_layout);
+			Assert::IsTrue(interleaved.get_tensor_layout() == hwc_layout);
+			Assert::IsTrue(nn.get_tensor_layout() == chw_layout);
+
+			neural_network interleaved_copy(interleaved);
+			Assert::IsTrue(interleaved_copy.get_tensor_layout() == hwc_layout);
+
+			for (int i = 0; i < 3; i++)
+			{
+				matrix input(vector3(8, 8, 2));
+				input.apply_noise(1);
+				matrix label(vector3(1, 2, 1));
+				label.apply_noise(1);
+
+				//the trained parameters of the previous item are compared through the output
+				nn.forward_propagation(input);
+				interleaved.forward_propagation(input);
+				Assert::IsTrue(matrix::are_equal(nn.get_output_readonly(), interleaved.get_output_readonly(), 0.0001f));
+
+				nn.back_propagation(input, label);
+				interleaved.back_propagation(input, label);
+				nn.apply_deltas(1, 0.1f);
+				interleaved.apply_deltas(1, 0.1f);
+			}
+		}
+		TEST_METHOD(nn_softmax_cross_entropy_learning_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(1, 4, 1));
+			nn.add_fully_connected_layer(6, e_activation_t::relu_fn);
+			nn.add_fully_connected_layer(3, e_activation_t::softmax_fn);
+			nn.xavier_initialization();
+			Assert::IsTrue(nn.get_cost_function() == cross_entropy_cost);
+			Assert::ExpectException<std::invalid_argument>([&]() {
+				nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			});
+			Assert::ExpectException<std::invalid_argument>([&]() {
+				convolutional_layer l(2, 3, 1, e_activation_t::softmax_fn);
+			});
+
+			//three classes, the input has a one at the index of the class
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 12; i++)
+			{
+				matrix d(vector3(1, 4, 1));
+				d.set_at_flat_host(i % 3, 1);
+				data.push_back(d);
+				matrix l(vector3(1, 3, 1));
+				l.set_at_flat_host(i % 3, 1);
+				label.push_back(l);
+			}
+			data_space ds(vector3(1, 4, 1), vector3(1, 3, 1), data, label);
+
+			test_result before = nn.evaluate(ds, 4);
+			nn.learn_on_ds(ds, 1, 4, 0.5f, false);
+			//the cost of every trained item is summed up
+			Assert::IsTrue(nn.get_training_cost() > 0);
+			nn.reset_training_cost();
+			Assert::AreEqual(0.0f, nn.get_training_cost());
+
+			nn.learn_on_ds(ds, 30, 4, 0.5f, false);
+			test_result after = nn.evaluate(ds, 4);
+			Assert::IsTrue(after.avg_cost < before.avg_cost);
+			Assert::AreEqual(1.0f, after.accuracy);
+		}
+		TEST_METHOD(nn_augmentation_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(4, 4, 1));
+			nn.add_fully_connected_layer(3, e_activation_t::sigmoid_fn);
+			nn.apply_noise(1);
+
+			std::vector<matrix> data;
+			std::vector<matrix> label;
+			for (int i = 0; i < 10; i++)
+			{
+				matrix d(vector3(4, 4, 1));
+				d.apply_noise(1);
+				data.push_back(d);
+				matrix l(vector3(1, 3, 1));
+				l.set_at_flat_host(i % 3, 1);
+				label.push_back(l);
+			}
+			data_space ds(vector3(4, 4, 1), vector3(1, 3, 1), data, label);
+			data_space augmented_ds(vector3(4, 4, 1), vector3(1, 3, 1), data, label);
+
+			augmentation_settings settings;
+			settings.max_shift = 1;
+			settings.max_rotation = 0.1f;
+			settings.noise = 0.05f;
+			neural_network augmented_nn(nn);
+			augmented_nn.set_augmentation(settings);
+			Assert::AreEqual(1.0f, augmented_nn.get_augmentation().max_shift);
+
+			//the batches and the remaining items are augmented, the data space is not changed
+			nn.learn_on_ds(ds, 1, 4, 0.1f, false);
+			augmented_nn.learn_on_ds(augmented_ds, 1, 4, 0.1f, false);
+			Assert::IsFalse(nn.equal_parameter(augmented_nn));
+
+			matrix item(vector3(4, 4, 1));
+			matrix augmented_item(vector3(4, 4, 1));
+			for (size_t i = 0; i < ds.get_item_count(); i++)
+			{
+				ds.observe_data_at_idx(item, i);
+				augmented_ds.observe_data_at_idx(augmented_item, i);
+				Assert::IsTrue(matrix::are_equal(item, augmented_item));
+			}
+
+			settings.noise = -1;
+			Assert::ExpectException<std::invalid_argument>([&]() { augmented_nn.set_augmentation(settings); });
+		}
 	};
-}
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/optimizer.hpp"
+#include "../ConvolutionalNeuralNetwork/code/cpu_math.hpp"
+#include <cmath>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(optimizer_test)
+	{
+	public:
+
+		TEST_METHOD(sgd_step_test)
+		{
+			optimizer opt = optimizer::sgd();
+			float params[2] = { 1.0f, -1.0f };
+			float deltas[2] = { 4.0f, -2.0f };
+			float momentum[2] = { 0, 0 };
+
+			opt.begin_step();
+			//the deltas are summed over 2 items
+			opt.update(0, params, deltas, momentum, 2, false, 2, 0.5f);
+
+			Assert::AreEqual(0.0f, params[0]);
+			Assert::AreEqual(-0.5f, params[1]);
+			Assert::AreEqual(0.0f, deltas[0]);
+			Assert::AreEqual(0.0f, deltas[1]);
+		}
+		TEST_METHOD(momentum_matches_apply_deltas_test)
+		{
+			float params[3] = { 1.0f, 2.0f, 3.0f };
+			float deltas[3] = { 0.5f, -1.0f, 2.0f };
+			float momentum[3] = { 0.1f, 0.2f, 0.3f };
+
+			float expected_params[3] = { 1.0f, 2.0f, 3.0f };
+			float expected_deltas[3] = { 0.5f, -1.0f, 2.0f };
+			float expected_momentum[3] = { 0.1f, 0.2f, 0.3f };
+
+			//the default optimizer is the update the network always used
+			optimizer opt;
+			Assert::IsTrue(opt.get_type() == momentum_optimizer);
+			opt.begin_step();
+			opt.update(0, params, deltas, momentum, 3, false, 4, 0.1f);
+			cpu_apply_deltas(expected_params, expected_deltas, expected_momentum, 3, 0.25f, 0.1f, 0.9f);
+
+			for (int i = 0; i < 3; i++)
+			{
+				Assert::AreEqual(expected_params[i], params[i], 0.00001f);
+				Assert::AreEqual(expected_momentum[i], momentum[i], 0.00001f);
+				Assert::AreEqual(0.0f, deltas[i]);
+			}
+		}
+		TEST_METHOD(nesterov_step_test)
+		{
+			optimizer opt = optimizer::nesterov(0.5f);
+			float params[1] = { 1.0f };
+			float deltas[1] = { 2.0f };
+			float momentum[1] = { 0 };
+
+			opt.begin_step();
+			opt.update(0, params, deltas, momentum, 1, false, 1, 1.0f);
+
+			//momentum = 0.5 * 0 + 0.5 * 2 = 1
+			//step = 0.5 * 1 + 0.5 * 2 = 1.5
+			Assert::AreEqual(1.0f, momentum[0], 0.00001f);
+			Assert::AreEqual(-0.5f, params[0], 0.00001f);
+		}
+		TEST_METHOD(adam_first_step_test)
+		{
+			optimizer opt = optimizer::adam();
+			float params[3] = { 0, 0, 0 };
+			float deltas[3] = { 10.0f, -0.001f, 0 };
+			float momentum[3] = { 0, 0, 0 };
+
+			opt.begin_step();
+			opt.update(0, params, deltas, momentum, 3, false, 1, 0.01f);
+
+			//with the bias correction the first step has the size of the learning rate
+			Assert::AreEqual(-0.01f, params[0], 0.0001f);
+			Assert::AreEqual(0.01f, params[1], 0.0001f);
+			Assert::AreEqual(0.0f, params[2]);
+			Assert::AreEqual((size_t)1, opt.get_step_count());
+
+			opt.reset();
+			Assert::AreEqual((size_t)0, opt.get_step_count());
+		}
+		TEST_METHOD(adamw_decays_weights_test)
+		{
+			optimizer opt = optimizer::adamw(0.5f);
+			float params[1] = { 2.0f };
+			float deltas[1] = { 0 };
+			float momentum[1] = { 0 };
+
+			opt.begin_step();
+			opt.update(0, params, deltas, momentum, 1, false, 1, 0.1f);
+
+			//no gradient, only the decoupled decay 0.1 * 0.5 * 2
+			Assert::AreEqual(1.9f, params[0], 0.00001f);
+			Assert::AreEqual(0.0f, momentum[0]);
+		}
+		TEST_METHOD(invalid_settings_test)
+		{
+			Assert::ExpectException<std::invalid_argument>([]() {
+				optimizer::momentum(1.0f);
+			});
+			Assert::ExpectException<std::invalid_argument>([]() {
+				optimizer::sgd(-1.0f);
+			});
+		}
+	};
+}
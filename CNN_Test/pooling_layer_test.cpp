@@ -104,5 +104,110 @@ namespace CNNTest
 				Assert::AreEqual(1.0f, pooling.get_activations_readonly().get_at_flat_host(i));
 			}
 		}
+		TEST_METHOD(back_propagation_test_max_pooling)
+		{
+			//the windows overlap (kernel size 2, stride 1)
+			matrix input(vector3(3, 3, 1), std::vector<float> {
+				1, 2, 3,
+					4, 9, 5,
+					6, 7, 8
+			});
+
+			pooling_layer pooling(2, 1, max_pooling);
+			pooling.set_input_format(input.get_format());
+			pooling.forward_propagation(input);
+
+			Assert::IsTrue(matrix::are_equal(pooling.get_activations_readonly(),
+				matrix(vector3(2, 2, 1), std::vector<float> {
+				9, 9,
+					9, 9
+			})));
+
+			matrix* error = pooling.get_error_p();
+			error->set_at_host(vector3(0, 0), 1);
+			error->set_at_host(vector3(1, 0), 2);
+			error->set_at_host(vector3(0, 1), 3);
+			error->set_at_host(vector3(1, 1), 4);
+
+			matrix passing_error(input.get_format());
+			pooling.back_propagation(input, &passing_error);
+
+			//every window selected the 9, so it gets the error of all of them
+			Assert::IsTrue(matrix::are_equal(passing_error,
+				matrix(vector3(3, 3, 1), std::vector<float> {
+				0, 0, 0,
+					0, 10, 0,
+					0, 0, 0
+			})));
+		}
+		TEST_METHOD(back_propagation_test_average_pooling)
+		{
+			matrix input(vector3(4, 4, 1));
+			input.set_all(1);
+
+			pooling_layer pooling(2, 2, average_pooling);
+			pooling.set_input_format(input.get_format());
+			pooling.forward_propagation(input);
+
+			matrix* error = pooling.get_error_p();
+			error->set_all(4);
+			error->set_at_host(vector3(1, 1), 8);
+
+			matrix passing_error(input.get_format());
+			pooling.back_propagation(input, &passing_error);
+
+			Assert::IsTrue(matrix::are_equal(passing_error,
+				matrix(vector3(4, 4, 1), std::vector<float> {
+				1, 1, 1, 1,
+					1, 1, 1, 1,
+					1, 1, 2, 2,
+					1, 1, 2, 2
+			})));
+		}
+		TEST_METHOD(fixed_pooling_matches_generic_test)
+		{
+			matrix input(vector3(6, 6, 2));
+			input.apply_noise(1);
+			//the first value of a window is kept if the others are equal
+			input.set_at_host(vector3(1, 0, 0), input.get_at_host(vector3(0, 0, 0)));
+
+			const e_pooling_type_t types[] = { max_pooling, min_pooling, average_pooling };
+			for (e_pooling_type_t type : types)
+			{
+				matrix expected(vector3(3, 3, 2));
+				matrix output(vector3(3, 3, 2));
+				pooling_index_buffer expected_indices;
+				pooling_index_buffer indices;
+				expected_indices.resize(expected.item_count());
+				indices.resize(output.item_count());
+
+				matrix::pooling(input, expected, 2, 2, type, &expected_indices, generic_kernel);
+				matrix::pooling(input, output, 2, 2, type, &indices, kernel_2x2_s2);
+
+				Assert::IsTrue(matrix::are_equal(expected, output));
+				if (type != average_pooling)
+				{
+					for (size_t i = 0; i < output.item_count(); i++)
+					{
+						Assert::AreEqual(expected_indices.get_host_ptr_readonly()[i], indices.get_host_ptr_readonly()[i]);
+					}
+				}
+			}
+		}
+		TEST_METHOD(back_propagation_test_inference_only)
+		{
+			matrix input(vector3(4, 4, 1));
+			input.set_all(1);
+
+			pooling_layer pooling(2, 2, max_pooling);
+			pooling.set_input_format(input.get_format());
+			pooling.set_inference_only(true);
+			pooling.forward_propagation(input);
+
+			matrix passing_error(input.get_format());
+			Assert::ExpectException<std::runtime_error>([&]() {
+				pooling.back_propagation(input, &passing_error);
+			});
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/population.hpp"
+#include "test_util.hpp"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(population_test)
+	{
+	public:
+
+		TEST_METHOD(population_keeps_fittest_genome_test)
+		{
+			neural_network nn = create_two_input_test_nn(3);
+			data_space ds = create_two_input_test_ds(8);
+
+			population pop(nn, 10, 0.5f, 2, 42);
+			float best_fitness = -1e9f;
+			for (int i = 0; i < 5; i++)
+			{
+				pop.evaluate(ds, 4);
+				const float curr_best = pop.get_fitness()[pop.get_fittest_genome_idx()];
+				//the fittest genome is kept, so the best fitness can not get worse
+				Assert::IsTrue(curr_best >= best_fitness - 0.0001f);
+				best_fitness = curr_best;
+				pop.evolve();
+			}
+			Assert::AreEqual((size_t)5, pop.get_generation());
+
+			//evolving again needs a new fitness
+			Assert::ExpectException<std::runtime_error>([&]() { pop.evolve(); });
+		}
+		TEST_METHOD(population_same_seed_test)
+		{
+			neural_network nn = create_two_input_test_nn(3);
+			data_space ds = create_two_input_test_ds(8);
+
+			//the random numbers do not depend on the number of threads
+			population first(nn, 6, 0.5f, 1, 7);
+			population second(nn, 6, 0.5f, 3, 7);
+			for (int i = 0; i < 3; i++)
+			{
+				first.evaluate(ds, 3);
+				second.evaluate(ds, 3);
+				first.evolve();
+				second.evolve();
+			}
+
+			neural_network first_nn = create_two_input_test_nn(3);
+			neural_network second_nn = create_two_input_test_nn(3);
+			for (size_t i = 0; i < first.get_genome_count(); i++)
+			{
+				first.copy_genome_to(i, first_nn);
+				second.copy_genome_to(i, second_nn);
+				Assert::IsTrue(first_nn.equal_parameter(second_nn));
+			}
+		}
+		TEST_METHOD(population_first_genome_is_model_test)
+		{
+			neural_network nn = create_two_input_test_nn(3);
+			population pop(nn, 4, 0.5f, 1, 3);
+
+			neural_network genome_nn = create_two_input_test_nn(3);
+			pop.copy_genome_to(0, genome_nn);
+			Assert::IsTrue(genome_nn.equal_parameter(nn));
+			pop.copy_genome_to(1, genome_nn);
+			Assert::IsFalse(genome_nn.equal_parameter(nn));
+
+			Assert::ExpectException<std::invalid_argument>([&]() { pop.set_fitness({ 1, 2 }); });
+			Assert::ExpectException<std::out_of_range>([&]() { pop.copy_genome_to(4, genome_nn); });
+		}
+	};
+}
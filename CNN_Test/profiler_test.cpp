@@ -0,0 +1,111 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(profiler_test)
+	{
+	public:
+
+		TEST_METHOD(profiler_records_every_layer_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(4, 4, 1));
+			nn.add_convolutional_layer(2, 3, 1, e_activation_t::relu_fn);
+			nn.add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+			nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+
+			profiler p;
+			nn.set_profiler(&p);
+
+			matrix input(vector3(4, 4, 1));
+			input.apply_noise(1);
+			matrix label(vector3(1, 2, 1));
+			label.set_at_flat_host(0, 1);
+
+			nn.back_propagation(input, label);
+			nn.back_propagation(input, label);
+			nn.apply_deltas(2, 0.1f);
+
+			//2 * (3 forward + 3 backward) + 1 step
+			std::vector<profile_record> records = p.get_records();
+			Assert::AreEqual((size_t)13, records.size());
+
+			size_t forward_count = 0;
+			size_t backward_count = 0;
+			size_t step_count = 0;
+			for (const profile_record& curr : records)
+			{
+				Assert::IsFalse(curr.on_gpu);
+				Assert::IsTrue(curr.duration_us >= 0);
+				forward_count += curr.phase == forward_phase ? 1 : 0;
+				backward_count += curr.phase == backward_phase ? 1 : 0;
+				step_count += curr.phase == apply_deltas_phase ? 1 : 0;
+			}
+			Assert::AreEqual((size_t)6, forward_count);
+			Assert::AreEqual((size_t)6, backward_count);
+			Assert::AreEqual((size_t)1, step_count);
+
+			Assert::AreEqual(std::string("layer 0 convolutional forward"), records[0].get_name());
+			Assert::AreEqual(std::string("layer 1 pooling forward"), records[1].get_name());
+			Assert::AreEqual(std::string("layer 2 fully_connected backward"), records[3].get_name());
+			Assert::AreEqual(std::string("network apply_deltas"), records.back().get_name());
+			Assert::IsTrue(records.back().layer_type == network_optimizer);
+
+			//nothing is copied on the cpu
+			Assert::AreEqual((size_t)0, p.get_counters().host2device_copies);
+			Assert::AreEqual((size_t)0, p.get_counters().device2host_copies);
+
+			std::string summary = p.summary();
+			Assert::IsTrue(summary.find("layer 1 pooling backward: 2 calls") != std::string::npos);
+			Assert::IsTrue(summary.find("network apply_deltas: 1 calls") != std::string::npos);
+
+			std::string trace = p.to_chrome_trace();
+			Assert::IsTrue(trace.find("\"traceEvents\"") != std::string::npos);
+			Assert::IsTrue(trace.find("\"name\": \"layer 0 convolutional backward\"") != std::string::npos);
+
+			//a network without a profiler does not record anything
+			nn.set_profiler(nullptr);
+			nn.back_propagation(input, label);
+			Assert::AreEqual((size_t)13, p.get_records().size());
+
+			p.reset();
+			Assert::AreEqual((size_t)0, p.get_records().size());
+		}
+		TEST_METHOD(profiler_counts_on_the_current_thread_test)
+		{
+			profiler p;
+			profiler_count_copy(true, 16);
+			Assert::AreEqual((size_t)0, p.get_counters().host2device_copies);
+
+			{
+				profiler_guard guard(&p);
+				Assert::IsTrue(profiler_get_current() == &p);
+
+				profile_scope scope(&p, -1, fully_connected, forward_phase, false);
+				profiler_count_copy(true, 16);
+				profiler_count_copy(false, 8);
+				profiler_count_kernel_launch();
+			}
+			//outside of a record it is only counted in the totals
+			profiler_guard guard(&p);
+			profiler_count_copy(true, 4);
+
+			Assert::IsTrue(profiler_get_current() == &p);
+			profile_counters totals = p.get_counters();
+			Assert::AreEqual((size_t)2, totals.host2device_copies);
+			Assert::AreEqual((size_t)20, totals.host2device_bytes);
+			Assert::AreEqual((size_t)1, totals.device2host_copies);
+			Assert::AreEqual((size_t)1, totals.kernel_launches);
+
+			std::vector<profile_record> records = p.get_records();
+			Assert::AreEqual((size_t)1, records.size());
+			Assert::AreEqual((size_t)1, records[0].counters.host2device_copies);
+			Assert::AreEqual((size_t)16, records[0].counters.host2device_bytes);
+			Assert::AreEqual((size_t)8, records[0].counters.device2host_bytes);
+			Assert::AreEqual((size_t)1, records[0].counters.kernel_launches);
+		}
+	};
+}
\ No newline at end of file
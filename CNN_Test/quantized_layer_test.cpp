@@ -0,0 +1,136 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+#include "../ConvolutionalNeuralNetwork/code/quantized_layer.hpp"
+#include "../ConvolutionalNeuralNetwork/code/cpu_math.hpp"
+#include "../ConvolutionalNeuralNetwork/code/precision.hpp"
+#include <cstdio>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(quantized_layer_test)
+	{
+	public:
+
+		TEST_METHOD(int8_dot_product_test)
+		{
+			//odd lengths hit the remainder of the simd kernels
+			for (size_t count : { (size_t)1, (size_t)7, (size_t)33, (size_t)100 })
+			{
+				std::vector<int8_t> a(count);
+				std::vector<int8_t> b(count);
+				int32_t expected = 0;
+				for (size_t i = 0; i < count; i++)
+				{
+					a[i] = (int8_t)((int)(i * 37 % 255) - 127);
+					b[i] = (int8_t)(127 - (int)(i * 53 % 255));
+					expected += (int32_t)a[i] * (int32_t)b[i];
+				}
+				Assert::AreEqual(expected, cpu_dot_int8(a.data(), b.data(), count));
+			}
+		}
+		TEST_METHOD(int8_matrix_quantize_rows_test)
+		{
+			const float values[] = {
+				1.0f, -0.5f, 0.25f,
+				0.0f, 0.0f, 0.0f };
+			int8_matrix m = int8_matrix::quantize_rows(values, 2, 3);
+
+			Assert::AreEqual((size_t)4, m.get_padded_column_count());
+			Assert::AreEqual(1.0f / 127.0f, m.get_scale(0));
+			Assert::AreEqual((int8_t)127, m.get_row_readonly(0)[0]);
+			Assert::AreEqual((int8_t)-64, m.get_row_readonly(0)[1]);
+			Assert::AreEqual(0.25f, m.get_value(0, 2), 0.005f);
+			//a row of zeros keeps a scale of 1
+			Assert::AreEqual(1.0f, m.get_scale(1));
+			Assert::AreEqual(0.0f, m.get_value(1, 1));
+		}
+		TEST_METHOD(quantized_fully_connected_forward_test)
+		{
+			matrix input(vector3(1, 20, 1));
+			input.apply_noise(1);
+			fully_connected_layer fc_layer(5, e_activation_t::sigmoid_fn);
+			fc_layer.set_input_format(input.get_format());
+			fc_layer.apply_noise(0.5f);
+			fc_layer.forward_propagation(input);
+
+			quantized_layer q_layer(fc_layer, int8_scale_for(1.0f));
+			q_layer.forward_propagation(input);
+
+			Assert::IsTrue(e_layer_type_t::quantized_fully_connected == q_layer.get_layer_type());
+			Assert::IsTrue(matrix::are_equal(
+				fc_layer.get_activations_readonly(),
+				q_layer.get_activations_readonly(),
+				0.02f));
+		}
+		TEST_METHOD(quantized_convolutional_forward_test)
+		{
+			matrix input(vector3(7, 7, 3));
+			input.apply_noise(1);
+			convolutional_layer conv_layer(4, 3, 2, e_activation_t::relu_fn);
+			conv_layer.set_input_format(input.get_format());
+			conv_layer.apply_noise(0.5f);
+			conv_layer.forward_propagation(input);
+
+			quantized_layer q_layer(conv_layer, int8_scale_for(1.0f));
+			q_layer.forward_propagation(input);
+
+			Assert::IsTrue(e_layer_type_t::quantized_convolutional == q_layer.get_layer_type());
+			Assert::IsTrue(matrix::are_equal(
+				conv_layer.get_activations_readonly(),
+				q_layer.get_activations_readonly(),
+				0.05f));
+		}
+		TEST_METHOD(quantized_layer_can_not_train_test)
+		{
+			matrix input(vector3(1, 4, 1));
+			fully_connected_layer fc_layer(2, e_activation_t::sigmoid_fn);
+			fc_layer.set_input_format(input.get_format());
+			quantized_layer q_layer(fc_layer, 1.0f);
+
+			Assert::ExpectException<std::runtime_error>([&]() { q_layer.back_propagation(input, nullptr); });
+			Assert::ExpectException<std::runtime_error>([&]() { q_layer.apply_noise(1); });
+		}
+		TEST_METHOD(nn_quantize_and_save_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(8, 8, 1));
+			nn.add_convolutional_layer(3, 3, 1, e_activation_t::leaky_relu_fn);
+			nn.add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+			nn.add_fully_connected_layer(4, e_activation_t::sigmoid_fn);
+			nn.xavier_initialization();
+
+			std::vector<matrix> data;
+			for (int i = 0; i < 8; i++)
+			{
+				matrix d(vector3(8, 8, 1));
+				d.apply_noise(1);
+				data.push_back(d);
+			}
+			data_space ds(vector3(8, 8, 1), data);
+
+			neural_network quantized = nn.quantize(ds, 8);
+			Assert::IsTrue(quantized.is_inference_only());
+			Assert::AreEqual((size_t)0, quantized.get_param_count());
+
+			matrix input(vector3(8, 8, 1));
+			ds.observe_data_at_idx(input, 3);
+			nn.forward_propagation(input);
+			quantized.forward_propagation(input);
+			Assert::IsTrue(matrix::are_equal(nn.get_output_readonly(), quantized.get_output_readonly(), 0.05f));
+
+			//the quantized layers are saved with their own layer tags
+			const std::string file_name = "quantized_nn_test.parameters";
+			quantized.save_to_file(file_name);
+			neural_network loaded(file_name);
+			std::remove(file_name.c_str());
+
+			Assert::IsTrue(loaded.is_inference_only());
+			Assert::IsTrue(loaded.nn_equal_format(quantized));
+			Assert::IsTrue(loaded.equal_parameter(quantized));
+
+			loaded.forward_propagation(input);
+			Assert::IsTrue(matrix::are_equal(quantized.get_output_readonly(), loaded.get_output_readonly()));
+		}
+	};
+}
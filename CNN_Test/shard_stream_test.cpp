@@ -0,0 +1,52 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/shard_stream.hpp"
+#include <cstdio>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(shard_stream_test)
+	{
+	public:
+
+		TEST_METHOD(shard_header_test)
+		{
+			const std::vector<float> first = { 1, 2, 3, 4, 5, 6 };
+			const std::vector<float> second = { 7, 8, 9 };
+			shard_stream::write_shard("shard_header_test_0.shard", vector3(2, 1, 1), vector3(1, 1, 1), 2, first.data());
+			shard_stream::write_shard("shard_header_test_1.shard", vector3(2, 1, 1), vector3(1, 1, 1), 1, second.data());
+
+			{
+				shard_stream stream({ "shard_header_test_0.shard", "shard_header_test_1.shard" });
+				Assert::AreEqual((size_t)2, stream.get_shard_count());
+				Assert::AreEqual((size_t)3, stream.get_item_count());
+				Assert::AreEqual((size_t)1, stream.get_shard_item_count(1));
+				Assert::IsTrue(vector3(2, 1, 1) == stream.get_data_format());
+				Assert::IsTrue(vector3(1, 1, 1) == stream.get_label_format());
+
+				stream.prefetch(1);
+				Assert::AreEqual((size_t)1, stream.get_prefetched_shard());
+				Assert::IsTrue(second == stream.load(1));
+				Assert::AreEqual(shard_stream::NO_SHARD, stream.get_prefetched_shard());
+				//a shard that was not prefetched is read directly
+				Assert::IsTrue(first == stream.load(0));
+			}
+
+			std::remove("shard_header_test_0.shard");
+			std::remove("shard_header_test_1.shard");
+		}
+		TEST_METHOD(shard_format_mismatch_test)
+		{
+			const std::vector<float> values = { 1, 2, 3, 4 };
+			shard_stream::write_shard("shard_mismatch_test_0.shard", vector3(2, 1, 1), vector3(0, 0, 0), 2, values.data());
+			shard_stream::write_shard("shard_mismatch_test_1.shard", vector3(4, 1, 1), vector3(0, 0, 0), 1, values.data());
+
+			Assert::ExpectException<std::runtime_error>([]() {
+				shard_stream stream({ "shard_mismatch_test_0.shard", "shard_mismatch_test_1.shard" });
+			});
+
+			std::remove("shard_mismatch_test_0.shard");
+			std::remove("shard_mismatch_test_1.shard");
+		}
+	};
+}
@@ -0,0 +1,149 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+#include "../ConvolutionalNeuralNetwork/code/sparse_layer.hpp"
+#include "../ConvolutionalNeuralNetwork/code/cpu_math.hpp"
+#include <cstdio>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(sparse_layer_test)
+	{
+	public:
+
+		TEST_METHOD(sparse_dot_test)
+		{
+			const float x[] = { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f };
+			//odd lengths hit the remainder of the simd kernel
+			for (size_t count : { (size_t)1, (size_t)7, (size_t)9, (size_t)19 })
+			{
+				std::vector<float> values(count);
+				std::vector<uint32_t> columns(count);
+				float expected = 0;
+				for (size_t i = 0; i < count; i++)
+				{
+					values[i] = (float)i * 0.5f - 2.0f;
+					columns[i] = (uint32_t)(i * 3 % 10);
+					expected += values[i] * x[columns[i]];
+				}
+				Assert::AreEqual(expected, cpu_sparse_dot(values.data(), columns.data(), count, x), 0.0001f);
+			}
+		}
+		TEST_METHOD(sparse_matrix_from_dense_test)
+		{
+			const float values[] = {
+				0.0f, 2.0f, 0.0f, -1.0f,
+				0.0f, 0.0f, 0.0f, 0.0f,
+				3.0f, 0.0f, 0.0f, 0.5f };
+			sparse_matrix m = sparse_matrix::from_dense(values, 3, 4);
+
+			Assert::AreEqual((size_t)4, m.get_nonzero_count());
+			Assert::AreEqual((size_t)2, m.get_row_nonzero_count(0));
+			Assert::AreEqual((size_t)0, m.get_row_nonzero_count(1));
+			Assert::AreEqual(2.0f / 3.0f, m.get_sparsity(), 0.0001f);
+			for (size_t row = 0; row < 3; row++)
+			{
+				for (size_t column = 0; column < 4; column++)
+				{
+					Assert::AreEqual(values[row * 4 + column], m.get_value(row, column));
+				}
+			}
+		}
+		TEST_METHOD(prune_weights_test)
+		{
+			fully_connected_layer fc_layer(6, e_activation_t::sigmoid_fn);
+			fc_layer.set_input_format(vector3(1, 20, 1));
+			fc_layer.apply_noise(1);
+			const matrix original(fc_layer.get_weights());
+			fc_layer.prune_weights(0.75f);
+
+			//every neuron keeps the same number of weights, the largest ones
+			const float* original_weights = original.host_span_readonly().data;
+			const float* weights = fc_layer.get_weights().host_span_readonly().data;
+			for (size_t row = 0; row < 6; row++)
+			{
+				size_t nonzero_count = 0;
+				float smallest_kept = 2;
+				float largest_pruned = 0;
+				for (size_t column = 0; column < 20; column++)
+				{
+					const float value = weights[row * 20 + column];
+					const float original_value = std::abs(original_weights[row * 20 + column]);
+					if (value != 0.0f)
+					{
+						nonzero_count++;
+						smallest_kept = std::min(smallest_kept, original_value);
+					}
+					else
+					{
+						largest_pruned = std::max(largest_pruned, original_value);
+					}
+				}
+				Assert::AreEqual((size_t)5, nonzero_count);
+				Assert::IsTrue(smallest_kept >= largest_pruned);
+			}
+		}
+		TEST_METHOD(sparse_fully_connected_forward_test)
+		{
+			matrix input(vector3(1, 30, 1));
+			input.apply_noise(1);
+			fully_connected_layer fc_layer(7, e_activation_t::relu_fn);
+			fc_layer.set_input_format(input.get_format());
+			fc_layer.apply_noise(0.5f);
+			fc_layer.prune_weights(0.9f);
+			fc_layer.forward_propagation(input);
+
+			sparse_layer s_layer(fc_layer);
+			s_layer.forward_propagation(input);
+
+			Assert::IsTrue(e_layer_type_t::sparse_fully_connected == s_layer.get_layer_type());
+			Assert::AreEqual((size_t)(7 * 3 + 7), s_layer.get_parameter_count());
+			Assert::IsTrue(matrix::are_equal(
+				fc_layer.get_activations_readonly(),
+				s_layer.get_activations_readonly(),
+				0.0001f));
+		}
+		TEST_METHOD(sparse_layer_can_not_train_test)
+		{
+			matrix input(vector3(1, 4, 1));
+			fully_connected_layer fc_layer(2, e_activation_t::sigmoid_fn);
+			fc_layer.set_input_format(input.get_format());
+			sparse_layer s_layer(fc_layer);
+
+			Assert::ExpectException<std::runtime_error>([&]() { s_layer.back_propagation(input, nullptr); });
+			Assert::ExpectException<std::runtime_error>([&]() { s_layer.mutate(1); });
+		}
+		TEST_METHOD(nn_prune_sparsify_and_save_test)
+		{
+			neural_network nn;
+			nn.set_input_format(vector3(6, 6, 1));
+			nn.add_convolutional_layer(2, 3, 1, e_activation_t::leaky_relu_fn);
+			nn.add_fully_connected_layer(10, e_activation_t::relu_fn);
+			nn.add_fully_connected_layer(3, e_activation_t::softmax_fn);
+			nn.xavier_initialization();
+			nn.prune(0.9f);
+
+			neural_network sparse = nn.sparsify();
+			Assert::IsTrue(sparse.is_inference_only());
+
+			matrix input(vector3(6, 6, 1));
+			input.apply_noise(1);
+			nn.forward_propagation(input);
+			sparse.forward_propagation(input);
+			Assert::IsTrue(matrix::are_equal(nn.get_output_readonly(), sparse.get_output_readonly(), 0.0001f));
+
+			//the pruned model is saved and loaded in the sparse form
+			const std::string file_name = "sparse_nn_test.parameters";
+			sparse.save_to_file(file_name);
+			neural_network loaded(file_name);
+			std::remove(file_name.c_str());
+
+			Assert::IsTrue(loaded.is_inference_only());
+			Assert::IsTrue(loaded.nn_equal_format(sparse));
+			Assert::IsTrue(loaded.equal_parameter(sparse));
+
+			loaded.forward_propagation(input);
+			Assert::IsTrue(matrix::are_equal(sparse.get_output_readonly(), loaded.get_output_readonly()));
+		}
+	};
+}
@@ -0,0 +1,79 @@
+#include "CppUnitTest.h"
+#include "../ConvolutionalNeuralNetwork/code/sweep_runner.hpp"
+#include "test_util.hpp"
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace CNNTest
+{
+	TEST_CLASS(sweep_runner_test)
+	{
+	public:
+
+		TEST_METHOD(sweep_trains_every_configuration_test)
+		{
+			neural_network nn = create_two_input_test_nn(4);
+			data_space training = create_two_input_test_ds(16);
+			data_space test = create_two_input_test_ds(16);
+
+			sweep_runner runner(training, &test);
+			runner.add_configuration(nn, { "short", 2, 4, 0.5f });
+			runner.add_configuration(nn, { "long", 5, 2, 0.5f });
+			runner.add_configuration(nn, { "untrained", 1, 4, 0.0f });
+			runner.run(2);
+
+			const std::vector<sweep_result>& results = runner.get_results();
+			Assert::AreEqual((size_t)3, results.size());
+			Assert::AreEqual((size_t)2, results[0].epoch_results.size());
+			Assert::AreEqual((size_t)5, results[1].epoch_results.size());
+			Assert::AreEqual((size_t)1, results[2].epoch_results.size());
+
+			//the configurations train their own copy of the model
+			Assert::IsFalse(runner.get_network(0).equal_parameter(nn));
+			Assert::IsFalse(runner.get_network(0).equal_parameter(runner.get_network(1)));
+			Assert::IsTrue(runner.get_network(2).equal_parameter(nn));
+
+			//the order is only frozen while the trainings run
+			Assert::IsFalse(training.is_order_frozen());
+		}
+		TEST_METHOD(sweep_matches_single_training_test)
+		{
+			//with a frozen order every training sees the same items in the same order,
+			//so a configuration of the sweep trains like a network on its own
+			neural_network nn = create_two_input_test_nn(4);
+			data_space training = create_two_input_test_ds(16);
+			training.set_order_frozen(true);
+
+			sweep_runner runner(training, nullptr);
+			runner.add_configuration(nn, { "a", 3, 4, 0.3f });
+			runner.add_configuration(nn, { "b", 3, 4, 0.3f });
+			runner.run(0);
+
+			neural_network single(nn);
+			single.learn_on_ds(training, 3, 4, 0.3f, false);
+
+			Assert::IsTrue(training.is_order_frozen());
+			Assert::IsTrue(runner.get_network(0).equal_parameter(single));
+			Assert::IsTrue(runner.get_network(1).equal_parameter(single));
+			Assert::ExpectException<std::runtime_error>([&]() { runner.get_best_idx(); });
+		}
+		TEST_METHOD(frozen_order_test)
+		{
+			data_space ds = create_two_input_test_ds(16);
+			ds.set_order_frozen(true);
+
+			std::vector<float> before;
+			matrix item(vector3(2, 1, 1));
+			for (size_t i = 0; i < ds.get_item_count(); i++)
+			{
+				ds.observe_data_at_idx(item, i);
+				before.push_back(item.get_at_flat_host(0) + 2 * item.get_at_flat_host(1));
+			}
+			ds.shuffle();
+			for (size_t i = 0; i < ds.get_item_count(); i++)
+			{
+				ds.observe_data_at_idx(item, i);
+				Assert::AreEqual(before[i], item.get_at_flat_host(0) + 2 * item.get_at_flat_host(1));
+			}
+		}
+	};
+}
@@ -12,4 +12,43 @@ bool float_vectors_equal(const std::vector<float>& vec1, const std::vector<float
 			return false;
 		}
 	}
+	return true;
+}
+
+neural_network create_two_input_test_nn(size_t hidden_count)
+{
+	neural_network nn;
+	nn.set_input_format(vector3(2, 1, 1));
+	nn.add_fully_connected_layer(hidden_count, e_activation_t::sigmoid_fn);
+	nn.add_fully_connected_layer(2, e_activation_t::sigmoid_fn);
+	nn.xavier_initialization();
+	return nn;
+}
+
+data_space create_two_input_test_ds(size_t item_count)
+{
+	std::vector<matrix> data;
+	std::vector<matrix> labels;
+	for (size_t i = 0; i < item_count; i++)
+	{
+		matrix curr_data(vector3(2, 1, 1));
+		curr_data.set_at_flat_host(0, (float)(i % 2));
+		curr_data.set_at_flat_host(1, (float)(i / 2 % 2));
+		matrix curr_label(vector3(1, 2, 1));
+		curr_label.set_at_flat_host(i % 2, 1);
+		data.push_back(curr_data);
+		labels.push_back(curr_label);
+	}
+	return data_space(vector3(2, 1, 1), vector3(1, 2, 1), data, labels);
+}
+
+neural_network create_conv_test_nn()
+{
+	neural_network nn;
+	nn.set_input_format(vector3(6, 6, 2));
+	nn.add_convolutional_layer(3, 3, 1, e_activation_t::relu_fn);
+	nn.add_pooling_layer(2, 2, e_pooling_type_t::max_pooling);
+	nn.add_fully_connected_layer(5, e_activation_t::sigmoid_fn);
+	nn.xavier_initialization();
+	return nn;
 }
\ No newline at end of file
@@ -1,5 +1,15 @@
 #pragma once
 #include <vector>
 #include <algorithm>
+#include "../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+#include "../ConvolutionalNeuralNetwork/code/data_space.hpp"
 
-bool float_vectors_equal(const std::vector<float>& vec1, const std::vector<float>& vec2);
\ No newline at end of file
+bool float_vectors_equal(const std::vector<float>& vec1, const std::vector<float>& vec2);
+
+//two inputs, one sigmoid hidden layer and two sigmoid outputs, xavier initialized
+neural_network create_two_input_test_nn(size_t hidden_count);
+//the inputs cycle through the four combinations of 0 and 1,
+//the label is the first input (one hot)
+data_space create_two_input_test_ds(size_t item_count);
+//a 6x6x2 input, one 3x3 relu kernel, 2x2 max pooling and 5 sigmoid neurons, xavier initialized
+neural_network create_conv_test_nn();
\ No newline at end of file
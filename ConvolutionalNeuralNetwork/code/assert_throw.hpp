@@ -10,3 +10,15 @@
 #define smart_assert(expression) if(!(expression)) { throw std::runtime_error(""); }
 
 #endif
+
+//used for the checks of accessors that are called in inner loops
+//defining CNN_UNCHECKED_ACCESS strips them even if smart_assert is active
+#ifdef CNN_UNCHECKED_ACCESS
+
+#define hot_assert(expression) ((void)0)
+
+#else
+
+#define hot_assert(expression) smart_assert(expression)
+
+#endif
@@ -0,0 +1,139 @@
+#include "batch_uploader.hpp"
+#include <stdexcept>
+#include <string>
+
+static void throw_if_cuda_error(cudaError_t error)
+{
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("cuda error: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+batch_uploader::batch_uploader(vector3 data_format, vector3 label_format, size_t batch_size)
+	:batch_size(batch_size)
+{
+	smart_assert(batch_size > 0);
+
+	const vector3 data_batch_format(data_format.item_count(), batch_size, (size_t)1);
+	const vector3 label_batch_format(label_format.item_count(), batch_size, (size_t)1);
+
+	try
+	{
+		throw_if_cuda_error(cudaStreamCreateWithFlags(&copy_stream, cudaStreamNonBlocking));
+		for (upload_slot& slot : slots)
+		{
+			slot.host_data = matrix(data_batch_format);
+			slot.host_data.move_to_allocator(get_pinned_matrix_allocator());
+			slot.device_data = matrix(data_batch_format);
+			slot.device_data.enable_gpu_mode();
+
+			//a data space without labels has no label batches
+			if (label_batch_format.item_count() != 0)
+			{
+				slot.host_label = matrix(label_batch_format);
+				slot.host_label.move_to_allocator(get_pinned_matrix_allocator());
+				slot.device_label = matrix(label_batch_format);
+				slot.device_label.enable_gpu_mode();
+			}
+
+			throw_if_cuda_error(cudaEventCreateWithFlags(&slot.uploaded, cudaEventDisableTiming));
+			throw_if_cuda_error(cudaEventCreateWithFlags(&slot.released, cudaEventDisableTiming));
+		}
+	}
+	catch (...)
+	{
+		destroy();
+		throw;
+	}
+}
+
+batch_uploader::~batch_uploader()
+{
+	destroy();
+}
+
+void batch_uploader::destroy()
+{
+	if (copy_stream != nullptr)
+	{
+		cudaStreamSynchronize(copy_stream);
+		cudaStreamDestroy(copy_stream);
+		copy_stream = nullptr;
+	}
+	for (upload_slot& slot : slots)
+	{
+		if (slot.uploaded != nullptr)
+		{
+			cudaEventDestroy(slot.uploaded);
+			slot.uploaded = nullptr;
+		}
+		if (slot.released != nullptr)
+		{
+			cudaEventDestroy(slot.released);
+			slot.released = nullptr;
+		}
+	}
+}
+
+size_t batch_uploader::get_batch_size() const
+{
+	return batch_size;
+}
+
+void batch_uploader::copy_to_device(const matrix& host, matrix& device)
+{
+	cudaMemcpyAsync(
+		device.device_span().data,
+		host.host_span_readonly().data,
+		host.item_count() * sizeof(float),
+		cudaMemcpyHostToDevice,
+		copy_stream);
+	throw_if_cuda_error(cudaGetLastError());
+}
+
+void batch_uploader::upload(data_space& ds, size_t start_idx, size_t slot_idx)
+{
+	smart_assert(slot_idx < SLOT_COUNT);
+	smart_assert(!ds.is_in_gpu_mode());
+	upload_slot& slot = slots[slot_idx];
+
+	//the host batches are still read by the last copy of this slot
+	throw_if_cuda_error(cudaEventSynchronize(slot.uploaded));
+
+	const bool has_labels = slot.host_label.is_initialized();
+	ds.get_batch(slot.host_data, has_labels ? &slot.host_label : nullptr, start_idx);
+
+	//the device batches are still used by the last batch of this slot
+	throw_if_cuda_error(cudaStreamWaitEvent(copy_stream, slot.released, 0));
+	copy_to_device(slot.host_data, slot.device_data);
+	if (has_labels)
+	{
+		copy_to_device(slot.host_label, slot.device_label);
+	}
+	throw_if_cuda_error(cudaEventRecord(slot.uploaded, copy_stream));
+}
+
+void batch_uploader::acquire(size_t slot_idx)
+{
+	smart_assert(slot_idx < SLOT_COUNT);
+	throw_if_cuda_error(cudaStreamWaitEvent(gpu_get_current_stream(), slots[slot_idx].uploaded, 0));
+}
+
+void batch_uploader::release(size_t slot_idx)
+{
+	smart_assert(slot_idx < SLOT_COUNT);
+	throw_if_cuda_error(cudaEventRecord(slots[slot_idx].released, gpu_get_current_stream()));
+}
+
+const matrix& batch_uploader::get_data_batch(size_t slot_idx) const
+{
+	smart_assert(slot_idx < SLOT_COUNT);
+	return slots[slot_idx].device_data;
+}
+
+const matrix& batch_uploader::get_label_batch(size_t slot_idx) const
+{
+	smart_assert(slot_idx < SLOT_COUNT);
+	return slots[slot_idx].device_label;
+}
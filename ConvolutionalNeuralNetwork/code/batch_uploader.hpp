@@ -0,0 +1,58 @@
+#pragma once
+#include "matrix.hpp"
+#include "data_space.hpp"
+
+#include "cuda_runtime.h"
+
+/*
+	feeds batches of a data space on the host to the gpu
+
+	there are two slots, each with page locked host batches and device batches.
+	while the current stream trains on the batch of one slot, the next batch is written
+	into the host batches of the other slot and copied on an own copy stream.
+	events order the work of both streams:
+	the current stream waits for the copy of a batch before using it (acquire)
+	and the copy stream waits until the current stream is done with a slot (release)
+	before it overwrites the device batches of it
+*/
+class batch_uploader {
+public:
+	static constexpr size_t SLOT_COUNT = 2;
+private:
+	struct upload_slot {
+		matrix host_data;
+		matrix host_label;
+		matrix device_data;
+		matrix device_label;
+		cudaEvent_t uploaded = nullptr;
+		cudaEvent_t released = nullptr;
+	};
+
+	upload_slot slots[SLOT_COUNT];
+	cudaStream_t copy_stream = nullptr;
+	size_t batch_size;
+
+	void copy_to_device(const matrix& host, matrix& device);
+	void destroy();
+public:
+	batch_uploader(vector3 data_format, vector3 label_format, size_t batch_size);
+	~batch_uploader();
+
+	batch_uploader(const batch_uploader&) = delete;
+	batch_uploader& operator=(const batch_uploader&) = delete;
+
+	size_t get_batch_size() const;
+
+	//writes the items from start_idx on into the host batches of the slot and starts copying them
+	//blocks until the previous copy of the slot is done, so its host batches can be overwritten
+	void upload(data_space& ds, size_t start_idx, size_t slot_idx);
+
+	//the current stream waits for the copy of the slot
+	void acquire(size_t slot_idx);
+	//the device batches of the slot can be overwritten after the work on the current stream that is enqueued so far
+	void release(size_t slot_idx);
+
+	//every row is one item (see data_space::get_batch)
+	const matrix& get_data_batch(size_t slot_idx) const;
+	const matrix& get_label_batch(size_t slot_idx) const;
+};
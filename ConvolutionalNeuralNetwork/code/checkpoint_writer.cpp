@@ -0,0 +1,239 @@
+#include "checkpoint_writer.hpp"
+#include <cstdio>
+#include <stdexcept>
+#include "matrix.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//the data of the file is on the disk when this returns, not only in the cache of the system
+static void flush_to_disk(const std::string& path)
+{
+#ifdef _WIN32
+	HANDLE file_handle = CreateFileA(
+		path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Could not open file " + path);
+	}
+	const bool flushed = FlushFileBuffers(file_handle) != 0;
+	CloseHandle(file_handle);
+#else
+	const int descriptor = open(path.c_str(), O_WRONLY);
+	if (descriptor < 0)
+	{
+		throw std::runtime_error("Could not open file " + path);
+	}
+	const bool flushed = fsync(descriptor) == 0;
+	close(descriptor);
+#endif
+	if (!flushed)
+	{
+		throw std::runtime_error("could not flush " + path);
+	}
+}
+
+//the target is either the old file or the new one, never a partially written one
+static void replace_file(const std::string& source, const std::string& target)
+{
+#ifdef _WIN32
+	if (MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) == 0)
+	{
+		throw std::runtime_error("could not rename " + source + " to " + target);
+	}
+#else
+	if (std::rename(source.c_str(), target.c_str()) != 0)
+	{
+		throw std::runtime_error("could not rename " + source + " to " + target);
+	}
+	//the new name is only durable after the directory is flushed
+	const size_t separator = target.find_last_of('/');
+	const std::string directory = separator == std::string::npos ? "." : target.substr(0, separator + 1);
+	const int descriptor = open(directory.c_str(), O_RDONLY);
+	if (descriptor >= 0)
+	{
+		fsync(descriptor);
+		close(descriptor);
+	}
+#endif
+}
+
+checkpoint_writer::checkpoint_writer(const std::string& path_prefix, size_t keep_count)
+	:path_prefix(path_prefix),
+	keep_count(keep_count)
+{
+	if (keep_count == 0)
+	{
+		throw std::invalid_argument("at least one checkpoint has to be kept");
+	}
+	worker = std::thread(&checkpoint_writer::worker_loop, this);
+}
+
+checkpoint_writer::~checkpoint_writer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	queue_cv.notify_all();
+	if (worker.joinable())
+	{
+		worker.join();
+	}
+}
+
+void checkpoint_writer::if_write_failed_throw_locked()
+{
+	if (write_exception != nullptr)
+	{
+		//the error is only reported once
+		std::exception_ptr error = write_exception;
+		write_exception = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+std::string checkpoint_writer::submit(model_writer snapshot)
+{
+	if (!snapshot.is_snapshot())
+	{
+		throw std::invalid_argument("a checkpoint has to be a snapshot, the tensors could change while it is written");
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cv.wait(lock, [&]() {
+		return write_exception != nullptr || queue.size() + (writing ? 1 : 0) < MAX_PENDING;
+	});
+	if_write_failed_throw_locked();
+
+	pending_checkpoint checkpoint;
+	checkpoint.path = path_prefix + "_" + std::to_string(next_number) + ".model";
+	checkpoint.snapshot = std::move(snapshot);
+	if (checkpoint.snapshot.has_device_tensors())
+	{
+		if (cudaEventCreateWithFlags(&checkpoint.copied, cudaEventDisableTiming) != cudaSuccess)
+		{
+			throw std::runtime_error("could not create the event of a checkpoint");
+		}
+		if (cudaEventRecord(checkpoint.copied, gpu_get_current_stream()) != cudaSuccess)
+		{
+			cudaEventDestroy(checkpoint.copied);
+			throw std::runtime_error("could not record the event of a checkpoint");
+		}
+	}
+	next_number++;
+
+	const std::string path = checkpoint.path;
+	queue.push_back(std::move(checkpoint));
+	lock.unlock();
+	queue_cv.notify_one();
+	return path;
+}
+
+void checkpoint_writer::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	done_cv.wait(lock, [&]() { return queue.empty() && !writing; });
+	if_write_failed_throw_locked();
+}
+
+std::vector<std::string> checkpoint_writer::get_checkpoint_paths() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return std::vector<std::string>(written_paths.begin(), written_paths.end());
+}
+
+size_t checkpoint_writer::get_pending_count() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return queue.size() + (writing ? 1 : 0);
+}
+
+void checkpoint_writer::write(pending_checkpoint& checkpoint)
+{
+	if (checkpoint.copied != nullptr)
+	{
+		const cudaError_t error = cudaEventSynchronize(checkpoint.copied);
+		cudaEventDestroy(checkpoint.copied);
+		checkpoint.copied = nullptr;
+		if (error != cudaSuccess)
+		{
+			throw std::runtime_error("the device copies of a checkpoint failed: " + std::string(cudaGetErrorString(error)));
+		}
+	}
+
+	const std::string temp_path = checkpoint.path + ".tmp";
+	try
+	{
+		checkpoint.snapshot.save(temp_path);
+		flush_to_disk(temp_path);
+		replace_file(temp_path, checkpoint.path);
+	}
+	catch (...)
+	{
+		std::remove(temp_path.c_str());
+		throw;
+	}
+}
+
+void checkpoint_writer::worker_loop()
+{
+	while (true)
+	{
+		pending_checkpoint checkpoint;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queue_cv.wait(lock, [&]() { return stopping || !queue.empty(); });
+			//the queued checkpoints are written before the writer stops
+			if (queue.empty())
+			{
+				return;
+			}
+			checkpoint = std::move(queue.front());
+			queue.pop_front();
+			writing = true;
+		}
+
+		std::exception_ptr error = nullptr;
+		try
+		{
+			write(checkpoint);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		std::vector<std::string> outdated_paths;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			writing = false;
+			if (error != nullptr)
+			{
+				if (write_exception == nullptr)
+				{
+					write_exception = error;
+				}
+			}
+			else
+			{
+				written_paths.push_back(checkpoint.path);
+				while (written_paths.size() > keep_count)
+				{
+					outdated_paths.push_back(written_paths.front());
+					written_paths.pop_front();
+				}
+			}
+		}
+		for (const std::string& curr : outdated_paths)
+		{
+			std::remove(curr.c_str());
+		}
+		done_cv.notify_all();
+	}
+}
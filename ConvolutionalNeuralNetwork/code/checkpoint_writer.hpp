@@ -0,0 +1,74 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cuda_runtime.h"
+#include "model_file.hpp"
+
+/*
+	writes checkpoints of a network on a background thread (see neural_network::save_checkpoint)
+
+	the network only takes a snapshot of its parameters, on the gpu with async copies
+	into pinned memory on its stream, so training continues while the copies run.
+	the background thread waits for the copies, writes the model file next to its target,
+	flushes it to the disk and renames it, so a checkpoint file is either complete or missing.
+
+	the checkpoints are named <path_prefix>_<number>.model, only the newest keep_count stay.
+	checkpoints of an earlier writer with the same prefix are not removed
+*/
+class checkpoint_writer {
+private:
+	struct pending_checkpoint {
+		model_writer snapshot;
+		std::string path;
+		//recorded after the device copies of the snapshot, nullptr if it has none
+		cudaEvent_t copied = nullptr;
+	};
+
+	std::string path_prefix;
+	size_t keep_count;
+	size_t next_number = 0;
+
+	mutable std::mutex mutex;
+	std::condition_variable queue_cv;
+	std::condition_variable done_cv;
+	std::deque<pending_checkpoint> queue;
+	bool writing = false;
+	bool stopping = false;
+	std::exception_ptr write_exception = nullptr;
+	//the written checkpoints, the oldest first
+	std::deque<std::string> written_paths;
+
+	std::thread worker;
+
+	void worker_loop();
+	void write(pending_checkpoint& checkpoint);
+	//mutex has to be locked
+	void if_write_failed_throw_locked();
+public:
+	//a snapshot waits for the background thread if this many checkpoints are not written yet
+	static constexpr size_t MAX_PENDING = 2;
+
+	checkpoint_writer(const std::string& path_prefix, size_t keep_count);
+	//writes the queued checkpoints
+	~checkpoint_writer();
+
+	checkpoint_writer(const checkpoint_writer&) = delete;
+	checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+	//queues the snapshot and returns the path it will be written to
+	//its device copies have to be enqueued on the current stream
+	//rethrows the error of a checkpoint that could not be written
+	std::string submit(model_writer snapshot);
+	//blocks until all queued checkpoints are written
+	//rethrows the error of a checkpoint that could not be written
+	void wait();
+
+	//the checkpoints that are written and kept, the oldest first
+	std::vector<std::string> get_checkpoint_paths() const;
+	size_t get_pending_count() const;
+};
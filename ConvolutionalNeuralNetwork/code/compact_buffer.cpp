@@ -0,0 +1,162 @@
+#include "compact_buffer.hpp"
+#include "precision.hpp"
+#include "matrix.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "cuda_runtime.h"
+
+void compact_buffer::free_device_data()
+{
+	if (device_data != nullptr)
+	{
+		cudaFree(device_data);
+		device_data = nullptr;
+	}
+}
+
+void compact_buffer::upload(size_t offset, size_t count)
+{
+	if (device_data == nullptr || count == 0)
+	{
+		return;
+	}
+
+	cudaError_t error = cudaMemcpy(
+		device_data + offset,
+		host_data.data() + offset,
+		count * sizeof(uint16_t),
+		cudaMemcpyHostToDevice);
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+compact_buffer::compact_buffer()
+{}
+
+compact_buffer::compact_buffer(size_t item_count, e_precision_t precision)
+	:precision(precision),
+	host_data(item_count, 0)
+{
+	if (precision == fp32_precision)
+	{
+		throw std::invalid_argument("a compact buffer stores fp16 or bf16 values");
+	}
+}
+
+compact_buffer::compact_buffer(const compact_buffer& other)
+	:precision(other.precision),
+	host_data(other.host_data)
+{
+	if (other.is_in_gpu_mode())
+	{
+		enable_gpu_mode();
+	}
+}
+
+compact_buffer& compact_buffer::operator=(const compact_buffer& other)
+{
+	if (this != &other)
+	{
+		free_device_data();
+		precision = other.precision;
+		host_data = other.host_data;
+		if (other.is_in_gpu_mode())
+		{
+			enable_gpu_mode();
+		}
+	}
+	return *this;
+}
+
+compact_buffer::~compact_buffer()
+{
+	free_device_data();
+}
+
+size_t compact_buffer::item_count() const
+{
+	return host_data.size();
+}
+
+size_t compact_buffer::byte_size() const
+{
+	return host_data.size() * sizeof(uint16_t);
+}
+
+e_precision_t compact_buffer::get_precision() const
+{
+	return precision;
+}
+
+void compact_buffer::enable_gpu_mode()
+{
+	if (device_data != nullptr || host_data.empty())
+	{
+		return;
+	}
+
+	cudaError_t error = cudaMalloc(&device_data, byte_size());
+	if (error != cudaSuccess)
+	{
+		device_data = nullptr;
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+	upload(0, host_data.size());
+}
+
+bool compact_buffer::is_in_gpu_mode() const
+{
+	return device_data != nullptr;
+}
+
+void compact_buffer::set(const float* values, size_t offset, size_t count)
+{
+	smart_assert(offset + count <= host_data.size());
+
+	for (size_t i = 0; i < count; i++)
+	{
+		host_data[offset + i] = encode_precision(precision, values[i]);
+	}
+	upload(offset, count);
+}
+
+void compact_buffer::set_all_zero()
+{
+	//zero has the same bits in fp16 and bf16
+	std::fill(host_data.begin(), host_data.end(), (uint16_t)0);
+	upload(0, host_data.size());
+}
+
+void compact_buffer::get(float* values, size_t offset, size_t count) const
+{
+	smart_assert(offset + count <= host_data.size());
+
+	for (size_t i = 0; i < count; i++)
+	{
+		values[i] = decode_precision(precision, host_data[offset + i]);
+	}
+}
+
+void compact_buffer::get_device(float* device_values, size_t offset, size_t count) const
+{
+	smart_assert(offset + count <= host_data.size());
+	if (device_data == nullptr)
+	{
+		throw std::runtime_error("compact buffer is not in gpu mode");
+	}
+
+	gpu_decode_precision(device_data + offset, device_values, count, precision);
+}
+
+const uint16_t* compact_buffer::get_host_ptr_readonly() const
+{
+	return host_data.data();
+}
+
+const uint16_t* compact_buffer::get_device_ptr_readonly() const
+{
+	return device_data;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "enum_space.hpp"
+
+//float values stored with 16 bits each (fp16 or bf16)
+//the values are always written on the host, the device copy is updated with them
+//reading decodes them into float arrays on the host or on the device
+class compact_buffer {
+private:
+	e_precision_t precision = fp16_precision;
+	std::vector<uint16_t> host_data;
+	uint16_t* device_data = nullptr;
+
+	void free_device_data();
+	void upload(size_t offset, size_t count);
+public:
+	compact_buffer();
+	//all values are zero
+	compact_buffer(size_t item_count, e_precision_t precision);
+	compact_buffer(const compact_buffer& other);
+	compact_buffer& operator=(const compact_buffer& other);
+	~compact_buffer();
+
+	size_t item_count() const;
+	size_t byte_size() const;
+	e_precision_t get_precision() const;
+
+	void enable_gpu_mode();
+	bool is_in_gpu_mode() const;
+
+	//rounds count values to the precision and stores them from offset on
+	void set(const float* values, size_t offset, size_t count);
+	void set_all_zero();
+
+	//decodes count values from offset on into a host array
+	void get(float* values, size_t offset, size_t count) const;
+	//decodes count values from offset on into a device array
+	void get_device(float* device_values, size_t offset, size_t count) const;
+
+	const uint16_t* get_host_ptr_readonly() const;
+	const uint16_t* get_device_ptr_readonly() const;
+};
@@ -0,0 +1,850 @@
+#include "conv_engine.hpp"
+#include "cpu_math.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+size_t conv_shape::patch_size() const
+{
+	return kernel_size * kernel_size * input_depth;
+}
+
+size_t conv_shape::output_positions() const
+{
+	return output_width * output_height;
+}
+
+e_conv_strategy_t conv_select_strategy(const conv_shape& shape)
+{
+	//copying the patches is not worth it for a few outputs
+	if (shape.output_positions() <= DIRECT_CONV_MAX_OUTPUTS)
+	{
+		return direct_conv;
+	}
+	if (shape.kernel_size == 3 && shape.stride == 1)
+	{
+		return winograd_conv;
+	}
+	return im2col_conv;
+}
+
+e_fixed_kernel_t conv_select_fixed_kernel(size_t kernel_size, size_t stride)
+{
+	if (kernel_size == 1 && stride == 1)
+		return kernel_1x1_s1;
+	if (kernel_size == 3 && stride == 1)
+		return kernel_3x3_s1;
+	if (kernel_size == 3 && stride == 2)
+		return kernel_3x3_s2;
+	if (kernel_size == 5 && stride == 1)
+		return kernel_5x5_s1;
+	if (kernel_size == 5 && stride == 2)
+		return kernel_5x5_s2;
+	return generic_kernel;
+}
+
+e_fixed_kernel_t pooling_select_fixed_kernel(size_t kernel_size, size_t stride)
+{
+	return kernel_size == 2 && stride == 2 ? kernel_2x2_s2 : generic_kernel;
+}
+
+//grows the buffer if needed and returns its data
+static float* get_scratch(std::vector<float>& buffer, size_t item_count)
+{
+	if (buffer.size() < item_count)
+	{
+		buffer.resize(item_count);
+	}
+	return buffer.data();
+}
+
+//applied once to every output when its sum is complete
+//the biases have the same layout as the output, null adds no biases
+template<typename activation_t>
+static float conv_epilogue(float sum, const float* biases, size_t output_idx)
+{
+	return activation_t::activate(biases == nullptr ? sum : sum + biases[output_idx]);
+}
+
+//DIRECT
+
+template<typename activation_t>
+static void direct_forward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	const size_t kernel_size = shape.kernel_size;
+	const size_t input_plane = shape.input_width * shape.input_height;
+	const size_t kernel_plane = kernel_size * kernel_size;
+	const size_t output_plane = shape.output_positions();
+
+	for (size_t z = 0; z < shape.kernel_count; z++)
+	{
+		for (size_t y = 0; y < shape.output_height; y++)
+		{
+			for (size_t x = 0; x < shape.output_width; x++)
+			{
+				//a kernel row and the overlaying input row are contiguous in memory
+				//so every row is a single dot product
+				float sum = 0;
+				for (size_t curr_depth = 0; curr_depth < shape.input_depth; curr_depth++)
+				{
+					for (size_t j = 0; j < kernel_size; j++)
+					{
+						const float* input_row =
+							input +
+							curr_depth * input_plane +
+							(y * shape.stride + j) * shape.input_width +
+							x * shape.stride;
+						const float* kernel_row =
+							kernels[z] +
+							curr_depth * kernel_plane +
+							j * kernel_size;
+						sum += cpu_dot(input_row, kernel_row, kernel_size);
+					}
+				}
+				const size_t output_idx = z * output_plane + y * shape.output_width + x;
+				output[output_idx] = conv_epilogue<activation_t>(sum, biases, output_idx);
+			}
+		}
+	}
+}
+
+static void direct_backward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* delta,
+	float* const* kernel_deltas,
+	float* passing_error)
+{
+	const size_t kernel_size = shape.kernel_size;
+	const size_t input_plane = shape.input_width * shape.input_height;
+	const size_t kernel_plane = kernel_size * kernel_size;
+	const size_t output_plane = shape.output_positions();
+
+	//every output got its value from the input rows under the kernel
+	//the same rows get the gradient of the kernel and the passing error
+	//kernel delta  += delta * input
+	//passing error += delta * kernel (this is the full convolution with the flipped kernel)
+	for (size_t z = 0; z < shape.kernel_count; z++)
+	{
+		for (size_t y = 0; y < shape.output_height; y++)
+		{
+			for (size_t x = 0; x < shape.output_width; x++)
+			{
+				const float curr_delta = delta[z * output_plane + y * shape.output_width + x];
+				if (curr_delta == 0)
+				{
+					continue;
+				}
+
+				for (size_t curr_depth = 0; curr_depth < shape.input_depth; curr_depth++)
+				{
+					for (size_t j = 0; j < kernel_size; j++)
+					{
+						const size_t input_offset =
+							curr_depth * input_plane +
+							(y * shape.stride + j) * shape.input_width +
+							x * shape.stride;
+						const size_t kernel_offset =
+							curr_depth * kernel_plane +
+							j * kernel_size;
+
+						cpu_axpy(curr_delta, input + input_offset, kernel_deltas[z] + kernel_offset, kernel_size);
+						if (passing_error != nullptr)
+						{
+							cpu_axpy(curr_delta, kernels[z] + kernel_offset, passing_error + input_offset, kernel_size);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+//IM2COL
+
+//every row of the patches is the input under the kernel for one output
+//it has the same layout as a kernel (width, height, depth)
+static void im2col(const conv_shape& shape, const float* input, float* patches)
+{
+	const size_t kernel_size = shape.kernel_size;
+	const size_t input_plane = shape.input_width * shape.input_height;
+	const size_t patch_size = shape.patch_size();
+
+	for (size_t y = 0; y < shape.output_height; y++)
+	{
+		for (size_t x = 0; x < shape.output_width; x++)
+		{
+			float* patch = patches + (y * shape.output_width + x) * patch_size;
+			for (size_t curr_depth = 0; curr_depth < shape.input_depth; curr_depth++)
+			{
+				for (size_t j = 0; j < kernel_size; j++)
+				{
+					const float* input_row =
+						input +
+						curr_depth * input_plane +
+						(y * shape.stride + j) * shape.input_width +
+						x * shape.stride;
+					std::memcpy(patch, input_row, kernel_size * sizeof(float));
+					patch += kernel_size;
+				}
+			}
+		}
+	}
+}
+
+//the same as im2col with the kernel size and stride known at compile time
+//the copy of a kernel row is unrolled instead of a memcpy of a runtime size
+template<size_t kernel_size, size_t stride>
+static void fixed_im2col(const conv_shape& shape, const float* input, float* patches)
+{
+	const size_t input_width = shape.input_width;
+	const size_t input_plane = input_width * shape.input_height;
+	const size_t patch_size = shape.patch_size();
+
+	for (size_t y = 0; y < shape.output_height; y++)
+	{
+		for (size_t x = 0; x < shape.output_width; x++)
+		{
+			float* patch = patches + (y * shape.output_width + x) * patch_size;
+			const float* window = input + y * stride * input_width + x * stride;
+			for (size_t curr_depth = 0; curr_depth < shape.input_depth; curr_depth++)
+			{
+				const float* window_layer = window + curr_depth * input_plane;
+				for (size_t j = 0; j < kernel_size; j++)
+				{
+					for (size_t i = 0; i < kernel_size; i++)
+					{
+						patch[j * kernel_size + i] = window_layer[j * input_width + i];
+					}
+				}
+				patch += kernel_size * kernel_size;
+			}
+		}
+	}
+}
+
+//the patches are shared by the generic and the fixed gather
+static float* get_im2col_patches(const conv_shape& shape)
+{
+	static thread_local std::vector<float> patch_buffer;
+	return get_scratch(patch_buffer, shape.patch_size() * shape.output_positions());
+}
+
+template<typename activation_t>
+static void im2col_multiply(
+	const conv_shape& shape,
+	const float* patches,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	const size_t patch_size = shape.patch_size();
+	const size_t output_positions = shape.output_positions();
+
+	//the patch stays in the cache while it is multiplied with every kernel
+	for (size_t position = 0; position < output_positions; position++)
+	{
+		const float* patch = patches + position * patch_size;
+		for (size_t z = 0; z < shape.kernel_count; z++)
+		{
+			const size_t output_idx = z * output_positions + position;
+			output[output_idx] = conv_epilogue<activation_t>(cpu_dot(kernels[z], patch, patch_size), biases, output_idx);
+		}
+	}
+}
+
+template<typename activation_t>
+static void im2col_forward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	float* patches = get_im2col_patches(shape);
+	im2col(shape, input, patches);
+	im2col_multiply<activation_t>(shape, patches, kernels, biases, output);
+}
+
+static void im2col_backward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* delta,
+	float* const* kernel_deltas,
+	float* passing_error)
+{
+	static thread_local std::vector<float> patch_buffer;
+	static thread_local std::vector<float> patch_error_buffer;
+
+	const size_t kernel_size = shape.kernel_size;
+	const size_t input_plane = shape.input_width * shape.input_height;
+	const size_t patch_size = shape.patch_size();
+	const size_t output_positions = shape.output_positions();
+	float* patches = get_scratch(patch_buffer, patch_size * output_positions);
+	float* patch_error = get_scratch(patch_error_buffer, patch_size);
+
+	im2col(shape, input, patches);
+
+	for (size_t position = 0; position < output_positions; position++)
+	{
+		const float* patch = patches + position * patch_size;
+		std::fill(patch_error, patch_error + patch_size, 0.0f);
+
+		for (size_t z = 0; z < shape.kernel_count; z++)
+		{
+			const float curr_delta = delta[z * output_positions + position];
+			if (curr_delta == 0)
+			{
+				continue;
+			}
+			cpu_axpy(curr_delta, patch, kernel_deltas[z], patch_size);
+			cpu_axpy(curr_delta, kernels[z], patch_error, patch_size);
+		}
+
+		if (passing_error == nullptr)
+		{
+			continue;
+		}
+
+		//col2im - the error of the patch is added to the input it was copied from
+		const size_t x = position % shape.output_width;
+		const size_t y = position / shape.output_width;
+		const float* patch_error_row = patch_error;
+		for (size_t curr_depth = 0; curr_depth < shape.input_depth; curr_depth++)
+		{
+			for (size_t j = 0; j < kernel_size; j++)
+			{
+				float* passing_error_row =
+					passing_error +
+					curr_depth * input_plane +
+					(y * shape.stride + j) * shape.input_width +
+					x * shape.stride;
+				cpu_add(passing_error_row, patch_error_row, passing_error_row, kernel_size);
+				patch_error_row += kernel_size;
+			}
+		}
+	}
+}
+
+//WINOGRAD F(2x2, 3x3)
+
+//U = G * g * G^T
+//G = | 1    0    0  |
+//    | 1/2  1/2  1/2|
+//    | 1/2 -1/2  1/2|
+//    | 0    0    1  |
+static void winograd_transform_kernel(const float* g, float* u)
+{
+	float tmp[4][3];
+	for (int i = 0; i < 3; i++)
+	{
+		const float g0 = g[0 * 3 + i];
+		const float g1 = g[1 * 3 + i];
+		const float g2 = g[2 * 3 + i];
+		tmp[0][i] = g0;
+		tmp[1][i] = (g0 + g1 + g2) * 0.5f;
+		tmp[2][i] = (g0 - g1 + g2) * 0.5f;
+		tmp[3][i] = g2;
+	}
+	for (int r = 0; r < 4; r++)
+	{
+		u[r * 4 + 0] = tmp[r][0];
+		u[r * 4 + 1] = (tmp[r][0] + tmp[r][1] + tmp[r][2]) * 0.5f;
+		u[r * 4 + 2] = (tmp[r][0] - tmp[r][1] + tmp[r][2]) * 0.5f;
+		u[r * 4 + 3] = tmp[r][2];
+	}
+}
+
+//V = B^T * d * B
+//B^T = | 1  0 -1  0|
+//      | 0  1  1  0|
+//      | 0 -1  1  0|
+//      | 0  1  0 -1|
+static void winograd_transform_tile(const float d[4][4], float* v)
+{
+	float tmp[4][4];
+	for (int c = 0; c < 4; c++)
+	{
+		tmp[0][c] = d[0][c] - d[2][c];
+		tmp[1][c] = d[1][c] + d[2][c];
+		tmp[2][c] = d[2][c] - d[1][c];
+		tmp[3][c] = d[1][c] - d[3][c];
+	}
+	for (int r = 0; r < 4; r++)
+	{
+		v[r * 4 + 0] = tmp[r][0] - tmp[r][2];
+		v[r * 4 + 1] = tmp[r][1] + tmp[r][2];
+		v[r * 4 + 2] = tmp[r][2] - tmp[r][1];
+		v[r * 4 + 3] = tmp[r][1] - tmp[r][3];
+	}
+}
+
+//Y = A^T * m * A
+//A^T = | 1  1  1  0|
+//      | 0  1 -1 -1|
+static void winograd_transform_output(const float* m, float y[2][2])
+{
+	float tmp[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		tmp[0][c] = m[0 * 4 + c] + m[1 * 4 + c] + m[2 * 4 + c];
+		tmp[1][c] = m[1 * 4 + c] - m[2 * 4 + c] - m[3 * 4 + c];
+	}
+	for (int r = 0; r < 2; r++)
+	{
+		y[r][0] = tmp[r][0] + tmp[r][1] + tmp[r][2];
+		y[r][1] = tmp[r][1] - tmp[r][2] - tmp[r][3];
+	}
+}
+
+template<typename activation_t>
+static void winograd_forward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	static thread_local std::vector<float> kernel_buffer;
+	static thread_local std::vector<float> tile_buffer;
+
+	const size_t depth = shape.input_depth;
+	const size_t input_plane = shape.input_width * shape.input_height;
+	const size_t output_plane = shape.output_positions();
+
+	//the transformed values are stored as [element][depth]
+	//so the sum over the depth of one element is a contiguous dot product
+	float* transformed_kernels = get_scratch(kernel_buffer, shape.kernel_count * 16 * depth);
+	float* transformed_tile = get_scratch(tile_buffer, 16 * depth);
+
+	//the kernels change after every update, so they are transformed on every call
+	for (size_t z = 0; z < shape.kernel_count; z++)
+	{
+		float* kernel_u = transformed_kernels + z * 16 * depth;
+		for (size_t curr_depth = 0; curr_depth < depth; curr_depth++)
+		{
+			float u[16];
+			winograd_transform_kernel(kernels[z] + curr_depth * 9, u);
+			for (size_t e = 0; e < 16; e++)
+			{
+				kernel_u[e * depth + curr_depth] = u[e];
+			}
+		}
+	}
+
+	//every tile has 4x4 inputs and 2x2 outputs
+	//the tiles at the border read zeros outside of the input and only write the valid outputs
+	for (size_t tile_y = 0; tile_y < shape.output_height; tile_y += 2)
+	{
+		for (size_t tile_x = 0; tile_x < shape.output_width; tile_x += 2)
+		{
+			//the inner tiles are completely inside of the input and are copied without bounds checks
+			const bool inner_tile = tile_x + 4 <= shape.input_width && tile_y + 4 <= shape.input_height;
+			for (size_t curr_depth = 0; curr_depth < depth; curr_depth++)
+			{
+				float d[4][4];
+				const float* input_layer = input + curr_depth * input_plane;
+				if (inner_tile)
+				{
+					const float* window = input_layer + tile_y * shape.input_width + tile_x;
+					for (size_t r = 0; r < 4; r++)
+					{
+						for (size_t c = 0; c < 4; c++)
+						{
+							d[r][c] = window[r * shape.input_width + c];
+						}
+					}
+				}
+				else
+				{
+					for (size_t r = 0; r < 4; r++)
+					{
+						for (size_t c = 0; c < 4; c++)
+						{
+							const size_t x = tile_x + c;
+							const size_t y = tile_y + r;
+							d[r][c] =
+								(x < shape.input_width && y < shape.input_height) ?
+								input_layer[y * shape.input_width + x] :
+								0;
+						}
+					}
+				}
+				float v[16];
+				winograd_transform_tile(d, v);
+				for (size_t e = 0; e < 16; e++)
+				{
+					transformed_tile[e * depth + curr_depth] = v[e];
+				}
+			}
+
+			for (size_t z = 0; z < shape.kernel_count; z++)
+			{
+				const float* kernel_u = transformed_kernels + z * 16 * depth;
+				float m[16];
+				for (size_t e = 0; e < 16; e++)
+				{
+					m[e] = cpu_dot(kernel_u + e * depth, transformed_tile + e * depth, depth);
+				}
+
+				float y[2][2];
+				winograd_transform_output(m, y);
+
+				for (size_t r = 0; r < 2 && tile_y + r < shape.output_height; r++)
+				{
+					for (size_t c = 0; c < 2 && tile_x + c < shape.output_width; c++)
+					{
+						const size_t output_idx = z * output_plane + (tile_y + r) * shape.output_width + tile_x + c;
+						output[output_idx] = conv_epilogue<activation_t>(y[r][c], biases, output_idx);
+					}
+				}
+			}
+		}
+	}
+}
+
+//FIXED
+
+//the kernel size and stride are known at compile time, so the loops over the kernel are unrolled
+//the weights of one depth of a kernel are loaded into registers once
+//and every output row of that depth is accumulated with them
+template<size_t kernel_size, size_t stride, typename activation_t>
+static void fixed_direct_forward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	const size_t input_width = shape.input_width;
+	const size_t input_plane = input_width * shape.input_height;
+	const size_t output_width = shape.output_width;
+	const size_t output_plane = shape.output_positions();
+
+	for (size_t z = 0; z < shape.kernel_count; z++)
+	{
+		float* kernel_output = output + z * output_plane;
+		std::fill(kernel_output, kernel_output + output_plane, 0.0f);
+
+		for (size_t curr_depth = 0; curr_depth < shape.input_depth; curr_depth++)
+		{
+			float weights[kernel_size][kernel_size];
+			const float* kernel = kernels[z] + curr_depth * kernel_size * kernel_size;
+			for (size_t j = 0; j < kernel_size; j++)
+			{
+				for (size_t i = 0; i < kernel_size; i++)
+				{
+					weights[j][i] = kernel[j * kernel_size + i];
+				}
+			}
+
+			const float* input_plane_ptr = input + curr_depth * input_plane;
+			for (size_t y = 0; y < shape.output_height; y++)
+			{
+				const float* window_row = input_plane_ptr + y * stride * input_width;
+				float* output_row = kernel_output + y * output_width;
+				for (size_t x = 0; x < output_width; x++)
+				{
+					const float* window = window_row + x * stride;
+					float sum = 0;
+					for (size_t j = 0; j < kernel_size; j++)
+					{
+						for (size_t i = 0; i < kernel_size; i++)
+						{
+							sum += weights[j][i] * window[j * input_width + i];
+						}
+					}
+					output_row[x] += sum;
+				}
+			}
+		}
+
+		//the outputs of the kernel are complete after its last depth and still in the cache
+		if (biases != nullptr || !std::is_same<activation_t, no_activation_traits>::value)
+		{
+			for (size_t i = 0; i < output_plane; i++)
+			{
+				kernel_output[i] = conv_epilogue<activation_t>(kernel_output[i], biases, z * output_plane + i);
+			}
+		}
+	}
+}
+
+//the direct and the im2col strategy gather the window with the fixed sizes
+//winograd is always 3x3 with a stride of 1, so it needs no fixed variant
+template<size_t kernel_size, size_t stride, typename activation_t>
+static void fixed_forward(
+	const conv_shape& shape,
+	e_conv_strategy_t strategy,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	if (strategy == direct_conv)
+	{
+		fixed_direct_forward<kernel_size, stride, activation_t>(shape, input, kernels, biases, output);
+		return;
+	}
+
+	float* patches = get_im2col_patches(shape);
+	fixed_im2col<kernel_size, stride>(shape, input, patches);
+	im2col_multiply<activation_t>(shape, patches, kernels, biases, output);
+}
+
+//INTERLEAVED
+
+template<typename activation_t>
+static void interleaved_forward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	static thread_local std::vector<float> kernel_buffer;
+
+	const size_t kernel_size = shape.kernel_size;
+	const size_t depth = shape.input_depth;
+	const size_t kernel_plane = kernel_size * kernel_size;
+	const size_t patch_size = shape.patch_size();
+	//one kernel row over all depths
+	const size_t row_size = kernel_size * depth;
+	const size_t input_row_size = shape.input_width * depth;
+
+	//packed[z][j][i][depth] = kernels[z][depth][j][i]
+	float* packed_kernels = get_scratch(kernel_buffer, shape.kernel_count * patch_size);
+	for (size_t z = 0; z < shape.kernel_count; z++)
+	{
+		float* packed_kernel = packed_kernels + z * patch_size;
+		for (size_t curr_depth = 0; curr_depth < depth; curr_depth++)
+		{
+			for (size_t position = 0; position < kernel_plane; position++)
+			{
+				packed_kernel[position * depth + curr_depth] = kernels[z][curr_depth * kernel_plane + position];
+			}
+		}
+	}
+
+	//the outputs of one position are next to each other, so all kernels are applied to the window
+	//while it is in the cache
+	for (size_t y = 0; y < shape.output_height; y++)
+	{
+		for (size_t x = 0; x < shape.output_width; x++)
+		{
+			const float* window = input + y * shape.stride * input_row_size + x * shape.stride * depth;
+			const size_t result_idx = (y * shape.output_width + x) * shape.kernel_count;
+			for (size_t z = 0; z < shape.kernel_count; z++)
+			{
+				const float* packed_kernel = packed_kernels + z * patch_size;
+				float sum = 0;
+				for (size_t j = 0; j < kernel_size; j++)
+				{
+					sum += cpu_dot(window + j * input_row_size, packed_kernel + j * row_size, row_size);
+				}
+				output[result_idx + z] = conv_epilogue<activation_t>(sum, biases, result_idx + z);
+			}
+		}
+	}
+}
+
+//DISPATCH
+
+template<typename activation_t>
+static void strategy_forward(
+	const conv_shape& shape,
+	e_conv_strategy_t strategy,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	switch (strategy)
+	{
+	case direct_conv:
+		direct_forward<activation_t>(shape, input, kernels, biases, output);
+		break;
+	case im2col_conv:
+		im2col_forward<activation_t>(shape, input, kernels, biases, output);
+		break;
+	case winograd_conv:
+		if (shape.kernel_size != 3 || shape.stride != 1)
+		{
+			throw std::invalid_argument("winograd convolution needs a 3x3 kernel and a stride of 1");
+		}
+		winograd_forward<activation_t>(shape, input, kernels, biases, output);
+		break;
+	default:
+		throw std::invalid_argument("unknown convolution strategy");
+	}
+}
+
+template<typename activation_t>
+static void fixed_kernel_forward(
+	const conv_shape& shape,
+	e_fixed_kernel_t fixed_kernel,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	float* output)
+{
+	if (fixed_kernel != generic_kernel &&
+		conv_select_fixed_kernel(shape.kernel_size, shape.stride) != fixed_kernel)
+	{
+		throw std::invalid_argument("the fixed kernel does not match the kernel size and stride");
+	}
+
+	const e_conv_strategy_t strategy = conv_select_strategy(shape);
+	if (fixed_kernel == generic_kernel || strategy == winograd_conv)
+	{
+		strategy_forward<activation_t>(shape, strategy, input, kernels, biases, output);
+		return;
+	}
+
+	switch (fixed_kernel)
+	{
+	case kernel_1x1_s1:
+		fixed_forward<1, 1, activation_t>(shape, strategy, input, kernels, biases, output);
+		break;
+	case kernel_3x3_s1:
+		fixed_forward<3, 1, activation_t>(shape, strategy, input, kernels, biases, output);
+		break;
+	case kernel_3x3_s2:
+		fixed_forward<3, 2, activation_t>(shape, strategy, input, kernels, biases, output);
+		break;
+	case kernel_5x5_s1:
+		fixed_forward<5, 1, activation_t>(shape, strategy, input, kernels, biases, output);
+		break;
+	case kernel_5x5_s2:
+		fixed_forward<5, 2, activation_t>(shape, strategy, input, kernels, biases, output);
+		break;
+	default:
+		throw std::invalid_argument("not a fixed convolution kernel");
+	}
+}
+
+//the softmax traits only add the biases, all outputs are normalized as one row afterwards
+//(the same as cpu_activate with biases of the output size)
+static void normalize_softmax(const conv_shape& shape, e_activation_t activation_fn, float* output)
+{
+	if (activation_fn == softmax_fn)
+	{
+		const size_t output_count = shape.output_positions() * shape.kernel_count;
+		cpu_add_bias_softmax(output, nullptr, output_count, output_count);
+	}
+}
+
+void conv_forward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	float* output)
+{
+	conv_forward(shape, conv_select_strategy(shape), input, kernels, output);
+}
+
+void conv_forward(
+	const conv_shape& shape,
+	e_conv_strategy_t strategy,
+	const float* input,
+	const float* const* kernels,
+	float* output)
+{
+	strategy_forward<no_activation_traits>(shape, strategy, input, kernels, nullptr, output);
+}
+
+void conv_forward_fixed(
+	const conv_shape& shape,
+	e_fixed_kernel_t fixed_kernel,
+	const float* input,
+	const float* const* kernels,
+	float* output)
+{
+	fixed_kernel_forward<no_activation_traits>(shape, fixed_kernel, input, kernels, nullptr, output);
+}
+
+void conv_forward_fixed(
+	const conv_shape& shape,
+	e_fixed_kernel_t fixed_kernel,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	e_activation_t activation_fn,
+	float* output)
+{
+	dispatch_activation(activation_fn, [&](auto traits) {
+		fixed_kernel_forward<decltype(traits)>(shape, fixed_kernel, input, kernels, biases, output);
+	});
+	normalize_softmax(shape, activation_fn, output);
+}
+
+void conv_forward_interleaved(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	float* output)
+{
+	interleaved_forward<no_activation_traits>(shape, input, kernels, nullptr, output);
+}
+
+void conv_forward_interleaved(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	e_activation_t activation_fn,
+	float* output)
+{
+	dispatch_activation(activation_fn, [&](auto traits) {
+		interleaved_forward<decltype(traits)>(shape, input, kernels, biases, output);
+	});
+	normalize_softmax(shape, activation_fn, output);
+}
+
+void conv_backward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* delta,
+	float* const* kernel_deltas,
+	float* passing_error)
+{
+	conv_backward(shape, conv_select_strategy(shape), input, kernels, delta, kernel_deltas, passing_error);
+}
+
+void conv_backward(
+	const conv_shape& shape,
+	e_conv_strategy_t strategy,
+	const float* input,
+	const float* const* kernels,
+	const float* delta,
+	float* const* kernel_deltas,
+	float* passing_error)
+{
+	if (passing_error != nullptr)
+	{
+		std::fill(passing_error, passing_error + shape.input_width * shape.input_height * shape.input_depth, 0.0f);
+	}
+
+	switch (strategy)
+	{
+	case direct_conv:
+		direct_backward(shape, input, kernels, delta, kernel_deltas, passing_error);
+		break;
+	case im2col_conv:
+	case winograd_conv:
+		im2col_backward(shape, input, kernels, delta, kernel_deltas, passing_error);
+		break;
+	default:
+		throw std::invalid_argument("unknown convolution strategy");
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include "enum_space.hpp"
+
+/*
+	cpu implementations of the valid cross correlation used by the convolutional layer
+	the strategy is chosen by the shape of the convolution
+
+	direct   - loops over every output and multiplies the kernel rows with the input rows
+	im2col   - copies every input patch into a row of a scratch buffer
+	           and multiplies these rows with the kernels (one long dot product per output)
+	winograd - F(2x2, 3x3), computes 2x2 outputs with 16 instead of 36 multiplications per depth
+	           only for 3x3 kernels with a stride of 1
+
+	the scratch buffers are kept per thread and reused across calls
+
+	the strategies work on planar values (chw_layout). interleaved values (hwc_layout)
+	have their own direct forward pass, the kernels stay planar for both
+
+	the common kernel sizes and strides also have forward passes with the sizes known
+	at compile time (e_fixed_kernel_t). the layers select it once when their input format is set.
+	the direct pass unrolls the loops over the kernel and keeps the weights of one depth in registers,
+	the im2col pass unrolls the gather of the patches. winograd is already fixed to 3x3 with a stride of 1
+*/
+
+//all convolutions that use this have a depth of the input equal to the kernel depth
+//and an output depth equal to the kernel count
+struct conv_shape {
+	size_t input_width;
+	size_t input_height;
+	size_t input_depth;
+	size_t kernel_size;
+	size_t kernel_count;
+	size_t stride;
+	size_t output_width;
+	size_t output_height;
+
+	//the number of values every kernel has
+	size_t patch_size() const;
+	//the number of outputs per kernel
+	size_t output_positions() const;
+};
+
+//outputs up to this count are computed directly
+constexpr size_t DIRECT_CONV_MAX_OUTPUTS = 16;
+
+e_conv_strategy_t conv_select_strategy(const conv_shape& shape);
+
+//generic_kernel if there is no specialized kernel for the size and stride
+e_fixed_kernel_t conv_select_fixed_kernel(size_t kernel_size, size_t stride);
+e_fixed_kernel_t pooling_select_fixed_kernel(size_t kernel_size, size_t stride);
+
+//kernels has kernel_count pointers, one for each kernel (width, height, depth)
+//the output is overwritten
+void conv_forward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	float* output);
+void conv_forward(
+	const conv_shape& shape,
+	e_conv_strategy_t strategy,
+	const float* input,
+	const float* const* kernels,
+	float* output);
+
+//uses the strategy of the shape with the window of the specialized kernel,
+//winograd and the generic_kernel use the regular strategy of the shape
+//throws if the fixed kernel does not match the kernel size and stride of the shape
+void conv_forward_fixed(
+	const conv_shape& shape,
+	e_fixed_kernel_t fixed_kernel,
+	const float* input,
+	const float* const* kernels,
+	float* output);
+//output = activation_fn(convolution + biases), applied by every strategy when it writes an output
+//the biases have the same layout as the output (the softmax normalizes all outputs afterwards)
+void conv_forward_fixed(
+	const conv_shape& shape,
+	e_fixed_kernel_t fixed_kernel,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	e_activation_t activation_fn,
+	float* output);
+
+//the input and the output are interleaved (hwc_layout), the kernels are planar
+//the kernels are repacked into the interleaved order once per call, so every kernel row
+//and the input row under it are one contiguous dot product over kernel_size * depth values
+void conv_forward_interleaved(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	float* output);
+void conv_forward_interleaved(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* biases,
+	e_activation_t activation_fn,
+	float* output);
+
+//delta is the error of the output multiplied with the activation derivative
+//the kernel deltas are summed up, the passing error is overwritten
+//passing error is null when it is not needed
+//winograd is only used for the forward pass, its backward pass uses im2col
+void conv_backward(
+	const conv_shape& shape,
+	const float* input,
+	const float* const* kernels,
+	const float* delta,
+	float* const* kernel_deltas,
+	float* passing_error);
+void conv_backward(
+	const conv_shape& shape,
+	e_conv_strategy_t strategy,
+	const float* input,
+	const float* const* kernels,
+	const float* delta,
+	float* const* kernel_deltas,
+	float* passing_error);
@@ -21,6 +21,9 @@ convolutional_layer::convolutional_layer(
 
 	if (stride > kernel_size)
 		throw std::invalid_argument("stride must be smaller or equal than the kernel_size");
+	//the softmax normalizes the outputs of a whole item
+	if (activation_function == softmax_fn)
+		throw std::invalid_argument("softmax can only be used in fully connected layers");
 }
 
 convolutional_layer::convolutional_layer(std::ifstream& file)
@@ -39,10 +42,33 @@ convolutional_layer::convolutional_layer(std::ifstream& file)
 	for (size_t i = 0; i < kernel_count; i++)
 	{
 		kernel_weights.push_back(matrix(file));
-		kernel_weights_deltas.push_back(kernel_weights[0].get_format());
+		kernel_weights_deltas.push_back(matrix(kernel_weights[0].get_format()));
+		kernel_weights_momentum.push_back(matrix(kernel_weights[0].get_format()));
 	}
 	kernel_biases = matrix(file);
 	kernel_bias_deltas = matrix(kernel_biases.get_format());
+	kernel_bias_momentum = matrix(kernel_biases.get_format());
+	fixed_kernel = conv_select_fixed_kernel(kernel_size, stride);
+}
+
+convolutional_layer::convolutional_layer(model_reader& reader)
+	:layer(reader, e_layer_type_t::convolutional)
+{
+	activation_fn = (e_activation_t)reader.read_u32();
+	kernel_size = (size_t)reader.read_u64();
+	stride = (size_t)reader.read_u64();
+	kernel_count = (size_t)reader.read_u64();
+
+	for (size_t i = 0; i < kernel_count; i++)
+	{
+		kernel_weights.push_back(matrix(reader));
+		kernel_weights_deltas.push_back(matrix(kernel_weights[0].get_format()));
+		kernel_weights_momentum.push_back(matrix(kernel_weights[0].get_format()));
+	}
+	kernel_biases = matrix(reader);
+	kernel_bias_deltas = matrix(kernel_biases.get_format());
+	kernel_bias_momentum = matrix(kernel_biases.get_format());
+	fixed_kernel = conv_select_fixed_kernel(kernel_size, stride);
 }
 
 convolutional_layer::convolutional_layer(
@@ -53,13 +79,46 @@ convolutional_layer::convolutional_layer(
 	stride(other.stride),
 	kernel_count(other.kernel_count),
 	activation_fn(other.activation_fn),
+	fixed_kernel(other.fixed_kernel),
 	kernel_biases(other.kernel_biases),
-	kernel_bias_deltas(other.kernel_bias_deltas, false) // do not copy the deltas
+	kernel_bias_deltas(other.kernel_bias_deltas, false), // do not copy the deltas
+	kernel_bias_momentum(other.kernel_bias_momentum, false) // do not copy the momentum
 {
 	for (const auto& kernel : other.kernel_weights)
 		kernel_weights.push_back(matrix(kernel));
 	for (const auto& kernel : other.kernel_weights_deltas)
 		kernel_weights_deltas.push_back(matrix(kernel, false)); // do noty copy the deltas
+	for (const auto& kernel : other.kernel_weights_momentum)
+		kernel_weights_momentum.push_back(matrix(kernel, false)); // do not copy the momentum
+}
+
+convolutional_layer::convolutional_layer(
+	const convolutional_layer& parameter_source,
+	share_parameters_t shared
+) :
+	layer(parameter_source),
+	kernel_size(parameter_source.kernel_size),
+	stride(parameter_source.stride),
+	kernel_count(parameter_source.kernel_count),
+	activation_fn(parameter_source.activation_fn),
+	fixed_kernel(parameter_source.fixed_kernel)
+{
+	kernel_weights = std::vector<matrix>(parameter_source.kernel_weights.size());
+	for (size_t i = 0; i < kernel_weights.size(); i++)
+	{
+		kernel_weights[i].observe(parameter_source.kernel_weights[i]);
+	}
+	kernel_biases.observe(parameter_source.kernel_biases);
+	if (!shared.with_deltas)
+	{
+		inference_only = true;
+		return;
+	}
+	for (const auto& kernel : kernel_weights)
+	{
+		kernel_weights_deltas.push_back(matrix(kernel.get_format()));
+	}
+	kernel_bias_deltas = matrix(kernel_biases.get_format());
 }
 
 std::unique_ptr<layer> convolutional_layer::clone() const
@@ -67,6 +126,16 @@ std::unique_ptr<layer> convolutional_layer::clone() const
 	return std::make_unique<convolutional_layer>(*this);
 }
 
+std::unique_ptr<layer> convolutional_layer::clone_instance() const
+{
+	return std::make_unique<convolutional_layer>(*this, share_parameters_t());
+}
+
+std::unique_ptr<layer> convolutional_layer::clone_workspace() const
+{
+	return std::make_unique<convolutional_layer>(*this, share_parameters_t{ true });
+}
+
 size_t convolutional_layer::get_parameter_count() const
 {
 	size_t result = 0;
@@ -89,6 +158,11 @@ size_t convolutional_layer::get_stride() const
 	return stride;
 }
 
+e_activation_t convolutional_layer::get_activation_function() const
+{
+	return activation_fn;
+}
+
 size_t convolutional_layer::get_kernel_count() const
 {
 	return kernel_count;
@@ -123,6 +197,9 @@ void convolutional_layer::set_input_format(vector3 input_format)
 	const size_t output_width = convolution_output_size(input_format.x, kernel_size, stride);
 	const size_t output_height = convolution_output_size(input_format.y, kernel_size, stride);
 
+	//the kernel size and stride do not change, so the kernel is only selected once
+	fixed_kernel = conv_select_fixed_kernel(kernel_size, stride);
+
 	activations = matrix(vector3(output_width, output_height, kernel_count));
 	error = matrix(activations.get_format());
 
@@ -130,7 +207,7 @@ void convolutional_layer::set_input_format(vector3 input_format)
 	{
 		kernel_weights.push_back(matrix(vector3(kernel_size, kernel_size, input_depth)));
 		kernel_weights_deltas.push_back(matrix(vector3(kernel_size, kernel_size, input_depth)));
-
+		kernel_weights_momentum.push_back(matrix(vector3(kernel_size, kernel_size, input_depth)));
 	}
 	kernel_biases = matrix(
 		vector3(
@@ -142,6 +219,18 @@ void convolutional_layer::set_input_format(vector3 input_format)
 			output_width,
 			output_height,
 			kernel_count));
+	kernel_bias_momentum = matrix(
+		vector3(
+			output_width,
+			output_height,
+			kernel_count));
+
+	set_activation_layout(tensor_layout);
+}
+
+void convolutional_layer::set_tensor_layout(e_tensor_layout_t layout)
+{
+	set_activation_layout(layout);
 }
 
 void convolutional_layer::set_all_parameters(float value)
@@ -215,6 +304,12 @@ void convolutional_layer::sync_device_and_host()
 		weights.sync_device_and_host();
 	}
 	kernel_bias_deltas.sync_device_and_host();
+
+	for (matrix& weights : kernel_weights_momentum)
+	{
+		weights.sync_device_and_host();
+	}
+	kernel_bias_momentum.sync_device_and_host();
 }
 
 void convolutional_layer::forward_propagation(const matrix& input)
@@ -228,25 +323,106 @@ void convolutional_layer::forward_propagation(const matrix& input)
 	if (activations.get_depth() != kernel_count)
 		throw std::invalid_argument("activations depth must be equal to the number of kernels");
 
-	activations.set_all(0);
-
-	matrix::cross_correlation(
-		input, kernel_weights, activations, stride);
-
-	matrix::add(activations, kernel_biases, activations);
-
-	activations.apply_activation_function(activation_fn);
+	//the cross correlation overwrites the activations
+	//the biases and the activation are applied when an output is written
+	const matrix* biases = &kernel_biases;
+	if (tensor_layout != chw_layout)
+	{
+		convert_into(kernel_biases, layout_biases, tensor_layout);
+		biases = &layout_biases;
+	}
+	matrix::cross_correlation_bias_activate(
+		input_in_layout(input, tensor_layout), kernel_weights, *biases, activations, stride, fixed_kernel, activation_fn);
 }
 
 void convolutional_layer::back_propagation(const matrix& input, matrix* passing_error)
 {
-	throw std::exception("not implemented");
 	layer::back_propagation(input, passing_error);
+
+	//the strategies of the back propagation only work on planar values
+	//the deltas are planar like the parameters, only the passing error has to be converted back
+	//(the error is not needed after the back propagation)
+	matrix* backprop_activations = &activations;
+	matrix* backprop_error = &error;
+	if (tensor_layout != chw_layout)
+	{
+		convert_into(activations, planar_activations, chw_layout);
+		convert_into(error, planar_error, chw_layout);
+		backprop_activations = &planar_activations;
+		backprop_error = &planar_error;
+	}
+	matrix* planar_passing_error = passing_error_in_layout(passing_error, chw_layout);
+
+	matrix::convolution_backprop(
+		input_in_layout(input, chw_layout),
+		kernel_weights,
+		*backprop_activations,
+		*backprop_error,
+		planar_passing_error,
+		kernel_weights_deltas,
+		kernel_bias_deltas,
+		stride,
+		activation_fn
+	);
+
+	write_passing_error(passing_error, planar_passing_error);
 }
 
 void convolutional_layer::apply_deltas(size_t training_data_count, float learning_rate)
 {
-	throw std::exception("not implemented");
+	for (size_t i = 0; i < kernel_weights.size(); i++)
+	{
+		kernel_weights[i].apply_deltas(
+			kernel_weights_deltas[i],
+			kernel_weights_momentum[i],
+			training_data_count,
+			learning_rate);
+	}
+	kernel_biases.apply_deltas(kernel_bias_deltas, kernel_bias_momentum, training_data_count, learning_rate);
+}
+
+void convolutional_layer::accumulate_deltas(layer& other)
+{
+	layer::accumulate_deltas(other);
+
+	convolutional_layer& other_casted = dynamic_cast<convolutional_layer&>(other);
+	smart_assert(kernel_weights_deltas.size() == other_casted.kernel_weights_deltas.size());
+
+	for (size_t i = 0; i < kernel_weights_deltas.size(); i++)
+	{
+		matrix::add(kernel_weights_deltas[i], other_casted.kernel_weights_deltas[i], kernel_weights_deltas[i]);
+		other_casted.kernel_weights_deltas[i].set_all(0);
+	}
+	matrix::add(kernel_bias_deltas, other_casted.kernel_bias_deltas, kernel_bias_deltas);
+	other_casted.kernel_bias_deltas.set_all(0);
+}
+
+void convolutional_layer::collect_parameters(
+	std::vector<matrix*>& parameters,
+	std::vector<matrix*>& deltas,
+	std::vector<matrix*>& momentum)
+{
+	for (size_t i = 0; i < kernel_weights.size(); i++)
+	{
+		parameters.push_back(&kernel_weights[i]);
+		deltas.push_back(&kernel_weights_deltas[i]);
+		momentum.push_back(&kernel_weights_momentum[i]);
+	}
+	parameters.push_back(&kernel_biases);
+	deltas.push_back(&kernel_bias_deltas);
+	momentum.push_back(&kernel_bias_momentum);
+}
+
+void convolutional_layer::release_training_buffers()
+{
+	layer::release_training_buffers();
+
+	planar_activations = matrix();
+	planar_error = matrix();
+	kernel_weights_deltas.clear();
+	kernel_weights_momentum.clear();
+	kernel_bias_deltas = matrix();
+	kernel_bias_momentum = matrix();
 }
 
 void convolutional_layer::enable_gpu_mode()
@@ -256,10 +432,26 @@ void convolutional_layer::enable_gpu_mode()
 	for (int i = 0; i < kernel_count; i++)
 	{
 		kernel_weights[i].enable_gpu_mode();
-		kernel_weights_deltas[i].enable_gpu_mode();
 	}
 	kernel_biases.enable_gpu_mode();
-	kernel_bias_deltas.enable_gpu_mode();
+
+	//an instance has no deltas or momentum, a workspace has no momentum
+	for (int i = 0; i < kernel_weights_deltas.size(); i++)
+	{
+		kernel_weights_deltas[i].enable_gpu_mode();
+	}
+	for (int i = 0; i < kernel_weights_momentum.size(); i++)
+	{
+		kernel_weights_momentum[i].enable_gpu_mode();
+	}
+	if (kernel_bias_deltas.is_initialized())
+	{
+		kernel_bias_deltas.enable_gpu_mode();
+	}
+	if (kernel_bias_momentum.is_initialized())
+	{
+		kernel_bias_momentum.enable_gpu_mode();
+	}
 }
 
 void convolutional_layer::disable_gpu()
@@ -340,4 +532,18 @@ void convolutional_layer::write_to_ofstream(std::ofstream& file) const
 		weights.write_to_ofstream(file);
 	}
 	kernel_biases.write_to_ofstream(file);
+}
+
+void convolutional_layer::write_to_model(model_writer& writer) const
+{
+	layer::write_to_model(writer);
+	writer.write_u32(activation_fn);
+	writer.write_u64(kernel_size);
+	writer.write_u64(stride);
+	writer.write_u64(kernel_count);
+	for (const matrix& weights : kernel_weights)
+	{
+		weights.write_to_model(writer);
+	}
+	kernel_biases.write_to_model(writer);
 }
\ No newline at end of file
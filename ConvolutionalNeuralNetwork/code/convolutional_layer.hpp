@@ -12,11 +12,24 @@ private:
 	std::vector<matrix> kernel_weights_deltas;
 	matrix kernel_bias_deltas;
 
+	std::vector<matrix> kernel_weights_momentum;
+	matrix kernel_bias_momentum;
+
 	size_t kernel_size;
 	size_t stride;
 	size_t kernel_count;
 
 	e_activation_t activation_fn;
+
+	//the specialized forward kernel of the kernel size and stride, selected in set_input_format
+	e_fixed_kernel_t fixed_kernel = generic_kernel;
+
+	//the kernels and biases are always planar
+	//the biases are converted into the layout of the activations for the forward propagation
+	matrix layout_biases;
+	//the back propagation only works on planar values, interleaved activations are converted into these
+	matrix planar_activations;
+	matrix planar_error;
 public:
 	convolutional_layer(
 		size_t number_of_kernels,
@@ -26,10 +39,16 @@ public:
 	);
 
 	convolutional_layer(std::ifstream& file);
+	convolutional_layer(model_reader& reader);
 
 	convolutional_layer(const convolutional_layer& other);
+	//the kernel weights and biases observe the ones of the parameter source
+	//the momentum is not allocated, the deltas only with_deltas (see clone_instance and clone_workspace)
+	convolutional_layer(const convolutional_layer& parameter_source, share_parameters_t shared);
 
 	std::unique_ptr<layer> clone() const override;
+	std::unique_ptr<layer> clone_instance() const override;
+	std::unique_ptr<layer> clone_workspace() const override;
 
 	size_t get_parameter_count() const override;
 
@@ -37,6 +56,7 @@ public:
 	size_t get_kernel_size() const;
 	size_t get_stride() const;
 	size_t get_kernel_count() const;
+	e_activation_t get_activation_function() const;
 
 	std::vector<matrix>& get_kernel_weights();
 	const std::vector<matrix>& get_kernel_weights_readonly() const;
@@ -44,6 +64,7 @@ public:
 	const matrix& get_kernel_biases_readonly() const;
 
 	void set_input_format(vector3 input_format) override;
+	void set_tensor_layout(e_tensor_layout_t layout) override;
 
 	//set all weights and biases to that value
 	void set_all_parameters(float value) override;
@@ -60,6 +81,13 @@ public:
 	void back_propagation(const matrix& input, matrix* passing_error) override;
 
 	void apply_deltas(size_t training_data_count, float learning_rate) override;
+	void accumulate_deltas(layer& other) override;
+	void collect_parameters(
+		std::vector<matrix*>& parameters,
+		std::vector<matrix*>& deltas,
+		std::vector<matrix*>& momentum) override;
+
+	void release_training_buffers() override;
 
 	void enable_gpu_mode() override;
 	void disable_gpu() override;
@@ -69,4 +97,5 @@ public:
 	void set_parameters(const layer& other) override;
 
 	void write_to_ofstream(std::ofstream& file) const override;
+	void write_to_model(model_writer& writer) const override;
 };
\ No newline at end of file
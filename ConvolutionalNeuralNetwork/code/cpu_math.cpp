@@ -0,0 +1,1244 @@
+#include "cpu_math.hpp"
+#include "math_functions.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_MATH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define CPU_MATH_NEON
+#include <arm_neon.h>
+#endif
+
+//msvc compiles intrinsics of every instruction set without extra flags
+//gcc and clang need the target attribute on the functions that use them
+#if defined(CPU_MATH_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#define TARGET_AVX512_VNNI __attribute__((target("avx512f,avx512vnni")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#define TARGET_AVX512_VNNI
+#endif
+
+//SCALAR
+
+static float scalar_dot(const float* a, const float* b, size_t count)
+{
+	float sum = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+static void scalar_axpy(float alpha, const float* x, float* y, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		y[i] += alpha * x[i];
+	}
+}
+
+static void scalar_add(const float* a, const float* b, float* result, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		result[i] = a[i] + b[i];
+	}
+}
+
+static void scalar_subtract(const float* a, const float* b, float* result, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		result[i] = a[i] - b[i];
+	}
+}
+
+static void scalar_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	float delta_scale,
+	float learning_rate,
+	float beta)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		momentum[i] = beta * momentum[i] + (1 - beta) * deltas[i] * delta_scale;
+		params[i] -= momentum[i] * learning_rate;
+		deltas[i] = 0;
+	}
+}
+
+static int32_t scalar_dot_int8(const int8_t* a, const int8_t* b, size_t count)
+{
+	int32_t sum = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		sum += (int32_t)a[i] * (int32_t)b[i];
+	}
+	return sum;
+}
+
+static float scalar_sparse_dot(const float* values, const uint32_t* column_indices, size_t count, const float* x)
+{
+	float sum = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		sum += values[i] * x[column_indices[i]];
+	}
+	return sum;
+}
+
+static void scalar_bytes_to_float(const uint8_t* source, float* destination, size_t count, float scale)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		destination[i] = (float)source[i] * scale;
+	}
+}
+
+//AVX2
+
+#ifdef CPU_MATH_X86
+TARGET_AVX2 static float avx2_dot(const float* a, const float* b, size_t count)
+{
+	//two accumulators hide the latency of the fma
+	__m256 sum_0 = _mm256_setzero_ps();
+	__m256 sum_1 = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		sum_0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum_0);
+		sum_1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum_1);
+	}
+	for (; i + 8 <= count; i += 8)
+	{
+		sum_0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum_0);
+	}
+	__m256 sum = _mm256_add_ps(sum_0, sum_1);
+
+	//horizontal sum of the 8 lanes
+	__m128 low = _mm256_castps256_ps128(sum);
+	__m128 high = _mm256_extractf128_ps(sum, 1);
+	__m128 sum_4 = _mm_add_ps(low, high);
+	__m128 sum_2 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+	__m128 sum_1_lane = _mm_add_ss(sum_2, _mm_shuffle_ps(sum_2, sum_2, 1));
+	float result = _mm_cvtss_f32(sum_1_lane);
+
+	for (; i < count; i++)
+	{
+		result += a[i] * b[i];
+	}
+	return result;
+}
+
+TARGET_AVX2 static void avx2_axpy(float alpha, const float* x, float* y, size_t count)
+{
+	__m256 alpha_v = _mm256_set1_ps(alpha);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(y + i, _mm256_fmadd_ps(alpha_v, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+	}
+	for (; i < count; i++)
+	{
+		y[i] += alpha * x[i];
+	}
+}
+
+TARGET_AVX2 static void avx2_add(const float* a, const float* b, float* result, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	for (; i < count; i++)
+	{
+		result[i] = a[i] + b[i];
+	}
+}
+
+TARGET_AVX2 static void avx2_subtract(const float* a, const float* b, float* result, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		_mm256_storeu_ps(result + i, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	for (; i < count; i++)
+	{
+		result[i] = a[i] - b[i];
+	}
+}
+
+TARGET_AVX2 static void avx2_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	float delta_scale,
+	float learning_rate,
+	float beta)
+{
+	const __m256 beta_v = _mm256_set1_ps(beta);
+	const __m256 delta_factor_v = _mm256_set1_ps((1 - beta) * delta_scale);
+	const __m256 learning_rate_v = _mm256_set1_ps(learning_rate);
+	const __m256 zero_v = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 m = _mm256_mul_ps(beta_v, _mm256_loadu_ps(momentum + i));
+		m = _mm256_fmadd_ps(delta_factor_v, _mm256_loadu_ps(deltas + i), m);
+		_mm256_storeu_ps(momentum + i, m);
+		_mm256_storeu_ps(params + i, _mm256_fnmadd_ps(m, learning_rate_v, _mm256_loadu_ps(params + i)));
+		_mm256_storeu_ps(deltas + i, zero_v);
+	}
+	scalar_apply_deltas(params + i, deltas + i, momentum + i, count - i, delta_scale, learning_rate, beta);
+}
+
+//the products of two int8 values fit into 16 bits, so pairs of them are summed into 32 bits
+TARGET_AVX2 static int32_t avx2_dot_int8(const int8_t* a, const int8_t* b, size_t count)
+{
+	__m256i sum = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i a_16 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+		__m256i b_16 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a_16, b_16));
+	}
+
+	__m128i sum_4 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	sum_4 = _mm_add_epi32(sum_4, _mm_shuffle_epi32(sum_4, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum_4 = _mm_add_epi32(sum_4, _mm_shuffle_epi32(sum_4, _MM_SHUFFLE(2, 3, 0, 1)));
+	int32_t result = _mm_cvtsi128_si32(sum_4);
+
+	return result + scalar_dot_int8(a + i, b + i, count - i);
+}
+
+//the values of x are gathered with the column indices
+TARGET_AVX2 static float avx2_sparse_dot(const float* values, const uint32_t* column_indices, size_t count, const float* x)
+{
+	__m256 sum = _mm256_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i indices = _mm256_loadu_si256((const __m256i*)(column_indices + i));
+		const __m256 gathered = _mm256_i32gather_ps(x, indices, sizeof(float));
+		sum = _mm256_fmadd_ps(_mm256_loadu_ps(values + i), gathered, sum);
+	}
+
+	__m128 sum_4 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	__m128 sum_2 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+	__m128 sum_1 = _mm_add_ss(sum_2, _mm_shuffle_ps(sum_2, sum_2, 1));
+	return _mm_cvtss_f32(sum_1) + scalar_sparse_dot(values + i, column_indices + i, count - i, x);
+}
+
+TARGET_AVX2 static void avx2_bytes_to_float(const uint8_t* source, float* destination, size_t count, float scale)
+{
+	const __m256 scale_v = _mm256_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(source + i)));
+		_mm256_storeu_ps(destination + i, _mm256_mul_ps(_mm256_cvtepi32_ps(values), scale_v));
+	}
+	scalar_bytes_to_float(source + i, destination + i, count - i, scale);
+}
+
+//AVX-512
+
+TARGET_AVX512 static float avx512_dot(const float* a, const float* b, size_t count)
+{
+	__m512 sum_0 = _mm512_setzero_ps();
+	__m512 sum_1 = _mm512_setzero_ps();
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		sum_0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum_0);
+		sum_1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), sum_1);
+	}
+	for (; i + 16 <= count; i += 16)
+	{
+		sum_0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum_0);
+	}
+	//the remaining items are loaded with a mask
+	if (i < count)
+	{
+		__mmask16 mask = (__mmask16)((1u << (count - i)) - 1);
+		sum_1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), sum_1);
+	}
+	return _mm512_reduce_add_ps(_mm512_add_ps(sum_0, sum_1));
+}
+
+TARGET_AVX512 static void avx512_axpy(float alpha, const float* x, float* y, size_t count)
+{
+	__m512 alpha_v = _mm512_set1_ps(alpha);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(y + i, _mm512_fmadd_ps(alpha_v, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+	}
+	if (i < count)
+	{
+		__mmask16 mask = (__mmask16)((1u << (count - i)) - 1);
+		__m512 result = _mm512_fmadd_ps(alpha_v, _mm512_maskz_loadu_ps(mask, x + i), _mm512_maskz_loadu_ps(mask, y + i));
+		_mm512_mask_storeu_ps(y + i, mask, result);
+	}
+}
+
+TARGET_AVX512 static void avx512_add(const float* a, const float* b, float* result, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(result + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+	}
+	if (i < count)
+	{
+		__mmask16 mask = (__mmask16)((1u << (count - i)) - 1);
+		__m512 sum = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+		_mm512_mask_storeu_ps(result + i, mask, sum);
+	}
+}
+
+TARGET_AVX512 static void avx512_subtract(const float* a, const float* b, float* result, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		_mm512_storeu_ps(result + i, _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+	}
+	if (i < count)
+	{
+		__mmask16 mask = (__mmask16)((1u << (count - i)) - 1);
+		__m512 difference = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+		_mm512_mask_storeu_ps(result + i, mask, difference);
+	}
+}
+
+TARGET_AVX512 static void avx512_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	float delta_scale,
+	float learning_rate,
+	float beta)
+{
+	const __m512 beta_v = _mm512_set1_ps(beta);
+	const __m512 delta_factor_v = _mm512_set1_ps((1 - beta) * delta_scale);
+	const __m512 learning_rate_v = _mm512_set1_ps(learning_rate);
+	const __m512 zero_v = _mm512_setzero_ps();
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512 m = _mm512_mul_ps(beta_v, _mm512_loadu_ps(momentum + i));
+		m = _mm512_fmadd_ps(delta_factor_v, _mm512_loadu_ps(deltas + i), m);
+		_mm512_storeu_ps(momentum + i, m);
+		_mm512_storeu_ps(params + i, _mm512_fnmadd_ps(m, learning_rate_v, _mm512_loadu_ps(params + i)));
+		_mm512_storeu_ps(deltas + i, zero_v);
+	}
+	scalar_apply_deltas(params + i, deltas + i, momentum + i, count - i, delta_scale, learning_rate, beta);
+}
+
+TARGET_AVX512 static void avx512_bytes_to_float(const uint8_t* source, float* destination, size_t count, float scale)
+{
+	const __m512 scale_v = _mm512_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m512i values = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(source + i)));
+		_mm512_storeu_ps(destination + i, _mm512_mul_ps(_mm512_cvtepi32_ps(values), scale_v));
+	}
+	scalar_bytes_to_float(source + i, destination + i, count - i, scale);
+}
+
+//vpdpbusd multiplies unsigned with signed bytes
+//a + 128 is unsigned, so the result is sum((a + 128) * b) - 128 * sum(b)
+TARGET_AVX512_VNNI static int32_t avx512_vnni_dot_int8(const int8_t* a, const int8_t* b, size_t count)
+{
+	const __m512i sign_flip = _mm512_set1_epi8((char)0x80);
+	const __m512i ones = _mm512_set1_epi8(1);
+	__m512i sum = _mm512_setzero_si512();
+	__m512i b_sum = _mm512_setzero_si512();
+	size_t i = 0;
+	for (; i + 64 <= count; i += 64)
+	{
+		__m512i a_unsigned = _mm512_xor_si512(_mm512_loadu_si512(a + i), sign_flip);
+		__m512i b_v = _mm512_loadu_si512(b + i);
+		sum = _mm512_dpbusd_epi32(sum, a_unsigned, b_v);
+		b_sum = _mm512_dpbusd_epi32(b_sum, ones, b_v);
+	}
+	int32_t result = _mm512_reduce_add_epi32(sum) - 128 * _mm512_reduce_add_epi32(b_sum);
+
+	return result + scalar_dot_int8(a + i, b + i, count - i);
+}
+#endif
+
+//NEON
+
+#ifdef CPU_MATH_NEON
+static float neon_dot(const float* a, const float* b, size_t count)
+{
+	float32x4_t sum_0 = vdupq_n_f32(0);
+	float32x4_t sum_1 = vdupq_n_f32(0);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		sum_0 = vfmaq_f32(sum_0, vld1q_f32(a + i), vld1q_f32(b + i));
+		sum_1 = vfmaq_f32(sum_1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	float result = vaddvq_f32(vaddq_f32(sum_0, sum_1));
+	for (; i < count; i++)
+	{
+		result += a[i] * b[i];
+	}
+	return result;
+}
+
+static void neon_axpy(float alpha, const float* x, float* y, size_t count)
+{
+	float32x4_t alpha_v = vdupq_n_f32(alpha);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		vst1q_f32(y + i, vfmaq_f32(vld1q_f32(y + i), alpha_v, vld1q_f32(x + i)));
+	}
+	for (; i < count; i++)
+	{
+		y[i] += alpha * x[i];
+	}
+}
+
+static void neon_add(const float* a, const float* b, float* result, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		vst1q_f32(result + i, vaddq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+	}
+	for (; i < count; i++)
+	{
+		result[i] = a[i] + b[i];
+	}
+}
+
+static void neon_subtract(const float* a, const float* b, float* result, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		vst1q_f32(result + i, vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+	}
+	for (; i < count; i++)
+	{
+		result[i] = a[i] - b[i];
+	}
+}
+
+static void neon_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	float delta_scale,
+	float learning_rate,
+	float beta)
+{
+	const float32x4_t beta_v = vdupq_n_f32(beta);
+	const float32x4_t delta_factor_v = vdupq_n_f32((1 - beta) * delta_scale);
+	const float32x4_t learning_rate_v = vdupq_n_f32(learning_rate);
+	const float32x4_t zero_v = vdupq_n_f32(0);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4_t m = vmulq_f32(beta_v, vld1q_f32(momentum + i));
+		m = vfmaq_f32(m, delta_factor_v, vld1q_f32(deltas + i));
+		vst1q_f32(momentum + i, m);
+		vst1q_f32(params + i, vfmsq_f32(vld1q_f32(params + i), m, learning_rate_v));
+		vst1q_f32(deltas + i, zero_v);
+	}
+	scalar_apply_deltas(params + i, deltas + i, momentum + i, count - i, delta_scale, learning_rate, beta);
+}
+
+static int32_t neon_dot_int8(const int8_t* a, const int8_t* b, size_t count)
+{
+	int32x4_t sum = vdupq_n_s32(0);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		int8x16_t a_v = vld1q_s8(a + i);
+		int8x16_t b_v = vld1q_s8(b + i);
+		sum = vpadalq_s16(sum, vmull_s8(vget_low_s8(a_v), vget_low_s8(b_v)));
+		sum = vpadalq_s16(sum, vmull_s8(vget_high_s8(a_v), vget_high_s8(b_v)));
+	}
+	return vaddvq_s32(sum) + scalar_dot_int8(a + i, b + i, count - i);
+}
+
+static void neon_bytes_to_float(const uint8_t* source, float* destination, size_t count, float scale)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		uint16x8_t values = vmovl_u8(vld1_u8(source + i));
+		float32x4_t low = vcvtq_f32_u32(vmovl_u16(vget_low_u16(values)));
+		float32x4_t high = vcvtq_f32_u32(vmovl_u16(vget_high_u16(values)));
+		vst1q_f32(destination + i, vmulq_n_f32(low, scale));
+		vst1q_f32(destination + i + 4, vmulq_n_f32(high, scale));
+	}
+	scalar_bytes_to_float(source + i, destination + i, count - i, scale);
+}
+#endif
+
+//DISPATCH
+
+#ifdef CPU_MATH_X86
+static void cpuid(int info[4], int function_id, int sub_function_id)
+{
+#ifdef _MSC_VER
+	__cpuidex(info, function_id, sub_function_id);
+#else
+	__asm__ __volatile__("cpuid"
+		: "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3])
+		: "a"(function_id), "c"(sub_function_id));
+#endif
+}
+
+//the os has to save the ymm (and zmm) registers, otherwise the instructions can not be used
+static unsigned long long read_xcr0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax = 0;
+	unsigned int edx = 0;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+static e_cpu_simd_level_t detect_simd_level()
+{
+#if defined(CPU_MATH_X86)
+	int info[4] = { 0 };
+	cpuid(info, 0, 0);
+	const int max_function_id = info[0];
+	if (max_function_id < 7)
+	{
+		return scalar_simd;
+	}
+
+	cpuid(info, 1, 0);
+	const bool has_osxsave = (info[2] & (1 << 27)) != 0;
+	const bool has_fma = (info[2] & (1 << 12)) != 0;
+	if (!has_osxsave)
+	{
+		return scalar_simd;
+	}
+	const unsigned long long xcr0 = read_xcr0();
+	const bool os_saves_ymm = (xcr0 & 0x6) == 0x6;
+	const bool os_saves_zmm = (xcr0 & 0xe6) == 0xe6;
+
+	cpuid(info, 7, 0);
+	const bool has_avx2 = (info[1] & (1 << 5)) != 0;
+	const bool has_avx512f = (info[1] & (1 << 16)) != 0;
+
+	const bool avx2_usable = has_avx2 && has_fma && os_saves_ymm;
+
+	//the avx512 table keeps the avx2 int8 and sparse dot products, so it needs avx2 as well
+	if (avx2_usable && has_avx512f && os_saves_zmm)
+	{
+		return avx512_simd;
+	}
+	if (avx2_usable)
+	{
+		return avx2_simd;
+	}
+	return scalar_simd;
+#elif defined(CPU_MATH_NEON)
+	return neon_simd;
+#else
+	return scalar_simd;
+#endif
+}
+
+//the int8 dot product uses vnni if the cpu has it
+static bool detect_avx512_vnni()
+{
+#if defined(CPU_MATH_X86)
+	int info[4] = { 0 };
+	cpuid(info, 0, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+	cpuid(info, 7, 0);
+	return (info[2] & (1 << 11)) != 0;
+#else
+	return false;
+#endif
+}
+
+struct cpu_kernel_table {
+	e_cpu_simd_level_t level;
+	float (*dot)(const float*, const float*, size_t);
+	void (*axpy)(float, const float*, float*, size_t);
+	void (*add)(const float*, const float*, float*, size_t);
+	void (*subtract)(const float*, const float*, float*, size_t);
+	void (*apply_deltas)(float*, float*, float*, size_t, float, float, float);
+	int32_t (*dot_int8)(const int8_t*, const int8_t*, size_t);
+	void (*bytes_to_float)(const uint8_t*, float*, size_t, float);
+	float (*sparse_dot)(const float*, const uint32_t*, size_t, const float*);
+};
+
+static cpu_kernel_table create_kernel_table()
+{
+	cpu_kernel_table table = {
+		scalar_simd,
+		scalar_dot,
+		scalar_axpy,
+		scalar_add,
+		scalar_subtract,
+		scalar_apply_deltas,
+		scalar_dot_int8,
+		scalar_bytes_to_float,
+		scalar_sparse_dot
+	};
+
+	switch (detect_simd_level())
+	{
+#ifdef CPU_MATH_X86
+	case avx512_simd:
+		table = { avx512_simd, avx512_dot, avx512_axpy, avx512_add, avx512_subtract, avx512_apply_deltas, avx2_dot_int8, avx512_bytes_to_float, avx2_sparse_dot };
+		if (detect_avx512_vnni())
+		{
+			table.dot_int8 = avx512_vnni_dot_int8;
+		}
+		break;
+	case avx2_simd:
+		table = { avx2_simd, avx2_dot, avx2_axpy, avx2_add, avx2_subtract, avx2_apply_deltas, avx2_dot_int8, avx2_bytes_to_float, avx2_sparse_dot };
+		break;
+#endif
+#ifdef CPU_MATH_NEON
+	case neon_simd:
+		table = { neon_simd, neon_dot, neon_axpy, neon_add, neon_subtract, neon_apply_deltas, neon_dot_int8, neon_bytes_to_float, scalar_sparse_dot };
+		break;
+#endif
+	default:
+		break;
+	}
+	return table;
+}
+
+//initialized on the first call (thread safe since c++11)
+static const cpu_kernel_table& kernels()
+{
+	static const cpu_kernel_table table = create_kernel_table();
+	return table;
+}
+
+e_cpu_simd_level_t cpu_get_simd_level()
+{
+	return kernels().level;
+}
+
+std::string cpu_simd_level_name()
+{
+	switch (cpu_get_simd_level())
+	{
+	case avx2_simd:
+		return "avx2";
+	case avx512_simd:
+		return "avx512";
+	case neon_simd:
+		return "neon";
+	default:
+		return "scalar";
+	}
+}
+
+float cpu_dot(const float* a, const float* b, size_t count)
+{
+	return kernels().dot(a, b, count);
+}
+
+int32_t cpu_dot_int8(const int8_t* a, const int8_t* b, size_t count)
+{
+	return kernels().dot_int8(a, b, count);
+}
+
+float cpu_sparse_dot(const float* values, const uint32_t* column_indices, size_t count, const float* x)
+{
+	return kernels().sparse_dot(values, column_indices, count, x);
+}
+
+void cpu_bytes_to_float(const uint8_t* source, float* destination, size_t count, float scale)
+{
+	kernels().bytes_to_float(source, destination, count, scale);
+}
+
+void cpu_axpy(float alpha, const float* x, float* y, size_t count)
+{
+	kernels().axpy(alpha, x, y, count);
+}
+
+void cpu_add(const float* a, const float* b, float* result, size_t count)
+{
+	kernels().add(a, b, result, count);
+}
+
+void cpu_subtract(const float* a, const float* b, float* result, size_t count)
+{
+	kernels().subtract(a, b, result, count);
+}
+
+void cpu_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	float delta_scale,
+	float learning_rate,
+	float beta)
+{
+	kernels().apply_deltas(params, deltas, momentum, count, delta_scale, learning_rate, beta);
+}
+
+void cpu_activate(
+	float* data,
+	const float* biases,
+	size_t bias_count,
+	size_t count,
+	e_activation_t activation_fn)
+{
+	if (activation_fn == softmax_fn)
+	{
+		cpu_add_bias_softmax(data, biases, biases == nullptr ? count : bias_count, count);
+		return;
+	}
+	dispatch_activation(activation_fn, [&](auto traits) {
+		using traits_t = decltype(traits);
+		if (biases == nullptr)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				data[i] = traits_t::activate(data[i]);
+			}
+			return;
+		}
+		//row by row, so the inner loop has no modulo
+		for (size_t offset = 0; offset < count; offset += bias_count)
+		{
+			float* row = data + offset;
+			for (size_t i = 0; i < bias_count; i++)
+			{
+				row[i] = traits_t::activate(row[i] + biases[i]);
+			}
+		}
+	});
+}
+
+void cpu_add_bias_softmax(
+	float* data,
+	const float* biases,
+	size_t row_width,
+	size_t count)
+{
+	for (size_t offset = 0; offset < count; offset += row_width)
+	{
+		float* row = data + offset;
+		float max_value = -INFINITY;
+		for (size_t i = 0; i < row_width; i++)
+		{
+			row[i] += biases == nullptr ? 0.0f : biases[i];
+			max_value = std::max(max_value, row[i]);
+		}
+		float sum = 0;
+		for (size_t i = 0; i < row_width; i++)
+		{
+			row[i] = expf(row[i] - max_value);
+			sum += row[i];
+		}
+		const float inverse_sum = 1.0f / sum;
+		for (size_t i = 0; i < row_width; i++)
+		{
+			row[i] *= inverse_sum;
+		}
+	}
+}
+
+void cpu_cost_derivative(
+	const float* activations,
+	const float* expected,
+	float* error,
+	size_t count,
+	e_cost_function_t cost_fn,
+	float* cost)
+{
+	float summed_cost = 0;
+	if (cost_fn == cross_entropy_cost)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			error[i] = activations[i] - expected[i];
+			summed_cost -= expected[i] * logf(std::max(activations[i], CROSS_ENTROPY_EPSILON));
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			const float difference = activations[i] - expected[i];
+			error[i] = 2.0f * difference;
+			summed_cost += difference * difference;
+		}
+	}
+	if (cost != nullptr)
+	{
+		*cost += summed_cost;
+	}
+}
+
+void cpu_multiply_activation_derivative(
+	const float* activations,
+	const float* error,
+	float* delta,
+	size_t count,
+	e_activation_t activation_fn)
+{
+	dispatch_activation(activation_fn, [&](auto traits) {
+		using traits_t = decltype(traits);
+		for (size_t i = 0; i < count; i++)
+		{
+			delta[i] = error[i] * traits_t::derivative_from_activation(activations[i]);
+		}
+	});
+}
+
+void cpu_optimizer_step(
+	e_optimizer_t optimizer_type,
+	const optimizer_step_settings& settings,
+	float* params,
+	float* deltas,
+	float* first_moment,
+	float* second_moment,
+	size_t count)
+{
+	//the classic momentum step has its own vectorized kernel
+	if (optimizer_type == momentum_optimizer && settings.weight_decay == 0)
+	{
+		cpu_apply_deltas(
+			params,
+			deltas,
+			first_moment,
+			count,
+			settings.delta_scale,
+			settings.learning_rate,
+			settings.beta1);
+		return;
+	}
+
+	dispatch_optimizer(optimizer_type, [&](auto type) {
+		float unused_moment = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			optimizer_update_item<decltype(type)::value>(
+				settings,
+				params[i],
+				deltas[i],
+				first_moment[i],
+				second_moment != nullptr ? second_moment[i] : unused_moment);
+		}
+	});
+}
+
+void cpu_evaluate_rows(
+	const float* outputs,
+	const float* labels,
+	size_t row_count,
+	size_t row_width,
+	e_cost_function_t cost_fn,
+	float* totals)
+{
+	for (size_t row = 0; row < row_count; row++)
+	{
+		const float* output = outputs + row * row_width;
+		const float* label = labels + row * row_width;
+		size_t output_max_idx = 0;
+		size_t label_max_idx = 0;
+		float cost = 0;
+		for (size_t i = 0; i < row_width; i++)
+		{
+			if (output[i] > output[output_max_idx])
+			{
+				output_max_idx = i;
+			}
+			if (label[i] > label[label_max_idx])
+			{
+				label_max_idx = i;
+			}
+			cost += cost_fn == cross_entropy_cost ?
+				-label[i] * logf(std::max(output[i], CROSS_ENTROPY_EPSILON)) :
+				(output[i] - label[i]) * (output[i] - label[i]);
+		}
+		totals[0] += output_max_idx == label_max_idx ? 1.0f : 0.0f;
+		totals[1] += cost;
+	}
+}
+
+void cpu_non_zero_rows(
+	const float* table,
+	size_t row_count,
+	size_t row_width,
+	size_t count,
+	uint8_t* result)
+{
+	for (size_t row = 0; row < row_count; row++)
+	{
+		const float* values = table + row * row_width;
+		result[row] = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (values[i] != 0)
+			{
+				result[row] = 1;
+				break;
+			}
+		}
+	}
+}
+
+void cpu_convert_layout(
+	const float* source,
+	float* destination,
+	size_t width,
+	size_t height,
+	size_t depth,
+	e_tensor_layout_t source_layout,
+	e_tensor_layout_t destination_layout)
+{
+	const size_t plane = width * height;
+	if (source_layout == destination_layout)
+	{
+		std::copy(source, source + plane * depth, destination);
+		return;
+	}
+
+	//the destination is written contiguously, the source is read with a stride
+	if (destination_layout == hwc_layout)
+	{
+		for (size_t position = 0; position < plane; position++)
+		{
+			float* destination_position = destination + position * depth;
+			for (size_t z = 0; z < depth; z++)
+			{
+				destination_position[z] = source[z * plane + position];
+			}
+		}
+	}
+	else
+	{
+		for (size_t z = 0; z < depth; z++)
+		{
+			float* destination_plane = destination + z * plane;
+			for (size_t position = 0; position < plane; position++)
+			{
+				destination_plane[position] = source[position * depth + z];
+			}
+		}
+	}
+}
+
+//the first value of the window is selected,
+//the later ones only if they are strictly bigger (smaller), like the generic pooling
+template<bool select_max>
+static void pooling_2x2_s2_select(
+	const float* input,
+	float* output,
+	unsigned char* selected_indices,
+	size_t input_width,
+	size_t output_width,
+	size_t output_height)
+{
+	for (size_t y = 0; y < output_height; y++)
+	{
+		const float* top = input + y * 2 * input_width;
+		const float* bottom = top + input_width;
+		float* output_row = output + y * output_width;
+		unsigned char* indices_row = selected_indices == nullptr ? nullptr : selected_indices + y * output_width;
+		for (size_t x = 0; x < output_width; x++)
+		{
+			const float values[4] = { top[2 * x], top[2 * x + 1], bottom[2 * x], bottom[2 * x + 1] };
+			float result = values[0];
+			unsigned char result_idx = 0;
+			for (unsigned char i = 1; i < 4; i++)
+			{
+				if (select_max ? values[i] > result : values[i] < result)
+				{
+					result = values[i];
+					result_idx = i;
+				}
+			}
+			output_row[x] = result;
+			if (indices_row != nullptr)
+				indices_row[x] = result_idx;
+		}
+	}
+}
+
+void cpu_pooling_2x2_s2(
+	const float* input,
+	float* output,
+	unsigned char* selected_indices,
+	size_t input_width,
+	size_t input_height,
+	size_t output_width,
+	size_t output_height,
+	size_t depth,
+	e_pooling_type_t pooling_type)
+{
+	const size_t input_plane = input_width * input_height;
+	const size_t output_plane = output_width * output_height;
+
+	for (size_t d = 0; d < depth; d++)
+	{
+		const float* input_depth = input + d * input_plane;
+		float* output_depth = output + d * output_plane;
+		unsigned char* indices = selected_indices == nullptr ? nullptr : selected_indices + d * output_plane;
+
+		switch (pooling_type)
+		{
+		case max_pooling:
+			pooling_2x2_s2_select<true>(input_depth, output_depth, indices, input_width, output_width, output_height);
+			break;
+		case min_pooling:
+			pooling_2x2_s2_select<false>(input_depth, output_depth, indices, input_width, output_width, output_height);
+			break;
+		case average_pooling:
+			for (size_t y = 0; y < output_height; y++)
+			{
+				const float* top = input_depth + y * 2 * input_width;
+				const float* bottom = top + input_width;
+				float* output_row = output_depth + y * output_width;
+				for (size_t x = 0; x < output_width; x++)
+				{
+					output_row[x] = (top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1]) * 0.25f;
+				}
+			}
+			break;
+		default:
+			throw std::runtime_error("Invalid pooling type");
+		}
+	}
+}
+
+void cpu_pooling_interleaved(
+	const float* input,
+	float* output,
+	unsigned char* selected_indices,
+	size_t input_width,
+	size_t output_width,
+	size_t output_height,
+	size_t depth,
+	size_t kernel_size,
+	size_t stride,
+	e_pooling_type_t pooling_type)
+{
+	const size_t window_size = kernel_size * kernel_size;
+	const float average_factor = 1.0f / (float)window_size;
+
+	for (size_t y = 0; y < output_height; y++)
+	{
+		for (size_t x = 0; x < output_width; x++)
+		{
+			const size_t output_offset = (y * output_width + x) * depth;
+			const float* window = input + (y * stride * input_width + x * stride) * depth;
+			float* result = output + output_offset;
+			unsigned char* indices = selected_indices == nullptr ? nullptr : selected_indices + output_offset;
+
+			//the first value of the window starts every depth
+			//the later ones only replace it if they are strictly bigger (smaller), like the planar pooling
+			std::copy(window, window + depth, result);
+			if (indices != nullptr)
+			{
+				std::fill(indices, indices + depth, (unsigned char)0);
+			}
+
+			for (size_t window_idx = 1; window_idx < window_size; window_idx++)
+			{
+				const float* values =
+					window + ((window_idx / kernel_size) * input_width + window_idx % kernel_size) * depth;
+				switch (pooling_type)
+				{
+				case max_pooling:
+					for (size_t z = 0; z < depth; z++)
+					{
+						if (values[z] > result[z])
+						{
+							result[z] = values[z];
+							if (indices != nullptr)
+								indices[z] = (unsigned char)window_idx;
+						}
+					}
+					break;
+				case min_pooling:
+					for (size_t z = 0; z < depth; z++)
+					{
+						if (values[z] < result[z])
+						{
+							result[z] = values[z];
+							if (indices != nullptr)
+								indices[z] = (unsigned char)window_idx;
+						}
+					}
+					break;
+				case average_pooling:
+					cpu_add(result, values, result, depth);
+					break;
+				default:
+					throw std::runtime_error("Invalid pooling type");
+				}
+			}
+
+			if (pooling_type == average_pooling)
+			{
+				for (size_t z = 0; z < depth; z++)
+				{
+					result[z] *= average_factor;
+				}
+			}
+		}
+	}
+}
+
+void cpu_pooling_backprop_interleaved(
+	const float* error,
+	float* passing_error,
+	const unsigned char* selected_indices,
+	size_t input_width,
+	size_t input_height,
+	size_t output_width,
+	size_t output_height,
+	size_t depth,
+	size_t kernel_size,
+	size_t stride)
+{
+	const float average_factor = 1.0f / (float)(kernel_size * kernel_size);
+
+	//the windows can overlap, so the errors are added up
+	std::fill(passing_error, passing_error + input_width * input_height * depth, 0.0f);
+
+	for (size_t y = 0; y < output_height; y++)
+	{
+		for (size_t x = 0; x < output_width; x++)
+		{
+			const size_t output_offset = (y * output_width + x) * depth;
+			const float* curr_error = error + output_offset;
+			float* window = passing_error + (y * stride * input_width + x * stride) * depth;
+
+			if (selected_indices != nullptr)
+			{
+				//only the selected value had an influence on the output
+				const unsigned char* indices = selected_indices + output_offset;
+				for (size_t z = 0; z < depth; z++)
+				{
+					const size_t window_idx = indices[z];
+					window[((window_idx / kernel_size) * input_width + window_idx % kernel_size) * depth + z] +=
+						curr_error[z];
+				}
+				continue;
+			}
+
+			//every value of the window had the same influence
+			for (size_t i = 0; i < kernel_size; i++)
+			{
+				for (size_t j = 0; j < kernel_size; j++)
+				{
+					cpu_axpy(average_factor, curr_error, window + (i * input_width + j) * depth, depth);
+				}
+			}
+		}
+	}
+}
+
+void cpu_evolve_rows(
+	const float* genomes,
+	const float* fitness,
+	size_t genome_count,
+	size_t genome_width,
+	const evolution_settings& settings,
+	size_t first_genome,
+	size_t end_genome,
+	float* next_genomes)
+{
+	for (size_t genome = first_genome; genome < end_genome; genome++)
+	{
+		float* next = next_genomes + genome * genome_width;
+		if (genome == settings.elite_idx)
+		{
+			std::copy(genomes + genome * genome_width, genomes + (genome + 1) * genome_width, next);
+			continue;
+		}
+
+		//the parents are the same for all parameters of a genome
+		uint32_t first_parent = 0;
+		uint32_t second_parent = 0;
+		select_parents(settings, fitness, (uint32_t)genome_count, (uint32_t)genome, first_parent, second_parent);
+		const float* first = genomes + first_parent * genome_width;
+		const float* second = genomes + second_parent * genome_width;
+		for (size_t i = 0; i < genome_width; i++)
+		{
+			next[i] = evolve_item(settings, (uint32_t)genome_count, (uint32_t)genome, i, first[i], second[i]);
+		}
+	}
+}
+
+void cpu_augment_rows(
+	const float* source,
+	float* destination,
+	size_t row_count,
+	size_t width,
+	size_t height,
+	size_t depth,
+	const augmentation_settings& settings)
+{
+	const size_t row_width = width * height * depth;
+	for (size_t row = 0; row < row_count; row++)
+	{
+		const float* source_row = source + row * row_width;
+		float* destination_row = destination + row * row_width;
+		for (size_t d = 0; d < depth; d++)
+		{
+			for (size_t y = 0; y < height; y++)
+			{
+				for (size_t x = 0; x < width; x++)
+				{
+					destination_row[(d * height + y) * width + x] = augment_item(
+						settings,
+						source_row,
+						(uint32_t)width,
+						(uint32_t)height,
+						row,
+						(uint32_t)x,
+						(uint32_t)y,
+						(uint32_t)d);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "enum_space.hpp"
+#include "math_functions.hpp"
+
+/*
+	vectorized kernels for the cpu paths of the matrix class
+	all of them work on raw contiguous float arrays
+
+	the instruction set is chosen at runtime the first time a kernel is called
+	avx-512 > avx2 (with fma) > neon > scalar
+*/
+
+enum _cpu_simd_level {
+	scalar_simd = 0,
+	avx2_simd = 1,
+	avx512_simd = 2,
+	neon_simd = 3
+} typedef e_cpu_simd_level_t;
+
+e_cpu_simd_level_t cpu_get_simd_level();
+std::string cpu_simd_level_name();
+
+//returns the sum of a[i] * b[i]
+float cpu_dot(const float* a, const float* b, size_t count);
+
+//returns the sum of a[i] * b[i] in 32 bit integers
+//uses vnni (avx-512) if the cpu has it
+int32_t cpu_dot_int8(const int8_t* a, const int8_t* b, size_t count);
+
+//returns the sum of values[i] * x[column_indices[i]] (one row of a csr matrix)
+//gathers 8 values of x at once with avx2
+float cpu_sparse_dot(const float* values, const uint32_t* column_indices, size_t count, const float* x);
+
+//destination[i] = source[i] * scale
+void cpu_bytes_to_float(const uint8_t* source, float* destination, size_t count, float scale);
+
+//y[i] += alpha * x[i]
+void cpu_axpy(float alpha, const float* x, float* y, size_t count);
+
+//result[i] = a[i] + b[i]
+//result can be the same array as a or b
+void cpu_add(const float* a, const float* b, float* result, size_t count);
+
+//result[i] = a[i] - b[i]
+void cpu_subtract(const float* a, const float* b, float* result, size_t count);
+
+//gradient decent with momentum
+//momentum = beta * momentum + (1 - beta) * delta * delta_scale
+//param -= momentum * learning_rate
+//the deltas are set to zero afterwards
+void cpu_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	float delta_scale,
+	float learning_rate,
+	float beta);
+
+//data[i] = activation_fn(data[i] + biases[i % bias_count])
+//biases can be null, then only the activation function is applied
+//the loop is specialized for every activation function
+//the softmax normalizes every row of bias_count values (all values if there are no biases)
+void cpu_activate(
+	float* data,
+	const float* biases,
+	size_t bias_count,
+	size_t count,
+	e_activation_t activation_fn);
+
+//every row of row_width values = softmax(row + biases) in one pass
+//the maximum of the row is subtracted before the exponent, so large values do not overflow
+//biases can be null
+void cpu_add_bias_softmax(
+	float* data,
+	const float* biases,
+	size_t row_width,
+	size_t count);
+
+//error[i] = the derivative of the cost at activations[i]
+//squared error: 2 * (activations[i] - expected[i])
+//cross entropy of a softmax: activations[i] - expected[i]
+//cost[0] += the summed cost of all values if cost is not null
+void cpu_cost_derivative(
+	const float* activations,
+	const float* expected,
+	float* error,
+	size_t count,
+	e_cost_function_t cost_fn,
+	float* cost);
+
+//delta[i] = error[i] * activation_fn'(activations[i])
+//delta can be the same array as error
+void cpu_multiply_activation_derivative(
+	const float* activations,
+	const float* error,
+	float* delta,
+	size_t count,
+	e_activation_t activation_fn);
+
+//one fused pass of the optimizer over count parameters
+//updates the parameters and moments and sets the deltas to zero
+//second_moment is only used by adam and adamw and can be null otherwise
+void cpu_optimizer_step(
+	e_optimizer_t optimizer_type,
+	const optimizer_step_settings& settings,
+	float* params,
+	float* deltas,
+	float* first_moment,
+	float* second_moment,
+	size_t count);
+
+//evaluation of row_count rows with row_width values each
+//totals[0] += the number of rows where the highest output and the highest label have the same index
+//totals[1] += the summed cost of all rows
+void cpu_evaluate_rows(
+	const float* outputs,
+	const float* labels,
+	size_t row_count,
+	size_t row_width,
+	e_cost_function_t cost_fn,
+	float* totals);
+
+//result[row] = 1 if one of the first count values of the row is not zero, otherwise 0
+//the table has row_count rows with row_width values each
+void cpu_non_zero_rows(
+	const float* table,
+	size_t row_count,
+	size_t row_width,
+	size_t count,
+	uint8_t* result);
+
+//tensor layouts (see e_tensor_layout_t)
+//destination = the values of the source (width, height, depth) in the destination layout
+//source and destination can not be the same array
+void cpu_convert_layout(
+	const float* source,
+	float* destination,
+	size_t width,
+	size_t height,
+	size_t depth,
+	e_tensor_layout_t source_layout,
+	e_tensor_layout_t destination_layout);
+//planar pooling with a 2x2 window and a stride of 2 (kernel_2x2_s2)
+//the four values of a window are read directly, without the loops over the window
+//selected_indices gets the position of the selected value in the window (max and min pooling), it can be null
+void cpu_pooling_2x2_s2(
+	const float* input,
+	float* output,
+	unsigned char* selected_indices,
+	size_t input_width,
+	size_t input_height,
+	size_t output_width,
+	size_t output_height,
+	size_t depth,
+	e_pooling_type_t pooling_type);
+//pooling of interleaved values, the depth is the innermost loop
+//so every position of the window is one contiguous run over all depths
+//selected_indices gets the position of the selected value in the window (max and min pooling), it can be null
+void cpu_pooling_interleaved(
+	const float* input,
+	float* output,
+	unsigned char* selected_indices,
+	size_t input_width,
+	size_t output_width,
+	size_t output_height,
+	size_t depth,
+	size_t kernel_size,
+	size_t stride,
+	e_pooling_type_t pooling_type);
+//passing_error is overwritten with the error of the interleaved pooling
+//selected_indices is null for average pooling
+void cpu_pooling_backprop_interleaved(
+	const float* error,
+	float* passing_error,
+	const unsigned char* selected_indices,
+	size_t input_width,
+	size_t input_height,
+	size_t output_width,
+	size_t output_height,
+	size_t depth,
+	size_t kernel_size,
+	size_t stride);
+
+//writes the genomes from first_genome to end_genome of the next generation (see evolve_item)
+//every genome is a row of genome_width parameters, fitness has one value per genome
+//the elite genome is copied
+void cpu_evolve_rows(
+	const float* genomes,
+	const float* fitness,
+	size_t genome_count,
+	size_t genome_width,
+	const evolution_settings& settings,
+	size_t first_genome,
+	size_t end_genome,
+	float* next_genomes);
+
+//every row of the destination is the augmented row of the source (see augment_item)
+//a row is one planar item of width x height x depth values, the row index is its random stream
+void cpu_augment_rows(
+	const float* source,
+	float* destination,
+	size_t row_count,
+	size_t width,
+	size_t height,
+	size_t depth,
+	const augmentation_settings& settings);
+
@@ -1,4 +1,9 @@
 #include "data_space.hpp"
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include "cpu_math.hpp"
+#include "cuda_runtime.h"
 
 size_t data_space::label_item_count()
 {
@@ -13,25 +18,96 @@ size_t data_space::data_item_count()
 void data_space::set_data_in_table_at(const matrix& m, size_t idx)
 {
 	smart_assert(vector3::are_equal(data_format, m.get_format()));
+	non_zero_rows_valid = false;
+	if (is_compact())
+	{
+		encode_into_table(m, idx * table_row_item_count());
+		return;
+	}
 	data_table.set_row_from_matrix(m, idx);
 }
 
 void data_space::set_label_in_table_at(const matrix& m, size_t idx)
 {
 	smart_assert(vector3::are_equal(label_format, m.get_format()));
+	if (is_compact())
+	{
+		encode_into_table(m, idx * table_row_item_count() + data_item_count());
+		return;
+	}
 	data_table.set_row_from_matrix(m, idx, data_item_count());
 }
 
 void data_space::allocate_data_table()
 {
+	non_zero_rows_valid = false;
+	if (is_compact())
+	{
+		compact_table = compact_buffer(table_row_item_count() * item_count, storage_precision);
+		return;
+	}
 	data_table = matrix(
 		vector3(
-			(size_t)(data_item_count() + label_item_count()),
+			table_row_item_count(),
 			item_count,
 			(size_t)1));
 	data_table.set_all(0);
 }
 
+bool data_space::is_compact() const
+{
+	return storage_precision != fp32_precision;
+}
+
+size_t data_space::table_row_item_count()
+{
+	return data_item_count() + label_item_count();
+}
+
+size_t data_space::table_row_count() const
+{
+	return shuffle_table.size();
+}
+
+void data_space::encode_into_table(const matrix& m, size_t table_idx)
+{
+	if (m.host_data_is_updated())
+	{
+		compact_table.set(m.host_span_readonly().data, table_idx, m.item_count());
+		return;
+	}
+	matrix host_copy(m);
+	host_copy.sync_device_and_host();
+	compact_table.set(host_copy.host_span_readonly().data, table_idx, m.item_count());
+}
+
+void data_space::decode_from_table(matrix& target, size_t target_idx, size_t table_idx, size_t count)
+{
+	smart_assert(target_idx + count <= target.item_count());
+	if (!target.is_owning_data())
+	{
+		throw std::invalid_argument("a compact data space can only be observed by matrices that own their data");
+	}
+
+	if (target.is_in_gpu_mode() && compact_table.is_in_gpu_mode())
+	{
+		if (!target.device_data_is_updated())
+		{
+			target.sync_device_and_host();
+		}
+		compact_table.get_device(target.device_span().data + target_idx, table_idx, count);
+		return;
+	}
+
+	if (!target.host_data_is_updated())
+	{
+		target.sync_device_and_host();
+	}
+	compact_table.get(target.host_span().data + target_idx, table_idx, count);
+	//uploads the decoded values if the target is on the gpu
+	target.sync_device_and_host();
+}
+
 void data_space::init_shuffle_table()
 {
 	smart_assert(is_initialized());
@@ -43,6 +119,174 @@ void data_space::init_shuffle_table()
 	}
 }
 
+bool data_space::is_streaming() const
+{
+	return stream != nullptr;
+}
+
+size_t data_space::table_row_of(size_t idx)
+{
+	if (!is_streaming())
+	{
+		return shuffle_table[idx];
+	}
+
+	const size_t start = shard_starts[current_shard_position];
+	if (idx < start || idx - start >= shuffle_table.size())
+	{
+		//the last position that starts at or before the item
+		const size_t position =
+			std::upper_bound(shard_starts.begin(), shard_starts.end(), idx) - shard_starts.begin() - 1;
+		load_shard_at(position);
+	}
+	return shuffle_table[idx - shard_starts[current_shard_position]];
+}
+
+void data_space::init_shard_starts()
+{
+	shard_starts.clear();
+	size_t start = 0;
+	for (size_t shard_idx : shard_order)
+	{
+		shard_starts.push_back(start);
+		start += stream->get_shard_item_count(shard_idx);
+	}
+}
+
+void data_space::load_shard_at(size_t position)
+{
+	const size_t shard_idx = shard_order[position];
+	const size_t shard_item_count = stream->get_shard_item_count(shard_idx);
+	const bool gpu_mode = is_initialized() && is_in_gpu_mode();
+
+	std::vector<float> values = stream->load(shard_idx);
+	if (is_compact())
+	{
+		compact_table = compact_buffer(values.size(), storage_precision);
+		compact_table.set(values.data(), 0, values.size());
+		if (gpu_mode)
+		{
+			compact_table.enable_gpu_mode();
+		}
+	}
+	else
+	{
+		data_table = matrix(vector3(table_row_item_count(), shard_item_count, (size_t)1), values);
+		if (gpu_mode)
+		{
+			data_table.enable_gpu_mode();
+		}
+	}
+	current_shard_position = position;
+	non_zero_rows_valid = false;
+
+	shuffle_table.resize(shard_item_count);
+	std::iota(shuffle_table.begin(), shuffle_table.end(), (size_t)0);
+	if (shuffle_shards)
+	{
+		std::random_device rd;
+		std::mt19937 generator(rd());
+		std::shuffle(shuffle_table.begin(), shuffle_table.end(), generator);
+	}
+
+	if (position + 1 < shard_order.size())
+	{
+		stream->prefetch(shard_order[position + 1]);
+	}
+}
+
+void data_space::copy_from_table(matrix& target, size_t target_idx, size_t table_idx, size_t count)
+{
+	smart_assert(target_idx + count <= target.item_count());
+	if (!target.is_owning_data())
+	{
+		throw std::invalid_argument("a streaming data space can only be observed by matrices that own their data");
+	}
+
+	if (target.is_in_gpu_mode() && data_table.is_in_gpu_mode())
+	{
+		if (!target.device_data_is_updated())
+		{
+			target.sync_device_and_host();
+		}
+		cudaError_t error = cudaMemcpyAsync(
+			target.device_span().data + target_idx,
+			data_table.device_span_readonly().data + table_idx,
+			count * sizeof(float),
+			cudaMemcpyDeviceToDevice,
+			gpu_get_current_stream());
+		if (error != cudaSuccess)
+		{
+			throw std::runtime_error("cuda error: " + std::string(cudaGetErrorString(error)));
+		}
+		return;
+	}
+
+	if (!target.host_data_is_updated())
+	{
+		target.sync_device_and_host();
+	}
+	const float* values = data_table.host_span_readonly().data + table_idx;
+	std::copy(values, values + count, target.host_span().data + target_idx);
+	//uploads the values if the target is on the gpu
+	target.sync_device_and_host();
+}
+
+void data_space::compute_non_zero_rows()
+{
+	const size_t row_count = table_row_count();
+	non_zero_rows.resize(row_count);
+
+	if (is_compact())
+	{
+		//the compact values are always on the host
+		std::vector<float> values(table_row_item_count() * row_count);
+		if (!values.empty())
+		{
+			compact_table.get(values.data(), 0, values.size());
+		}
+		cpu_non_zero_rows(values.data(), row_count, table_row_item_count(), data_item_count(), non_zero_rows.data());
+	}
+	else if (data_table.is_in_gpu_mode() && !data_table.host_data_is_updated())
+	{
+		//only one value per row is copied back instead of the table
+		matrix device_result(vector3(row_count, (size_t)1, (size_t)1));
+		device_result.enable_gpu_mode();
+		gpu_non_zero_rows(
+			data_table.device_span_readonly().data,
+			row_count,
+			table_row_item_count(),
+			data_item_count(),
+			device_result.device_span().data);
+		device_result.sync_device_and_host();
+		const float* result = device_result.host_span_readonly().data;
+		for (size_t i = 0; i < row_count; i++)
+		{
+			non_zero_rows[i] = result[i] != 0 ? 1 : 0;
+		}
+	}
+	else
+	{
+		cpu_non_zero_rows(
+			data_table.host_span_readonly().data,
+			row_count,
+			table_row_item_count(),
+			data_item_count(),
+			non_zero_rows.data());
+	}
+	non_zero_rows_valid = true;
+}
+
+bool data_space::can_gather_on_device(const matrix& data_batch, const matrix* label_batch) const
+{
+	return
+		!is_streaming() &&
+		!is_compact() &&
+		device_shuffle_table.is_in_gpu_mode() &&
+		data_batch.is_in_gpu_mode() &&
+		(label_batch == nullptr || label_batch->is_in_gpu_mode());
+}
+
 data_space::data_space()
 {}
 
@@ -106,26 +350,128 @@ data_space::data_space(
 	}
 }
 
+data_space::data_space(const std::vector<std::string>& shard_paths)
+	:stream(std::make_unique<shard_stream>(shard_paths))
+{
+	data_format = stream->get_data_format();
+	label_format = stream->get_label_format();
+	item_count = stream->get_item_count();
+
+	shard_order.resize(stream->get_shard_count());
+	std::iota(shard_order.begin(), shard_order.end(), (size_t)0);
+	init_shard_starts();
+	load_shard_at(0);
+}
+
+data_space::data_space(const idx_file& data_file, const idx_file& label_file, size_t class_count)
+	:data_space(
+		data_file.get_item_count(),
+		data_file.get_item_format(),
+		vector3(1, class_count, 1))
+{
+	if (item_count == 0)
+	{
+		throw std::invalid_argument("idx file has no items");
+	}
+	if (data_file.get_item_count() != label_file.get_item_count())
+	{
+		throw std::invalid_argument("data and label size mismatch");
+	}
+	if (label_file.get_item_format().item_count() != 1)
+	{
+		throw std::invalid_argument("every label has to be one class index");
+	}
+	const uint8_t* labels = label_file.get_values();
+	for (size_t i = 0; i < item_count; i++)
+	{
+		if (labels[i] >= class_count)
+		{
+			throw std::invalid_argument("label is not smaller than the class count");
+		}
+	}
+
+	const uint8_t* values = data_file.get_values();
+	const size_t data_items = data_item_count();
+	const size_t row_items = table_row_item_count();
+	//the table is zeroed, so only the ones of the labels are written
+	float* table = data_table.host_span().data;
+
+	auto convert_items = [=](size_t start, size_t end) {
+		for (size_t i = start; i < end; i++)
+		{
+			float* row = table + i * row_items;
+			cpu_bytes_to_float(values + i * data_items, row, data_items, 1.0f / 255.0f);
+			row[data_items + labels[i]] = 1;
+		}
+	};
+
+	const size_t thread_count = std::min(
+		std::max((size_t)1, (size_t)std::thread::hardware_concurrency()),
+		std::max((size_t)1, item_count));
+	const size_t items_per_thread = (item_count + thread_count - 1) / thread_count;
+
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < thread_count; t++)
+	{
+		const size_t start = std::min(item_count, t * items_per_thread);
+		const size_t end = std::min(item_count, start + items_per_thread);
+		threads.emplace_back(convert_items, start, end);
+	}
+	convert_items(0, std::min(item_count, items_per_thread));
+	for (auto& curr : threads)
+	{
+		curr.join();
+	}
+}
+
 data_space& data_space::operator=(const data_space& other)
 {
 	if (this != &other)
 	{
 		shuffle_table = other.shuffle_table;
+		device_shuffle_table = other.device_shuffle_table;
 		data_table = other.data_table;
+		storage_precision = other.storage_precision;
+		compact_table = other.compact_table;
 		data_format = other.data_format;
 		label_format = other.label_format;
 		item_count = other.item_count;
+		non_zero_rows = other.non_zero_rows;
+		non_zero_rows_valid = other.non_zero_rows_valid;
+
+		//the copy reads the shards on its own
+		stream.reset();
+		shard_order = other.shard_order;
+		shard_starts = other.shard_starts;
+		current_shard_position = other.current_shard_position;
+		shuffle_shards = other.shuffle_shards;
+		if (other.stream != nullptr)
+		{
+			stream = std::make_unique<shard_stream>(other.stream->get_shard_paths());
+			if (current_shard_position + 1 < shard_order.size())
+			{
+				stream->prefetch(shard_order[current_shard_position + 1]);
+			}
+		}
 	}
 	return *this;
 }
 
 bool data_space::is_in_gpu_mode() const
 {
+	if (is_compact())
+	{
+		return compact_table.is_in_gpu_mode();
+	}
 	return data_table.is_in_gpu_mode();
 }
 
 bool data_space::is_initialized() const
 {
+	if (is_compact())
+	{
+		return compact_table.item_count() != 0;
+	}
 	return data_table.item_count() != 0;
 }
 
@@ -147,18 +493,154 @@ vector3 data_space::get_label_format() const
 void data_space::shuffle()
 {
 	smart_assert(is_initialized());
+	if (order_frozen)
+	{
+		return;
+	}
 
 	std::random_device rd;
 	std::mt19937 generator(rd());
-	std::shuffle(shuffle_table.begin(), shuffle_table.end(), generator);
+
+	if (is_streaming())
+	{
+		std::unique_lock<std::shared_mutex> lock(table_mutex);
+		const size_t current_shard = shard_order[current_shard_position];
+		std::shuffle(shard_order.begin(), shard_order.end(), generator);
+		init_shard_starts();
+		shuffle_shards = true;
+
+		//the loaded shard is kept, only its position and the order inside of it change
+		current_shard_position = std::find(shard_order.begin(), shard_order.end(), current_shard) - shard_order.begin();
+		std::shuffle(shuffle_table.begin(), shuffle_table.end(), generator);
+
+		//the next epoch starts at the first position
+		const size_t next_position = current_shard_position == 0 ? 1 : 0;
+		if (next_position < shard_order.size())
+		{
+			stream->prefetch(shard_order[next_position]);
+		}
+		return;
+	}
+
+	std::vector<size_t> new_order;
+	{
+		std::shared_lock<std::shared_mutex> lock(table_mutex);
+		new_order = shuffle_table;
+	}
+	std::shuffle(new_order.begin(), new_order.end(), generator);
+
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
+	shuffle_table.swap(new_order);
+	if (device_shuffle_table.is_in_gpu_mode())
+	{
+		device_shuffle_table.set(shuffle_table);
+	}
+}
+
+void data_space::set_order_frozen(bool frozen)
+{
+	order_frozen = frozen;
+}
+
+bool data_space::is_order_frozen() const
+{
+	return order_frozen;
 }
 
 size_t data_space::byte_size() const
 {
 	smart_assert(is_initialized());
+	if (is_compact())
+	{
+		return compact_table.byte_size();
+	}
 	return data_table.item_count() * sizeof(float);
 }
 
+void data_space::set_storage_precision(e_precision_t precision)
+{
+	if (precision == storage_precision)
+	{
+		return;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
+
+	const bool gpu_mode = is_initialized() && is_in_gpu_mode();
+	const size_t table_item_count = table_row_item_count() * table_row_count();
+	//small values can be rounded to zero
+	non_zero_rows_valid = false;
+
+	if (precision == fp32_precision)
+	{
+		data_table = matrix(vector3(table_row_item_count(), table_row_count(), (size_t)1));
+		if (table_item_count != 0)
+		{
+			compact_table.get(data_table.host_span().data, 0, table_item_count);
+		}
+		compact_table = compact_buffer();
+		storage_precision = precision;
+		if (gpu_mode)
+		{
+			copy_to_gpu();
+		}
+		return;
+	}
+
+	compact_buffer new_table(table_item_count, precision);
+	if (table_item_count != 0)
+	{
+		if (is_compact())
+		{
+			//from one 16 bit format to the other
+			std::vector<float> values(table_item_count);
+			compact_table.get(values.data(), 0, table_item_count);
+			new_table.set(values.data(), 0, table_item_count);
+		}
+		else
+		{
+			data_table.sync_device_and_host();
+			new_table.set(data_table.host_span_readonly().data, 0, table_item_count);
+		}
+	}
+	data_table = matrix();
+	compact_table = new_table;
+	storage_precision = precision;
+	if (gpu_mode)
+	{
+		compact_table.enable_gpu_mode();
+	}
+}
+
+e_precision_t data_space::get_storage_precision() const
+{
+	return storage_precision;
+}
+
+bool data_space::item_has_non_zero_data(size_t idx)
+{
+	smart_assert(is_initialized());
+	smart_assert(idx < item_count);
+
+	if (!is_streaming())
+	{
+		std::shared_lock<std::shared_mutex> lock(table_mutex);
+		if (non_zero_rows_valid)
+		{
+			return non_zero_rows[shuffle_table[idx]] != 0;
+		}
+	}
+
+	//the mask is computed once, in streaming mode the shard of the item might be loaded first
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
+	const size_t row = table_row_of(idx);
+	if (!non_zero_rows_valid)
+	{
+		compute_non_zero_rows();
+	}
+	return non_zero_rows[row] != 0;
+}
+
 void data_space::observe_data_at_idx(matrix& observer_matrix, size_t idx)
 {
 	smart_assert(is_initialized());
@@ -169,8 +651,22 @@ void data_space::observe_data_at_idx(matrix& observer_matrix, size_t idx)
 	//if the observer matrix is owning a matrix, then it gets deleted
 	//it also handles gpu mode
 
-	std::lock_guard<std::mutex> lock(data_mutex); //this could be improved, because more than one thread can read at the same time
-	observer_matrix.observe_row(data_table, shuffle_table[idx]);
+	//in streaming mode the table can be replaced, so it is locked exclusively
+	std::shared_lock<std::shared_mutex> read_lock(table_mutex, std::defer_lock);
+	std::unique_lock<std::shared_mutex> stream_lock(table_mutex, std::defer_lock);
+	is_streaming() ? stream_lock.lock() : read_lock.lock();
+	const size_t table_row = table_row_of(idx);
+	if (is_compact())
+	{
+		decode_from_table(observer_matrix, 0, table_row * table_row_item_count(), data_item_count());
+		return;
+	}
+	if (is_streaming())
+	{
+		copy_from_table(observer_matrix, 0, table_row * table_row_item_count(), data_item_count());
+		return;
+	}
+	observer_matrix.observe_row(data_table, table_row);
 }
 
 void data_space::observe_label_at_idx(matrix& observer_matrix, size_t idx)
@@ -180,16 +676,90 @@ void data_space::observe_label_at_idx(matrix& observer_matrix, size_t idx)
 	smart_assert(idx < item_count);
 	smart_assert(vector3::are_equal(observer_matrix.get_format(), label_format));
 
-	std::lock_guard<std::mutex> lock(label_mutex);
-	observer_matrix.observe_row(data_table, shuffle_table[idx], data_item_count()); //this could be improved, because more than one thread can read at the same time
+	std::shared_lock<std::shared_mutex> read_lock(table_mutex, std::defer_lock);
+	std::unique_lock<std::shared_mutex> stream_lock(table_mutex, std::defer_lock);
+	is_streaming() ? stream_lock.lock() : read_lock.lock();
+	const size_t table_row = table_row_of(idx);
+	if (is_compact())
+	{
+		decode_from_table(
+			observer_matrix,
+			0,
+			table_row * table_row_item_count() + data_item_count(),
+			label_item_count());
+		return;
+	}
+	if (is_streaming())
+	{
+		copy_from_table(
+			observer_matrix,
+			0,
+			table_row * table_row_item_count() + data_item_count(),
+			label_item_count());
+		return;
+	}
+	observer_matrix.observe_row(data_table, table_row, data_item_count());
+}
+
+void data_space::get_batch(matrix& data_batch, matrix* label_batch, size_t start_idx)
+{
+	smart_assert(is_initialized());
+	smart_assert(data_batch.is_initialized());
+	smart_assert(data_batch.get_width() == data_item_count());
+	smart_assert(start_idx + data_batch.get_height() <= item_count);
+	smart_assert(label_batch == nullptr || label_batch->get_width() == label_item_count());
+	smart_assert(label_batch == nullptr || label_batch->get_height() == data_batch.get_height());
+
+	std::shared_lock<std::shared_mutex> read_lock(table_mutex, std::defer_lock);
+	std::unique_lock<std::shared_mutex> stream_lock(table_mutex, std::defer_lock);
+	is_streaming() ? stream_lock.lock() : read_lock.lock();
+	if (can_gather_on_device(data_batch, label_batch))
+	{
+		const uint32_t* row_indices = device_shuffle_table.get_device_ptr_readonly() + start_idx;
+		data_batch.set_rows_from_matrix_rows(data_table, row_indices, 0, data_item_count());
+		if (label_batch != nullptr)
+		{
+			label_batch->set_rows_from_matrix_rows(data_table, row_indices, data_item_count(), label_item_count());
+		}
+		return;
+	}
+	for (size_t batch_idx = 0; batch_idx < data_batch.get_height(); batch_idx++)
+	{
+		size_t table_idx = table_row_of(start_idx + batch_idx);
+		if (is_compact())
+		{
+			const size_t row_start = table_idx * table_row_item_count();
+			decode_from_table(data_batch, batch_idx * data_item_count(), row_start, data_item_count());
+			if (label_batch != nullptr)
+			{
+				decode_from_table(
+					*label_batch,
+					batch_idx * label_item_count(),
+					row_start + data_item_count(),
+					label_item_count());
+			}
+			continue;
+		}
+		data_batch.set_row_from_matrix_row(
+			data_table, table_idx, 0, batch_idx, data_item_count());
+		if (label_batch != nullptr)
+		{
+			label_batch->set_row_from_matrix_row(
+				data_table, table_idx, data_item_count(), batch_idx, label_item_count());
+		}
+	}
 }
 
 void data_space::set_data(const matrix& m, size_t idx)
 {
 	smart_assert(is_initialized());
 	smart_assert(idx < item_count);
+	if (is_streaming())
+	{
+		throw std::runtime_error("a streaming data space can not be changed");
+	}
 
-	std::lock_guard<std::mutex> lock(data_mutex);
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
 	set_data_in_table_at(m, shuffle_table[idx]);
 }
 
@@ -197,24 +767,110 @@ void data_space::set_label(const matrix& m, size_t idx)
 {
 	smart_assert(is_initialized());
 	smart_assert(idx < item_count);
+	if (is_streaming())
+	{
+		throw std::runtime_error("a streaming data space can not be changed");
+	}
 
-	std::lock_guard<std::mutex> lock(label_mutex);
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
 	set_label_in_table_at(m, shuffle_table[idx]);
 }
 
 void data_space::copy_to_gpu()
 {
 	smart_assert(is_initialized());
+	if (is_compact())
+	{
+		compact_table.enable_gpu_mode();
+		return;
+	}
 	data_table.enable_gpu_mode();
+	if (!is_streaming())
+	{
+		device_shuffle_table.set(shuffle_table);
+		device_shuffle_table.enable_gpu_mode();
+	}
+}
+
+void data_space::set_device_only(bool device_only)
+{
+	smart_assert(is_initialized());
+	if (!is_in_gpu_mode())
+	{
+		throw std::runtime_error("only a data space on the gpu can be device only");
+	}
+	if (is_streaming() || is_compact())
+	{
+		throw std::runtime_error("a streaming or compact data space keeps its host values");
+	}
+
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
+	data_table.set_device_only(device_only);
+}
+
+std::vector<std::string> data_space::save_shards(const std::string& path_prefix, size_t items_per_shard)
+{
+	smart_assert(is_initialized());
+	if (items_per_shard == 0)
+	{
+		throw std::invalid_argument("a shard needs at least one item");
+	}
+	if (is_streaming())
+	{
+		throw std::runtime_error("a streaming data space is already saved in shards");
+	}
+
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
+
+	if (!is_compact())
+	{
+		data_table.sync_device_and_host();
+	}
+
+	const size_t row_item_count = table_row_item_count();
+	std::vector<std::string> paths;
+	std::vector<float> values;
+	for (size_t start = 0; start < item_count; start += items_per_shard)
+	{
+		const size_t shard_item_count = std::min(items_per_shard, item_count - start);
+		values.resize(shard_item_count * row_item_count);
+		for (size_t i = 0; i < shard_item_count; i++)
+		{
+			const size_t table_idx = shuffle_table[start + i] * row_item_count;
+			float* row = values.data() + i * row_item_count;
+			if (is_compact())
+			{
+				compact_table.get(row, table_idx, row_item_count);
+			}
+			else
+			{
+				const float* table_values = data_table.host_span_readonly().data + table_idx;
+				std::copy(table_values, table_values + row_item_count, row);
+			}
+		}
+
+		paths.push_back(path_prefix + "_" + std::to_string(paths.size()) + ".shard");
+		shard_stream::write_shard(paths.back(), data_format, label_format, shard_item_count, values.data());
+	}
+	return paths;
 }
 
 void data_space::clear()
 {
 	smart_assert(is_initialized());
+	if (is_streaming())
+	{
+		throw std::runtime_error("a streaming data space can not be changed");
+	}
 	
-	std::lock_guard<std::mutex> lock1(label_mutex);
-	std::lock_guard<std::mutex> lock2(data_mutex);
+	std::unique_lock<std::shared_mutex> lock(table_mutex);
+	non_zero_rows_valid = false;
 
+	if (is_compact())
+	{
+		compact_table.set_all_zero();
+		return;
+	}
 	data_table.set_all(0);
 }
 
@@ -237,7 +893,10 @@ std::string data_space::to_string()
 		label_observer.enable_gpu_mode();
 	}
 
-	data_table.sync_device_and_host();
+	if (!is_compact())
+	{
+		data_table.sync_device_and_host();
+	}
 
 	for (int i = 0; i < item_count; i++)
 	{
@@ -1,6 +1,12 @@
 #pragma once
 #include "matrix.hpp"
+#include "compact_buffer.hpp"
+#include "shard_stream.hpp"
+#include "idx_file.hpp"
+#include "row_index_buffer.hpp"
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 
 class data_space
 {
@@ -28,13 +34,40 @@ private:
 		+-------------+-----+
 	*/
 	matrix data_table;
+	//the same table with 16 bits per value (see set_storage_precision)
+	//only one of both tables is allocated
+	e_precision_t storage_precision = fp32_precision;
+	compact_buffer compact_table;
 	std::vector<size_t> shuffle_table;
+	//the shuffle table on the device, get_batch gathers the rows of a batch with it in one kernel
+	//it is only used if the float table is on the gpu
+	row_index_buffer device_shuffle_table;
+
+	//streaming mode (see the shard constructor)
+	//the table only holds the current shard, the shuffle table is the order inside of it
+	std::unique_ptr<shard_stream> stream;
+	std::vector<size_t> shard_order;
+	//the index of the first item of every position in the shard order
+	std::vector<size_t> shard_starts;
+	size_t current_shard_position = 0;
+	bool shuffle_shards = false;
+
+	//shuffle does nothing while the order is frozen
+	bool order_frozen = false;
+	
+	//one value per table row, 1 if the data of the row has a value that is not zero
+	//it is computed for the whole table the first time it is needed
+	//(with one kernel if the table is only updated on the gpu) and again after the table changed
+	std::vector<uint8_t> non_zero_rows;
+	bool non_zero_rows_valid = false;
 	
 	vector3 data_format;
 	vector3 label_format;
 
-	std::mutex data_mutex;
-	std::mutex label_mutex;
+	//the observers and get_batch share the lock, so any number of threads can read at the same time
+	//only the methods that change the table or the order lock it exclusively
+	//in streaming mode reading can replace the table, so the readers lock it exclusively as well
+	std::shared_mutex table_mutex;
 
 	size_t label_item_count();
 	size_t data_item_count();
@@ -44,8 +77,31 @@ private:
 
 	void allocate_data_table();
 
+	bool is_compact() const;
+	size_t table_row_item_count();
+	//the number of items in the table, the items of the current shard in streaming mode
+	size_t table_row_count() const;
+	//encodes the values of the matrix into the compact table from the given table index on
+	void encode_into_table(const matrix& m, size_t table_idx);
+	//decodes count values from the compact table into the target matrix from target_idx on
+	void decode_from_table(matrix& target, size_t target_idx, size_t table_idx, size_t count);
+
 	void init_shuffle_table();
 
+	bool is_streaming() const;
+	//the row of the item in the table, loads the shard of the item in streaming mode
+	size_t table_row_of(size_t idx);
+	void init_shard_starts();
+	//replaces the table with the shard at this position of the shard order
+	//and starts reading the next one
+	void load_shard_at(size_t position);
+	//copies count values from the table into the target matrix from target_idx on
+	void copy_from_table(matrix& target, size_t target_idx, size_t table_idx, size_t count);
+	//table_mutex has to be locked exclusively
+	void compute_non_zero_rows();
+	//true if get_batch can gather the batch on the device
+	bool can_gather_on_device(const matrix& data_batch, const matrix* label_batch) const;
+
 public:
 	data_space();
 	data_space(size_t given_item_count, vector3 data_format);
@@ -60,6 +116,18 @@ public:
 		vector3 data_format,
 		const std::vector<matrix>& given_data);
 
+	//streams the items from shard files (see save_shards)
+	//only one shard is in memory, the next one is read on a background thread
+	//shuffle changes the order of the shards and the order inside of each shard.
+	//like in the compact mode the observers get a copy, so they have to own their data
+	//a streaming data space can not be changed
+	data_space(const std::vector<std::string>& shard_paths);
+
+	//reads the items of two idx files (for example the mnist data sets)
+	//the bytes are scaled to [0, 1] and every label becomes a one hot vector of the format (1, class_count, 1)
+	//the items are converted straight into the table on all hardware threads
+	data_space(const idx_file& data_file, const idx_file& label_file, size_t class_count);
+
 	data_space& operator=(const data_space& other);
 
 	bool is_initialized() const;
@@ -69,16 +137,49 @@ public:
 	vector3 get_data_format() const;
 	vector3 get_label_format() const;
 
+	//the new order is created without blocking the readers, it is only locked to swap it in
 	void shuffle();
+	//while the order is frozen shuffle does nothing, so trainings that share the data space
+	//read the same order and none of them changes it for the others (see sweep_runner)
+	//it should only be changed while no training reads the data space
+	void set_order_frozen(bool frozen);
+	bool is_order_frozen() const;
 
 	size_t byte_size() const;
 
+	//fp16 or bf16 halve the size of the table, the values are rounded once
+	//the matrices that observe the data then get a decoded copy instead of a view of the table
+	//so they have to own their data
+	void set_storage_precision(e_precision_t precision);
+	e_precision_t get_storage_precision() const;
+
+	//true if the data (not the label) of the item has a value that is not zero
+	//the answer comes from the mask of the whole table, so no item is copied for it
+	//(used by the zero check of the training)
+	bool item_has_non_zero_data(size_t idx);
+
 	void observe_data_at_idx(matrix& observer_matrix, size_t idx);
 	void observe_label_at_idx(matrix& observer_matrix, size_t idx);
+	//copies the data and labels of the items from start_idx on into the given batches
+	//every row of a batch is one item. the batches have the format (item count, batch size, 1)
+	//the label batch can be null if only the data is needed
+	//if the table and the batches are on the gpu, the rows are gathered in one kernel per batch
+	void get_batch(matrix& data_batch, matrix* label_batch, size_t start_idx);
 	void set_data(const matrix& m, size_t idx);
 	void set_label(const matrix& m, size_t idx);
 
+	//in streaming mode only the current shard is on the gpu
 	void copy_to_gpu();
+	//the table is only kept on the device after it was copied to the gpu (see matrix::set_device_only)
+	//the items are observed and gathered on the device, reading them on the host
+	//(to_string, save_shards) allocates the host table again
+	//a streaming or compact data space keeps its host values, this throws for them
+	void set_device_only(bool device_only);
+
+	//writes the items in their current order into shard files
+	//path_prefix_0.shard, path_prefix_1.shard... the last one can have fewer items
+	//returns the paths of the files
+	std::vector<std::string> save_shards(const std::string& path_prefix, size_t items_per_shard);
 
 	void clear();
 
@@ -10,11 +10,79 @@ enum _pooling_type
 typedef enum _layer_type {
 	convolutional,
 	pooling,
-	fully_connected
+	fully_connected,
+	//int8 inference layers (see quantized_layer)
+	quantized_fully_connected,
+	quantized_convolutional,
+	//pruned fully connected layer with csr weights (see sparse_layer)
+	sparse_fully_connected,
+	//not a layer, tags the profile records of the optimizer step of the whole network
+	network_optimizer
 } e_layer_type_t;
 
 enum _activation {
 	sigmoid_fn = 0,
 	relu_fn = 1,
-	leaky_relu_fn = 2
+	leaky_relu_fn = 2,
+	//only for the last fully connected layer, the outputs of every item sum up to 1
+	//the cost of the network is then the cross entropy
+	softmax_fn = 3
 } typedef e_activation_t;
+//the cost the error of the last layer is the gradient of
+enum _cost_function {
+	squared_error_cost = 0,
+	//of a softmax output, the error is the gradient of the values before the softmax
+	cross_entropy_cost = 1
+} typedef e_cost_function_t;
+
+enum _gpu_backend {
+	native_backend = 0,
+	cublas_backend = 1,
+	cudnn_backend = 2
+} typedef e_gpu_backend_t;
+enum _optimizer {
+	sgd_optimizer = 0,
+	momentum_optimizer = 1,
+	nesterov_optimizer = 2,
+	adam_optimizer = 3,
+	adamw_optimizer = 4
+} typedef e_optimizer_t;
+enum _precision {
+	fp32_precision = 0,
+	fp16_precision = 1,
+	bf16_precision = 2
+} typedef e_precision_t;
+enum _conv_strategy {
+	direct_conv = 0,
+	im2col_conv = 1,
+	winograd_conv = 2
+} typedef e_conv_strategy_t;
+//the kernel size and stride of a convolution or pooling that has a kernel
+//with the loops unrolled at compile time (see conv_select_fixed_kernel)
+enum _fixed_kernel {
+	generic_kernel = 0,
+	kernel_1x1_s1 = 1,
+	kernel_3x3_s1 = 2,
+	kernel_3x3_s2 = 3,
+	kernel_5x5_s1 = 4,
+	kernel_5x5_s2 = 5,
+	//only used by the pooling
+	kernel_2x2_s2 = 6
+} typedef e_fixed_kernel_t;
+//how the values of a matrix (width, height, depth) are ordered in memory
+enum _tensor_layout {
+	//planar - every depth is one contiguous plane, the width changes fastest
+	chw_layout = 0,
+	//interleaved - the depth values of one position are contiguous, the depth changes fastest
+	hwc_layout = 1
+} typedef e_tensor_layout_t;
+enum _tensor_type {
+	float32_tensor = 0,
+	int8_tensor = 1,
+	uint32_tensor = 2
+} typedef e_tensor_type_t;
+enum _profile_phase {
+	forward_phase = 0,
+	backward_phase = 1,
+	apply_deltas_phase = 2
+} typedef e_profile_phase_t;
@@ -1,4 +1,7 @@
 #include "fully_connected_layer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 fully_connected_layer::fully_connected_layer(
 	size_t number_of_neurons,
@@ -34,6 +37,20 @@ fully_connected_layer::fully_connected_layer(std::ifstream& file)
 	bias_momentum = matrix(biases.get_format());
 }
 
+fully_connected_layer::fully_connected_layer(model_reader& reader)
+	:layer(reader, e_layer_type_t::fully_connected)
+{
+	activation_fn = (e_activation_t)reader.read_u32();
+	weights = matrix(reader);
+	biases = matrix(reader);
+
+	weight_deltas = matrix(weights.get_format());
+	bias_deltas = matrix(biases.get_format());
+
+	weight_momentum = matrix(weights.get_format());
+	bias_momentum = matrix(biases.get_format());
+}
+
 fully_connected_layer::fully_connected_layer(
 	const fully_connected_layer& other
 ) :
@@ -47,11 +64,39 @@ fully_connected_layer::fully_connected_layer(
 	bias_momentum(other.bias_momentum, false) //du not copy the momentum
 {}
 
+fully_connected_layer::fully_connected_layer(
+	const fully_connected_layer& parameter_source,
+	share_parameters_t shared
+) :
+	layer(parameter_source),
+	activation_fn(parameter_source.activation_fn)
+{
+	weights.observe(parameter_source.weights);
+	biases.observe(parameter_source.biases);
+	if (!shared.with_deltas)
+	{
+		inference_only = true;
+		return;
+	}
+	weight_deltas = matrix(weights.get_format());
+	bias_deltas = matrix(biases.get_format());
+}
+
 std::unique_ptr<layer> fully_connected_layer::clone() const
 {
 	return std::make_unique<fully_connected_layer>(*this);
 }
 
+std::unique_ptr<layer> fully_connected_layer::clone_instance() const
+{
+	return std::make_unique<fully_connected_layer>(*this, share_parameters_t());
+}
+
+std::unique_ptr<layer> fully_connected_layer::clone_workspace() const
+{
+	return std::make_unique<fully_connected_layer>(*this, share_parameters_t{ true });
+}
+
 size_t fully_connected_layer::get_parameter_count() const
 {
 	return weights.item_count() + biases.item_count();
@@ -80,6 +125,16 @@ const matrix& fully_connected_layer::get_biases() const
 	return biases;
 }
 
+e_activation_t fully_connected_layer::get_activation_function() const
+{
+	return activation_fn;
+}
+
+e_cost_function_t fully_connected_layer::get_cost_function() const
+{
+	return activation_fn == softmax_fn ? cross_entropy_cost : squared_error_cost;
+}
+
 matrix& fully_connected_layer::get_weights_ref()
 {
 	return weights;
@@ -116,6 +171,39 @@ void fully_connected_layer::mutate(float range)
 	}
 }
 
+void fully_connected_layer::prune_weights(float sparsity)
+{
+	smart_assert(sparsity >= 0.0f && sparsity <= 1.0f);
+
+	const size_t column_count = weights.get_width();
+	const size_t pruned_count = (size_t)std::round(sparsity * column_count);
+	if (pruned_count == 0)
+	{
+		return;
+	}
+
+	float* values = weights.host_span().data;
+	std::vector<size_t> order(column_count);
+	for (size_t row = 0; row < weights.get_height(); row++)
+	{
+		float* row_values = values + row * column_count;
+		for (size_t i = 0; i < column_count; i++)
+		{
+			order[i] = i;
+		}
+		//the first pruned_count columns are the ones with the smallest absolute values
+		std::nth_element(
+			order.begin(),
+			order.begin() + (pruned_count - 1),
+			order.end(),
+			[row_values](size_t a, size_t b) { return std::abs(row_values[a]) < std::abs(row_values[b]); });
+		for (size_t i = 0; i < pruned_count; i++)
+		{
+			row_values[order[i]] = 0.0f;
+		}
+	}
+}
+
 std::string fully_connected_layer::parameter_analysis() const
 {
 	std::string ret_val = layer::parameter_analysis();
@@ -140,21 +228,52 @@ void fully_connected_layer::forward_propagation(const matrix& input)
 {
 	layer::forward_propagation(input);
 
-	matrix::dot_product_flat(weights, input, activations);
-	matrix::add_flat(activations, biases, activations);
-	activations.apply_activation_function(activation_fn);
+	//the weights belong to the planar order of the input
+	matrix::dot_product_bias_activate(weights, input_in_layout(input, chw_layout), biases, activations, activation_fn);
 }
 
 void fully_connected_layer::back_propagation(const matrix& input, matrix* passing_error)
 {
 	layer::back_propagation(input, passing_error);
 
+	matrix* planar_passing_error = passing_error_in_layout(passing_error, chw_layout);
+
 	matrix::fully_connected_backprop(
 		activations,
 		weights,
-		input,
+		input_in_layout(input, chw_layout),
 		error,
-		passing_error,
+		planar_passing_error,
+		weight_deltas,
+		bias_deltas,
+		activation_fn
+	);
+
+	write_passing_error(passing_error, planar_passing_error);
+}
+
+bool fully_connected_layer::supports_batch_propagation() const
+{
+	return true;
+}
+
+void fully_connected_layer::forward_propagation_batch(const matrix& input_batch)
+{
+	layer::forward_propagation_batch(input_batch);
+
+	matrix::dot_product_batch_bias_activate(weights, input_batch, biases, batch_activations, activation_fn);
+}
+
+void fully_connected_layer::back_propagation_batch(const matrix& input_batch, matrix* passing_error_batch)
+{
+	layer::back_propagation_batch(input_batch, passing_error_batch);
+
+	matrix::fully_connected_backprop_batch(
+		batch_activations,
+		weights,
+		input_batch,
+		batch_error,
+		passing_error_batch,
 		weight_deltas,
 		bias_deltas,
 		activation_fn
@@ -167,16 +286,59 @@ void fully_connected_layer::apply_deltas(size_t training_data_count, float learn
 	weights.apply_deltas(weight_deltas, weight_momentum, training_data_count, learning_rate);
 }
 
+void fully_connected_layer::accumulate_deltas(layer& other)
+{
+	layer::accumulate_deltas(other);
+
+	fully_connected_layer& other_casted = dynamic_cast<fully_connected_layer&>(other);
+
+	matrix::add(weight_deltas, other_casted.weight_deltas, weight_deltas);
+	matrix::add(bias_deltas, other_casted.bias_deltas, bias_deltas);
+
+	other_casted.weight_deltas.set_all(0);
+	other_casted.bias_deltas.set_all(0);
+}
+
+void fully_connected_layer::collect_parameters(
+	std::vector<matrix*>& parameters,
+	std::vector<matrix*>& deltas,
+	std::vector<matrix*>& momentum)
+{
+	parameters.push_back(&weights);
+	deltas.push_back(&weight_deltas);
+	momentum.push_back(&weight_momentum);
+	parameters.push_back(&biases);
+	deltas.push_back(&bias_deltas);
+	momentum.push_back(&bias_momentum);
+}
+
+void fully_connected_layer::release_training_buffers()
+{
+	layer::release_training_buffers();
+
+	weight_deltas = matrix();
+	bias_deltas = matrix();
+	weight_momentum = matrix();
+	bias_momentum = matrix();
+}
+
 void fully_connected_layer::enable_gpu_mode()
 {
 	layer::enable_gpu_mode();
 
 	weights.enable_gpu_mode();
 	biases.enable_gpu_mode();
-	weight_deltas.enable_gpu_mode();
-	bias_deltas.enable_gpu_mode();
-	weight_momentum.enable_gpu_mode();
-	bias_momentum.enable_gpu_mode();
+	//an instance has no deltas or momentum, a workspace has no momentum
+	if (weight_deltas.is_initialized())
+	{
+		weight_deltas.enable_gpu_mode();
+		bias_deltas.enable_gpu_mode();
+	}
+	if (weight_momentum.is_initialized())
+	{
+		weight_momentum.enable_gpu_mode();
+		bias_momentum.enable_gpu_mode();
+	}
 }
 
 void fully_connected_layer::disable_gpu()
@@ -233,3 +395,11 @@ void fully_connected_layer::write_to_ofstream(std::ofstream& file) const
 	weights.write_to_ofstream(file);
 	biases.write_to_ofstream(file);
 }
+
+void fully_connected_layer::write_to_model(model_writer& writer) const
+{
+	layer::write_to_model(writer);
+	writer.write_u32(activation_fn);
+	weights.write_to_model(writer);
+	biases.write_to_model(writer);
+}
@@ -31,9 +31,17 @@ public:
 	fully_connected_layer(
 		std::ifstream& file);
 
+	fully_connected_layer(
+		model_reader& reader);
+
 	fully_connected_layer(const fully_connected_layer& other);
+	//the weights and biases observe the ones of the parameter source
+	//the momentum is not allocated, the deltas only with_deltas (see clone_instance and clone_workspace)
+	fully_connected_layer(const fully_connected_layer& parameter_source, share_parameters_t shared);
 
 	std::unique_ptr<layer> clone() const override;
+	std::unique_ptr<layer> clone_instance() const override;
+	std::unique_ptr<layer> clone_workspace() const override;
 
 	size_t get_parameter_count() const override;
 
@@ -43,6 +51,9 @@ public:
 	const matrix& get_biases() const;
 	matrix& get_weights_ref();
 	matrix& get_biases_ref();
+	e_activation_t get_activation_function() const;
+	//the cross entropy for a softmax output
+	e_cost_function_t get_cost_function() const override;
 
 	//set all weights and biases to that value
 	void set_all_parameters(float value) override;
@@ -50,6 +61,9 @@ public:
 	void apply_noise(float range) override;
 	//add a random value between range and -range to one weight or bias 
 	void mutate(float range) override;
+	//magnitude pruning, sets the smallest share of the weights of every neuron to zero
+	//every neuron keeps the same number of weights, so the rows of the sparse layer have the same length
+	void prune_weights(float sparsity);
 
 	std::string parameter_analysis() const override;
 
@@ -58,7 +72,18 @@ public:
 	void forward_propagation(const matrix& input) override;
 	void back_propagation(const matrix& input, matrix* passing_error) override;
 
+	bool supports_batch_propagation() const override;
+	void forward_propagation_batch(const matrix& input_batch) override;
+	void back_propagation_batch(const matrix& input_batch, matrix* passing_error_batch) override;
+
 	void apply_deltas(size_t training_data_count, float learning_rate) override;
+	void accumulate_deltas(layer& other) override;
+	void collect_parameters(
+		std::vector<matrix*>& parameters,
+		std::vector<matrix*>& deltas,
+		std::vector<matrix*>& momentum) override;
+
+	void release_training_buffers() override;
 
 	void enable_gpu_mode() override;
 	void disable_gpu() override;
@@ -68,4 +93,5 @@ public:
 	void set_parameters(const layer& other) override;
 
 	void write_to_ofstream(std::ofstream& file) const override;
+	void write_to_model(model_writer& writer) const override;
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "gpu_graph.hpp"
+#include <stdexcept>
+#include <string>
+
+gpu_graph::gpu_graph()
+{}
+
+gpu_graph::~gpu_graph()
+{
+	reset();
+}
+
+bool gpu_graph::capture(cudaStream_t stream, const std::function<void()>& work)
+{
+	reset();
+
+	//thread local - only the calls of this thread that can not be captured make the capture fail
+	if (cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal) != cudaSuccess)
+	{
+		cudaGetLastError();
+		return false;
+	}
+
+	bool work_done = true;
+	try
+	{
+		work();
+	}
+	catch (const std::exception&)
+	{
+		//a call that can not be captured reports its error here
+		work_done = false;
+	}
+
+	cudaGraph_t graph = nullptr;
+	const cudaError_t end_error = cudaStreamEndCapture(stream, &graph);
+	if (!work_done || end_error != cudaSuccess || graph == nullptr)
+	{
+		if (graph != nullptr)
+		{
+			cudaGraphDestroy(graph);
+		}
+		//the capture errors are not sticky, they are cleared so the next kernel does not report them
+		cudaGetLastError();
+		return false;
+	}
+
+	const cudaError_t instantiate_error = cudaGraphInstantiateWithFlags(&graph_exec, graph, 0);
+	//the executable graph is independent of the captured one
+	cudaGraphDestroy(graph);
+	if (instantiate_error != cudaSuccess)
+	{
+		graph_exec = nullptr;
+		cudaGetLastError();
+		return false;
+	}
+	return true;
+}
+
+bool gpu_graph::is_captured() const
+{
+	return graph_exec != nullptr;
+}
+
+void gpu_graph::launch(cudaStream_t stream) const
+{
+	if (!is_captured())
+	{
+		throw std::runtime_error("the graph has not been captured");
+	}
+	cudaError_t error = cudaGraphLaunch(graph_exec, stream);
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("could not launch cuda graph: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+void gpu_graph::reset()
+{
+	if (graph_exec != nullptr)
+	{
+		cudaGraphExecDestroy(graph_exec);
+		graph_exec = nullptr;
+	}
+}
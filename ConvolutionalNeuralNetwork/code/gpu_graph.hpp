@@ -0,0 +1,33 @@
+#pragma once
+#include <functional>
+#include "cuda_runtime.h"
+
+/*
+	the gpu work a function enqueues on a stream, captured once into a cuda graph
+
+	a replay launches all captured kernels and copies with one call,
+	with the same arguments and the same buffers as during the capture.
+	the host code of the function is not run again, so it may only be captured
+	if it enqueues the same work every time (no changing kernel arguments, no allocations,
+	no synchronization with the host)
+*/
+class gpu_graph {
+private:
+	cudaGraphExec_t graph_exec = nullptr;
+public:
+	gpu_graph();
+	~gpu_graph();
+
+	gpu_graph(const gpu_graph&) = delete;
+	gpu_graph& operator=(const gpu_graph&) = delete;
+
+	//runs the host code of the work once and records its gpu work instead of running it
+	//the work has to use the given stream as its current stream
+	//returns false if the work could not be captured (for example because it synchronizes),
+	//then none of its gpu work was run
+	bool capture(cudaStream_t stream, const std::function<void()>& work);
+	bool is_captured() const;
+	//enqueues the captured work on the stream
+	void launch(cudaStream_t stream) const;
+	void reset();
+};
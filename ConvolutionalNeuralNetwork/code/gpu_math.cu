@@ -1,7 +1,36 @@
 #include "gpu_math.cuh"
+#include "profiler.hpp"
+#include <map>
+#include <memory>
+
+#ifdef CNN_USE_CUBLAS
+#include <cublas_v2.h>
+#endif
+#ifdef CNN_USE_CUDNN
+#include <cudnn.h>
+#endif
 
 #define THREADS_PER_BLOCK 1024
 
+#define WARP_SIZE 32
+//the warp per row kernels use 8 warps per block
+#define ROWS_PER_BLOCK 8
+#define ROW_BLOCK_SIZE (WARP_SIZE * ROWS_PER_BLOCK)
+//the tiled batch kernels use square tiles (TILE_SIZE x TILE_SIZE threads per block)
+#define TILE_SIZE 16
+
+//define this to synchronize the stream after every kernel
+//this makes it easier to find the kernel that caused an error
+//#define GPU_SYNC_AFTER_KERNEL
+
+//every thread has its own current stream
+//kernels and copies are enqueued on it
+//0 is the legacy default stream
+static thread_local cudaStream_t current_stream = 0;
+//every thread has its own current backend as well
+//the native kernels are used if a library call is not available
+static thread_local e_gpu_backend_t current_backend = native_backend;
+
 static unsigned int get_block_count(unsigned int size)
 {
 	//if we have 1024 elements, we need 1 block
@@ -11,6 +40,17 @@ static unsigned int get_block_count(unsigned int size)
 	return ((size - 1) / THREADS_PER_BLOCK) + 1;
 }
 
+//if every row is processed by one warp
+static unsigned int get_row_block_count(unsigned int row_count)
+{
+	return ((row_count - 1) / ROWS_PER_BLOCK) + 1;
+}
+
+static unsigned int get_tile_count(unsigned int size)
+{
+	return ((size - 1) / TILE_SIZE) + 1;
+}
+
 static void cuda_error_check()
 {
 	cudaError_t cudaStatus = cudaGetLastError();
@@ -22,171 +62,338 @@ static void cuda_error_check()
 }
 static void cuda_sync()
 {
-	cudaError_t cudaStatus = cudaDeviceSynchronize();
+	cudaError_t cudaStatus = cudaStreamSynchronize(current_stream);
 	if (cudaStatus != cudaSuccess)
 	{
 		std::string cuda_status = cudaGetErrorString(cudaStatus);
-		throw std::runtime_error("could not sync cuda device cuda status:" + cuda_status);
+		throw std::runtime_error("could not sync cuda stream cuda status:" + cuda_status);
 	}
 }
 
+//checking for launch errors does not block the host
+//errors that occur while the kernel is running are reported at the next sync point
 static void check_for_error_and_synchronize()
 {
 	cuda_error_check();
+#ifdef GPU_SYNC_AFTER_KERNEL
 	cuda_sync();
+#endif
 }
 
-__device__ int get_idx(int x, int y, int z, int height, int width)
+void gpu_set_current_stream(cudaStream_t stream)
 {
-	return x + y * width + z * width * height;
+	current_stream = stream;
 }
 
-__device__ int get_z(int idx, int height, int width)
+cudaStream_t gpu_get_current_stream()
 {
-	return idx / (width * height);
+	return current_stream;
 }
 
-__device__ int get_y(int idx, int height, int width)
+void gpu_sync_current_stream()
 {
-	return (idx - get_z(idx, height, width) * width * height) / width;
+	cuda_sync();
+	cuda_error_check();
 }
 
-__device__ int get_x(int idx, int height, int width)
+void gpu_set_current_backend(e_gpu_backend_t backend)
 {
-	return idx - get_z(idx, height, width) * width * height - get_y(idx, height, width) * width;
+	if (!gpu_backend_available(backend))
+	{
+		throw std::invalid_argument("this gpu backend was not compiled in");
+	}
+	current_backend = backend;
 }
 
-__device__ float gpu_single_sigmoid(float x)
+e_gpu_backend_t gpu_get_current_backend()
 {
-	return 1 / (1 + exp(-x));
+	return current_backend;
+}
+
+bool gpu_backend_available(e_gpu_backend_t backend)
+{
+	switch (backend)
+	{
+	case native_backend:
+		return true;
+	case cublas_backend:
+#ifdef CNN_USE_CUBLAS
+		return true;
+#else
+		return false;
+#endif
+	case cudnn_backend:
+		//the cudnn backend uses cublas for everything that is not a convolution
+#if defined(CNN_USE_CUDNN) && defined(CNN_USE_CUBLAS)
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
 }
 
-__device__ float gpu_single_relu(float x)
+gpu_stream_guard::gpu_stream_guard(cudaStream_t stream)
+	:gpu_stream_guard(stream, current_backend)
+{}
+
+gpu_stream_guard::gpu_stream_guard(cudaStream_t stream, e_gpu_backend_t backend)
+	:previous_stream(current_stream),
+	previous_backend(current_backend)
 {
-	return x > 0 ? x : 0;
+	current_stream = stream;
+	current_backend = backend;
 }
 
-__device__ float gpu_single_leaky_relu(float x)
+gpu_stream_guard::~gpu_stream_guard()
 {
-	return x > 0 ? x : LEAKY_RELU_FACTOR * x;
+	current_stream = previous_stream;
+	current_backend = previous_backend;
 }
 
-//not clean, but it has to do for now
-__device__ float gpu_single_activation(float x, int function_idx)
+//device memory that is reused by the calls of one thread
+//it only grows. if it is used on a different stream than before
+//the old stream is synchronized first, so the memory is not overwritten while in use
+class gpu_scratch_buffer {
+private:
+	float* data = nullptr;
+	size_t capacity = 0;
+	cudaStream_t last_stream = 0;
+public:
+	~gpu_scratch_buffer()
+	{
+		if (data != nullptr)
+		{
+			cudaFree(data);
+		}
+	}
+	float* get(size_t item_count)
+	{
+		if (last_stream != current_stream)
+		{
+			cudaStreamSynchronize(last_stream);
+			last_stream = current_stream;
+		}
+		if (item_count > capacity)
+		{
+			if (data != nullptr)
+			{
+				cudaFree(data);
+			}
+			cudaMalloc(&data, item_count * sizeof(float));
+			cuda_error_check();
+			capacity = item_count;
+		}
+		return data;
+	}
+};
+
+#ifdef CNN_USE_CUBLAS
+static void cublas_check(cublasStatus_t status)
 {
-	if (function_idx == 0)
+	if (status != CUBLAS_STATUS_SUCCESS)
 	{
-		return gpu_single_sigmoid(x);
+		throw std::runtime_error("cublas error: " + std::to_string((int)status));
 	}
-	else if (function_idx == 1)
+}
+
+class cublas_handle_holder {
+public:
+	cublasHandle_t handle = nullptr;
+	cublas_handle_holder()
 	{
-		return gpu_single_relu(x);
+		cublas_check(cublasCreate(&handle));
 	}
-	else if (function_idx == 2)
+	~cublas_handle_holder()
 	{
-		return gpu_single_leaky_relu(x);
+		cublasDestroy(handle);
 	}
-	else
+};
+
+//one handle per thread, it is bound to the current stream before every use
+static cublasHandle_t get_cublas_handle()
+{
+	static thread_local cublas_handle_holder holder;
+	cublas_check(cublasSetStream(holder.handle, current_stream));
+	return holder.handle;
+}
+#endif
+
+#ifdef CNN_USE_CUDNN
+static void cudnn_check(cudnnStatus_t status)
+{
+	if (status != CUDNN_STATUS_SUCCESS)
 	{
-		printf("single_activation not implemented");
-		return 0;
+		throw std::runtime_error("cudnn error: " + std::string(cudnnGetErrorString(status)));
 	}
 }
 
-__device__ float gpu_single_sigmoid_derivative(float x)
+class cudnn_handle_holder {
+public:
+	cudnnHandle_t handle = nullptr;
+	cudnn_handle_holder()
+	{
+		cudnn_check(cudnnCreate(&handle));
+	}
+	~cudnn_handle_holder()
+	{
+		cudnnDestroy(handle);
+	}
+};
+
+static cudnnHandle_t get_cudnn_handle()
 {
-	float sigmoid = gpu_single_sigmoid(x);
-	return sigmoid * (1 - sigmoid);
+	static thread_local cudnn_handle_holder holder;
+	cudnn_check(cudnnSetStream(holder.handle, current_stream));
+	return holder.handle;
 }
+#endif
 
-__device__ float gpu_single_relu_derivative(float x)
+static bool use_cublas()
 {
-	return x > 0 ? 1 : 0;
+#ifdef CNN_USE_CUBLAS
+	return current_backend == cublas_backend || current_backend == cudnn_backend;
+#else
+	return false;
+#endif
 }
 
-__device__ float gpu_single_leaky_relu_derivative(float x)
+static bool use_cudnn()
 {
-	return x > 0 ? 1 : LEAKY_RELU_FACTOR;
+#ifdef CNN_USE_CUDNN
+	return current_backend == cudnn_backend;
+#else
+	return false;
+#endif
 }
 
-//not clean, but it has to do for now
-__device__ float gpu_single_derivative(float x, int function_idx)
+//sums up the values of all threads in a warp
+//the result is only valid in the first thread of the warp
+__device__ float warp_reduce_sum(float value)
 {
-	if (function_idx == 0)
+	for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
 	{
-		return gpu_single_sigmoid_derivative(x);
+		value += __shfl_down_sync(0xffffffff, value, offset);
 	}
-	else if (function_idx == 1)
-	{
-		return gpu_single_relu_derivative(x);
-	}
-	else if (function_idx == 2)
+	return value;
+}
+
+//the maximum of all threads in a warp, the result is valid in every thread
+__device__ float warp_all_reduce_max(float value)
+{
+	for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
 	{
-		return gpu_single_leaky_relu_derivative(x);
+		value = fmaxf(value, __shfl_xor_sync(0xffffffff, value, offset));
 	}
-	else
+	return value;
+}
+
+//the sum of all threads in a warp, the result is valid in every thread
+__device__ float warp_all_reduce_sum(float value)
+{
+	for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
 	{
-		printf("single_derivative not implemented");
-		return 0;
+		value += __shfl_xor_sync(0xffffffff, value, offset);
 	}
+	return value;
+}
+
+__device__ int get_idx(int x, int y, int z, int height, int width)
+{
+	return x + y * width + z * width * height;
+}
+
+__device__ int get_z(int idx, int height, int width)
+{
+	return idx / (width * height);
 }
 
-__device__ float gpu_single_sigmoid_inverse(float x)
+__device__ int get_y(int idx, int height, int width)
 {
-	return log(x / (1 - x));
+	return (idx - get_z(idx, height, width) * width * height) / width;
 }
 
-__device__ float gpu_single_relu_inverse(float x)
+__device__ int get_x(int idx, int height, int width)
 {
-	printf("gpu_single_relu_inverse not implemented");
-	return x;
+	return idx - get_z(idx, height, width) * width * height - get_y(idx, height, width) * width;
 }
 
-__device__ float gpu_single_leaky_relu_inverse(float x)
+//the interleaved layout (hwc) keeps the depth of every position together
+__device__ int get_interleaved_idx(int x, int y, int z, int width, int depth)
 {
-	return x > 0 ? x : x / LEAKY_RELU_FACTOR;
+	return z + x * depth + y * width * depth;
 }
 
-//not clean, but it has to do for now
-__device__ float gpu_single_inverse(float x, int function_idx)
+__device__ void get_position(int idx, int width, int height, int depth, bool interleaved, int& x, int& y, int& z)
 {
-	if (function_idx == 0)
-	{
-		return gpu_single_sigmoid_inverse(x);
-	}
-	else if (function_idx == 1)
-	{
-		return gpu_single_relu_inverse(x);
-	}
-	else if (function_idx == 2)
+	if (interleaved)
 	{
-		return gpu_single_leaky_relu_inverse(x);
+		z = idx % depth;
+		x = (idx / depth) % width;
+		y = idx / (depth * width);
 	}
 	else
 	{
-		printf("single_inverse not implemented");
-		return 0;
+		x = get_x(idx, height, width);
+		y = get_y(idx, height, width);
+		z = get_z(idx, height, width);
 	}
 }
 
+__device__ int get_layout_idx(int x, int y, int z, int width, int height, int depth, bool interleaved)
+{
+	return interleaved ?
+		get_interleaved_idx(x, y, z, width, depth) :
+		get_idx(x, y, z, height, width);
+}
+
+//the activation functions come from the activation_traits (math_functions.hpp)
+//every element wise kernel is templated on them,
+//so the function is chosen once per launch and not once per element
+
+//every warp computes one activation
+//the threads of the warp read neighbouring weights of the same row (coalesced)
+//the input is staged in shared memory, because all warps of the block use it
+//the bias (if there are biases) and the activation are applied before the result is written
+//the plain dot product uses no_activation_traits, the softmax normalizes in a second pass
+template<typename activation_t>
 __global__ void gpu_dot_product_kernel(
 	const float* weights,
 	const float* input,
 	const int input_size,
+	const float* biases,
 	float* activations,
 	const int activations_size)
 {
-	unsigned int activation_idx = blockIdx.x * blockDim.x + threadIdx.x;
-	if (activation_idx < activations_size)
+	__shared__ float input_tile[ROW_BLOCK_SIZE];
+
+	const int lane = threadIdx.x % WARP_SIZE;
+	const int activation_idx = blockIdx.x * ROWS_PER_BLOCK + threadIdx.x / WARP_SIZE;
+
+	float sum = 0;
+	for (int tile_start = 0; tile_start < input_size; tile_start += ROW_BLOCK_SIZE)
 	{
-		float sum = 0;
-		for (int i = 0; i < input_size; i++)
+		const int input_idx = tile_start + threadIdx.x;
+		input_tile[threadIdx.x] = input_idx < input_size ? input[input_idx] : 0;
+		__syncthreads();
+
+		if (activation_idx < activations_size)
 		{
-			int weight_idx = get_idx(i, activation_idx, 0,
-				activations_size, input_size);
-			sum += weights[weight_idx] * input[i];
+			const float* weight_row = weights + activation_idx * input_size + tile_start;
+			const int tile_size = min(ROW_BLOCK_SIZE, input_size - tile_start);
+			for (int i = lane; i < tile_size; i += WARP_SIZE)
+			{
+				sum += weight_row[i] * input_tile[i];
+			}
 		}
-		activations[activation_idx] = sum;
+		__syncthreads();
+	}
+
+	sum = warp_reduce_sum(sum);
+	if (activation_idx < activations_size && lane == 0)
+	{
+		const float bias = biases == nullptr ? 0.0f : biases[activation_idx];
+		activations[activation_idx] = activation_t::activate(sum + bias);
 	}
 }
 
@@ -205,20 +412,278 @@ void gpu_dot_product(
 
 	smart_assert(gpu_activations.item_count() * gpu_input.item_count() == gpu_weights.item_count());
 
+#ifdef CNN_USE_CUBLAS
+	if (use_cublas())
+	{
+		//cublas is column major. the row major weights (input x activations)
+		//are the transposed column major matrix
+		const float alpha = 1;
+		const float beta = 0;
+		cublas_check(cublasSgemv(
+			get_cublas_handle(),
+			CUBLAS_OP_T,
+			(int)gpu_input.item_count(),
+			(int)gpu_activations.item_count(),
+			&alpha,
+			gpu_weights.get_device_ptr_readonly(),
+			(int)gpu_input.item_count(),
+			gpu_input.get_device_ptr_readonly(), 1,
+			&beta,
+			gpu_activations.get_device_ptr(), 1));
+		return;
+	}
+#endif
 
 	unsigned int size = gpu_activations.item_count();
-	unsigned int block_count = get_block_count(size);
-	cuda_sync();
-	gpu_dot_product_kernel << < block_count, THREADS_PER_BLOCK >> > (
+	profiler_count_kernel_launch();
+	gpu_dot_product_kernel<no_activation_traits> << <get_row_block_count(size), ROW_BLOCK_SIZE, 0, current_stream >> > (
 		gpu_weights.get_device_ptr_readonly(),
 		gpu_input.get_device_ptr_readonly(),
 		gpu_input.item_count(),
+		nullptr,
 		gpu_activations.get_device_ptr(),
 		gpu_activations.item_count());
 
 	check_for_error_and_synchronize();
 }
 
+//defined with the activation kernels
+static void gpu_add_bias_softmax(float* data, const float* biases, size_t row_width, size_t count);
+
+void gpu_dot_product_bias_activation(
+	const matrix& gpu_weights,
+	const matrix& gpu_input,
+	const matrix& gpu_biases,
+	matrix& gpu_activations,
+	e_activation_t activation_idx)
+{
+	smart_assert((gpu_weights.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_biases.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations.get_device_ptr() != nullptr));
+
+	smart_assert(gpu_activations.item_count() != 0);
+	smart_assert(gpu_activations.item_count() * gpu_input.item_count() == gpu_weights.item_count());
+	smart_assert(gpu_activations.item_count() == gpu_biases.item_count());
+
+#ifdef CNN_USE_CUBLAS
+	if (use_cublas())
+	{
+		//the gemv of cublas has no epilogue
+		gpu_dot_product(gpu_weights, gpu_input, gpu_activations);
+		gpu_add_bias_activation(gpu_activations, gpu_biases, activation_idx);
+		return;
+	}
+#endif
+
+	unsigned int size = gpu_activations.item_count();
+	dispatch_activation(activation_idx, [&](auto traits) {
+		profiler_count_kernel_launch();
+		gpu_dot_product_kernel<decltype(traits)> << <get_row_block_count(size), ROW_BLOCK_SIZE, 0, current_stream >> > (
+			gpu_weights.get_device_ptr_readonly(),
+			gpu_input.get_device_ptr_readonly(),
+			gpu_input.item_count(),
+			gpu_biases.get_device_ptr_readonly(),
+			gpu_activations.get_device_ptr(),
+			gpu_activations.item_count());
+	});
+	check_for_error_and_synchronize();
+
+	if (activation_idx == softmax_fn)
+	{
+		gpu_add_bias_softmax(gpu_activations.get_device_ptr(), nullptr, size, size);
+	}
+}
+
+//every block computes a tile of the result batch (TILE_SIZE items x TILE_SIZE activations)
+//the matching tiles of the input batch and the weights are staged in shared memory
+//both are loaded along their rows, so the global memory access is coalesced
+//the bias (if there are biases) and the activation are applied before the result is written,
+//the biases repeat every bias_size results
+template<typename activation_t>
+__global__ void gpu_dot_product_batch_kernel(
+	const float* weights,
+	const float* input_batch,
+	const int input_size,
+	const float* biases,
+	const int bias_size,
+	float* activations_batch,
+	const int activations_size,
+	const int batch_size)
+{
+	__shared__ float input_tile[TILE_SIZE][TILE_SIZE];
+	//padded, so reading a column does not cause bank conflicts
+	__shared__ float weight_tile[TILE_SIZE][TILE_SIZE + 1];
+
+	const int activation_idx = blockIdx.x * TILE_SIZE + threadIdx.x;
+	const int batch_idx = blockIdx.y * TILE_SIZE + threadIdx.y;
+	const int weight_row = blockIdx.x * TILE_SIZE + threadIdx.y;
+
+	float sum = 0;
+	for (int tile_start = 0; tile_start < input_size; tile_start += TILE_SIZE)
+	{
+		const int input_idx = tile_start + threadIdx.x;
+
+		input_tile[threadIdx.y][threadIdx.x] =
+			(batch_idx < batch_size && input_idx < input_size) ?
+			input_batch[batch_idx * input_size + input_idx] :
+			0;
+		weight_tile[threadIdx.y][threadIdx.x] =
+			(weight_row < activations_size && input_idx < input_size) ?
+			weights[weight_row * input_size + input_idx] :
+			0;
+		__syncthreads();
+
+		for (int k = 0; k < TILE_SIZE; k++)
+		{
+			sum += input_tile[threadIdx.y][k] * weight_tile[threadIdx.x][k];
+		}
+		__syncthreads();
+	}
+
+	if (activation_idx < activations_size && batch_idx < batch_size)
+	{
+		const int result_idx = batch_idx * activations_size + activation_idx;
+		const float bias = biases == nullptr ? 0.0f : biases[result_idx % bias_size];
+		activations_batch[result_idx] = activation_t::activate(sum + bias);
+	}
+}
+
+//defined with the activation kernels
+template<typename activation_t>
+static void gpu_bias_activation_pass(float* data, const float* biases, size_t bias_size, size_t size);
+
+//activations_batch[b][a] = activation_t::activate(dot(input_batch[b], weights[a]) + biases[(b * activations_size + a) % bias_size])
+//all rows are input_size long, the biases are null for the plain product
+template<typename activation_t>
+static void gpu_dot_product_rows(
+	const float* weights,
+	const float* input_batch,
+	const float* biases,
+	int bias_size,
+	float* activations_batch,
+	int input_size,
+	int activations_size,
+	int batch_size)
+{
+#ifdef CNN_USE_CUBLAS
+	if (use_cublas())
+	{
+		//in column major the result batch is (activations x batch)
+		//result = weights^T(column major) * input_batch(column major)
+		const float alpha = 1;
+		const float beta = 0;
+		cublas_check(cublasSgemm(
+			get_cublas_handle(),
+			CUBLAS_OP_T,
+			CUBLAS_OP_N,
+			activations_size,
+			batch_size,
+			input_size,
+			&alpha,
+			weights,
+			input_size,
+			input_batch,
+			input_size,
+			&beta,
+			activations_batch,
+			activations_size));
+		//the gemm of cublas has no epilogue
+		gpu_bias_activation_pass<activation_t>(
+			activations_batch,
+			biases,
+			bias_size,
+			(size_t)activations_size * batch_size);
+		return;
+	}
+#endif
+
+	dim3 block_count(
+		get_tile_count(activations_size),
+		get_tile_count(batch_size));
+	dim3 threads_per_block(TILE_SIZE, TILE_SIZE);
+	profiler_count_kernel_launch();
+	gpu_dot_product_batch_kernel<activation_t> << <block_count, threads_per_block, 0, current_stream >> > (
+		weights,
+		input_batch,
+		input_size,
+		biases,
+		bias_size,
+		activations_batch,
+		activations_size,
+		batch_size);
+
+	check_for_error_and_synchronize();
+}
+
+void gpu_dot_product_batch(
+	const matrix& gpu_weights,
+	const matrix& gpu_input_batch,
+	matrix& gpu_activations_batch)
+{
+	smart_assert((gpu_weights.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_input_batch.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations_batch.get_device_ptr() != nullptr));
+
+	smart_assert(gpu_weights.item_count() != 0);
+	smart_assert(gpu_input_batch.item_count() != 0);
+	smart_assert(gpu_activations_batch.item_count() != 0);
+
+	smart_assert(gpu_weights.get_width() == gpu_input_batch.get_width());
+	smart_assert(gpu_weights.get_height() == gpu_activations_batch.get_width());
+	smart_assert(gpu_input_batch.get_height() == gpu_activations_batch.get_height());
+
+	gpu_dot_product_rows<no_activation_traits>(
+		gpu_weights.get_device_ptr_readonly(),
+		gpu_input_batch.get_device_ptr_readonly(),
+		nullptr,
+		0,
+		gpu_activations_batch.get_device_ptr(),
+		(int)gpu_input_batch.get_width(),
+		(int)gpu_activations_batch.get_width(),
+		(int)gpu_activations_batch.get_height());
+}
+
+void gpu_dot_product_batch_bias_activation(
+	const matrix& gpu_weights,
+	const matrix& gpu_input_batch,
+	const matrix& gpu_biases,
+	matrix& gpu_activations_batch,
+	e_activation_t activation_idx)
+{
+	smart_assert((gpu_weights.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_input_batch.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_biases.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations_batch.get_device_ptr() != nullptr));
+
+	smart_assert(gpu_activations_batch.item_count() != 0);
+	smart_assert(gpu_weights.get_width() == gpu_input_batch.get_width());
+	smart_assert(gpu_weights.get_height() == gpu_activations_batch.get_width());
+	smart_assert(gpu_input_batch.get_height() == gpu_activations_batch.get_height());
+	smart_assert(gpu_biases.item_count() == gpu_activations_batch.get_width());
+
+	dispatch_activation(activation_idx, [&](auto traits) {
+		gpu_dot_product_rows<decltype(traits)>(
+			gpu_weights.get_device_ptr_readonly(),
+			gpu_input_batch.get_device_ptr_readonly(),
+			gpu_biases.get_device_ptr_readonly(),
+			(int)gpu_biases.item_count(),
+			gpu_activations_batch.get_device_ptr(),
+			(int)gpu_input_batch.get_width(),
+			(int)gpu_activations_batch.get_width(),
+			(int)gpu_activations_batch.get_height());
+	});
+
+	if (activation_idx == softmax_fn)
+	{
+		gpu_add_bias_softmax(
+			gpu_activations_batch.get_device_ptr(),
+			nullptr,
+			gpu_activations_batch.get_width(),
+			gpu_activations_batch.item_count());
+	}
+}
+
 __global__ void gpu_add_matrices_kernel(const float* a, const float* b, float* result, unsigned int size)
 {
 	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
@@ -242,8 +707,8 @@ void gpu_add(
 
 	unsigned int size = gpu_memory_a.item_count();
 
-	cuda_sync();
-	gpu_add_matrices_kernel << < get_block_count(size), THREADS_PER_BLOCK >> > (
+	profiler_count_kernel_launch();
+	gpu_add_matrices_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
 		gpu_memory_a.get_device_ptr_readonly(),
 		gpu_memory_b.get_device_ptr_readonly(),
 		gpu_memory_result.get_device_ptr(),
@@ -252,6 +717,46 @@ void gpu_add(
 	check_for_error_and_synchronize();
 }
 
+__global__ void gpu_add_flat_batch_kernel(
+	const float* batch,
+	const float* flat,
+	float* result_batch,
+	unsigned int row_size,
+	unsigned int size)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		result_batch[index] = batch[index] + flat[index % row_size];
+	}
+}
+
+void gpu_add_flat_batch(
+	const matrix& gpu_batch,
+	const matrix& gpu_flat,
+	matrix& gpu_result_batch)
+{
+	smart_assert((gpu_batch.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_flat.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_result_batch.get_device_ptr() != nullptr));
+
+	smart_assert((gpu_batch.item_count() != 0));
+	smart_assert((gpu_batch.get_width() == gpu_flat.item_count()));
+	smart_assert((gpu_batch.item_count() == gpu_result_batch.item_count()));
+
+	unsigned int size = gpu_batch.item_count();
+
+	profiler_count_kernel_launch();
+	gpu_add_flat_batch_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		gpu_batch.get_device_ptr_readonly(),
+		gpu_flat.get_device_ptr_readonly(),
+		gpu_result_batch.get_device_ptr(),
+		gpu_flat.item_count(),
+		size);
+
+	check_for_error_and_synchronize();
+}
+
 __global__ void gpu_subtract_matrices_kernel(const float* a, const float* b, float* result, unsigned int size)
 {
 	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
@@ -272,8 +777,8 @@ void gpu_subtract(
 
 	unsigned int size = gpu_memory_a.item_count();
 
-	cuda_sync();
-	gpu_subtract_matrices_kernel << < get_block_count(size), THREADS_PER_BLOCK >> > (
+	profiler_count_kernel_launch();
+	gpu_subtract_matrices_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
 		gpu_memory_a.get_device_ptr_readonly(),
 		gpu_memory_b.get_device_ptr_readonly(),
 		gpu_memory_result.get_device_ptr(),
@@ -302,8 +807,8 @@ void gpu_scalar_mult(
 
 	unsigned int size = gpu_memory_a.item_count();
 
-	cuda_sync();
-	gpu_scalar_mult_kernel << < get_block_count(size), THREADS_PER_BLOCK >> > (
+	profiler_count_kernel_launch();
+	gpu_scalar_mult_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
 		gpu_memory_a.get_device_ptr_readonly(),
 		scalar,
 		gpu_memory_result.get_device_ptr(),
@@ -312,9 +817,14 @@ void gpu_scalar_mult(
 	check_for_error_and_synchronize();
 }
 
+//the fixed kernels (see e_fixed_kernel_t) pass the kernel width and the stride as template arguments,
+//so the loops over the window are unrolled. the generic kernel passes 0 and uses the arguments
+//the biases (null for none) have the layout of the result
+template<int fixed_width, int fixed_stride, typename activation_t>
 __global__ void gpu_valid_cross_correlation_kernel(
 	const float* input,
 	const float* weights,
+	const float* biases,
 	float* result,
 	const int input_depth,
 	const int input_width,
@@ -322,33 +832,41 @@ __global__ void gpu_valid_cross_correlation_kernel(
 	const int output_width,
 	const int stride)
 {
+	const int width = fixed_width > 0 ? fixed_width : kernel_width;
+	const int step = fixed_stride > 0 ? fixed_stride : stride;
 	unsigned int result_idx = blockIdx.x * blockDim.x + threadIdx.x;
 
 	if (result_idx < output_width * output_width)
 	{
-		int input_x = (result_idx % output_width) * stride;
-		int input_y = (result_idx / output_width) * stride;
+		int input_x = (result_idx % output_width) * step;
+		int input_y = (result_idx / output_width) * step;
 
 		float sum = 0;
-		for (int kernel_x = 0; kernel_x < kernel_width; kernel_x++)
+		for (int kernel_z = 0; kernel_z < input_depth; kernel_z++)
 		{
-			for (int kernel_y = 0; kernel_y < kernel_width; kernel_y++)
+#pragma unroll
+			for (int kernel_y = 0; kernel_y < width; kernel_y++)
 			{
-				for (int kernel_z = 0; kernel_z < input_depth; kernel_z++)
+#pragma unroll
+				for (int kernel_x = 0; kernel_x < width; kernel_x++)
 				{
 					int input_idx = get_idx(input_x + kernel_x, input_y + kernel_y, kernel_z, input_width, input_width);
-					int weight_idx = get_idx(kernel_x, kernel_y, kernel_z, kernel_width, kernel_width);
+					int weight_idx = get_idx(kernel_x, kernel_y, kernel_z, width, width);
 					sum += input[input_idx] * weights[weight_idx];
 				}
 			}
 		}
-		result[result_idx] = sum;
+		const float bias = biases == nullptr ? 0.0f : biases[result_idx];
+		result[result_idx] = activation_t::activate(sum + bias);
 	}
 }
 
-void gpu_valid_cross_correlation(
+//one launch per kernel, every thread computes one output of it
+template<int fixed_width, int fixed_stride, typename activation_t>
+static void gpu_direct_cross_correlation(
 	const matrix& gpu_input,
 	const std::vector<matrix>& gpu_kernel_weights,
+	const float* biases,
 	matrix& gpu_activations,
 	size_t input_width,
 	size_t input_depth,
@@ -357,21 +875,17 @@ void gpu_valid_cross_correlation(
 	size_t stride,
 	size_t output_width)
 {
-	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
-	smart_assert((gpu_activations.get_device_ptr() != nullptr));
-
-	cuda_sync();
 	for (int activation_depth = 0; activation_depth < kernel_count; activation_depth++)
 	{
 		//splits the gpu_activations into each depth layer
 		//if the activations have a depth of 3 this loop will iterate 3 times
-		//float* activation_ptr = gpu_sub_ptr(gpu_activations.get_device_ptr(), output_width * output_width, activation_depth);
-
 		size_t block_count = get_block_count(output_width * output_width);
 
-		gpu_valid_cross_correlation_kernel << <(int)block_count, THREADS_PER_BLOCK >> > (
+		profiler_count_kernel_launch();
+		gpu_valid_cross_correlation_kernel<fixed_width, fixed_stride, activation_t> << <(int)block_count, THREADS_PER_BLOCK, 0, current_stream >> > (
 			gpu_input.get_device_ptr_readonly(),
 			gpu_kernel_weights[activation_depth].get_device_ptr_readonly(),
+			biases == nullptr ? nullptr : biases + activation_depth * output_width * output_width,
 			gpu_activations.get_device_ptr_layer(activation_depth),
 			(int)input_depth,
 			(int)input_width,
@@ -382,246 +896,2364 @@ void gpu_valid_cross_correlation(
 	}
 }
 
-__global__ void pooling_kernel(
+//one thread per value of the patches
+//every row of the patches is the input under the kernel for one output (same layout as a kernel)
+//the fixed kernels pass the kernel width and the stride as template arguments,
+//so the divisions of the index by the window become divisions by constants
+template<int fixed_width, int fixed_stride>
+__global__ void gpu_im2col_kernel(
 	const float* input,
-	float* output,
+	float* patches,
+	const int input_depth,
 	const int input_width,
+	const int kernel_width,
 	const int output_width,
-	const int depth,
-	const int kernel_size,
-	const int stride,
-	const int pooling_type)
+	const int stride)
 {
-	unsigned int result_idx = blockIdx.x * blockDim.x + threadIdx.x;
+	const int width = fixed_width > 0 ? fixed_width : kernel_width;
+	const int step = fixed_stride > 0 ? fixed_stride : stride;
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	const int patch_size = width * width * input_depth;
 
-	if (result_idx < output_width * output_width * depth)
+	if (idx < output_width * output_width * patch_size)
 	{
-		int x = get_x(result_idx, output_width, output_width);
-		int y = get_y(result_idx, output_width, output_width);
-		int z = get_z(result_idx, output_width, output_width);
+		int position = idx / patch_size;
+		int patch_idx = idx % patch_size;
 
-		int input_x = x * stride;
-		int input_y = y * stride;
+		int kernel_x = get_x(patch_idx, width, width);
+		int kernel_y = get_y(patch_idx, width, width);
+		int kernel_z = get_z(patch_idx, width, width);
 
-		float min = FLT_MAX;
-		float max = FLT_MIN;
-		float sum = 0;
+		int input_x = (position % output_width) * step + kernel_x;
+		int input_y = (position / output_width) * step + kernel_y;
+
+		patches[idx] = input[get_idx(input_x, input_y, kernel_z, input_width, input_width)];
+	}
+}
+
+//one thread per kernel value, the pointers of the kernels are read from device memory
+__global__ void gpu_gather_kernels_kernel(
+	const float* const* kernels,
+	float* packed,
+	const int kernel_item_count,
+	const int kernel_count)
+{
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (idx < kernel_item_count * kernel_count)
+	{
+		packed[idx] = kernels[idx / kernel_item_count][idx % kernel_item_count];
+	}
+}
 
-		for (int kernel_x = 0; kernel_x < kernel_size; kernel_x++)
+//the kernels of a layer are separate matrices, the convolutions need them in one block
+//the device pointers of the kernels of a layer are uploaded once (they only change when the layer
+//is rebuilt) and one launch gathers the values instead of one copy per kernel.
+//the values are gathered on every call, the optimizer and the flat parameters write them
+//without the layer, and parameter sharing copies read the kernels of another network
+class packed_kernel_cache {
+private:
+	//a rebuilt layer that gets the pointers of an old one uses the same table
+	std::map<std::vector<const float*>, const float**> pointer_tables;
+	gpu_scratch_buffer packed_kernels;
+
+	//the tables of destroyed layers are dropped once there are this many
+	static constexpr size_t MAX_POINTER_TABLES = 256;
+
+	void free_pointer_tables()
+	{
+		for (auto& entry : pointer_tables)
 		{
-			for (int kernel_y = 0; kernel_y < kernel_size; kernel_y++)
-			{
-				int input_idx = get_idx(input_x + kernel_x, input_y + kernel_y, z, input_width, input_width);
-				float value = input[input_idx];
+			cudaFree(entry.second);
+		}
+		pointer_tables.clear();
+	}
+public:
+	~packed_kernel_cache()
+	{
+		free_pointer_tables();
+	}
 
-				if (value < min)
-				{
-					min = value;
-				}
-				if (value > max)
-				{
-					max = value;
-				}
-				sum += value;
-			}
+	//the kernels one after another, valid until the next call on this thread
+	float* pack(const std::vector<matrix>& gpu_kernel_weights)
+	{
+		std::vector<const float*> kernel_ptrs(gpu_kernel_weights.size());
+		for (size_t i = 0; i < gpu_kernel_weights.size(); i++)
+		{
+			kernel_ptrs[i] = gpu_kernel_weights[i].get_device_ptr_readonly();
 		}
 
-		float result = 0;
-		/*
-		copied from the enum - TODO find a way to use the enum directly
-		max_pooling = 0,
-		min_pooling = 1,
-		average_pooling = 2
-		*/
-		switch (pooling_type)
+		auto table = pointer_tables.find(kernel_ptrs);
+		if (table == pointer_tables.end())
 		{
-		case 0:
-			result = max;
-			break;
-		case 1:
-			result = min;
-			break;
-		case 2:
-			result = sum / (kernel_size * kernel_size);
-			break;
+			if (pointer_tables.size() >= MAX_POINTER_TABLES)
+			{
+				//the tables can still be read on any stream this thread used
+				cudaDeviceSynchronize();
+				free_pointer_tables();
+			}
+			const float** device_table = nullptr;
+			cudaMalloc(&device_table, kernel_ptrs.size() * sizeof(const float*));
+			cuda_error_check();
+			table = pointer_tables.emplace(kernel_ptrs, device_table).first;
+			//the key stays in the map, so the host pointers outlive the copy
+			cudaMemcpyAsync(
+				device_table,
+				table->first.data(),
+				kernel_ptrs.size() * sizeof(const float*),
+				cudaMemcpyHostToDevice,
+				current_stream);
 		}
 
-		output[result_idx] = result;
+		const size_t kernel_item_count = gpu_kernel_weights[0].item_count();
+		const size_t item_count = kernel_item_count * gpu_kernel_weights.size();
+		float* packed = packed_kernels.get(item_count);
+		profiler_count_kernel_launch();
+		gpu_gather_kernels_kernel << <get_block_count(item_count), THREADS_PER_BLOCK, 0, current_stream >> > (
+			table->second,
+			packed,
+			(int)kernel_item_count,
+			(int)gpu_kernel_weights.size());
+		check_for_error_and_synchronize();
+		return packed;
 	}
-}
+};
 
-void gpu_pooling(
-	const matrix& input,
-	matrix& output,
+//the patches are multiplied with the packed kernels in one matrix multiplication
+//activations[kernel][position] = dot(patches[position], kernels[kernel])
+//the result of the multiplication has the layout of the activations, so it takes their biases
+template<int fixed_width, int fixed_stride, typename activation_t>
+static void gpu_im2col_cross_correlation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const float* biases,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
 	size_t stride,
-	size_t kernel_size,
-	e_pooling_type_t pooling_type)
+	size_t output_width)
 {
-	smart_assert((input.get_device_ptr_readonly() != nullptr));
-	smart_assert((output.get_device_ptr() != nullptr));
+	static thread_local gpu_scratch_buffer patch_buffer;
+	static thread_local packed_kernel_cache packed_kernels;
 
+	const size_t patch_size = kernel_width * kernel_width * input_depth;
+	const size_t output_positions = output_width * output_width;
+
+	float* patches = patch_buffer.get(patch_size * output_positions);
+	profiler_count_kernel_launch();
+	gpu_im2col_kernel<fixed_width, fixed_stride> << <get_block_count(patch_size * output_positions), THREADS_PER_BLOCK, 0, current_stream >> > (
+		gpu_input.get_device_ptr_readonly(),
+		patches,
+		(int)input_depth,
+		(int)input_width,
+		(int)kernel_width,
+		(int)output_width,
+		(int)stride);
+	check_for_error_and_synchronize();
+
+	float* kernels_ptr = packed_kernels.pack(gpu_kernel_weights);
+
+	gpu_dot_product_rows<activation_t>(
+		patches,
+		kernels_ptr,
+		biases,
+		(int)(output_positions * kernel_count),
+		gpu_activations.get_device_ptr(),
+		(int)patch_size,
+		(int)output_positions,
+		(int)kernel_count);
+}
+
+//runs the im2col or the direct convolution with the same fixed window
+template<int fixed_width, int fixed_stride, typename activation_t>
+static void gpu_fixed_cross_correlation(
+	bool use_im2col,
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const float* biases,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width)
+{
+	if (use_im2col)
+	{
+		gpu_im2col_cross_correlation<fixed_width, fixed_stride, activation_t>(gpu_input, gpu_kernel_weights, biases, gpu_activations, input_width, input_depth, kernel_width, kernel_count, stride, output_width);
+	}
+	else
+	{
+		gpu_direct_cross_correlation<fixed_width, fixed_stride, activation_t>(gpu_input, gpu_kernel_weights, biases, gpu_activations, input_width, input_depth, kernel_width, kernel_count, stride, output_width);
+	}
+}
+
+//one thread per kernel weight
+//the planar kernels are packed as [kernel_y][kernel_x][depth][kernel],
+//so neighbouring threads of the interleaved convolution read neighbouring weights
+__global__ void gpu_pack_interleaved_kernels_kernel(
+	const float* kernels,
+	float* packed,
+	const int kernel_width,
+	const int depth,
+	const int kernel_count)
+{
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	const int kernel_size = kernel_width * kernel_width * depth;
+
+	if (idx < kernel_size * kernel_count)
+	{
+		int kernel = idx / kernel_size;
+		int kernel_idx = idx % kernel_size;
+
+		int kernel_x = get_x(kernel_idx, kernel_width, kernel_width);
+		int kernel_y = get_y(kernel_idx, kernel_width, kernel_width);
+		int kernel_z = get_z(kernel_idx, kernel_width, kernel_width);
+
+		packed[((kernel_y * kernel_width + kernel_x) * depth + kernel_z) * kernel_count + kernel] = kernels[idx];
+	}
+}
+
+//one thread per output value, the kernel (output depth) changes the fastest
+//the threads of a position read the same input and neighbouring packed weights
+template<typename activation_t>
+__global__ void gpu_interleaved_cross_correlation_kernel(
+	const float* input,
+	const float* packed_kernels,
+	const float* biases,
+	float* output,
+	const int input_width,
+	const int depth,
+	const int kernel_width,
+	const int kernel_count,
+	const int output_width,
+	const int stride)
+{
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+	if (idx < output_width * output_width * kernel_count)
+	{
+		int x, y, kernel;
+		get_position(idx, output_width, output_width, kernel_count, true, x, y, kernel);
+
+		float sum = 0;
+		for (int kernel_y = 0; kernel_y < kernel_width; kernel_y++)
+		{
+			for (int kernel_x = 0; kernel_x < kernel_width; kernel_x++)
+			{
+				const float* values = input + get_interleaved_idx(
+					x * stride + kernel_x, y * stride + kernel_y, 0, input_width, depth);
+				const float* weights = packed_kernels + (kernel_y * kernel_width + kernel_x) * depth * kernel_count + kernel;
+				for (int z = 0; z < depth; z++)
+				{
+					sum += values[z] * weights[z * kernel_count];
+				}
+			}
+		}
+		const float bias = biases == nullptr ? 0.0f : biases[idx];
+		output[idx] = activation_t::activate(sum + bias);
+	}
+}
+
+template<typename activation_t>
+static void gpu_interleaved_cross_correlation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const float* biases,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width)
+{
+	static thread_local packed_kernel_cache planar_kernels;
+	static thread_local gpu_scratch_buffer packed_kernels;
+
+	const size_t kernel_item_count = gpu_kernel_weights[0].item_count();
+	const float* planar_ptr = planar_kernels.pack(gpu_kernel_weights);
+
+	float* packed_ptr = packed_kernels.get(kernel_item_count * kernel_count);
+	profiler_count_kernel_launch();
+	gpu_pack_interleaved_kernels_kernel << <get_block_count(kernel_item_count * kernel_count), THREADS_PER_BLOCK, 0, current_stream >> > (
+		planar_ptr,
+		packed_ptr,
+		(int)kernel_width,
+		(int)input_depth,
+		(int)kernel_count);
+	check_for_error_and_synchronize();
+
+	profiler_count_kernel_launch();
+	gpu_interleaved_cross_correlation_kernel<activation_t> << <get_block_count(gpu_activations.item_count()), THREADS_PER_BLOCK, 0, current_stream >> > (
+		gpu_input.get_device_ptr_readonly(),
+		packed_ptr,
+		biases,
+		gpu_activations.get_device_ptr(),
+		(int)input_width,
+		(int)input_depth,
+		(int)kernel_width,
+		(int)kernel_count,
+		(int)output_width,
+		(int)stride);
+	check_for_error_and_synchronize();
+}
+
+#ifdef CNN_USE_CUDNN
+//the descriptors, the algorithm and the workspace size of one convolution shape
+//the matrix format (width, height, depth) is NCHW with a batch of 1
+class cudnn_conv_plan {
+public:
+	cudnnTensorDescriptor_t input_desc = nullptr;
+	cudnnTensorDescriptor_t output_desc = nullptr;
+	cudnnFilterDescriptor_t kernel_desc = nullptr;
+	cudnnConvolutionDescriptor_t conv_desc = nullptr;
+	cudnnConvolutionFwdAlgo_t algo;
+	size_t workspace_size = 0;
+
+	cudnn_conv_plan(
+		cudnnHandle_t handle,
+		int input_width,
+		int input_depth,
+		int kernel_width,
+		int kernel_count,
+		int stride,
+		int output_width)
+	{
+		cudnn_check(cudnnCreateTensorDescriptor(&input_desc));
+		cudnn_check(cudnnCreateTensorDescriptor(&output_desc));
+		cudnn_check(cudnnCreateFilterDescriptor(&kernel_desc));
+		cudnn_check(cudnnCreateConvolutionDescriptor(&conv_desc));
+
+		cudnn_check(cudnnSetTensor4dDescriptor(
+			input_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+			1, input_depth, input_width, input_width));
+		cudnn_check(cudnnSetTensor4dDescriptor(
+			output_desc, CUDNN_TENSOR_NCHW, CUDNN_DATA_FLOAT,
+			1, kernel_count, output_width, output_width));
+		cudnn_check(cudnnSetFilter4dDescriptor(
+			kernel_desc, CUDNN_DATA_FLOAT, CUDNN_TENSOR_NCHW,
+			kernel_count, input_depth, kernel_width, kernel_width));
+		cudnn_check(cudnnSetConvolution2dDescriptor(
+			conv_desc, 0, 0, stride, stride, 1, 1,
+			CUDNN_CROSS_CORRELATION, CUDNN_DATA_FLOAT));
+
+		cudnnConvolutionFwdAlgoPerf_t algo_perf;
+		int returned_algo_count = 0;
+		cudnn_check(cudnnGetConvolutionForwardAlgorithm_v7(
+			handle, input_desc, kernel_desc, conv_desc, output_desc,
+			1, &returned_algo_count, &algo_perf));
+		algo = algo_perf.algo;
+
+		cudnn_check(cudnnGetConvolutionForwardWorkspaceSize(
+			handle, input_desc, kernel_desc, conv_desc, output_desc,
+			algo, &workspace_size));
+	}
+	~cudnn_conv_plan()
+	{
+		cudnnDestroyConvolutionDescriptor(conv_desc);
+		cudnnDestroyFilterDescriptor(kernel_desc);
+		cudnnDestroyTensorDescriptor(output_desc);
+		cudnnDestroyTensorDescriptor(input_desc);
+	}
+
+	cudnn_conv_plan(const cudnn_conv_plan&) = delete;
+	cudnn_conv_plan& operator=(const cudnn_conv_plan&) = delete;
+};
+
+//the plans are created on the first call of a shape and kept per thread like the cudnn handle
+static const cudnn_conv_plan& get_cudnn_conv_plan(
+	cudnnHandle_t handle,
+	int input_width,
+	int input_depth,
+	int kernel_width,
+	int kernel_count,
+	int stride,
+	int output_width)
+{
+	static thread_local std::map<std::vector<int>, std::unique_ptr<cudnn_conv_plan>> plans;
+
+	std::vector<int> shape = { input_width, input_depth, kernel_width, kernel_count, stride, output_width };
+	auto plan = plans.find(shape);
+	if (plan == plans.end())
+	{
+		plan = plans.emplace(
+			shape,
+			std::make_unique<cudnn_conv_plan>(handle, input_width, input_depth, kernel_width, kernel_count, stride, output_width)).first;
+	}
+	return *plan->second;
+}
+
+static void cudnn_valid_cross_correlation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width)
+{
+	static thread_local packed_kernel_cache packed_kernels;
+	static thread_local gpu_scratch_buffer workspace;
+
+	cudnnHandle_t handle = get_cudnn_handle();
+	const cudnn_conv_plan& plan = get_cudnn_conv_plan(
+		handle,
+		(int)input_width,
+		(int)input_depth,
+		(int)kernel_width,
+		(int)kernel_count,
+		(int)stride,
+		(int)output_width);
+
+	//cudnn needs the kernels in one block of memory
+	const float* kernels_ptr = packed_kernels.pack(gpu_kernel_weights);
+
+	float* workspace_ptr = plan.workspace_size == 0 ?
+		nullptr :
+		workspace.get((plan.workspace_size + sizeof(float) - 1) / sizeof(float));
+
+	const float alpha = 1;
+	const float beta = 0;
+	cudnn_check(cudnnConvolutionForward(
+		handle,
+		&alpha,
+		plan.input_desc, gpu_input.get_device_ptr_readonly(),
+		plan.kernel_desc, kernels_ptr,
+		plan.conv_desc, plan.algo,
+		workspace_ptr, plan.workspace_size,
+		&beta,
+		plan.output_desc, gpu_activations.get_device_ptr()));
+}
+#endif
+
+void gpu_valid_cross_correlation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width)
+{
+	gpu_valid_cross_correlation(
+		gpu_input,
+		gpu_kernel_weights,
+		gpu_activations,
+		input_width,
+		input_depth,
+		kernel_width,
+		kernel_count,
+		stride,
+		output_width,
+		generic_kernel);
+}
+
+//the biases are null for the plain cross correlation
+template<typename activation_t>
+static void gpu_cross_correlation_bias_activation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const float* biases,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width,
+	e_fixed_kernel_t fixed_kernel)
+{
+	//the interleaved layout has its own kernel, the other strategies only work on planar values
+	if (gpu_input.get_layout() == hwc_layout)
+	{
+		gpu_interleaved_cross_correlation<activation_t>(
+			gpu_input,
+			gpu_kernel_weights,
+			biases,
+			gpu_activations,
+			input_width,
+			input_depth,
+			kernel_width,
+			kernel_count,
+			stride,
+			output_width);
+		return;
+	}
+
+#ifdef CNN_USE_CUDNN
+	if (use_cudnn())
+	{
+		cudnn_valid_cross_correlation(
+			gpu_input,
+			gpu_kernel_weights,
+			gpu_activations,
+			input_width,
+			input_depth,
+			kernel_width,
+			kernel_count,
+			stride,
+			output_width);
+		//cudnn only has a bias per kernel, the biases here have one value per output
+		gpu_bias_activation_pass<activation_t>(
+			gpu_activations.get_device_ptr(),
+			biases,
+			gpu_activations.item_count(),
+			gpu_activations.item_count());
+		return;
+	}
+#endif
+
+	conv_shape shape;
+	shape.input_width = input_width;
+	shape.input_height = input_width;
+	shape.input_depth = input_depth;
+	shape.kernel_size = kernel_width;
+	shape.kernel_count = kernel_count;
+	shape.stride = stride;
+	shape.output_width = output_width;
+	shape.output_height = output_width;
+
+	//there is no winograd kernel on the gpu, the matrix multiplication is used instead
+	const bool use_im2col = conv_select_strategy(shape) != direct_conv;
+
+	//the fixed kernels unroll the window of whichever strategy is chosen
+	switch (fixed_kernel)
+	{
+	case kernel_1x1_s1:
+		gpu_fixed_cross_correlation<1, 1, activation_t>(use_im2col, gpu_input, gpu_kernel_weights, biases, gpu_activations, input_width, input_depth, kernel_width, kernel_count, stride, output_width);
+		return;
+	case kernel_3x3_s1:
+		gpu_fixed_cross_correlation<3, 1, activation_t>(use_im2col, gpu_input, gpu_kernel_weights, biases, gpu_activations, input_width, input_depth, kernel_width, kernel_count, stride, output_width);
+		return;
+	case kernel_3x3_s2:
+		gpu_fixed_cross_correlation<3, 2, activation_t>(use_im2col, gpu_input, gpu_kernel_weights, biases, gpu_activations, input_width, input_depth, kernel_width, kernel_count, stride, output_width);
+		return;
+	case kernel_5x5_s1:
+		gpu_fixed_cross_correlation<5, 1, activation_t>(use_im2col, gpu_input, gpu_kernel_weights, biases, gpu_activations, input_width, input_depth, kernel_width, kernel_count, stride, output_width);
+		return;
+	case kernel_5x5_s2:
+		gpu_fixed_cross_correlation<5, 2, activation_t>(use_im2col, gpu_input, gpu_kernel_weights, biases, gpu_activations, input_width, input_depth, kernel_width, kernel_count, stride, output_width);
+		return;
+	default:
+		break;
+	}
+
+	gpu_fixed_cross_correlation<0, 0, activation_t>(
+		use_im2col,
+		gpu_input,
+		gpu_kernel_weights,
+		biases,
+		gpu_activations,
+		input_width,
+		input_depth,
+		kernel_width,
+		kernel_count,
+		stride,
+		output_width);
+}
+
+void gpu_valid_cross_correlation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width,
+	e_fixed_kernel_t fixed_kernel)
+{
+	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations.get_device_ptr() != nullptr));
+	smart_assert((fixed_kernel == generic_kernel || fixed_kernel == conv_select_fixed_kernel(kernel_width, stride)));
+
+	gpu_cross_correlation_bias_activation<no_activation_traits>(
+		gpu_input,
+		gpu_kernel_weights,
+		nullptr,
+		gpu_activations,
+		input_width,
+		input_depth,
+		kernel_width,
+		kernel_count,
+		stride,
+		output_width,
+		fixed_kernel);
+}
+
+void gpu_valid_cross_correlation_bias_activation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const matrix& gpu_biases,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width,
+	e_fixed_kernel_t fixed_kernel,
+	e_activation_t activation_idx)
+{
+	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_biases.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations.get_device_ptr() != nullptr));
+	smart_assert(gpu_biases.item_count() == gpu_activations.item_count());
+	smart_assert((fixed_kernel == generic_kernel || fixed_kernel == conv_select_fixed_kernel(kernel_width, stride)));
+
+	dispatch_activation(activation_idx, [&](auto traits) {
+		gpu_cross_correlation_bias_activation<decltype(traits)>(
+			gpu_input,
+			gpu_kernel_weights,
+			gpu_biases.get_device_ptr_readonly(),
+			gpu_activations,
+			input_width,
+			input_depth,
+			kernel_width,
+			kernel_count,
+			stride,
+			output_width,
+			fixed_kernel);
+	});
+
+	//the same as gpu_add_bias_activation with biases of the activation size, all values are one row
+	if (activation_idx == softmax_fn)
+	{
+		gpu_add_bias_softmax(
+			gpu_activations.get_device_ptr(),
+			nullptr,
+			gpu_activations.item_count(),
+			gpu_activations.item_count());
+	}
+}
+
+//one thread per value, the destination is written contiguously
+__global__ void gpu_convert_layout_kernel(
+	const float* source,
+	float* destination,
+	const int width,
+	const int height,
+	const int depth,
+	const bool source_interleaved,
+	const bool destination_interleaved)
+{
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+	if (idx < width * height * depth)
+	{
+		int x, y, z;
+		get_position(idx, width, height, depth, destination_interleaved, x, y, z);
+		destination[idx] = source[get_layout_idx(x, y, z, width, height, depth, source_interleaved)];
+	}
+}
+
+void gpu_convert_layout(
+	const float* source,
+	float* destination,
+	size_t width,
+	size_t height,
+	size_t depth,
+	e_tensor_layout_t source_layout,
+	e_tensor_layout_t destination_layout)
+{
+	smart_assert((source != nullptr));
+	smart_assert((destination != nullptr));
+
+	const size_t size = width * height * depth;
+	profiler_count_kernel_launch();
+	gpu_convert_layout_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		source,
+		destination,
+		(int)width,
+		(int)height,
+		(int)depth,
+		source_layout == hwc_layout,
+		destination_layout == hwc_layout);
+	check_for_error_and_synchronize();
+}
+
+//selected indices is null if they are not needed
+//the input and the output have the same layout
+//the fixed pooling kernel (kernel_2x2_s2) passes its window size and stride as template arguments,
+//the generic one passes 0 and uses the arguments
+template<int fixed_size, int fixed_stride>
+__global__ void pooling_kernel(
+	const float* input,
+	float* output,
+	unsigned char* selected_indices,
+	const int input_width,
+	const int output_width,
+	const int depth,
+	const int kernel_size,
+	const int stride,
+	const int pooling_type,
+	const bool interleaved)
+{
+	unsigned int result_idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+	const int window_size = fixed_size > 0 ? fixed_size : kernel_size;
+	const int step = fixed_stride > 0 ? fixed_stride : stride;
+
+	if (result_idx < output_width * output_width * depth)
+	{
+		int x, y, z;
+		get_position(result_idx, output_width, output_width, depth, interleaved, x, y, z);
+
+		int input_x = x * step;
+		int input_y = y * step;
+
+		float min = FLT_MAX;
+		float max = -FLT_MAX;
+		float sum = 0;
+		int min_idx = 0;
+		int max_idx = 0;
+
+#pragma unroll
+		for (int kernel_y = 0; kernel_y < window_size; kernel_y++)
+		{
+#pragma unroll
+			for (int kernel_x = 0; kernel_x < window_size; kernel_x++)
+			{
+				int input_idx = get_layout_idx(
+					input_x + kernel_x, input_y + kernel_y, z, input_width, input_width, depth, interleaved);
+				float value = input[input_idx];
+
+				if (value < min)
+				{
+					min = value;
+					min_idx = kernel_y * window_size + kernel_x;
+				}
+				if (value > max)
+				{
+					max = value;
+					max_idx = kernel_y * window_size + kernel_x;
+				}
+				sum += value;
+			}
+		}
+
+		float result = 0;
+		/*
+		copied from the enum - TODO find a way to use the enum directly
+		max_pooling = 0,
+		min_pooling = 1,
+		average_pooling = 2
+		*/
+		switch (pooling_type)
+		{
+		case 0:
+			result = max;
+			if (selected_indices != nullptr)
+				selected_indices[result_idx] = (unsigned char)max_idx;
+			break;
+		case 1:
+			result = min;
+			if (selected_indices != nullptr)
+				selected_indices[result_idx] = (unsigned char)min_idx;
+			break;
+		case 2:
+			result = sum / (window_size * window_size);
+			break;
+		}
+
+		output[result_idx] = result;
+	}
+}
+
+void gpu_pooling(
+	const matrix& input,
+	matrix& output,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	pooling_index_buffer* selected_indices)
+{
+	gpu_pooling(input, output, stride, kernel_size, pooling_type, selected_indices, generic_kernel);
+}
+
+void gpu_pooling(
+	const matrix& input,
+	matrix& output,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	pooling_index_buffer* selected_indices,
+	e_fixed_kernel_t fixed_kernel)
+{
+	smart_assert((input.get_device_ptr_readonly() != nullptr));
+	smart_assert((output.get_device_ptr() != nullptr));
 
 	unsigned int size = output.item_count();
-	cuda_sync();
-	pooling_kernel << < get_block_count(size), THREADS_PER_BLOCK >> > (
+	//the kernel of the fixed window only differs in the template arguments
+	auto kernel = fixed_kernel == kernel_2x2_s2 ? pooling_kernel<2, 2> : pooling_kernel<0, 0>;
+	profiler_count_kernel_launch();
+	kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
 		input.get_device_ptr_readonly(),
 		output.get_device_ptr(),
+		selected_indices == nullptr ? nullptr : selected_indices->get_device_ptr(),
 		(int)input.get_width(),
 		(int)output.get_width(),
 		(int)input.get_depth(), //must be same as output
 		(int)kernel_size,
 		(int)stride,
-		(int)pooling_type);
+		(int)pooling_type,
+		input.get_layout() == hwc_layout);
+
+	check_for_error_and_synchronize();
+}
+
+//one thread per value of the passing error
+//the windows can overlap, so every thread collects the error of all windows it is part of
+//this does not need atomics
+__global__ void pooling_backprop_kernel(
+	const float* error,
+	float* passing_error,
+	const unsigned char* selected_indices,
+	const int input_width,
+	const int output_width,
+	const int depth,
+	const int kernel_size,
+	const int stride,
+	const bool interleaved)
+{
+	unsigned int input_idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+	if (input_idx < input_width * input_width * depth)
+	{
+		int input_x, input_y, input_z;
+		get_position(input_idx, input_width, input_width, depth, interleaved, input_x, input_y, input_z);
+
+		float sum = 0;
+		for (int kernel_y = 0; kernel_y < kernel_size && kernel_y <= input_y; kernel_y++)
+		{
+			int output_y = input_y - kernel_y;
+			if (output_y % stride != 0 || output_y / stride >= output_width)
+				continue;
+			output_y /= stride;
+
+			for (int kernel_x = 0; kernel_x < kernel_size && kernel_x <= input_x; kernel_x++)
+			{
+				int output_x = input_x - kernel_x;
+				if (output_x % stride != 0 || output_x / stride >= output_width)
+					continue;
+				output_x /= stride;
+
+				int output_idx = get_layout_idx(
+					output_x, output_y, input_z, output_width, output_width, depth, interleaved);
+				if (selected_indices == nullptr)
+				{
+					//average pooling
+					sum += error[output_idx] / (kernel_size * kernel_size);
+				}
+				else if (selected_indices[output_idx] == kernel_y * kernel_size + kernel_x)
+				{
+					sum += error[output_idx];
+				}
+			}
+		}
+		passing_error[input_idx] = sum;
+	}
+}
+
+void gpu_pooling_backprop(
+	const matrix& error,
+	matrix& passing_error,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	const pooling_index_buffer* selected_indices)
+{
+	smart_assert((error.get_device_ptr_readonly() != nullptr));
+	smart_assert((passing_error.get_device_ptr() != nullptr));
+	smart_assert((pooling_type == average_pooling || selected_indices != nullptr));
+
+	unsigned int size = passing_error.item_count();
+	profiler_count_kernel_launch();
+	pooling_backprop_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		error.get_device_ptr_readonly(),
+		passing_error.get_device_ptr(),
+		pooling_type == average_pooling ? nullptr : selected_indices->get_device_ptr_readonly(),
+		(int)passing_error.get_width(),
+		(int)error.get_width(),
+		(int)error.get_depth(),
+		(int)kernel_size,
+		(int)stride,
+		error.get_layout() == hwc_layout);
+
+	check_for_error_and_synchronize();
+}
+
+//error multiplied with the derivative of the activation function
+//the delta is also the change of the bias
+template<typename activation_t>
+__global__ void gpu_fc_delta_kernel(
+	const float* activations,
+	const float* error,
+	float* delta,
+	float* bias_deltas,
+	const unsigned int size
+)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		float curr_delta = error[index] * activation_t::derivative_from_activation(activations[index]);
+		delta[index] = curr_delta;
+		bias_deltas[index] += curr_delta;
+	}
+}
+
+//one thread per neuron
+//multiplies the error with the activation derivative in place
+//and sums up the bias deltas of the whole batch
+template<typename activation_t>
+__global__ void gpu_fc_backprop_batch_delta_kernel(
+	const float* activations_batch,
+	float* error_batch,
+	float* bias_deltas,
+	const unsigned int activation_count,
+	const unsigned int batch_size
+)
+{
+	unsigned int neuron_idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (neuron_idx < activation_count)
+	{
+		float bias_change = 0;
+		for (unsigned int batch_idx = 0; batch_idx < batch_size; batch_idx++)
+		{
+			unsigned int idx = batch_idx * activation_count + neuron_idx;
+
+			float delta = error_batch[idx] * activation_t::derivative_from_activation(activations_batch[idx]);
+
+			error_batch[idx] = delta;
+			bias_change += delta;
+		}
+		bias_deltas[neuron_idx] += bias_change;
+	}
+}
+
+//one thread per weight
+__global__ void gpu_fc_backprop_batch_weight_kernel(
+	const float* delta_batch,
+	const float* input_batch,
+	float* weight_deltas,
+	const unsigned int activation_count,
+	const unsigned int input_count,
+	const unsigned int batch_size
+)
+{
+	unsigned int weight_idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (weight_idx < activation_count * input_count)
+	{
+		unsigned int input_idx = weight_idx % input_count;
+		unsigned int neuron_idx = weight_idx / input_count;
+
+		float weight_change = 0;
+		for (unsigned int batch_idx = 0; batch_idx < batch_size; batch_idx++)
+		{
+			weight_change +=
+				delta_batch[batch_idx * activation_count + neuron_idx] *
+				input_batch[batch_idx * input_count + input_idx];
+		}
+		weight_deltas[weight_idx] += weight_change;
+	}
+}
+
+//one thread per input of every item
+__global__ void gpu_fc_backprop_batch_passing_error_kernel(
+	const float* delta_batch,
+	const float* weights,
+	float* passing_error_batch,
+	const unsigned int activation_count,
+	const unsigned int input_count,
+	const unsigned int batch_size
+)
+{
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (idx < input_count * batch_size)
+	{
+		unsigned int input_idx = idx % input_count;
+		unsigned int batch_idx = idx / input_count;
+
+		const float* delta_row = delta_batch + batch_idx * activation_count;
+
+		float error_sum = 0;
+		for (unsigned int neuron_idx = 0; neuron_idx < activation_count; neuron_idx++)
+		{
+			error_sum += delta_row[neuron_idx] * weights[neuron_idx * input_count + input_idx];
+		}
+		passing_error_batch[idx] = error_sum;
+	}
+}
+
+void gpu_fc_backprop(
+	const matrix& activations,
+	const matrix& weights,
+	const matrix& input,
+	const matrix& error,
+	matrix* passing_error,
+	matrix& weight_deltas,
+	matrix& bias_deltas,
+	e_activation_t activation_fn)
+{
+	smart_assert((activations.get_device_ptr_readonly() != nullptr));
+	smart_assert((weights.get_device_ptr_readonly() != nullptr));
+	smart_assert((input.get_device_ptr_readonly() != nullptr));
+	smart_assert((error.get_device_ptr_readonly() != nullptr));
+	smart_assert((weight_deltas.get_device_ptr() != nullptr));
+	smart_assert((bias_deltas.get_device_ptr() != nullptr));
+
+	static thread_local gpu_scratch_buffer delta_buffer;
+
+	unsigned int size = activations.item_count();
+	unsigned int input_count = input.item_count();
+	float* delta = delta_buffer.get(size);
+
+	dispatch_activation(activation_fn, [&](auto traits) {
+		profiler_count_kernel_launch();
+		gpu_fc_delta_kernel<decltype(traits)> << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+			activations.get_device_ptr_readonly(),
+			error.get_device_ptr_readonly(),
+			delta,
+			bias_deltas.get_device_ptr(),
+			size);
+	});
+	check_for_error_and_synchronize();
+
+#ifdef CNN_USE_CUBLAS
+	if (use_cublas())
+	{
+		cublasHandle_t handle = get_cublas_handle();
+		const float one = 1;
+		const float zero = 0;
+
+		//weight_deltas += input * delta^T (column major)
+		cublas_check(cublasSger(
+			handle, (int)input_count, (int)size, &one,
+			input.get_device_ptr_readonly(), 1,
+			delta, 1,
+			weight_deltas.get_device_ptr(), (int)input_count));
+		//passing_error = weights(column major) * delta
+		if (passing_error != nullptr)
+		{
+			cublas_check(cublasSgemv(
+				handle, CUBLAS_OP_N, (int)input_count, (int)size, &one,
+				weights.get_device_ptr_readonly(), (int)input_count,
+				delta, 1,
+				&zero,
+				passing_error->get_device_ptr(), 1));
+		}
+		return;
+	}
+#endif
+
+	//a single item is a batch of one
+	//weight gradient - parallel over all weights
+	profiler_count_kernel_launch();
+	gpu_fc_backprop_batch_weight_kernel << <get_block_count(weights.item_count()), THREADS_PER_BLOCK, 0, current_stream >> > (
+		delta,
+		input.get_device_ptr_readonly(),
+		weight_deltas.get_device_ptr(),
+		size,
+		input_count,
+		1);
+
+	//input gradient - parallel over all inputs
+	//passing error is null when this is the first layer
+	if (passing_error != nullptr)
+	{
+		profiler_count_kernel_launch();
+		gpu_fc_backprop_batch_passing_error_kernel << <get_block_count(input_count), THREADS_PER_BLOCK, 0, current_stream >> > (
+			delta,
+			weights.get_device_ptr_readonly(),
+			passing_error->get_device_ptr(),
+			size,
+			input_count,
+			1);
+	}
+
+	check_for_error_and_synchronize();
+}
+
+void gpu_fc_backprop_batch(
+	const matrix& activations_batch,
+	const matrix& weights,
+	const matrix& input_batch,
+	matrix& error_batch,
+	matrix* passing_error_batch,
+	matrix& weight_deltas,
+	matrix& bias_deltas,
+	e_activation_t activation_fn)
+{
+	smart_assert((activations_batch.get_device_ptr_readonly() != nullptr));
+	smart_assert((weights.get_device_ptr_readonly() != nullptr));
+	smart_assert((input_batch.get_device_ptr_readonly() != nullptr));
+	smart_assert((error_batch.get_device_ptr() != nullptr));
+	smart_assert((weight_deltas.get_device_ptr() != nullptr));
+	smart_assert((bias_deltas.get_device_ptr() != nullptr));
+
+	unsigned int activation_count = activations_batch.get_width();
+	unsigned int input_count = input_batch.get_width();
+	unsigned int batch_size = activations_batch.get_height();
+
+	dispatch_activation(activation_fn, [&](auto traits) {
+		profiler_count_kernel_launch();
+		gpu_fc_backprop_batch_delta_kernel<decltype(traits)> << <get_block_count(activation_count), THREADS_PER_BLOCK, 0, current_stream >> > (
+			activations_batch.get_device_ptr_readonly(),
+			error_batch.get_device_ptr(),
+			bias_deltas.get_device_ptr(),
+			activation_count,
+			batch_size);
+	});
+	check_for_error_and_synchronize();
+
+#ifdef CNN_USE_CUBLAS
+	if (use_cublas())
+	{
+		//the error batch now contains the deltas (activations x batch in column major)
+		cublasHandle_t handle = get_cublas_handle();
+		const float one = 1;
+		const float zero = 0;
+
+		//weight_deltas += input_batch * delta_batch^T
+		cublas_check(cublasSgemm(
+			handle, CUBLAS_OP_N, CUBLAS_OP_T,
+			(int)input_count, (int)activation_count, (int)batch_size,
+			&one,
+			input_batch.get_device_ptr_readonly(), (int)input_count,
+			error_batch.get_device_ptr_readonly(), (int)activation_count,
+			&one,
+			weight_deltas.get_device_ptr(), (int)input_count));
+
+		//passing_error_batch = weights * delta_batch
+		if (passing_error_batch != nullptr)
+		{
+			cublas_check(cublasSgemm(
+				handle, CUBLAS_OP_N, CUBLAS_OP_N,
+				(int)input_count, (int)batch_size, (int)activation_count,
+				&one,
+				weights.get_device_ptr_readonly(), (int)input_count,
+				error_batch.get_device_ptr_readonly(), (int)activation_count,
+				&zero,
+				passing_error_batch->get_device_ptr(), (int)input_count));
+		}
+		return;
+	}
+#endif
+
+	unsigned int weight_count = weights.item_count();
+	profiler_count_kernel_launch();
+	gpu_fc_backprop_batch_weight_kernel << <get_block_count(weight_count), THREADS_PER_BLOCK, 0, current_stream >> > (
+		error_batch.get_device_ptr_readonly(),
+		input_batch.get_device_ptr_readonly(),
+		weight_deltas.get_device_ptr(),
+		activation_count,
+		input_count,
+		batch_size);
+
+	//passing error is null when this is the first layer
+	if (passing_error_batch != nullptr)
+	{
+		unsigned int passing_size = passing_error_batch->item_count();
+		profiler_count_kernel_launch();
+		gpu_fc_backprop_batch_passing_error_kernel << <get_block_count(passing_size), THREADS_PER_BLOCK, 0, current_stream >> > (
+			error_batch.get_device_ptr_readonly(),
+			weights.get_device_ptr_readonly(),
+			passing_error_batch->get_device_ptr(),
+			activation_count,
+			input_count,
+			batch_size);
+	}
+
+	check_for_error_and_synchronize();
+}
+
+//one thread per weight of one kernel
+//sums up the delta of every output multiplied with the input that lies under this weight
+__global__ void gpu_conv_kernel_delta_kernel(
+	const float* input,
+	const float* delta,
+	float* kernel_deltas,
+	const int input_depth,
+	const int input_width,
+	const int kernel_width,
+	const int output_width,
+	const int stride)
+{
+	unsigned int weight_idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+	if (weight_idx < kernel_width * kernel_width * input_depth)
+	{
+		int kernel_x = get_x(weight_idx, kernel_width, kernel_width);
+		int kernel_y = get_y(weight_idx, kernel_width, kernel_width);
+		int kernel_z = get_z(weight_idx, kernel_width, kernel_width);
+
+		float sum = 0;
+		for (int output_y = 0; output_y < output_width; output_y++)
+		{
+			for (int output_x = 0; output_x < output_width; output_x++)
+			{
+				int input_idx = get_idx(
+					output_x * stride + kernel_x,
+					output_y * stride + kernel_y,
+					kernel_z,
+					input_width,
+					input_width);
+				sum += delta[output_x + output_y * output_width] * input[input_idx];
+			}
+		}
+		kernel_deltas[weight_idx] += sum;
+	}
+}
+
+//one thread per input value
+//adds up the delta of every output this input was used for multiplied with the weight it was multiplied with
+//this is the full convolution of the delta with the flipped kernel
+__global__ void gpu_conv_passing_error_kernel(
+	const float* weights,
+	const float* delta,
+	float* passing_error,
+	const int input_depth,
+	const int input_width,
+	const int kernel_width,
+	const int output_width,
+	const int stride)
+{
+	unsigned int input_idx = blockIdx.x * blockDim.x + threadIdx.x;
+
+	if (input_idx < input_width * input_width * input_depth)
+	{
+		int input_x = get_x(input_idx, input_width, input_width);
+		int input_y = get_y(input_idx, input_width, input_width);
+		int input_z = get_z(input_idx, input_width, input_width);
+
+		float sum = 0;
+		for (int kernel_y = 0; kernel_y < kernel_width && kernel_y <= input_y; kernel_y++)
+		{
+			int output_y = input_y - kernel_y;
+			if (output_y % stride != 0 || output_y / stride >= output_width)
+				continue;
+			output_y /= stride;
+
+			for (int kernel_x = 0; kernel_x < kernel_width && kernel_x <= input_x; kernel_x++)
+			{
+				int output_x = input_x - kernel_x;
+				if (output_x % stride != 0 || output_x / stride >= output_width)
+					continue;
+				output_x /= stride;
+
+				int weight_idx = get_idx(kernel_x, kernel_y, input_z, kernel_width, kernel_width);
+				sum += delta[output_x + output_y * output_width] * weights[weight_idx];
+			}
+		}
+		passing_error[input_idx] += sum;
+	}
+}
+
+void gpu_convolution_backprop(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const matrix& gpu_activations,
+	matrix& gpu_error,
+	matrix* gpu_passing_error,
+	std::vector<matrix>& gpu_kernel_deltas,
+	matrix& gpu_bias_deltas,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width,
+	e_activation_t activation_fn)
+{
+	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_error.get_device_ptr() != nullptr));
+	smart_assert((gpu_bias_deltas.get_device_ptr() != nullptr));
+	smart_assert((gpu_passing_error == nullptr || gpu_passing_error->get_device_ptr() != nullptr));
+
+	//the error is multiplied with the activation derivative in place
+	//and the biases are not shared, so the bias deltas are the same format as the error
+	unsigned int size = gpu_activations.item_count();
+	dispatch_activation(activation_fn, [&](auto traits) {
+		profiler_count_kernel_launch();
+		gpu_fc_delta_kernel<decltype(traits)> << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+			gpu_activations.get_device_ptr_readonly(),
+			gpu_error.get_device_ptr(),
+			gpu_error.get_device_ptr(),
+			gpu_bias_deltas.get_device_ptr(),
+			size);
+	});
+	check_for_error_and_synchronize();
+
+	if (gpu_passing_error != nullptr)
+	{
+		cudaMemsetAsync(
+			gpu_passing_error->get_device_ptr(),
+			0,
+			gpu_passing_error->item_count() * sizeof(float),
+			current_stream);
+	}
+
+	unsigned int kernel_item_count = (unsigned int)(kernel_width * kernel_width * input_depth);
+	unsigned int input_item_count = (unsigned int)(input_width * input_width * input_depth);
+
+	//every kernel only affected one depth layer of the output
+	for (int activation_depth = 0; activation_depth < kernel_count; activation_depth++)
+	{
+		const float* delta = gpu_error.get_device_ptr_layer(activation_depth);
+
+		profiler_count_kernel_launch();
+		gpu_conv_kernel_delta_kernel << <get_block_count(kernel_item_count), THREADS_PER_BLOCK, 0, current_stream >> > (
+			gpu_input.get_device_ptr_readonly(),
+			delta,
+			gpu_kernel_deltas[activation_depth].get_device_ptr(),
+			(int)input_depth,
+			(int)input_width,
+			(int)kernel_width,
+			(int)output_width,
+			(int)stride);
+		check_for_error_and_synchronize();
+
+		if (gpu_passing_error != nullptr)
+		{
+			profiler_count_kernel_launch();
+			gpu_conv_passing_error_kernel << <get_block_count(input_item_count), THREADS_PER_BLOCK, 0, current_stream >> > (
+				gpu_kernel_weights[activation_depth].get_device_ptr_readonly(),
+				delta,
+				gpu_passing_error->get_device_ptr(),
+				(int)input_depth,
+				(int)input_width,
+				(int)kernel_width,
+				(int)output_width,
+				(int)stride);
+			check_for_error_and_synchronize();
+		}
+	}
+}
+
+//one thread per parameter, the branches of the other optimizers are removed at compile time
+template<e_optimizer_t optimizer_type>
+__global__ void gpu_optimizer_step_kernel(
+	const optimizer_step_settings settings,
+	float* params,
+	float* deltas,
+	float* first_moment,
+	float* second_moment,
+	unsigned int size
+)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		float unused_moment = 0;
+		optimizer_update_item<optimizer_type>(
+			settings,
+			params[index],
+			deltas[index],
+			first_moment[index],
+			second_moment != nullptr ? second_moment[index] : unused_moment);
+	}
+}
+
+void gpu_optimizer_step(
+	e_optimizer_t optimizer_type,
+	const optimizer_step_settings& settings,
+	float* params,
+	float* deltas,
+	float* first_moment,
+	float* second_moment,
+	size_t count)
+{
+	smart_assert(params != nullptr);
+	smart_assert(deltas != nullptr);
+	smart_assert(first_moment != nullptr);
+
+	unsigned int size = (unsigned int)count;
+	dispatch_optimizer(optimizer_type, [&](auto type) {
+		profiler_count_kernel_launch();
+		gpu_optimizer_step_kernel<decltype(type)::value> << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+			settings,
+			params,
+			deltas,
+			first_moment,
+			second_moment,
+			size);
+	});
+	check_for_error_and_synchronize();
+}
+
+void gpu_apply_deltas(
+	matrix& a,
+	matrix& delta,
+	matrix& momentum,
+	size_t training_data_count,
+	float learning_rate)
+{
+	smart_assert((a.get_device_ptr() != nullptr));
+	smart_assert((delta.get_device_ptr() != nullptr));
+	smart_assert((momentum.get_device_ptr() != nullptr));
+
+	gpu_apply_deltas(
+		a.get_device_ptr(),
+		delta.get_device_ptr(),
+		momentum.get_device_ptr(),
+		a.item_count(),
+		training_data_count,
+		learning_rate);
+}
+
+void gpu_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	size_t training_data_count,
+	float learning_rate)
+{
+	//momentum with a beta of 0.9, the same as cpu_apply_deltas
+	optimizer_step_settings settings{};
+	settings.learning_rate = learning_rate;
+	settings.delta_scale = 1.0f / (float)training_data_count;
+	settings.beta1 = 0.9f;
+	gpu_optimizer_step(momentum_optimizer, settings, params, deltas, momentum, nullptr, count);
+}
+
+template<typename activation_t>
+__global__ void gpu_activation_kernel(float* data, unsigned int size)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		data[index] = activation_t::activate(data[index]);
+	}
+}
+
+//one warp per row, the values of the row are read three times from global memory
+//but the rows of an output layer are short, so they stay in the cache
+__global__ void gpu_add_bias_softmax_kernel(
+	float* data,
+	const float* biases,
+	unsigned int row_width,
+	unsigned int row_count)
+{
+	const unsigned int row = blockIdx.x * ROWS_PER_BLOCK + threadIdx.x / WARP_SIZE;
+	const unsigned int lane = threadIdx.x % WARP_SIZE;
+	if (row >= row_count)
+	{
+		return;
+	}
+	float* values = data + row * row_width;
+
+	float max_value = -INFINITY;
+	for (unsigned int i = lane; i < row_width; i += WARP_SIZE)
+	{
+		values[i] += biases == nullptr ? 0.0f : biases[i];
+		max_value = fmaxf(max_value, values[i]);
+	}
+	max_value = warp_all_reduce_max(max_value);
+
+	float sum = 0;
+	for (unsigned int i = lane; i < row_width; i += WARP_SIZE)
+	{
+		values[i] = expf(values[i] - max_value);
+		sum += values[i];
+	}
+	const float inverse_sum = 1.0f / warp_all_reduce_sum(sum);
+
+	for (unsigned int i = lane; i < row_width; i += WARP_SIZE)
+	{
+		values[i] *= inverse_sum;
+	}
+}
+
+static void gpu_add_bias_softmax(
+	float* data,
+	const float* biases,
+	size_t row_width,
+	size_t count)
+{
+	unsigned int row_count = (unsigned int)(count / row_width);
+	profiler_count_kernel_launch();
+	gpu_add_bias_softmax_kernel << <get_row_block_count(row_count), ROW_BLOCK_SIZE, 0, current_stream >> > (
+		data,
+		biases,
+		(unsigned int)row_width,
+		row_count);
+	check_for_error_and_synchronize();
+}
+
+void gpu_activation_fn(
+	matrix& gpu_memory,
+	e_activation_t activation_idx)
+{
+	smart_assert((gpu_memory.get_device_ptr() != nullptr));
+	smart_assert(gpu_memory.item_count() > 0);
+
+	//without biases all values are one row
+	if (activation_idx == softmax_fn)
+	{
+		gpu_add_bias_softmax(gpu_memory.get_device_ptr(), nullptr, gpu_memory.item_count(), gpu_memory.item_count());
+		return;
+	}
+
+	unsigned int size = gpu_memory.item_count();
+	dispatch_activation(activation_idx, [&](auto traits) {
+		profiler_count_kernel_launch();
+		gpu_activation_kernel<decltype(traits)> << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+			gpu_memory.get_device_ptr(),
+			size);
+	});
+
+	check_for_error_and_synchronize();
+}
+
+//the biases can be null, then only the activation is applied
+template<typename activation_t>
+__global__ void gpu_add_bias_activation_kernel(
+	float* activations,
+	const float* biases,
+	unsigned int bias_size,
+	unsigned int size)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		const float bias = biases == nullptr ? 0.0f : biases[index % bias_size];
+		activations[index] = activation_t::activate(activations[index] + bias);
+	}
+}
+
+//the epilogue for the library calls without one (cublas, cudnn)
+//nothing is launched for the plain product
+template<typename activation_t>
+static void gpu_bias_activation_pass(float* data, const float* biases, size_t bias_size, size_t size)
+{
+	if (biases == nullptr && std::is_same<activation_t, no_activation_traits>::value)
+	{
+		return;
+	}
+
+	profiler_count_kernel_launch();
+	gpu_add_bias_activation_kernel<activation_t> << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		data,
+		biases,
+		(unsigned int)bias_size,
+		(unsigned int)size);
+	check_for_error_and_synchronize();
+}
+
+void gpu_add_bias_activation(
+	matrix& gpu_activations,
+	const matrix& gpu_biases,
+	e_activation_t activation_idx)
+{
+	smart_assert((gpu_activations.get_device_ptr() != nullptr));
+	smart_assert((gpu_biases.get_device_ptr_readonly() != nullptr));
+	smart_assert(gpu_biases.item_count() > 0);
+	smart_assert(gpu_activations.item_count() % gpu_biases.item_count() == 0);
+
+	if (activation_idx == softmax_fn)
+	{
+		gpu_add_bias_softmax(
+			gpu_activations.get_device_ptr(),
+			gpu_biases.get_device_ptr_readonly(),
+			gpu_biases.item_count(),
+			gpu_activations.item_count());
+		return;
+	}
+
+	unsigned int size = gpu_activations.item_count();
+	dispatch_activation(activation_idx, [&](auto traits) {
+		profiler_count_kernel_launch();
+		gpu_add_bias_activation_kernel<decltype(traits)> << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+			gpu_activations.get_device_ptr(),
+			gpu_biases.get_device_ptr_readonly(),
+			gpu_biases.item_count(),
+			size);
+	});
+
+	check_for_error_and_synchronize();
+}
+__global__ void gpu_set_all_kernel(
+	float* data,
+	float value,
+	unsigned int size)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		data[index] = value;
+	}
+}
+
+void gpu_set_all(float* data, size_t count, float value)
+{
+	smart_assert(data != nullptr);
+	if (count == 0)
+	{
+		return;
+	}
+
+	unsigned int size = (unsigned int)count;
+	profiler_count_kernel_launch();
+	gpu_set_all_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		data,
+		value,
+		size);
+	check_for_error_and_synchronize();
+}
+
+//every value has its own counter, so no random state is kept between the threads
+__global__ void gpu_apply_noise_kernel(
+	float* data,
+	float min,
+	float max,
+	uint64_t seed,
+	unsigned int size)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		data[index] += counter_uniform(seed, 0, index, min, max);
+	}
+}
+
+void gpu_apply_noise(float* data, size_t count, float min, float max, uint64_t seed)
+{
+	smart_assert(data != nullptr);
+	if (count == 0)
+	{
+		return;
+	}
+
+	unsigned int size = (unsigned int)count;
+	profiler_count_kernel_launch();
+	gpu_apply_noise_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		data,
+		min,
+		max,
+		seed,
+		size);
+	check_for_error_and_synchronize();
+}
+
+__global__ void gpu_decode_precision_kernel(
+	const uint16_t* compact,
+	float* values,
+	e_precision_t precision,
+	unsigned int size)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		values[index] = decode_precision(precision, compact[index]);
+	}
+}
+
+void gpu_decode_precision(
+	const uint16_t* compact,
+	float* values,
+	size_t count,
+	e_precision_t precision)
+{
+	smart_assert(compact != nullptr);
+	smart_assert(values != nullptr);
+	if (count == 0)
+	{
+		return;
+	}
 
+	unsigned int size = (unsigned int)count;
+	profiler_count_kernel_launch();
+	gpu_decode_precision_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		compact,
+		values,
+		precision,
+		size);
 	check_for_error_and_synchronize();
 }
 
-__global__ void gpu_fc_backprop_kernel(
+__global__ void gpu_cost_derivative_kernel(
 	const float* activations,
-	const float* weights,
-	const float* input,
-	const float* error,
-	float* passing_error,
-	float* weight_deltas,
-	float* bias_deltas,
-	e_activation_t activation_fn,
-	const unsigned int activation_count,
-	const unsigned int input_count
-)
+	const float* expected,
+	float* error,
+	unsigned int size,
+	e_cost_function_t cost_fn,
+	float* cost)
 {
-	unsigned int neuron_idx = blockIdx.x * blockDim.x + threadIdx.x;
-	if (neuron_idx < activation_count)
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	float item_cost = 0;
+	if (index < size)
+	{
+		const float difference = activations[index] - expected[index];
+		if (cost_fn == cross_entropy_cost)
+		{
+			error[index] = difference;
+			item_cost = -expected[index] * logf(fmaxf(activations[index], CROSS_ENTROPY_EPSILON));
+		}
+		else
+		{
+			error[index] = 2.0f * difference;
+			item_cost = difference * difference;
+		}
+	}
+	//every thread of the warp takes part in the reduction, also the ones behind the end
+	if (cost != nullptr)
 	{
-		float error_value = error[neuron_idx];
+		item_cost = warp_reduce_sum(item_cost);
+		if (threadIdx.x % WARP_SIZE == 0 && item_cost != 0)
+		{
+			atomicAdd(cost, item_cost);
+		}
+	}
+}
 
-		float unactivated_activation = gpu_single_inverse(activations[neuron_idx], activation_fn);
-		float activation_derivative = gpu_single_derivative(unactivated_activation, activation_fn);
+void gpu_cost_derivative(
+	const float* activations,
+	const float* expected,
+	float* error,
+	size_t count,
+	e_cost_function_t cost_fn,
+	float* cost)
+{
+	smart_assert(activations != nullptr);
+	smart_assert(expected != nullptr);
+	smart_assert(error != nullptr);
+	if (count == 0)
+	{
+		return;
+	}
 
-		//bias change
-		float bias_change = error_value * activation_derivative;
-		bias_deltas[neuron_idx] += bias_change;
+	unsigned int size = (unsigned int)count;
+	profiler_count_kernel_launch();
+	gpu_cost_derivative_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		activations,
+		expected,
+		error,
+		size,
+		cost_fn,
+		cost);
+	check_for_error_and_synchronize();
+}
 
-		//iterate input layer
-		for (int input_idx = 0; input_idx < input_count; input_idx++)
+__global__ void gpu_evaluate_rows_kernel(
+	const float* outputs,
+	const float* labels,
+	unsigned int row_count,
+	unsigned int row_width,
+	e_cost_function_t cost_fn,
+	float* totals)
+{
+	unsigned int row = blockIdx.x * blockDim.x + threadIdx.x;
+	if (row < row_count)
+	{
+		const float* output = outputs + row * row_width;
+		const float* label = labels + row * row_width;
+		unsigned int output_max_idx = 0;
+		unsigned int label_max_idx = 0;
+		float cost = 0;
+		for (unsigned int i = 0; i < row_width; i++)
+		{
+			if (output[i] > output[output_max_idx])
+			{
+				output_max_idx = i;
+			}
+			if (label[i] > label[label_max_idx])
+			{
+				label_max_idx = i;
+			}
+			cost += cost_fn == cross_entropy_cost ?
+				-label[i] * logf(fmaxf(output[i], CROSS_ENTROPY_EPSILON)) :
+				(output[i] - label[i]) * (output[i] - label[i]);
+		}
+		if (output_max_idx == label_max_idx)
 		{
-			float input_value = input[input_idx];
+			atomicAdd(totals, 1.0f);
+		}
+		atomicAdd(totals + 1, cost);
+	}
+}
+
+void gpu_evaluate_rows(
+	const float* outputs,
+	const float* labels,
+	size_t row_count,
+	size_t row_width,
+	e_cost_function_t cost_fn,
+	float* totals)
+{
+	smart_assert(outputs != nullptr);
+	smart_assert(labels != nullptr);
+	smart_assert(totals != nullptr);
+	if (row_count == 0)
+	{
+		return;
+	}
+
+	//one thread per row, the rows of a classification are short
+	unsigned int size = (unsigned int)row_count;
+	profiler_count_kernel_launch();
+	gpu_evaluate_rows_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		outputs,
+		labels,
+		size,
+		(unsigned int)row_width,
+		cost_fn,
+		totals);
+	check_for_error_and_synchronize();
+}
 
-			int weight_idx = get_idx(input_idx, neuron_idx, 0, activation_count, input_count);
+__global__ void gpu_gather_rows_kernel(
+	const float* source,
+	unsigned int source_width,
+	unsigned int source_offset,
+	const uint32_t* row_indices,
+	unsigned int count,
+	float* destination,
+	unsigned int destination_width,
+	unsigned int size)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index < size)
+	{
+		//the threads of one row read one contiguous source row
+		const unsigned int row = index / count;
+		const unsigned int column = index % count;
+		destination[row * destination_width + column] =
+			source[(size_t)row_indices[row] * source_width + source_offset + column];
+	}
+}
 
-			float weight = weights[weight_idx]; // could be moved in if statement
+void gpu_gather_rows(
+	const float* source,
+	size_t source_width,
+	size_t source_offset,
+	const uint32_t* row_indices,
+	size_t row_count,
+	size_t count,
+	float* destination,
+	size_t destination_width)
+{
+	smart_assert(source != nullptr);
+	smart_assert(row_indices != nullptr);
+	smart_assert(destination != nullptr);
+	smart_assert(source_offset + count <= source_width);
+	smart_assert(count <= destination_width);
+	if (row_count == 0 || count == 0)
+	{
+		return;
+	}
 
-			weight_deltas[weight_idx] += (error_value * activation_derivative * input_value);
+	unsigned int size = (unsigned int)(row_count * count);
+	profiler_count_kernel_launch();
+	gpu_gather_rows_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		source,
+		(unsigned int)source_width,
+		(unsigned int)source_offset,
+		row_indices,
+		(unsigned int)count,
+		destination,
+		(unsigned int)destination_width,
+		size);
+	check_for_error_and_synchronize();
+}
 
-			if (passing_error != nullptr)
+__global__ void gpu_non_zero_rows_kernel(
+	const float* table,
+	unsigned int row_count,
+	unsigned int row_width,
+	unsigned int count,
+	float* result)
+{
+	unsigned int row = blockIdx.x * blockDim.x + threadIdx.x;
+	if (row < row_count)
+	{
+		const float* values = table + (size_t)row * row_width;
+		float found = 0.0f;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (values[i] != 0.0f)
 			{
-				passing_error[input_idx] = (error_value * activation_derivative * weight);
+				found = 1.0f;
+				break;
 			}
 		}
+		result[row] = found;
 	}
 }
 
-void gpu_fc_backprop(
-	const matrix& activations,
-	const matrix& weights,
-	const matrix& input,
-	const matrix& error,
-	matrix* passing_error,
-	matrix& weight_deltas,
-	matrix& bias_deltas,
-	e_activation_t activation_fn)
+void gpu_non_zero_rows(
+	const float* table,
+	size_t row_count,
+	size_t row_width,
+	size_t count,
+	float* result)
 {
-	smart_assert((activations.get_device_ptr_readonly() != nullptr));
-	smart_assert((weights.get_device_ptr_readonly() != nullptr));
-	smart_assert((input.get_device_ptr_readonly() != nullptr));
-	smart_assert((error.get_device_ptr_readonly() != nullptr));
-	smart_assert((weight_deltas.get_device_ptr() != nullptr));
-	smart_assert((bias_deltas.get_device_ptr() != nullptr));
-
-	unsigned int size = activations.item_count();
+	smart_assert(table != nullptr);
+	smart_assert(result != nullptr);
+	if (row_count == 0)
+	{
+		return;
+	}
 
-	cuda_sync();
-	gpu_fc_backprop_kernel << <get_block_count(size), THREADS_PER_BLOCK >> > (
-		activations.get_device_ptr_readonly(),
-		weights.get_device_ptr_readonly(),
-		input.get_device_ptr_readonly(),
-		error.get_device_ptr_readonly(),
-		passing_error == nullptr ? nullptr : passing_error->get_device_ptr(),
-		weight_deltas.get_device_ptr(),
-		bias_deltas.get_device_ptr(),
-		activation_fn,
+	unsigned int size = (unsigned int)row_count;
+	profiler_count_kernel_launch();
+	gpu_non_zero_rows_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		table,
 		size,
-		input.item_count());
+		(unsigned int)row_width,
+		(unsigned int)count,
+		result);
+	check_for_error_and_synchronize();
+}
 
+//one thread per value of the batch, the transform of an item is computed again by every thread
+//since it only needs a few random numbers, so the whole augmentation is one pass
+__global__ void gpu_augment_rows_kernel(
+	const float* source,
+	float* destination,
+	unsigned int width,
+	unsigned int height,
+	unsigned int depth,
+	augmentation_settings settings,
+	unsigned int size)
+{
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (idx >= size)
+	{
+		return;
+	}
+
+	const unsigned int row_width = width * height * depth;
+	const unsigned int row = idx / row_width;
+	const unsigned int item_idx = idx % row_width;
+	destination[idx] = augment_item(
+		settings,
+		source + (size_t)row * row_width,
+		width,
+		height,
+		row,
+		item_idx % width,
+		item_idx / width % height,
+		item_idx / (width * height));
+}
+
+void gpu_augment_rows(
+	const float* source,
+	float* destination,
+	size_t row_count,
+	size_t width,
+	size_t height,
+	size_t depth,
+	const augmentation_settings& settings)
+{
+	smart_assert(source != nullptr);
+	smart_assert(destination != nullptr);
+	smart_assert(source != destination);
+	smart_assert(row_count * width * height * depth <= 0xFFFFFFFFull);
+	if (row_count == 0 || width * height * depth == 0)
+	{
+		return;
+	}
+
+	unsigned int size = (unsigned int)(row_count * width * height * depth);
+	profiler_count_kernel_launch();
+	gpu_augment_rows_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		source,
+		destination,
+		(unsigned int)width,
+		(unsigned int)height,
+		(unsigned int)depth,
+		settings,
+		size);
 	check_for_error_and_synchronize();
 }
 
-__global__ void gpu_apply_deltas_kernel(
-	float* a,
-	float* delta,
-	float* momentum,
-	int training_data_count,
-	float learning_rate,
-	unsigned int size
-)
+//one thread per parameter of the next generation
+//the parents of a genome are picked again by every thread, the tournaments only read a few values
+__global__ void gpu_evolve_rows_kernel(
+	const float* genomes,
+	const float* fitness,
+	unsigned int genome_count,
+	unsigned int genome_width,
+	evolution_settings settings,
+	float* next_genomes,
+	unsigned int size)
+{
+	unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (idx >= size)
+	{
+		return;
+	}
+
+	const unsigned int genome_idx = idx / genome_width;
+	const unsigned int item_idx = idx % genome_width;
+	if (genome_idx == settings.elite_idx)
+	{
+		next_genomes[idx] = genomes[idx];
+		return;
+	}
+
+	uint32_t first_parent = 0;
+	uint32_t second_parent = 0;
+	select_parents(settings, fitness, genome_count, genome_idx, first_parent, second_parent);
+	next_genomes[idx] = evolve_item(
+		settings,
+		genome_count,
+		genome_idx,
+		item_idx,
+		genomes[(size_t)first_parent * genome_width + item_idx],
+		genomes[(size_t)second_parent * genome_width + item_idx]);
+}
+
+void gpu_evolve_rows(
+	const float* genomes,
+	const float* fitness,
+	size_t genome_count,
+	size_t genome_width,
+	const evolution_settings& settings,
+	float* next_genomes)
+{
+	smart_assert(genomes != nullptr);
+	smart_assert(fitness != nullptr);
+	smart_assert(next_genomes != nullptr);
+	smart_assert(genome_count * genome_width <= 0xFFFFFFFFull);
+	if (genome_count == 0 || genome_width == 0)
+	{
+		return;
+	}
+
+	unsigned int size = (unsigned int)(genome_count * genome_width);
+	profiler_count_kernel_launch();
+	gpu_evolve_rows_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		genomes,
+		fitness,
+		(unsigned int)genome_count,
+		(unsigned int)genome_width,
+		settings,
+		next_genomes,
+		size);
+	check_for_error_and_synchronize();
+}
+
+void gpu_copy_peer(
+	float* destination,
+	int destination_device,
+	const float* source,
+	int source_device,
+	size_t count)
+{
+	smart_assert(destination != nullptr);
+	smart_assert(source != nullptr);
+	if (count == 0)
+	{
+		return;
+	}
+
+	cudaError_t error = cudaMemcpyPeerAsync(
+		destination,
+		destination_device,
+		source,
+		source_device,
+		count * sizeof(float),
+		current_stream);
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("could not copy between gpus: " + std::string(cudaGetErrorString(error)));
+	}
+	check_for_error_and_synchronize();
+}
+
+void gpu_enable_peer_access(int device, int peer_device)
+{
+	int can_access = 0;
+	if (device == peer_device ||
+		cudaDeviceCanAccessPeer(&can_access, device, peer_device) != cudaSuccess ||
+		can_access == 0)
+	{
+		return;
+	}
+
+	//peer access is enabled for the current device
+	int previous_device = 0;
+	cudaGetDevice(&previous_device);
+	cudaSetDevice(device);
+	cudaError_t error = cudaDeviceEnablePeerAccess(peer_device, 0);
+	cudaSetDevice(previous_device);
+
+	if (error == cudaErrorPeerAccessAlreadyEnabled)
+	{
+		//clears the error, it is not an error for us
+		cudaGetLastError();
+	}
+	else if (error != cudaSuccess)
+	{
+		throw std::runtime_error("could not enable peer access: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+//the padding after the values is filled with zeros
+__global__ void gpu_quantize_int8_kernel(
+	const float* values,
+	int8_t* quantized,
+	float inverse_scale,
+	unsigned int size,
+	unsigned int padded_size)
 {
 	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
-	if (index < size)
+	if (index < padded_size)
+	{
+		quantized[index] = index < size ? quantize_int8(values[index], inverse_scale) : 0;
+	}
+}
+
+//quantizes count values into the scratch buffer (padded to a multiple of 4)
+static const int8_t* gpu_quantize_input(
+	gpu_scratch_buffer& buffer,
+	const float* values,
+	size_t count,
+	float input_scale)
+{
+	const unsigned int padded_size = (unsigned int)int8_matrix::padded_count(count);
+	//the buffer holds floats, 4 int8 values fit into one
+	int8_t* quantized = (int8_t*)buffer.get(padded_size / 4);
+	profiler_count_kernel_launch();
+	gpu_quantize_int8_kernel << <get_block_count(padded_size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		values,
+		quantized,
+		1.0f / input_scale,
+		(unsigned int)count,
+		padded_size);
+	check_for_error_and_synchronize();
+	return quantized;
+}
+
+//one warp per row, every lane sums up 4 products at once with dp4a
+__global__ void gpu_int8_dot_product_kernel(
+	const int8_t* weights,
+	const float* scales,
+	const int8_t* input,
+	float input_scale,
+	float* activations,
+	unsigned int row_count,
+	unsigned int padded_column_count)
+{
+	const unsigned int row = blockIdx.x * ROWS_PER_BLOCK + threadIdx.x / WARP_SIZE;
+	const unsigned int lane = threadIdx.x % WARP_SIZE;
+	if (row >= row_count)
+	{
+		return;
+	}
+
+	const int* weight_row = (const int*)(weights + row * padded_column_count);
+	const int* input_packed = (const int*)input;
+	int sum = 0;
+	for (unsigned int i = lane; i < padded_column_count / 4; i += WARP_SIZE)
 	{
-		float beta = 0.9f;
-		float curr_delta = delta[index] / (float)training_data_count;
-		momentum[index] = beta * momentum[index] + (1 - beta) * curr_delta;
+		sum = __dp4a(weight_row[i], input_packed[i], sum);
+	}
 
-		a[index] -= (momentum[index] * learning_rate);
-		delta[index] = 0;
+	for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+	{
+		sum += __shfl_down_sync(0xffffffff, sum, offset);
+	}
+	if (lane == 0)
+	{
+		activations[row] = (float)sum * input_scale * scales[row];
 	}
 }
 
-void gpu_apply_deltas(
-	matrix& a,
-	matrix& delta,
-	matrix& momentum,
-	size_t training_data_count,
-	float learning_rate)
+void gpu_int8_dot_product(
+	const int8_matrix& weights,
+	const matrix& gpu_input,
+	float input_scale,
+	matrix& gpu_activations)
 {
-	smart_assert((a.get_device_ptr() != nullptr));
-	smart_assert((delta.get_device_ptr() != nullptr));
-	smart_assert((momentum.get_device_ptr() != nullptr));
+	smart_assert(weights.get_device_ptr_readonly() != nullptr);
+	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations.get_device_ptr() != nullptr));
+	smart_assert(weights.get_column_count() == gpu_input.item_count());
+	smart_assert(weights.get_row_count() == gpu_activations.item_count());
 
-	unsigned int size = a.item_count();
-	cuda_sync();
-	gpu_apply_deltas_kernel << < get_block_count(size), THREADS_PER_BLOCK >> > (
-		a.get_device_ptr(),
-		delta.get_device_ptr(),
-		momentum.get_device_ptr(),
-		training_data_count,
-		learning_rate,
-		a.item_count()
-		);
+	static thread_local gpu_scratch_buffer input_buffer;
+	const int8_t* quantized_input = gpu_quantize_input(
+		input_buffer,
+		gpu_input.get_device_ptr_readonly(),
+		gpu_input.item_count(),
+		input_scale);
+
+	unsigned int row_count = (unsigned int)weights.get_row_count();
+	profiler_count_kernel_launch();
+	gpu_int8_dot_product_kernel << <get_row_block_count(row_count), ROW_BLOCK_SIZE, 0, current_stream >> > (
+		weights.get_device_ptr_readonly(),
+		weights.get_device_scales_readonly(),
+		quantized_input,
+		input_scale,
+		gpu_activations.get_device_ptr(),
+		row_count,
+		(unsigned int)weights.get_padded_column_count());
 	check_for_error_and_synchronize();
 }
 
-__global__ void gpu_activation_kernel(float* data, unsigned int size, int activation_idx)
+//one thread per output value
+//the input values of the window are packed into groups of 4 for dp4a
+//the kernel rows are zero padded, so the last group can contain any values
+__global__ void gpu_int8_cross_correlation_kernel(
+	const int8_t* input,
+	const int8_t* kernels,
+	const float* scales,
+	float input_scale,
+	float* activations,
+	unsigned int input_width,
+	unsigned int input_height,
+	unsigned int input_depth,
+	unsigned int kernel_size,
+	unsigned int stride,
+	unsigned int output_width,
+	unsigned int output_height,
+	unsigned int kernel_count,
+	unsigned int padded_patch_size)
 {
 	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
-	if (index < size)
+	const unsigned int positions = output_width * output_height;
+	if (index >= positions * kernel_count)
+	{
+		return;
+	}
+
+	const unsigned int kernel_idx = index / positions;
+	const unsigned int position = index % positions;
+	const unsigned int x_start = (position % output_width) * stride;
+	const unsigned int y_start = (position / output_width) * stride;
+	const unsigned int window_size = kernel_size * kernel_size;
+	const unsigned int patch_size = window_size * input_depth;
+
+	const int* kernel_row = (const int*)(kernels + kernel_idx * padded_patch_size);
+	int sum = 0;
+	for (unsigned int group = 0; group < padded_patch_size / 4; group++)
 	{
-		data[index] = gpu_single_activation(data[index], activation_idx);
+		int packed = 0;
+		for (unsigned int j = 0; j < 4; j++)
+		{
+			const unsigned int i = group * 4 + j;
+			if (i < patch_size)
+			{
+				//same order as the flat kernel (x, then y, then depth)
+				const unsigned int z = i / window_size;
+				const unsigned int y = (i % window_size) / kernel_size;
+				const unsigned int x = i % kernel_size;
+				const int8_t value = input[(x_start + x) + (y_start + y) * input_width + z * input_width * input_height];
+				packed |= ((int)(uint8_t)value) << (8 * j);
+			}
+		}
+		sum = __dp4a(kernel_row[group], packed, sum);
 	}
+	activations[index] = (float)sum * input_scale * scales[kernel_idx];
 }
 
-void gpu_activation_fn(
-	matrix& gpu_memory,
-	e_activation_t activation_idx)
+void gpu_int8_valid_cross_correlation(
+	const int8_matrix& kernels,
+	const matrix& gpu_input,
+	float input_scale,
+	matrix& gpu_activations,
+	size_t kernel_size,
+	size_t stride)
 {
-	smart_assert((gpu_memory.get_device_ptr() != nullptr));
-	smart_assert(gpu_memory.item_count() > 0);
+	smart_assert(kernels.get_device_ptr_readonly() != nullptr);
+	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations.get_device_ptr() != nullptr));
+	smart_assert(kernels.get_row_count() == gpu_activations.get_depth());
+	smart_assert(kernels.get_column_count() == kernel_size * kernel_size * gpu_input.get_depth());
 
-	unsigned int size = gpu_memory.item_count();
-	cuda_sync();
-	gpu_activation_kernel << < get_block_count(size), THREADS_PER_BLOCK >> > (
-		gpu_memory.get_device_ptr(),
-		size,
-		(int)activation_idx);
+	static thread_local gpu_scratch_buffer input_buffer;
+	const int8_t* quantized_input = gpu_quantize_input(
+		input_buffer,
+		gpu_input.get_device_ptr_readonly(),
+		gpu_input.item_count(),
+		input_scale);
+
+	unsigned int size = (unsigned int)gpu_activations.item_count();
+	profiler_count_kernel_launch();
+	gpu_int8_cross_correlation_kernel << <get_block_count(size), THREADS_PER_BLOCK, 0, current_stream >> > (
+		quantized_input,
+		kernels.get_device_ptr_readonly(),
+		kernels.get_device_scales_readonly(),
+		input_scale,
+		gpu_activations.get_device_ptr(),
+		(unsigned int)gpu_input.get_width(),
+		(unsigned int)gpu_input.get_height(),
+		(unsigned int)gpu_input.get_depth(),
+		(unsigned int)kernel_size,
+		(unsigned int)stride,
+		(unsigned int)gpu_activations.get_width(),
+		(unsigned int)gpu_activations.get_height(),
+		(unsigned int)gpu_activations.get_depth(),
+		(unsigned int)kernels.get_padded_column_count());
+	check_for_error_and_synchronize();
+}
+
+//one warp per row, the lanes walk over the nonzero values of the row
+//and gather the input values with the column indices
+__global__ void gpu_sparse_dot_product_kernel(
+	const uint32_t* row_offsets,
+	const uint32_t* column_indices,
+	const float* values,
+	const float* input,
+	float* activations,
+	unsigned int row_count)
+{
+	const unsigned int row = blockIdx.x * ROWS_PER_BLOCK + threadIdx.x / WARP_SIZE;
+	const unsigned int lane = threadIdx.x % WARP_SIZE;
+	if (row >= row_count)
+	{
+		return;
+	}
+
+	const unsigned int row_end = row_offsets[row + 1];
+	float sum = 0;
+	for (unsigned int i = row_offsets[row] + lane; i < row_end; i += WARP_SIZE)
+	{
+		sum += values[i] * input[column_indices[i]];
+	}
+
+	for (int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+	{
+		sum += __shfl_down_sync(0xffffffff, sum, offset);
+	}
+	if (lane == 0)
+	{
+		activations[row] = sum;
+	}
+}
 
+void gpu_sparse_dot_product(
+	const sparse_matrix& weights,
+	const matrix& gpu_input,
+	matrix& gpu_activations)
+{
+	smart_assert(weights.get_device_row_offsets_readonly() != nullptr);
+	smart_assert((gpu_input.get_device_ptr_readonly() != nullptr));
+	smart_assert((gpu_activations.get_device_ptr() != nullptr));
+	smart_assert(weights.get_column_count() == gpu_input.item_count());
+	smart_assert(weights.get_row_count() == gpu_activations.item_count());
+
+	unsigned int row_count = (unsigned int)weights.get_row_count();
+	profiler_count_kernel_launch();
+	gpu_sparse_dot_product_kernel << <get_row_block_count(row_count), ROW_BLOCK_SIZE, 0, current_stream >> > (
+		weights.get_device_row_offsets_readonly(),
+		weights.get_device_column_indices_readonly(),
+		weights.get_device_values_readonly(),
+		gpu_input.get_device_ptr_readonly(),
+		gpu_activations.get_device_ptr(),
+		row_count);
 	check_for_error_and_synchronize();
-}
\ No newline at end of file
+}
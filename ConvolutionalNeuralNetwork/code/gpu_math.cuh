@@ -1,5 +1,6 @@
 #pragma once
 #include <stdexcept>
 #include "matrix.hpp"
+#include "precision.hpp"
 #include <cuda_runtime.h>
 #include <device_launch_parameters.h>
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "idx_file.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t read_big_endian_u32(const uint8_t* bytes)
+{
+	return
+		((size_t)bytes[0] << 24) |
+		((size_t)bytes[1] << 16) |
+		((size_t)bytes[2] << 8) |
+		(size_t)bytes[3];
+}
+
+idx_file::idx_file(const std::string& file_path)
+{
+#ifdef _WIN32
+	file_handle = CreateFileA(
+		file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		throw std::runtime_error("Could not open file " + file_path);
+	}
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file_handle, &file_size);
+	size = (size_t)file_size.QuadPart;
+
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle != nullptr)
+	{
+		data = (uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	const int descriptor = open(file_path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+	{
+		throw std::runtime_error("Could not open file " + file_path);
+	}
+	struct stat file_stat;
+	if (fstat(descriptor, &file_stat) == 0 && file_stat.st_size > 0)
+	{
+		size = (size_t)file_stat.st_size;
+		void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+		data = mapping == MAP_FAILED ? nullptr : (uint8_t*)mapping;
+	}
+	//the mapping stays valid after the file is closed
+	close(descriptor);
+#endif
+
+	if (data == nullptr)
+	{
+		unmap();
+		throw std::runtime_error("Could not map file " + file_path);
+	}
+
+	try
+	{
+		read_header();
+	}
+	catch (...)
+	{
+		unmap();
+		throw;
+	}
+}
+
+idx_file::~idx_file()
+{
+	unmap();
+}
+
+void idx_file::unmap()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping_handle != nullptr)
+	{
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+	if (file_handle != nullptr)
+	{
+		CloseHandle(file_handle);
+		file_handle = nullptr;
+	}
+#else
+	if (data != nullptr)
+	{
+		munmap(data, size);
+	}
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+void idx_file::read_header()
+{
+	if (size < 4 || data[0] != 0 || data[1] != 0)
+	{
+		throw std::runtime_error("file is not an idx file");
+	}
+	if (data[2] != IDX_UNSIGNED_BYTE_TYPE)
+	{
+		throw std::runtime_error("only idx files with unsigned bytes are supported");
+	}
+
+	const size_t dimension_count = data[3];
+	if (dimension_count == 0 || dimension_count > 4)
+	{
+		throw std::runtime_error("idx files need between 1 and 4 dimensions");
+	}
+	header_size = 4 + dimension_count * 4;
+	if (size < header_size)
+	{
+		throw std::runtime_error("idx file is too small");
+	}
+
+	std::vector<size_t> dimensions(dimension_count);
+	for (size_t i = 0; i < dimension_count; i++)
+	{
+		dimensions[i] = read_big_endian_u32(data + 4 + i * 4);
+	}
+
+	//the item format is filled from the innermost dimension on
+	size_t format[3] = { 1, 1, 1 };
+	for (size_t i = 1; i < dimension_count; i++)
+	{
+		format[dimension_count - 1 - i] = dimensions[i];
+	}
+	item_count = dimensions[0];
+	item_format = vector3(format[0], format[1], format[2]);
+
+	if (size - header_size < item_count * item_format.item_count())
+	{
+		throw std::runtime_error("idx file is smaller than its dimensions");
+	}
+}
+
+size_t idx_file::get_item_count() const
+{
+	return item_count;
+}
+
+vector3 idx_file::get_item_format() const
+{
+	return item_format;
+}
+
+const uint8_t* idx_file::get_values() const
+{
+	return data + header_size;
+}
+
+const uint8_t* idx_file::get_item(size_t idx) const
+{
+	if (idx >= item_count)
+	{
+		throw std::out_of_range("idx file item is out of range");
+	}
+	return get_values() + idx * item_format.item_count();
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vector3.hpp"
+
+/*
+	a memory mapped idx file (the format of the mnist data sets)
+
+	magic number - two zero bytes, the type of the values and the number of dimensions
+	dimensions   - one big endian 32 bit size per dimension
+	values       - the values, the last dimension is the innermost one
+
+	the first dimension is the item count, the others are the format of one item
+	the last dimension is the width, the one before the height and the one before the depth.
+	only unsigned bytes are supported (the type of all mnist files)
+*/
+constexpr uint8_t IDX_UNSIGNED_BYTE_TYPE = 0x08;
+
+class idx_file {
+private:
+	uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+
+	size_t item_count = 0;
+	vector3 item_format;
+	size_t header_size = 0;
+
+	void read_header();
+	void unmap();
+public:
+	//throws if the file can not be mapped or is not a valid idx file
+	idx_file(const std::string& file_path);
+	~idx_file();
+
+	idx_file(const idx_file&) = delete;
+	idx_file& operator=(const idx_file&) = delete;
+
+	size_t get_item_count() const;
+	vector3 get_item_format() const;
+
+	//the values of all items, item after item
+	const uint8_t* get_values() const;
+	const uint8_t* get_item(size_t idx) const;
+};
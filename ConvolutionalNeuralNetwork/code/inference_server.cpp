@@ -0,0 +1,283 @@
+#include "inference_server.hpp"
+#include <algorithm>
+
+static float percentile(std::vector<float> values, float fraction)
+{
+	if (values.empty())
+	{
+		return 0;
+	}
+	const size_t idx = std::min(values.size() - 1, (size_t)(fraction * (float)values.size()));
+	std::nth_element(values.begin(), values.begin() + idx, values.end());
+	return values[idx];
+}
+
+std::string inference_server::statistics::to_string() const
+{
+	std::string result = "";
+	result += "Requests: " + std::to_string(request_count) + "\n";
+	result += "Batches: " + std::to_string(batch_count) + "\n";
+	result += "Avg batch size: " + std::to_string(average_batch_size) + "\n";
+	result += "p50 latency: " + std::to_string(p50_latency_ms) + "ms\n";
+	result += "p99 latency: " + std::to_string(p99_latency_ms) + "ms\n";
+	result += "Throughput: " + std::to_string(throughput) + " requests/s\n";
+	result += "Running workers: " + std::to_string(running_workers) + "\n";
+	return result;
+}
+
+inference_server::inference_server(
+	const neural_network& model,
+	size_t worker_count,
+	size_t max_batch_size,
+	std::chrono::microseconds max_wait
+) :
+	max_batch_size(max_batch_size),
+	max_wait(max_wait),
+	input_format(model.get_input_format()),
+	output_format(model.get_output_readonly().get_format()),
+	statistics_start(std::chrono::steady_clock::now())
+{
+	if (max_batch_size == 0)
+	{
+		throw std::invalid_argument("the max batch size must be greater than 0");
+	}
+	if (worker_count == 0)
+	{
+		worker_count = std::max((size_t)1, (size_t)std::thread::hardware_concurrency());
+	}
+
+	parameters = std::make_shared<const neural_network>(model);
+	running_workers = worker_count;
+	latencies_ms.reserve(LATENCY_WINDOW);
+	for (size_t i = 0; i < worker_count; i++)
+	{
+		workers.push_back(std::make_unique<neural_network>(parameters));
+	}
+	for (size_t i = 0; i < worker_count; i++)
+	{
+		threads.emplace_back(&inference_server::worker_loop, this, i);
+	}
+}
+
+inference_server::~inference_server()
+{
+	stop();
+}
+
+std::future<matrix> inference_server::submit(const matrix& input)
+{
+	if (!vector3::are_equal(input.get_format(), input_format))
+	{
+		throw std::invalid_argument("the input does not have the input format of the network");
+	}
+
+	request curr;
+	//the workers copy the inputs on the host
+	curr.input = matrix(input_format);
+	input.copy_values_to_host(curr.input.host_span().data);
+	curr.submitted = std::chrono::steady_clock::now();
+	std::future<matrix> result = curr.output.get_future();
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		if (stopping)
+		{
+			throw std::runtime_error("the inference server is stopped");
+		}
+		queue.push_back(std::move(curr));
+	}
+	queue_cv.notify_one();
+	return result;
+}
+
+matrix inference_server::predict(const matrix& input)
+{
+	return submit(input).get();
+}
+
+void inference_server::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	queue_cv.notify_all();
+	for (auto& curr : threads)
+	{
+		if (curr.joinable())
+		{
+			curr.join();
+		}
+	}
+}
+
+std::vector<inference_server::request> inference_server::take_batch()
+{
+	std::vector<request> batch;
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	while (true)
+	{
+		queue_cv.wait(lock, [&]() { return stopping || !queue.empty(); });
+		if (queue.empty())
+		{
+			return batch;
+		}
+
+		//the oldest request decides how long the batch can wait
+		const auto deadline = queue.front().submitted + max_wait;
+		queue_cv.wait_until(lock, deadline, [&]() { return stopping || queue.size() >= max_batch_size; });
+		//another worker that waited as well could have taken the requests
+		if (!queue.empty())
+		{
+			break;
+		}
+	}
+
+	const size_t count = std::min(max_batch_size, queue.size());
+	for (size_t i = 0; i < count; i++)
+	{
+		batch.push_back(std::move(queue.front()));
+		queue.pop_front();
+	}
+	//the other workers can take the rest
+	if (!queue.empty())
+	{
+		queue_cv.notify_one();
+	}
+	return batch;
+}
+
+void inference_server::worker_loop(size_t worker_idx)
+{
+	neural_network& worker = *workers[worker_idx];
+	while (true)
+	{
+		std::vector<request> batch = take_batch();
+		if (batch.empty())
+		{
+			std::lock_guard<std::mutex> lock(statistics_mutex);
+			running_workers--;
+			return;
+		}
+
+		try
+		{
+			run_batch(worker, batch);
+		}
+		catch (...)
+		{
+			for (request& curr : batch)
+			{
+				curr.output.set_exception(std::current_exception());
+			}
+		}
+	}
+}
+
+void inference_server::run_batch(neural_network& worker, std::vector<request>& batch)
+{
+	gpu_stream_guard stream_guard(worker.get_stream(), worker.get_gpu_backend());
+	const bool gpu_mode = worker.is_in_gpu_mode();
+
+	std::vector<matrix> outputs(batch.size(), matrix(output_format));
+	if (worker.supports_batch_propagation())
+	{
+		worker.set_batch_size(batch.size());
+		const size_t input_items = input_format.item_count();
+		matrix input_batch(vector3(input_items, batch.size(), (size_t)1));
+		float* input_values = input_batch.host_span().data;
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			data_span<const float> values = batch[i].input.host_span_readonly();
+			std::copy(values.begin(), values.end(), input_values + i * input_items);
+		}
+		if (gpu_mode)
+		{
+			input_batch.enable_gpu_mode();
+		}
+
+		worker.forward_propagation_batch(input_batch);
+
+		matrix output_batch(worker.get_batch_output_readonly().get_format());
+		worker.get_batch_output_readonly().copy_values_to_host(output_batch.host_span().data);
+		const size_t output_items = output_format.item_count();
+		data_span<const float> output_values = output_batch.host_span_readonly();
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			std::copy(
+				output_values.data + i * output_items,
+				output_values.data + (i + 1) * output_items,
+				outputs[i].host_span().data);
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (gpu_mode)
+			{
+				batch[i].input.enable_gpu_mode();
+			}
+			worker.forward_propagation(batch[i].input);
+			worker.get_output_readonly().copy_values_to_host(outputs[i].host_span().data);
+		}
+	}
+
+	//recorded first, so the statistics contain every request whose output is ready
+	record(batch);
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		batch[i].output.set_value(std::move(outputs[i]));
+	}
+}
+
+void inference_server::record(const std::vector<request>& batch)
+{
+	const auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(statistics_mutex);
+	for (const request& curr : batch)
+	{
+		const float latency = std::chrono::duration<float, std::milli>(now - curr.submitted).count();
+		if (latencies_ms.size() < LATENCY_WINDOW)
+		{
+			latencies_ms.push_back(latency);
+		}
+		else
+		{
+			latencies_ms[request_count % LATENCY_WINDOW] = latency;
+		}
+		request_count++;
+	}
+	batch_count++;
+}
+
+inference_server::statistics inference_server::get_statistics() const
+{
+	std::lock_guard<std::mutex> lock(statistics_mutex);
+	statistics result;
+	result.request_count = request_count;
+	result.batch_count = batch_count;
+	result.running_workers = running_workers;
+	if (batch_count != 0)
+	{
+		result.average_batch_size = (float)request_count / (float)batch_count;
+	}
+	result.p50_latency_ms = percentile(latencies_ms, 0.5f);
+	result.p99_latency_ms = percentile(latencies_ms, 0.99f);
+
+	const float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - statistics_start).count();
+	if (seconds > 0)
+	{
+		result.throughput = (float)request_count / seconds;
+	}
+	return result;
+}
+
+void inference_server::reset_statistics()
+{
+	std::lock_guard<std::mutex> lock(statistics_mutex);
+	latencies_ms.clear();
+	request_count = 0;
+	batch_count = 0;
+	statistics_start = std::chrono::steady_clock::now();
+}
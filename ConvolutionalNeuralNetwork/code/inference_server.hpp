@@ -0,0 +1,103 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "neural_network.hpp"
+
+/*
+	answers concurrent forward propagation requests with a pool of workers
+
+	every request is one input. the requests wait in one queue,
+	a free worker takes the oldest one and waits up to max_wait (after it was submitted)
+	for more requests, until max_batch_size inputs are collected.
+	the inputs are then propagated as one batch (one by one if a layer does not support batches)
+
+	every worker is an instance of one copy of the network (see neural_network),
+	so the parameters are stored once and every worker has its own activations.
+	the workers never wait for each other, they are in gpu mode if the given network is
+*/
+class inference_server {
+public:
+	struct statistics {
+		size_t request_count = 0;
+		size_t batch_count = 0;
+		float average_batch_size = 0;
+		//the time from submitting a request until its output is ready
+		//of the last LATENCY_WINDOW requests
+		float p50_latency_ms = 0;
+		float p99_latency_ms = 0;
+		//requests per second since the server was started or the statistics were reset
+		float throughput = 0;
+		//the workers that still take requests (all of them until the server stops)
+		size_t running_workers = 0;
+
+		std::string to_string() const;
+	};
+private:
+	struct request {
+		matrix input;
+		std::promise<matrix> output;
+		std::chrono::steady_clock::time_point submitted;
+	};
+
+	size_t max_batch_size;
+	std::chrono::microseconds max_wait;
+	vector3 input_format;
+	vector3 output_format;
+
+	std::shared_ptr<const neural_network> parameters;
+	std::vector<std::unique_ptr<neural_network>> workers;
+	std::vector<std::thread> threads;
+
+	std::mutex queue_mutex;
+	std::condition_variable queue_cv;
+	std::deque<request> queue;
+	bool stopping = false;
+
+	//the percentiles are taken over a ring buffer of the last latencies,
+	//so a long running server does not store the latency of every request
+	static constexpr size_t LATENCY_WINDOW = 4096;
+
+	mutable std::mutex statistics_mutex;
+	std::vector<float> latencies_ms;
+	size_t request_count = 0;
+	size_t batch_count = 0;
+	size_t running_workers = 0;
+	std::chrono::steady_clock::time_point statistics_start;
+
+	void worker_loop(size_t worker_idx);
+	//blocks until there is at least one request, returns an empty batch only when the server stops
+	std::vector<request> take_batch();
+	void run_batch(neural_network& worker, std::vector<request>& batch);
+	void record(const std::vector<request>& batch);
+public:
+	//a worker count of 0 uses all hardware threads
+	//the model is copied once, changing it afterwards does not change the server
+	inference_server(
+		const neural_network& model,
+		size_t worker_count,
+		size_t max_batch_size,
+		std::chrono::microseconds max_wait);
+	//waits for the requests in the queue
+	~inference_server();
+
+	inference_server(const inference_server&) = delete;
+	inference_server& operator=(const inference_server&) = delete;
+
+	//the input is copied, the future gets a copy of the output of the network (on the host)
+	std::future<matrix> submit(const matrix& input);
+	//submits the input and waits for the output
+	matrix predict(const matrix& input);
+
+	//answers the requests that are still queued and stops the workers
+	//submitting afterwards throws
+	void stop();
+
+	statistics get_statistics() const;
+	void reset_statistics();
+};
@@ -0,0 +1,232 @@
+#include "int8_matrix.hpp"
+#include "precision.hpp"
+#include "assert_throw.hpp"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "cuda_runtime.h"
+
+void int8_matrix::free_device_data()
+{
+	if (device_data != nullptr)
+	{
+		cudaFree(device_data);
+		device_data = nullptr;
+	}
+	if (device_scales != nullptr)
+	{
+		cudaFree(device_scales);
+		device_scales = nullptr;
+	}
+}
+
+size_t int8_matrix::padded_count(size_t column_count)
+{
+	return (column_count + 3) / 4 * 4;
+}
+
+int8_matrix::int8_matrix()
+{}
+
+int8_matrix::int8_matrix(size_t row_count, size_t column_count)
+	:row_count(row_count),
+	column_count(column_count),
+	padded_column_count(padded_count(column_count)),
+	host_data(row_count * padded_count(column_count), 0),
+	scales(row_count, 1.0f)
+{}
+
+int8_matrix::int8_matrix(std::ifstream& file)
+{
+	if (!file.is_open())
+	{
+		throw std::runtime_error("file is not open");
+	}
+
+	file.read((char*)&row_count, sizeof(row_count));
+	file.read((char*)&column_count, sizeof(column_count));
+	padded_column_count = padded_count(column_count);
+
+	host_data.resize(row_count * padded_column_count);
+	scales.resize(row_count);
+	file.read((char*)scales.data(), scales.size() * sizeof(float));
+	file.read((char*)host_data.data(), host_data.size() * sizeof(int8_t));
+	if (!file)
+	{
+		throw std::runtime_error("could not read int8 matrix");
+	}
+}
+
+int8_matrix::int8_matrix(model_reader& reader)
+{
+	column_count = (size_t)reader.read_u64();
+
+	vector3 data_format;
+	const int8_t* data = (const int8_t*)reader.next_tensor(int8_tensor, data_format);
+	vector3 scale_format;
+	const float* row_scales = (const float*)reader.next_tensor(float32_tensor, scale_format);
+
+	row_count = data_format.y;
+	padded_column_count = padded_count(column_count);
+	if (data_format.x != padded_column_count || scale_format.item_count() != row_count)
+	{
+		throw std::runtime_error("invalid int8 matrix in model file");
+	}
+	host_data.assign(data, data + row_count * padded_column_count);
+	scales.assign(row_scales, row_scales + row_count);
+}
+
+int8_matrix::int8_matrix(const int8_matrix& other)
+	:row_count(other.row_count),
+	column_count(other.column_count),
+	padded_column_count(other.padded_column_count),
+	host_data(other.host_data),
+	scales(other.scales)
+{
+	if (other.is_in_gpu_mode())
+	{
+		enable_gpu_mode();
+	}
+}
+
+int8_matrix& int8_matrix::operator=(const int8_matrix& other)
+{
+	if (this != &other)
+	{
+		free_device_data();
+		row_count = other.row_count;
+		column_count = other.column_count;
+		padded_column_count = other.padded_column_count;
+		host_data = other.host_data;
+		scales = other.scales;
+		if (other.is_in_gpu_mode())
+		{
+			enable_gpu_mode();
+		}
+	}
+	return *this;
+}
+
+int8_matrix::~int8_matrix()
+{
+	free_device_data();
+}
+
+int8_matrix int8_matrix::quantize_rows(const float* values, size_t row_count, size_t column_count)
+{
+	int8_matrix result(row_count, column_count);
+	for (size_t row = 0; row < row_count; row++)
+	{
+		const float* row_values = values + row * column_count;
+
+		float max_abs = 0;
+		for (size_t i = 0; i < column_count; i++)
+		{
+			max_abs = std::fmax(max_abs, std::fabs(row_values[i]));
+		}
+
+		const float scale = int8_scale_for(max_abs);
+		result.scales[row] = scale;
+		int8_t* row_data = result.host_data.data() + row * result.padded_column_count;
+		for (size_t i = 0; i < column_count; i++)
+		{
+			row_data[i] = quantize_int8(row_values[i], 1.0f / scale);
+		}
+	}
+	return result;
+}
+
+size_t int8_matrix::get_row_count() const
+{
+	return row_count;
+}
+
+size_t int8_matrix::get_column_count() const
+{
+	return column_count;
+}
+
+size_t int8_matrix::get_padded_column_count() const
+{
+	return padded_column_count;
+}
+
+size_t int8_matrix::byte_size() const
+{
+	return host_data.size() * sizeof(int8_t) + scales.size() * sizeof(float);
+}
+
+const int8_t* int8_matrix::get_row_readonly(size_t row_idx) const
+{
+	smart_assert(row_idx < row_count);
+	return host_data.data() + row_idx * padded_column_count;
+}
+
+float int8_matrix::get_scale(size_t row_idx) const
+{
+	smart_assert(row_idx < row_count);
+	return scales[row_idx];
+}
+
+float int8_matrix::get_value(size_t row_idx, size_t column_idx) const
+{
+	smart_assert(column_idx < column_count);
+	return get_row_readonly(row_idx)[column_idx] * get_scale(row_idx);
+}
+
+void int8_matrix::enable_gpu_mode()
+{
+	if (device_data != nullptr || host_data.empty())
+	{
+		return;
+	}
+
+	cudaError_t error = cudaMalloc(&device_data, host_data.size() * sizeof(int8_t));
+	if (error == cudaSuccess)
+	{
+		error = cudaMalloc(&device_scales, scales.size() * sizeof(float));
+	}
+	if (error == cudaSuccess)
+	{
+		error = cudaMemcpy(device_data, host_data.data(), host_data.size() * sizeof(int8_t), cudaMemcpyHostToDevice);
+	}
+	if (error == cudaSuccess)
+	{
+		error = cudaMemcpy(device_scales, scales.data(), scales.size() * sizeof(float), cudaMemcpyHostToDevice);
+	}
+	if (error != cudaSuccess)
+	{
+		free_device_data();
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+bool int8_matrix::is_in_gpu_mode() const
+{
+	return device_data != nullptr;
+}
+
+const int8_t* int8_matrix::get_device_ptr_readonly() const
+{
+	return device_data;
+}
+
+const float* int8_matrix::get_device_scales_readonly() const
+{
+	return device_scales;
+}
+
+void int8_matrix::write_to_ofstream(std::ofstream& file) const
+{
+	file.write((char*)&row_count, sizeof(row_count));
+	file.write((char*)&column_count, sizeof(column_count));
+	file.write((char*)scales.data(), scales.size() * sizeof(float));
+	file.write((char*)host_data.data(), host_data.size() * sizeof(int8_t));
+}
+
+void int8_matrix::write_to_model(model_writer& writer) const
+{
+	writer.write_u64(column_count);
+	writer.add_tensor(int8_tensor, vector3(padded_column_count, row_count, 1), host_data.data());
+	writer.add_tensor(float32_tensor, vector3(row_count, 1, 1), scales.data());
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include "model_file.hpp"
+
+//a row major matrix of int8 values with one scale per row
+//the value of an item is q * row scale (see quantize_int8)
+//the rows are padded with zeros to a multiple of 4 items,
+//so the gpu can read 4 items at once (dp4a)
+class int8_matrix {
+private:
+	size_t row_count = 0;
+	size_t column_count = 0;
+	size_t padded_column_count = 0;
+
+	std::vector<int8_t> host_data;
+	std::vector<float> scales;
+
+	int8_t* device_data = nullptr;
+	float* device_scales = nullptr;
+
+	void free_device_data();
+public:
+	static size_t padded_count(size_t column_count);
+
+	int8_matrix();
+	//all values are zero, all scales are 1
+	int8_matrix(size_t row_count, size_t column_count);
+	int8_matrix(std::ifstream& file);
+	//the values are copied out of the mapped file (they are a quarter of the float size)
+	int8_matrix(model_reader& reader);
+	int8_matrix(const int8_matrix& other);
+	int8_matrix& operator=(const int8_matrix& other);
+	~int8_matrix();
+
+	//every row gets the scale of its largest absolute value (per channel quantization)
+	static int8_matrix quantize_rows(const float* values, size_t row_count, size_t column_count);
+
+	size_t get_row_count() const;
+	size_t get_column_count() const;
+	size_t get_padded_column_count() const;
+	size_t byte_size() const;
+
+	const int8_t* get_row_readonly(size_t row_idx) const;
+	float get_scale(size_t row_idx) const;
+	//the dequantized value
+	float get_value(size_t row_idx, size_t column_idx) const;
+
+	void enable_gpu_mode();
+	bool is_in_gpu_mode() const;
+	const int8_t* get_device_ptr_readonly() const;
+	const float* get_device_scales_readonly() const;
+
+	void write_to_ofstream(std::ofstream& file) const;
+	void write_to_model(model_writer& writer) const;
+};
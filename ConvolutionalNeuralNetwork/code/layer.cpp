@@ -20,6 +20,20 @@ void layer::valid_passing_error_check_cpu(const matrix* passing_error) const
 	valid_input_check(*passing_error);
 }
 
+void layer::valid_batch_input_check(const matrix& input_batch) const
+{
+	if (!supports_batch_propagation())
+	{
+		throw std::runtime_error("this layer does not support batch propagation");
+	}
+	if (input_format.item_count() == 0 ||
+		input_batch.get_width() != input_format.item_count() ||
+		input_batch.get_height() != get_batch_size())
+	{
+		throw std::runtime_error("input batch does not match the input format or the batch size");
+	}
+}
+
 layer::layer(std::ifstream& file, e_layer_type_t given_type)
 {
 	if (!file.is_open())
@@ -34,6 +48,16 @@ layer::layer(std::ifstream& file, e_layer_type_t given_type)
 	error = matrix(activation_format);
 }
 
+layer::layer(model_reader& reader, e_layer_type_t given_type)
+	:type(given_type)
+{
+	input_format = reader.read_vector3();
+	vector3 activation_format = reader.read_vector3();
+
+	activations = matrix(activation_format);
+	error = matrix(activation_format);
+}
+
 layer::layer(e_layer_type_t given_layer_type)
 	: type(given_layer_type)
 {}
@@ -53,9 +77,25 @@ layer::layer(
 	type(other.type),
 	activations(other.activations, false), // copy the format - not the values
 	error(other.error, false), //copy the format - not the values
-	input_format(other.input_format)
+	batch_activations(other.batch_activations, false),
+	batch_error(other.batch_error, false),
+	input_format(other.input_format),
+	inference_only(other.inference_only),
+	tensor_layout(other.tensor_layout)
 {}
 
+std::unique_ptr<layer> layer::clone_instance() const
+{
+	std::unique_ptr<layer> result = clone();
+	result->set_inference_only(true);
+	return result;
+}
+
+std::unique_ptr<layer> layer::clone_workspace() const
+{
+	return clone();
+}
+
 const e_layer_type_t layer::get_layer_type() const
 {
 	return type;
@@ -106,25 +146,206 @@ matrix* layer::get_error_p()
 	return &error;
 }
 
+void layer::set_tensor_layout(e_tensor_layout_t layout)
+{
+	if (layout != chw_layout)
+	{
+		throw std::invalid_argument("this layer only supports the planar layout");
+	}
+}
+
+e_tensor_layout_t layer::get_tensor_layout() const
+{
+	return tensor_layout;
+}
+
+void layer::set_activation_layout(e_tensor_layout_t layout)
+{
+	tensor_layout = layout;
+	if (activations.is_initialized())
+	{
+		activations.set_layout(layout);
+	}
+	if (error.is_initialized())
+	{
+		error.set_layout(layout);
+	}
+}
+
+void layer::fit_layout_buffer(const matrix& source, matrix& buffer, e_tensor_layout_t layout)
+{
+	if (!buffer.is_initialized() ||
+		!matrix::equal_format(source, buffer) ||
+		buffer.get_layout() != layout ||
+		buffer.is_in_gpu_mode() != source.is_in_gpu_mode())
+	{
+		buffer = matrix(source.get_format());
+		buffer.set_layout(layout);
+		if (source.is_in_gpu_mode())
+		{
+			buffer.enable_gpu_mode();
+		}
+	}
+}
+
+void layer::convert_into(const matrix& source, matrix& buffer, e_tensor_layout_t layout)
+{
+	fit_layout_buffer(source, buffer, layout);
+	matrix::convert_layout(source, buffer);
+}
+
+const matrix& layer::input_in_layout(const matrix& input, e_tensor_layout_t layout)
+{
+	if (input.get_layout() == layout)
+	{
+		return input;
+	}
+	convert_into(input, layout_input, layout);
+	return layout_input;
+}
+
+matrix* layer::passing_error_in_layout(matrix* passing_error, e_tensor_layout_t layout)
+{
+	if (passing_error == nullptr ||
+		passing_error->get_layout() == layout)
+	{
+		return passing_error;
+	}
+	fit_layout_buffer(*passing_error, layout_passing_error, layout);
+	//the values are overwritten by the back propagation, they do not have to be converted
+	return &layout_passing_error;
+}
+
+void layer::write_passing_error(matrix* passing_error, const matrix* layout_error)
+{
+	if (passing_error != layout_error)
+	{
+		matrix::convert_layout(*layout_error, *passing_error);
+	}
+}
+
+e_cost_function_t layer::get_cost_function() const
+{
+	return squared_error_cost;
+}
+
 void layer::set_error_for_last_layer(const matrix& expected)
+{
+	set_error_for_last_layer(expected, nullptr);
+}
+
+void layer::set_error_for_last_layer(const matrix& expected, matrix* cost)
 {
 	smart_assert(matrix::equal_format(activations, expected));
 
-	//this calculates the const derivative
-	error.set_all(0); // i don think that is necessary - has to be tested
-	matrix::subtract(activations, expected, error);
-	error.scalar_multiplication(2);
+	//this calculates the cost derivative
+	matrix::cost_derivative(activations, expected, error, get_cost_function(), cost);
+}
+
+void layer::set_error_for_last_layer_batch(const matrix& expected_batch)
+{
+	set_error_for_last_layer_batch(expected_batch, nullptr);
+}
+
+void layer::set_error_for_last_layer_batch(const matrix& expected_batch, matrix* cost)
+{
+	smart_assert(matrix::equal_format(batch_activations, expected_batch));
+
+	//same as set_error_for_last_layer, but for every item in the batch
+	matrix::cost_derivative(batch_activations, expected_batch, batch_error, get_cost_function(), cost);
+}
+
+void layer::set_batch_size(size_t batch_size)
+{
+	if (batch_size == 0)
+	{
+		throw std::invalid_argument("batch size must be greater than 0");
+	}
+	if (batch_size == get_batch_size())
+	{
+		return;
+	}
+
+	vector3 batch_format(activations.item_count(), batch_size, (size_t)1);
+	batch_activations = matrix(batch_format);
+	//the batch error is only needed if the layer keeps its error (see release_training_buffers)
+	batch_error = error.is_initialized() ? matrix(batch_format) : matrix();
+
+	if (activations.is_in_gpu_mode())
+	{
+		batch_activations.enable_gpu_mode();
+		if (batch_error.is_initialized())
+		{
+			batch_error.enable_gpu_mode();
+		}
+	}
+}
+
+size_t layer::get_batch_size() const
+{
+	return batch_activations.is_initialized() ? batch_activations.get_height() : 0;
+}
+
+const matrix& layer::get_batch_activations_readonly() const
+{
+	return batch_activations;
+}
+
+matrix* layer::get_batch_error_p()
+{
+	return &batch_error;
+}
+
+void layer::move_activations_to(matrix_allocator& target)
+{
+	activations.move_to_allocator(target);
+}
+
+void layer::move_batch_activations_to(matrix_allocator& target)
+{
+	batch_activations.move_to_allocator(target);
+}
+
+void layer::release_training_buffers()
+{
+	error = matrix();
+	batch_error = matrix();
+	layout_passing_error = matrix();
+	set_inference_only(true);
 }
 
 void layer::enable_gpu_mode()
 {
 	activations.enable_gpu_mode();
-	error.enable_gpu_mode();
+	//the errors are not allocated after release_training_buffers
+	if (error.is_initialized())
+	{
+		error.enable_gpu_mode();
+	}
+
+	if (batch_activations.is_initialized())
+	{
+		batch_activations.enable_gpu_mode();
+	}
+	if (batch_error.is_initialized())
+	{
+		batch_error.enable_gpu_mode();
+	}
 
 	//input_format.enable_gpu();
 	//gpu_activations = std::make_unique<gpu_matrix>(activations, true);
 }
 
+void layer::set_inference_only(bool given_inference_only)
+{
+	inference_only = given_inference_only;
+}
+
+bool layer::is_inference_only() const
+{
+	return inference_only;
+}
+
 void layer::disable_gpu()
 {
 	//gpu_activations = nullptr;
@@ -136,8 +357,8 @@ bool layer::equal_format(const layer& other)
 	return
 		input_format == other.input_format &&
 		type == other.type &&
+		//the error has the format of the activations, if it is not released
 		matrix::equal_format(activations, other.activations) &&
-		matrix::equal_format(error, other.error) &&
 		matrix::equal_format(input_format, other.input_format);
 }
 
@@ -148,12 +369,22 @@ void layer::write_to_ofstream(std::ofstream& file) const
 	activations.get_format().write_to_ofstream(file);
 }
 
+void layer::write_to_model(model_writer& writer) const
+{
+	writer.write_u32(type);
+	writer.write_vector3(input_format);
+	writer.write_vector3(activations.get_format());
+}
+
 std::string layer::parameter_analysis() const
 {
 	std::string ret_val =
 		type == pooling ? "pooling layer\n" :
 		type == convolutional ? "convolutional layer\n" :
 		type == fully_connected ? "fully connected layer\n" :
+		type == quantized_fully_connected ? "quantized fully connected layer\n" :
+		type == quantized_convolutional ? "quantized convolutional layer\n" :
+		type == sparse_fully_connected ? "sparse fully connected layer\n" :
 		"invalid layer type\n";
 	ret_val += "input format: " + input_format.to_string() + "\n";
 	ret_val += "activation format: " + activations.get_format().to_string() + "\n";
@@ -176,4 +407,38 @@ void layer::back_propagation(const matrix& input, matrix* passing_error)
 {
 	valid_input_check(input);
 	valid_passing_error_check_cpu(passing_error);
-}
\ No newline at end of file
+}
+
+bool layer::supports_batch_propagation() const
+{
+	return false;
+}
+
+void layer::forward_propagation_batch(const matrix& input_batch)
+{
+	valid_batch_input_check(input_batch);
+}
+
+void layer::back_propagation_batch(const matrix& input_batch, matrix* passing_error_batch)
+{
+	valid_batch_input_check(input_batch);
+	if (passing_error_batch != nullptr &&
+		!matrix::equal_format(*passing_error_batch, input_batch))
+	{
+		throw std::runtime_error("passing error batch does not match the input batch");
+	}
+}
+
+void layer::accumulate_deltas(layer& other)
+{
+	if (type != other.type)
+	{
+		throw std::invalid_argument("cannot accumulate the deltas of a different layer type");
+	}
+}
+
+void layer::collect_parameters(
+	std::vector<matrix*>& parameters,
+	std::vector<matrix*>& deltas,
+	std::vector<matrix*>& momentum)
+{}
\ No newline at end of file
@@ -4,11 +4,19 @@
 #include "device_launch_parameters.h"
 #include <fstream>
 
+//selects the constructors of the layers that share the parameters of another layer
+//(see layer::clone_instance and layer::clone_workspace)
+struct share_parameters_t {
+	//the copy gets its own deltas, so it can run the back propagation
+	bool with_deltas = false;
+};
+
 class layer {
 
 private:
 	void valid_input_check(const matrix& input) const;
 	void valid_passing_error_check_cpu(const matrix* passing_error) const;
+	void valid_batch_input_check(const matrix& input_batch) const;
 protected:
 	e_layer_type_t type;
 
@@ -17,9 +25,40 @@ protected:
 	//the current error - the same format as the activations
 	matrix error;
 
+	//every row is the flat activation of one item of the batch
+	//these are only allocated if a batch size is set
+	matrix batch_activations;
+	//the error of the batch - the same format as the batch activations
+	matrix batch_error;
+
 	vector3 input_format;
 
+	//layers do not keep data that is only needed for the back propagation if this is true
+	bool inference_only = false;
+
+	//the layout of the activations, it is kept if the input format changes
+	e_tensor_layout_t tensor_layout = chw_layout;
+
+	//the input and the passing error in the layout of the layer
+	//only used if the previous layer has a different layout (see input_in_layout)
+	matrix layout_input;
+	matrix layout_passing_error;
+
+	//reallocates the buffer if it does not fit the format and the gpu mode of the source and the layout
+	static void fit_layout_buffer(const matrix& source, matrix& buffer, e_tensor_layout_t layout);
+	static void convert_into(const matrix& source, matrix& buffer, e_tensor_layout_t layout);
+	//the input itself if it already has the layout, otherwise a converted copy
+	const matrix& input_in_layout(const matrix& input, e_tensor_layout_t layout);
+	//the passing error itself (or null) if it already has the layout, otherwise a buffer that
+	//has to be written back with write_passing_error after the back propagation filled it
+	matrix* passing_error_in_layout(matrix* passing_error, e_tensor_layout_t layout);
+	void write_passing_error(matrix* passing_error, const matrix* layout_error);
+
+	//the activations and the error (if they are allocated) get the layout
+	void set_activation_layout(e_tensor_layout_t layout);
+
 	layer(std::ifstream& file, e_layer_type_t given_type);
+	layer(model_reader& reader, e_layer_type_t given_type);
 
 public:
 	layer(e_layer_type_t given_layer_type);
@@ -29,6 +68,15 @@ public:
 	layer(const layer& other);
 	//clone
 	virtual std::unique_ptr<layer> clone() const = 0;
+	//an inference only copy that reads the parameters of this layer instead of copying them
+	//only the activations and errors belong to the copy
+	//the parameters of this layer must not change while the copy is used
+	//layers that do not override this (the ones without float parameters) return a clone
+	virtual std::unique_ptr<layer> clone_instance() const;
+	//a training copy that reads the parameters of this layer, like an instance,
+	//but has its own deltas (no momentum). the deltas are summed up with accumulate_deltas
+	//layers that do not override this (the ones without float parameters) return a clone
+	virtual std::unique_ptr<layer> clone_workspace() const;
 	
 	const e_layer_type_t get_layer_type() const;
 
@@ -45,8 +93,39 @@ public:
 	const matrix& get_error() const;
 	matrix* get_error_p();
 
-	//TODO - make this separate
+	//the memory layout of the activations (see e_tensor_layout_t)
+	//the layer converts inputs of a different layout itself
+	//only the convolutional and the pooling layer can change it, the others throw
+	virtual void set_tensor_layout(e_tensor_layout_t layout);
+	e_tensor_layout_t get_tensor_layout() const;
+
+	//the cost the error of the last layer is calculated with
+	//the squared error unless the layer has a softmax output
+	virtual e_cost_function_t get_cost_function() const;
+
+	//the error is the derivative of the cost function
+	//if the cost matrix is set, the cost of the item is added to its first item
 	void set_error_for_last_layer(const matrix& expected);
+	void set_error_for_last_layer(const matrix& expected, matrix* cost);
+	//every row of the expected batch is the label of one item
+	void set_error_for_last_layer_batch(const matrix& expected_batch);
+	void set_error_for_last_layer_batch(const matrix& expected_batch, matrix* cost);
+
+	//allocates the batch activations and batch error
+	//does nothing if the batch size did not change
+	virtual void set_batch_size(size_t batch_size);
+	size_t get_batch_size() const;
+
+	const matrix& get_batch_activations_readonly() const;
+	matrix* get_batch_error_p();
+
+	//moves the activations or the batch activations into the memory of the allocator
+	//(see neural_network::compile_inference_plan)
+	void move_activations_to(matrix_allocator& target);
+	void move_batch_activations_to(matrix_allocator& target);
+	//frees the errors and the deltas and momentum of the parameters
+	//the layer is inference only afterwards and can not be trained anymore
+	virtual void release_training_buffers();
 
 	//set all weights and biases to that value
 	virtual void set_all_parameters(float value) = 0;
@@ -62,17 +141,42 @@ public:
 	virtual void forward_propagation(const matrix& input);
 	virtual	void back_propagation(const matrix& input, matrix* passing_error);
 
+	//layers that can process a whole batch at once override these
+	//the default implementation throws
+	virtual bool supports_batch_propagation() const;
+	virtual void forward_propagation_batch(const matrix& input_batch);
+	virtual void back_propagation_batch(const matrix& input_batch, matrix* passing_error_batch);
+
 	//the deltas got calculated in the backprop function
 	//all the deltas got summed up. now we need to apply the
 	//average. this is done by dividing the deltas by the number of inputs
 	virtual void apply_deltas(size_t training_data_count, float learning_rate) = 0;
 
+	//adds the deltas of the other layer to the deltas of this layer
+	//and sets the deltas of the other layer to zero.
+	//this combines the deltas of multiple workers. layers without parameters do nothing
+	virtual void accumulate_deltas(layer& other);
+
+	//appends the parameter matrices and their delta and momentum matrices
+	//the i-th delta and momentum belong to the i-th parameter (same format)
+	//layers without parameters do nothing
+	virtual void collect_parameters(
+		std::vector<matrix*>& parameters,
+		std::vector<matrix*>& deltas,
+		std::vector<matrix*>& momentum);
+
 	virtual void enable_gpu_mode();
 	virtual void disable_gpu();
 
+	//the back propagation can not be used in inference only mode
+	virtual void set_inference_only(bool inference_only);
+	bool is_inference_only() const;
+
 	virtual bool equal_format(const layer& other);
 	virtual bool equal_parameter(const layer& other) = 0;
 	virtual void set_parameters(const layer& other) = 0;
 
 	virtual void write_to_ofstream(std::ofstream& file) const;
+	//the model file format (see model_file.hpp)
+	virtual void write_to_model(model_writer& writer) const;
 };
\ No newline at end of file
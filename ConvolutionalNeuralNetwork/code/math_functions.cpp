@@ -4,17 +4,17 @@
 
 float sigmoid(float x)
 {
-	return 1.0f / (1.0f + exp(-x));
+	return activation_traits<sigmoid_fn>::activate(x);
 }
 
 float relu(float x)
 {
-	return x > 0 ? x : 0;
+	return activation_traits<relu_fn>::activate(x);
 }
 
 float leaky_relu(float x)
 {
-	return x > 0 ? x : LEAKY_RELU_FACTOR * x;
+	return activation_traits<leaky_relu_fn>::activate(x);
 }
 
 float sigmoid_derivative(float x)
@@ -33,6 +33,22 @@ float leaky_relu_derivative(float x)
 	return x > 0 ? 1.0f : LEAKY_RELU_FACTOR;
 }
 
+float sigmoid_derivative_from_activation(float activation)
+{
+	return activation_traits<sigmoid_fn>::derivative_from_activation(activation);
+}
+
+float relu_derivative_from_activation(float activation)
+{
+	return activation_traits<relu_fn>::derivative_from_activation(activation);
+}
+
+//the leaky relu keeps the sign, so the sign of the activation is the sign of the input
+float leaky_relu_derivative_from_activation(float activation)
+{
+	return activation_traits<leaky_relu_fn>::derivative_from_activation(activation);
+}
+
 float logit(float x)
 {
 	return log(x / (1.0f - x));
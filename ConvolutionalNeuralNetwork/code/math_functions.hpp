@@ -1,7 +1,20 @@
 #pragma once
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
 #include "enum_space.hpp"
 
+//the activation traits below are compiled for the cpu and the gpu
+#ifdef __CUDACC__
+#define CNN_HOST_DEVICE __host__ __device__
+#else
+#define CNN_HOST_DEVICE
+#endif
+
 constexpr float LEAKY_RELU_FACTOR = 0.01f;
+//the smallest output the logarithm of the cross entropy is taken of
+constexpr float CROSS_ENTROPY_EPSILON = 1e-12f;
 
 float sigmoid(float x);
 float relu(float x);
@@ -11,12 +24,20 @@ float sigmoid_derivative(float x);
 float relu_derivative(float x);
 float leaky_relu_derivative(float x);
 
+//the derivative computed from the activated value
+//all activations have closed forms, so the pre activation is not needed
+//(and no logarithm has to be computed in the back propagation)
+float sigmoid_derivative_from_activation(float activation);
+float relu_derivative_from_activation(float activation);
+float leaky_relu_derivative_from_activation(float activation);
+
 //inverse sigmoid
 float logit(float x);
 float inverse_relu(float x);
 float inverse_leaky_relu(float x);
 
 //activation function pointer
+//softmax is not element wise, so it has no entry in the tables
 using activation_fn = float(*)(float);
 
 const activation_fn ACTIVATION[] =
@@ -25,5 +46,345 @@ const activation_fn ACTIVATION[] =
 const activation_fn DERIVATIVE[] =
 { sigmoid_derivative, relu_derivative, leaky_relu_derivative };
 
-const activation_fn INVERSE[]
-{ logit, inverse_relu, leaky_relu, inverse_leaky_relu };
\ No newline at end of file
+const activation_fn DERIVATIVE_FROM_ACTIVATION[] =
+{ sigmoid_derivative_from_activation, relu_derivative_from_activation, leaky_relu_derivative_from_activation };
+
+const activation_fn INVERSE[] =
+{ logit, inverse_relu, inverse_leaky_relu };
+
+/*
+	compile time activation functions
+	the element wise loops and kernels are templated on these traits,
+	so every activation gets its own loop that can be inlined and vectorized.
+	dispatch_activation switches on the runtime value once per call, not once per element
+*/
+template<e_activation_t activation_fn>
+struct activation_traits;
+
+template<>
+struct activation_traits<sigmoid_fn> {
+	CNN_HOST_DEVICE static float activate(float x) { return 1.0f / (1.0f + expf(-x)); }
+	CNN_HOST_DEVICE static float derivative_from_activation(float activation) { return activation * (1.0f - activation); }
+};
+
+template<>
+struct activation_traits<relu_fn> {
+	CNN_HOST_DEVICE static float activate(float x) { return x > 0 ? x : 0; }
+	CNN_HOST_DEVICE static float derivative_from_activation(float activation) { return activation > 0 ? 1.0f : 0; }
+};
+
+template<>
+struct activation_traits<leaky_relu_fn> {
+	CNN_HOST_DEVICE static float activate(float x) { return x > 0 ? x : LEAKY_RELU_FACTOR * x; }
+	CNN_HOST_DEVICE static float derivative_from_activation(float activation) { return activation > 0 ? 1.0f : LEAKY_RELU_FACTOR; }
+};
+
+//the element wise part of the softmax
+//the values of an item are normalized in a separate pass (see cpu_add_bias_softmax),
+//the error of the cross entropy already is the gradient of the values before the softmax
+template<>
+struct activation_traits<softmax_fn> {
+	CNN_HOST_DEVICE static float activate(float x) { return x; }
+	CNN_HOST_DEVICE static float derivative_from_activation(float activation) { return 1.0f; }
+};
+
+//the identity, for the passes that only compute the weighted sums
+//(it is not an e_activation_t, so it is never dispatched)
+struct no_activation_traits {
+	CNN_HOST_DEVICE static float activate(float x) { return x; }
+	CNN_HOST_DEVICE static float derivative_from_activation(float activation) { return 1.0f; }
+};
+
+//calls function with an instance of the matching activation_traits
+//for example: dispatch_activation(fn, [&](auto traits) { using traits_t = decltype(traits); ... });
+template<typename function_t>
+inline void dispatch_activation(e_activation_t activation_fn, function_t&& function)
+{
+	switch (activation_fn)
+	{
+	case sigmoid_fn:
+		function(activation_traits<sigmoid_fn>());
+		return;
+	case relu_fn:
+		function(activation_traits<relu_fn>());
+		return;
+	case leaky_relu_fn:
+		function(activation_traits<leaky_relu_fn>());
+		return;
+	case softmax_fn:
+		function(activation_traits<softmax_fn>());
+		return;
+	default:
+		throw std::invalid_argument("activation function not implemented");
+	}
+}
+
+//the values of one optimizer step, they are the same for all parameters
+struct optimizer_step_settings {
+	float learning_rate;
+	//the deltas are the sum over the batch, this turns them into the average
+	float delta_scale;
+	float beta1;
+	float beta2;
+	float epsilon;
+	float weight_decay;
+	//1 - beta^t for the bias correction of adam
+	float first_moment_correction;
+	float second_moment_correction;
+};
+
+//updates one parameter and clears its delta
+//the first moment is the momentum, the second moment is only used by adam and adamw
+//the compiler removes the branches that do not belong to the optimizer type
+template<e_optimizer_t optimizer_type>
+CNN_HOST_DEVICE inline void optimizer_update_item(
+	const optimizer_step_settings& settings,
+	float& param,
+	float& delta,
+	float& first_moment,
+	float& second_moment)
+{
+	float gradient = delta * settings.delta_scale;
+	//adamw decays the weights directly instead of adding the decay to the gradient
+	if (optimizer_type != adamw_optimizer)
+	{
+		gradient += settings.weight_decay * param;
+	}
+
+	if (optimizer_type == sgd_optimizer)
+	{
+		param -= settings.learning_rate * gradient;
+	}
+	else if (optimizer_type == momentum_optimizer)
+	{
+		first_moment = settings.beta1 * first_moment + (1.0f - settings.beta1) * gradient;
+		param -= settings.learning_rate * first_moment;
+	}
+	else if (optimizer_type == nesterov_optimizer)
+	{
+		first_moment = settings.beta1 * first_moment + (1.0f - settings.beta1) * gradient;
+		//looks ahead along the updated momentum
+		param -= settings.learning_rate * (settings.beta1 * first_moment + (1.0f - settings.beta1) * gradient);
+	}
+	else
+	{
+		first_moment = settings.beta1 * first_moment + (1.0f - settings.beta1) * gradient;
+		second_moment = settings.beta2 * second_moment + (1.0f - settings.beta2) * gradient * gradient;
+		const float corrected_first = first_moment / settings.first_moment_correction;
+		const float corrected_second = second_moment / settings.second_moment_correction;
+		float step = corrected_first / (sqrtf(corrected_second) + settings.epsilon);
+		if (optimizer_type == adamw_optimizer)
+		{
+			step += settings.weight_decay * param;
+		}
+		param -= settings.learning_rate * step;
+	}
+	delta = 0;
+}
+
+//calls function with a std::integral_constant of the optimizer type
+template<typename function_t>
+inline void dispatch_optimizer(e_optimizer_t optimizer_type, function_t&& function)
+{
+	switch (optimizer_type)
+	{
+	case sgd_optimizer:
+		function(std::integral_constant<e_optimizer_t, sgd_optimizer>());
+		return;
+	case momentum_optimizer:
+		function(std::integral_constant<e_optimizer_t, momentum_optimizer>());
+		return;
+	case nesterov_optimizer:
+		function(std::integral_constant<e_optimizer_t, nesterov_optimizer>());
+		return;
+	case adam_optimizer:
+		function(std::integral_constant<e_optimizer_t, adam_optimizer>());
+		return;
+	case adamw_optimizer:
+		function(std::integral_constant<e_optimizer_t, adamw_optimizer>());
+		return;
+	default:
+		throw std::invalid_argument("optimizer not implemented");
+	}
+}
+
+//the values of one generation of a population (see population), they are the same for all genomes
+struct evolution_settings {
+	uint64_t seed;
+	uint64_t generation;
+	//this genome is copied into the next generation unchanged (the fittest one)
+	uint32_t elite_idx;
+	uint32_t tournament_size;
+	//the probability that a parameter is mutated and the range of the mutation
+	float mutation_rate;
+	float mutation_range;
+};
+
+//splitmix64
+CNN_HOST_DEVICE inline uint64_t counter_hash(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+//a random number in [0, 1) that only depends on its arguments
+//every stream is a sequence of numbers, the counter is the position in it
+//so the cpu and the gpu get the same numbers in any order
+CNN_HOST_DEVICE inline float counter_random(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+	//the upper 24 bits fit into a float exactly
+	return (float)(counter_hash(counter_hash(seed ^ counter_hash(stream)) + counter) >> 40) * (1.0f / 16777216.0f);
+}
+
+//a random number between min and max from counter_random
+//fmaf rounds only once on the cpu and the gpu, so both get exactly the same value
+CNN_HOST_DEVICE inline float counter_uniform(uint64_t seed, uint64_t stream, uint64_t counter, float min, float max)
+{
+	return fmaf(counter_random(seed, stream, counter), max - min, min);
+}
+
+//the fittest of tournament_size random genomes
+CNN_HOST_DEVICE inline uint32_t tournament_select(
+	const float* fitness,
+	uint32_t genome_count,
+	uint32_t tournament_size,
+	uint64_t seed,
+	uint64_t stream)
+{
+	uint32_t best = genome_count;
+	for (uint32_t i = 0; i < tournament_size; i++)
+	{
+		uint32_t candidate = (uint32_t)(counter_random(seed, stream, i) * (float)genome_count);
+		candidate = candidate < genome_count ? candidate : genome_count - 1;
+		if (best == genome_count || fitness[candidate] > fitness[best])
+		{
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+//every genome of the next generation (except the elite) has two parents picked by tournaments
+//the random numbers of a genome only depend on the seed, the generation and its index
+CNN_HOST_DEVICE inline void select_parents(
+	const evolution_settings& settings,
+	const float* fitness,
+	uint32_t genome_count,
+	uint32_t genome_idx,
+	uint32_t& first_parent,
+	uint32_t& second_parent)
+{
+	const uint64_t stream = settings.generation * genome_count + genome_idx;
+	first_parent = tournament_select(fitness, genome_count, settings.tournament_size, settings.seed + 1, stream);
+	second_parent = tournament_select(fitness, genome_count, settings.tournament_size, settings.seed + 2, stream);
+}
+
+//uniform crossover - the parameter is taken from one of both parents
+//and mutated by a random value between -mutation_range and mutation_range with the mutation rate
+CNN_HOST_DEVICE inline float evolve_item(
+	const evolution_settings& settings,
+	uint32_t genome_count,
+	uint32_t genome_idx,
+	uint64_t item_idx,
+	float first_parent_value,
+	float second_parent_value)
+{
+	const uint64_t stream = settings.generation * genome_count + genome_idx;
+	const uint64_t counter = item_idx * 3;
+	float value = counter_random(settings.seed, stream, counter) < 0.5f ? first_parent_value : second_parent_value;
+	if (counter_random(settings.seed, stream, counter + 1) < settings.mutation_rate)
+	{
+		value += (counter_random(settings.seed, stream, counter + 2) * 2.0f - 1.0f) * settings.mutation_range;
+	}
+	return value;
+}
+
+//the random transforms of the data augmentation (see neural_network::set_augmentation)
+//every item gets its own shift, rotation and distortion, all zero keeps the items unchanged
+struct augmentation_settings {
+	//the seed of the first batch, every batch uses the next one
+	uint64_t seed = 0;
+	//the largest shift along x and y in pixels
+	float max_shift = 0;
+	//the largest rotation around the center in radians
+	float max_rotation = 0;
+	//the largest displacement of the elastic distortion in pixels
+	float elastic_amplitude = 0;
+	//the number of waves of the distortion over the image
+	float elastic_frequency = 2;
+	//a random value between -noise and noise is added to every value
+	float noise = 0;
+};
+
+//the value of the plane at the pixel, zero outside of it
+CNN_HOST_DEVICE inline float pixel_or_zero(const float* plane, int width, int height, int x, int y)
+{
+	return x < 0 || y < 0 || x >= width || y >= height ? 0.0f : plane[y * width + x];
+}
+
+//the value of the augmented item (a planar image) at x, y and depth d
+//the position is mapped back into the source item, which is read with bilinear filtering
+//the elastic distortion is a smooth displacement of two waves with random phases,
+//so every value is computed on its own instead of filtering a random displacement field
+//the random numbers of an item only depend on the seed and the item (stream)
+CNN_HOST_DEVICE inline float augment_item(
+	const augmentation_settings& settings,
+	const float* source,
+	uint32_t width,
+	uint32_t height,
+	uint64_t stream,
+	uint32_t x,
+	uint32_t y,
+	uint32_t d)
+{
+	const float two_pi = 6.2831853f;
+	const uint64_t seed = settings.seed;
+	const float shift_x = counter_uniform(seed, stream, 0, -settings.max_shift, settings.max_shift);
+	const float shift_y = counter_uniform(seed, stream, 1, -settings.max_shift, settings.max_shift);
+	const float angle = counter_uniform(seed, stream, 2, -settings.max_rotation, settings.max_rotation);
+	const float amplitude = counter_random(seed, stream, 3) * settings.elastic_amplitude;
+	const float phase_x = counter_random(seed, stream, 4) * two_pi;
+	const float phase_y = counter_random(seed, stream, 5) * two_pi;
+
+	const float center_x = (float)(width - 1) * 0.5f;
+	const float center_y = (float)(height - 1) * 0.5f;
+	float offset_x = (float)x - center_x - shift_x;
+	float offset_y = (float)y - center_y - shift_y;
+	if (amplitude != 0.0f)
+	{
+		const float wave = two_pi * settings.elastic_frequency;
+		offset_x += amplitude * sinf(wave * (float)y / (float)height + phase_x);
+		offset_y += amplitude * sinf(wave * (float)x / (float)width + phase_y);
+	}
+
+	//the inverse rotation
+	const float cos_angle = cosf(angle);
+	const float sin_angle = sinf(angle);
+	const float source_x = cos_angle * offset_x + sin_angle * offset_y + center_x;
+	const float source_y = cos_angle * offset_y - sin_angle * offset_x + center_y;
+
+	const float* plane = source + (size_t)d * width * height;
+	const float floor_x = floorf(source_x);
+	const float floor_y = floorf(source_y);
+	const int x0 = (int)floor_x;
+	const int y0 = (int)floor_y;
+	const float weight_x = source_x - floor_x;
+	const float weight_y = source_y - floor_y;
+	const float top =
+		pixel_or_zero(plane, width, height, x0, y0) * (1.0f - weight_x) +
+		pixel_or_zero(plane, width, height, x0 + 1, y0) * weight_x;
+	const float bottom =
+		pixel_or_zero(plane, width, height, x0, y0 + 1) * (1.0f - weight_x) +
+		pixel_or_zero(plane, width, height, x0 + 1, y0 + 1) * weight_x;
+	float value = top * (1.0f - weight_y) + bottom * weight_y;
+
+	if (settings.noise != 0.0f)
+	{
+		//the first counters of the stream belong to the transform
+		const uint64_t counter = 8 + ((uint64_t)d * height + y) * width + x;
+		value += counter_uniform(seed, stream, counter, -settings.noise, settings.noise);
+	}
+	return value;
+}
@@ -1,4 +1,6 @@
 #include "matrix.hpp"
+#include "cpu_math.hpp"
+#include "profiler.hpp"
 #include <fstream>
 #include <numeric>
 
@@ -35,6 +37,23 @@ void matrix::if_not_owning_throw() const
 	}
 }
 
+void matrix::if_device_only_throw() const
+{
+	if (host_data == nullptr && device_data != nullptr)
+	{
+		throw std::runtime_error("matrix is device only, sync it before reading the host data");
+	}
+}
+
+void matrix::sync_if_device_only()
+{
+	if (host_data == nullptr && device_data != nullptr)
+	{
+		//throws for an observer, it can not allocate the data it observes
+		sync_device_and_host();
+	}
+}
+
 void matrix::if_gpu_not_allocated_throw() const
 {
 	if (!gpu_enabled)
@@ -48,8 +67,11 @@ void matrix::allocate_device_mem()
 	smart_assert(is_initialized());
 	smart_assert(!is_in_gpu_mode());
 
-	cudaMalloc(&device_data, item_count() * sizeof(float));
-	if_cuda_error_throw();
+	if (allocator == nullptr)
+	{
+		allocator = &get_matrix_allocator();
+	}
+	device_data = allocator->allocate_device(item_count());
 	gpu_enabled = true;
 }
 
@@ -58,12 +80,15 @@ void matrix::copy_host2device()
 	smart_assert(is_initialized());
 	//smart_assert(is_owning_data()); //copying to a non-owning matrix is allowed - but it is not tested
 	smart_assert(is_in_gpu_mode());
+	profiler_count_copy(true, item_count() * sizeof(float));
 
-	cudaMemcpy(
+	//the host data is pageable, so the call returns as soon as it has been staged
+	cudaMemcpyAsync(
 		device_data,
 		host_data,
 		item_count() * sizeof(float),
-		cudaMemcpyHostToDevice);
+		cudaMemcpyHostToDevice,
+		gpu_get_current_stream());
 	if_cuda_error_throw();
 
 	last_updated_data = nullptr;
@@ -73,13 +98,16 @@ void matrix::copy_device2host()
 	smart_assert(is_initialized());
 	//smart_assert(is_owning_data());//copying to a non-owning matrix is allowed - but it is not tested
 	smart_assert(is_in_gpu_mode());
+	profiler_count_copy(false, item_count() * sizeof(float));
 
-	cudaMemcpy(
+	cudaMemcpyAsync(
 		host_data,
 		device_data,
 		item_count() * sizeof(float),
-		cudaMemcpyDeviceToHost);
-	if_cuda_error_throw();
+		cudaMemcpyDeviceToHost,
+		gpu_get_current_stream());
+	//the host needs the data now - this is where we wait for the gpu
+	gpu_sync_current_stream();
 
 	last_updated_data = nullptr;
 }
@@ -107,11 +135,62 @@ void matrix::allocate_host_mem()
 	smart_assert(format_is_valid());
 	smart_assert(item_count() > 0);
 
-	host_data = new float[item_count()];
+	allocator = &get_matrix_allocator();
+	host_data = allocator->allocate_host(item_count());
 	owning_data = true;
 	set_all(0);
 }
 
+void matrix::ensure_host_mem()
+{
+	if (host_data != nullptr)
+	{
+		return;
+	}
+	//an observer can not allocate the data of the matrix it observes
+	if_not_owning_throw();
+	host_data = allocator->allocate_host(item_count());
+}
+
+void matrix::allocate_device_only_from(const matrix& source, bool copy_values)
+{
+	smart_assert(source.is_in_gpu_mode());
+	smart_assert(host_data == nullptr);
+	smart_assert(device_data == nullptr);
+
+	allocator = &get_matrix_allocator();
+	device_data = allocator->allocate_device(item_count());
+	owning_data = true;
+	gpu_enabled = true;
+	last_updated_data = device_data;
+
+	if (copy_values)
+	{
+		cudaMemcpyAsync(
+			device_data,
+			source.device_data,
+			item_count() * sizeof(float),
+			cudaMemcpyDeviceToDevice,
+			gpu_get_current_stream());
+		if_cuda_error_throw();
+	}
+	else
+	{
+		gpu_set_all(device_data, item_count(), 0);
+	}
+}
+
+const float* matrix::host_values_or_copy(std::vector<float>& copy) const
+{
+	if (host_data != nullptr)
+	{
+		return host_data;
+	}
+	copy.resize(item_count());
+	copy_values_to_host(copy.data());
+	return copy.data();
+}
+
 void matrix::copy_host2host_from(const matrix& src)
 {
 	smart_assert(is_initialized());
@@ -137,11 +216,12 @@ void matrix::copy_device2device_from(const matrix& src)
 	
 	smart_assert(equal_format(*this, src));
 
-	cudaMemcpy(
+	cudaMemcpyAsync(
 		device_data,
 		src.device_data,
 		item_count() * sizeof(float),
-		cudaMemcpyDeviceToDevice);
+		cudaMemcpyDeviceToDevice,
+		gpu_get_current_stream());
 	if_cuda_error_throw();
 	set_device_as_last_updated();
 }
@@ -152,13 +232,12 @@ void matrix::delete_data_if_owning()
 	{
 		if (host_data != nullptr)
 		{
-			delete[] host_data;
+			allocator->free_host(host_data);
 			host_data = nullptr;
 		}
 		if (device_data != nullptr)
 		{
-			cudaFree(device_data);
-			if_cuda_error_throw();
+			allocator->free_device(device_data);
 			device_data = nullptr;
 		}
 		owning_data = false;
@@ -167,26 +246,39 @@ void matrix::delete_data_if_owning()
 
 float* matrix::get_ptr_layer(float* given_ptr, size_t depth_idx)
 {
-	smart_assert(is_initialized());
-	smart_assert(given_ptr != nullptr);
-	smart_assert(depth_idx < get_depth());
-	smart_assert(given_ptr == host_data || given_ptr == device_data);
+	hot_assert(is_initialized());
+	hot_assert(given_ptr != nullptr);
+	hot_assert(depth_idx < get_depth());
+	hot_assert(given_ptr == host_data || given_ptr == device_data);
+	//the depths are only contiguous planes in the planar layout
+	hot_assert(layout == chw_layout);
 
 	return sub_ptr<float>(given_ptr, get_width() * get_height(), depth_idx);
 }
 
 float* matrix::get_ptr_row(float* given_ptr, size_t height_idx, size_t depth_idx)
 {
-	smart_assert(height_idx < get_height());
+	hot_assert(height_idx < get_height());
 	return get_ptr_layer(given_ptr, depth_idx) + height_idx * get_width();
 }
 
 float* matrix::get_ptr_item(float* given_ptr, size_t width_idx, size_t height_idx, size_t depth_idx)
 {
-	smart_assert(width_idx < get_width());
+	hot_assert(width_idx < get_width());
 	return get_ptr_row(given_ptr, height_idx, depth_idx) + width_idx;
 }
 
+size_t matrix::get_flat_idx(const vector3& pos) const
+{
+#ifdef CNN_UNCHECKED_ACCESS
+	return layout == chw_layout ?
+		pos.x + pos.y * format.x + pos.z * format.x * format.y :
+		pos.z + pos.x * format.z + pos.y * format.x * format.z;
+#else
+	return pos.get_index(format, layout);
+#endif
+}
+
 matrix::matrix(
 ) :
 	owning_data(false),
@@ -235,6 +327,13 @@ matrix::matrix(const matrix& source, bool copy_values)
 	if (source.is_initialized())
 	{
 		this->format = source.format;
+		this->layout = source.layout;
+		if (source.host_data == nullptr)
+		{
+			//the copy of a device only matrix is device only as well
+			allocate_device_only_from(source, copy_values);
+			return;
+		}
 		allocate_host_mem();
 		if (copy_values)
 		{
@@ -270,6 +369,19 @@ matrix::matrix(std::ifstream& file)
 	}
 }
 
+matrix::matrix(model_reader& reader)
+	:matrix()
+{
+	float* mapped_data = (float*)reader.next_tensor(float32_tensor, format);
+	if (!format_is_valid())
+	{
+		throw std::runtime_error("invalid format");
+	}
+	//the mapped file does not free the data, so the matrix can handle it as its own
+	host_data = mapped_data;
+	allocator = &reader.get_file();
+	owning_data = true;
+}
 
 matrix::~matrix()
 {
@@ -278,7 +390,8 @@ matrix::~matrix()
 
 bool matrix::is_initialized() const
 {
-	return host_data != nullptr && format.item_count() != 0;
+	//device only matrices have no host data
+	return (host_data != nullptr || device_data != nullptr) && format.item_count() != 0;
 }
 
 void matrix::sync_device_and_host()
@@ -294,6 +407,8 @@ void matrix::sync_device_and_host()
 	}
 	else if (last_updated_data == device_data)
 	{
+		//a device only matrix gets its host data back here
+		ensure_host_mem();
 		copy_device2host();
 	}
 	else
@@ -319,15 +434,21 @@ bool matrix::host_data_is_updated() const
 
 matrix& matrix::operator=(const matrix& other)
 {
-	smart_assert(other.is_initialized());
 	//sets this matrix to the value of the other
 	//by copying
 
 	if (this != &other) {
 		delete_data_if_owning();
 		this->format = other.format;
+		this->layout = other.layout;
 
 		if (other.is_initialized() &&
+			other.host_data == nullptr)
+		{
+			//the copy of a device only matrix is device only as well
+			allocate_device_only_from(other, true);
+		}
+		else if (other.is_initialized() &&
 			other.format.item_count() != 0)
 		{
 			allocate_host_mem();
@@ -337,6 +458,12 @@ matrix& matrix::operator=(const matrix& other)
 				enable_gpu_mode();
 			}
 		}
+		else
+		{
+			//assigning an empty matrix frees the data
+			gpu_enabled = false;
+			last_updated_data = nullptr;
+		}
 	}
 	return *this;
 }
@@ -359,6 +486,11 @@ void matrix::set_data_from_src(const matrix& src)
 	smart_assert(format == src.format);
 	smart_assert(is_in_gpu_mode() == src.is_in_gpu_mode());
 
+	if (layout != src.layout)
+	{
+		convert_layout(src, *this);
+		return;
+	}
 	if (gpu_enabled)
 	{
 		copy_device2device_from(src);
@@ -373,14 +505,16 @@ void matrix::set_all(float value)
 {
 	if_not_initialized_throw();
 
-	for (int i = 0; i < item_count(); i++)
+	if (host_data != nullptr)
 	{
-		host_data[i] = value;
+		std::fill(host_data, host_data + item_count(), value);
 	}
 
-	if (gpu_enabled)
+	//the device values are set by a kernel instead of an upload
+	if (gpu_enabled && device_data != nullptr)
 	{
-		copy_host2device();
+		gpu_set_all(device_data, item_count(), value);
+		last_updated_data = host_data == nullptr ? device_data : nullptr;
 	}
 }
 
@@ -393,20 +527,36 @@ void matrix::apply_noise(float min, float max)
 {
 	if_not_initialized_throw();
 
-	for (int i = 0; i < item_count(); i++)
+	if (!gpu_enabled)
 	{
-		host_data[i] += random_float_excl(min, max);
+		for (int i = 0; i < item_count(); i++)
+		{
+			host_data[i] += random_float_excl(min, max);
+		}
+		return;
 	}
 
-	if (gpu_enabled)
+	//the noise is generated on the device and not uploaded
+	//the host adds the same counter based values, so an updated host stays synced
+	if (last_updated_data == host_data)
 	{
 		copy_host2device();
 	}
+	const uint64_t seed = random_seed();
+	gpu_apply_noise(device_data, item_count(), min, max, seed);
+	if (host_data != nullptr && host_data_is_updated())
+	{
+		for (size_t i = 0; i < item_count(); i++)
+		{
+			host_data[i] += counter_uniform(seed, 0, i, min, max);
+		}
+	}
 }
 
 void matrix::mutate(float range)
 {
 	smart_assert(is_initialized());
+	sync_if_device_only();
 
 	add_at_flat(
 		random_idx((int)item_count()),
@@ -419,8 +569,50 @@ void matrix::write_to_ofstream(std::ofstream& file) const
 {
 	smart_assert(is_initialized());
 
+	std::vector<float> device_values;
+	const float* values = host_values_or_copy(device_values);
+
 	format.write_to_ofstream(file);
-	file.write((char*)host_data, sizeof(float) * item_count());
+	if (layout != chw_layout)
+	{
+		//the files always keep the planar layout
+		std::vector<float> planar(item_count());
+		cpu_convert_layout(values, planar.data(), get_width(), get_height(), get_depth(), layout, chw_layout);
+		file.write((char*)planar.data(), sizeof(float) * item_count());
+		return;
+	}
+	file.write((char*)values, sizeof(float) * item_count());
+}
+
+void matrix::write_to_model(model_writer& writer) const
+{
+	smart_assert(is_initialized());
+
+	//the files always keep the planar layout, so an interleaved matrix writes a converted copy
+	//(a snapshot of it waits for the device)
+	if (layout != chw_layout)
+	{
+		std::vector<float> values(item_count());
+		std::vector<float> planar(item_count());
+		copy_values_to_host(values.data());
+		cpu_convert_layout(values.data(), planar.data(), get_width(), get_height(), get_depth(), layout, chw_layout);
+		writer.add_tensor_copy(float32_tensor, format, planar.data());
+		return;
+	}
+	//a snapshot does not wait for the device, the values are copied in the order of the stream
+	if (writer.is_snapshot() && gpu_enabled && device_data_is_updated())
+	{
+		writer.add_device_tensor(float32_tensor, format, device_data);
+		return;
+	}
+	if (host_data == nullptr)
+	{
+		std::vector<float> values(item_count());
+		copy_values_to_host(values.data());
+		writer.add_tensor_copy(float32_tensor, format, values.data());
+		return;
+	}
+	writer.add_tensor(float32_tensor, format, host_data);
 }
 
 vector3 matrix::get_format() const
@@ -428,6 +620,42 @@ vector3 matrix::get_format() const
 	return format;
 }
 
+void matrix::set_layout(e_tensor_layout_t new_layout)
+{
+	if_not_initialized_throw();
+	if (new_layout == layout)
+	{
+		return;
+	}
+
+	//the values are reordered through a copy, the conversion can not work in place
+	if (gpu_enabled && last_updated_data == device_data)
+	{
+		matrix_allocator& scratch_allocator = get_matrix_allocator();
+		float* scratch = scratch_allocator.allocate_device(item_count());
+		cudaMemcpyAsync(
+			scratch,
+			device_data,
+			item_count() * sizeof(float),
+			cudaMemcpyDeviceToDevice,
+			gpu_get_current_stream());
+		gpu_convert_layout(scratch, device_data, get_width(), get_height(), get_depth(), layout, new_layout);
+		scratch_allocator.free_device(scratch);
+	}
+	else
+	{
+		std::vector<float> values(host_data, host_data + item_count());
+		cpu_convert_layout(values.data(), host_data, get_width(), get_height(), get_depth(), layout, new_layout);
+		set_host_as_last_updated();
+	}
+	layout = new_layout;
+}
+
+e_tensor_layout_t matrix::get_layout() const
+{
+	return layout;
+}
+
 size_t matrix::get_width() const
 {
 	return format.x;
@@ -541,16 +769,18 @@ std::string matrix::analyse_string() const
 
 float matrix::get_at_flat_host(size_t idx) const
 {
-	smart_assert(is_initialized());
-	smart_assert(idx < item_count());
+	hot_assert(is_initialized());
+	hot_assert(idx < item_count());
+	if_device_only_throw();
 
 	return host_data[idx];
 }
 
 void matrix::set_at_flat_host(size_t idx, float value)
 {
-	smart_assert(is_initialized());
-	smart_assert(idx < item_count());
+	hot_assert(is_initialized());
+	hot_assert(idx < item_count());
+	sync_if_device_only();
 
 	host_data[idx] = value;
 
@@ -559,7 +789,68 @@ void matrix::set_at_flat_host(size_t idx, float value)
 
 void matrix::add_at_flat(size_t idx, float value)
 {
-	set_at_flat_host(idx, get_at_flat_host(idx) + value);
+	hot_assert(is_initialized());
+	hot_assert(idx < item_count());
+	sync_if_device_only();
+
+	host_data[idx] += value;
+
+	set_host_as_last_updated();
+}
+
+void matrix::copy_values_to_host(float* destination) const
+{
+	smart_assert(is_initialized());
+	smart_assert(destination != nullptr);
+
+	if (gpu_enabled && last_updated_data == device_data)
+	{
+		cudaMemcpyAsync(
+			destination,
+			device_data,
+			item_count() * sizeof(float),
+			cudaMemcpyDeviceToHost,
+			gpu_get_current_stream());
+		gpu_sync_current_stream();
+		return;
+	}
+	memcpy(destination, host_data, item_count() * sizeof(float));
+}
+
+data_span<float> matrix::host_span()
+{
+	smart_assert(is_initialized());
+	smart_assert(host_data_is_updated());
+
+	set_host_as_last_updated();
+	return data_span<float>{ host_data, item_count() };
+}
+
+data_span<const float> matrix::host_span_readonly() const
+{
+	smart_assert(is_initialized());
+	smart_assert(host_data_is_updated());
+
+	return data_span<const float>{ host_data, item_count() };
+}
+
+data_span<float> matrix::device_span()
+{
+	smart_assert(is_initialized());
+	smart_assert(is_in_gpu_mode());
+	smart_assert(device_data_is_updated());
+
+	set_device_as_last_updated();
+	return data_span<float>{ device_data, item_count() };
+}
+
+data_span<const float> matrix::device_span_readonly() const
+{
+	smart_assert(is_initialized());
+	smart_assert(is_in_gpu_mode());
+	smart_assert(device_data_is_updated());
+
+	return data_span<const float>{ device_data, item_count() };
 }
 
 float* matrix::get_device_ptr()
@@ -602,6 +893,102 @@ bool matrix::is_owning_data() const
 	return owning_data;
 }
 
+void matrix::move_to_allocator(matrix_allocator& target)
+{
+	if_not_initialized_throw();
+	if_not_owning_throw();
+
+	if (allocator == &target)
+	{
+		return;
+	}
+
+	//an allocator that keeps its memory hands out host data at the same offsets as the device data
+	//(see neural_network::ensure_flat_parameters), so it gets the host data back
+	if (host_data == nullptr && !target.releases_host_memory())
+	{
+		sync_device_and_host();
+	}
+	if (host_data == nullptr)
+	{
+		//a device only matrix moves its device data directly
+		float* new_device_data = target.allocate_device(item_count());
+		cudaMemcpyAsync(
+			new_device_data,
+			device_data,
+			item_count() * sizeof(float),
+			cudaMemcpyDeviceToDevice,
+			gpu_get_current_stream());
+		if_cuda_error_throw();
+		allocator->free_device(device_data);
+		device_data = new_device_data;
+		allocator = &target;
+		last_updated_data = device_data;
+		return;
+	}
+
+	//only the host data is copied, the device gets it from there
+	sync_device_and_host();
+
+	float* new_host_data = target.allocate_host(item_count());
+	std::copy(host_data, host_data + item_count(), new_host_data);
+	allocator->free_host(host_data);
+	host_data = new_host_data;
+
+	if (device_data != nullptr)
+	{
+		float* new_device_data = target.allocate_device(item_count());
+		allocator->free_device(device_data);
+		device_data = new_device_data;
+		copy_host2device();
+	}
+
+	allocator = &target;
+	last_updated_data = nullptr;
+}
+
+matrix_allocator* matrix::get_allocator() const
+{
+	return allocator;
+}
+
+void matrix::set_device_only(bool device_only)
+{
+	if_not_initialized_throw();
+	if_not_owning_throw();
+	if_gpu_not_allocated_throw();
+
+	if (!device_only)
+	{
+		sync_device_and_host();
+		return;
+	}
+	if (host_data == nullptr || !allocator->releases_host_memory())
+	{
+		return;
+	}
+
+	if (last_updated_data == host_data)
+	{
+		copy_host2device();
+		//pinned host data might still be read by the copy
+		gpu_sync_current_stream();
+	}
+	allocator->free_host(host_data);
+	host_data = nullptr;
+	last_updated_data = device_data;
+}
+
+bool matrix::is_device_only() const
+{
+	return gpu_enabled && host_data == nullptr && device_data != nullptr;
+}
+
+bool matrix::has_host_data() const
+{
+	return host_data != nullptr;
+}
+
 void matrix::observe_row(matrix& m, size_t row_idx)
 {
 	observe_row(m, row_idx, 0);
@@ -646,13 +1033,15 @@ void matrix::observe_row(matrix& m, size_t row_idx, size_t item_idx)
 
 	delete_data_if_owning();
 	
-	host_data = m.get_ptr_item(m.host_data, item_idx, row_idx, 0);
+	//a device only matrix has no host row
+	host_data = m.host_data == nullptr ? nullptr : m.get_ptr_item(m.host_data, item_idx, row_idx, 0);
 
 	if (gpu_enabled)
 	{
 		device_data = m.get_ptr_item(m.device_data, item_idx, row_idx, 0);
 	}
 	owning_data = false;
+	last_updated_data = host_data == nullptr ? device_data : nullptr;
 
 	/*
 	m.last_updated_data ==
@@ -662,6 +1051,27 @@ void matrix::observe_row(matrix& m, size_t row_idx, size_t item_idx)
 	*/
 }
 
+void matrix::observe(const matrix& m)
+{
+	smart_assert(m.is_initialized());
+	if (&m == this)
+	{
+		return;
+	}
+
+	delete_data_if_owning();
+
+	format = m.format;
+	layout = m.layout;
+	host_data = m.host_data;
+	device_data = m.device_data;
+	gpu_enabled = m.gpu_enabled;
+	allocator = nullptr;
+	owning_data = false;
+	//the pointers are the same, so the updated side is the same as well
+	last_updated_data = m.last_updated_data;
+}
+
 void matrix::set_row_from_matrix(const matrix& m, size_t row_idx)
 {
 	set_row_from_matrix(m, row_idx, 0);
@@ -747,7 +1157,7 @@ void matrix::set_row_from_matrix(const matrix& m, size_t row_idx, size_t item_id
 	{
 		float* new_ptr = get_ptr_item(device_data, item_idx, row_idx, 0);
 
-		cudaMemcpy(new_ptr, m.device_data, m.item_count() * sizeof(float), cudaMemcpyDeviceToDevice);
+		cudaMemcpyAsync(new_ptr, m.device_data, m.item_count() * sizeof(float), cudaMemcpyDeviceToDevice, gpu_get_current_stream());
 		if_cuda_error_throw();
 		set_device_as_last_updated();
 	}
@@ -760,28 +1170,118 @@ void matrix::set_row_from_matrix(const matrix& m, size_t row_idx, size_t item_id
 	}
 }
 
-void matrix::set_at_host(vector3 pos, float value)
+void matrix::set_rows_from_matrix_rows(
+	const matrix& m,
+	const uint32_t* src_row_indices,
+	size_t src_item_idx,
+	size_t item_count)
+{
+	smart_assert(is_initialized());
+	smart_assert(m.is_initialized());
+	smart_assert(is_owning_data());
+	smart_assert(src_row_indices != nullptr);
+	smart_assert(src_item_idx + item_count <= m.get_width());
+	smart_assert(item_count <= get_width());
+	smart_assert(m.is_in_gpu_mode() == is_in_gpu_mode());
+
+	if (is_in_gpu_mode())
+	{
+		gpu_gather_rows(
+			m.get_device_ptr_readonly(),
+			m.get_width(),
+			src_item_idx,
+			src_row_indices,
+			get_height(),
+			item_count,
+			get_device_ptr(),
+			get_width());
+		set_device_as_last_updated();
+		return;
+	}
+
+	for (size_t row_idx = 0; row_idx < get_height(); row_idx++)
+	{
+		smart_assert(src_row_indices[row_idx] < m.get_height());
+		memcpy(
+			host_data + row_idx * get_width(),
+			m.host_data + src_row_indices[row_idx] * m.get_width() + src_item_idx,
+			item_count * sizeof(float));
+	}
+	set_host_as_last_updated();
+}
+
+void matrix::set_row_from_matrix_row(
+	const matrix& m,
+	size_t src_row_idx,
+	size_t src_item_idx,
+	size_t row_idx,
+	size_t item_count)
 {
 	smart_assert(is_initialized());
+	smart_assert(m.is_initialized());
 	smart_assert(is_owning_data());
-	smart_assert(pos.is_in_bounds(format));
+	smart_assert(src_row_idx < m.get_height());
+	smart_assert(row_idx < get_height());
+	smart_assert(src_item_idx + item_count <= m.get_width());
+	smart_assert(item_count <= get_width());
+	smart_assert(m.is_in_gpu_mode() == is_in_gpu_mode());
+
+	//both rows are at depth 0, so the offset is just the row times the width
+	const size_t src_offset = src_row_idx * m.get_width() + src_item_idx;
+	const size_t dst_offset = row_idx * get_width();
+
+	if (is_in_gpu_mode())
+	{
+		cudaMemcpyAsync(
+			device_data + dst_offset,
+			m.device_data + src_offset,
+			item_count * sizeof(float),
+			cudaMemcpyDeviceToDevice,
+			gpu_get_current_stream());
+		if_cuda_error_throw();
+		set_device_as_last_updated();
+	}
+	else
+	{
+		memcpy(
+			host_data + dst_offset,
+			m.host_data + src_offset,
+			item_count * sizeof(float));
+		set_host_as_last_updated();
+	}
+}
+
+void matrix::set_at_host(vector3 pos, float value)
+{
+	hot_assert(is_initialized());
+	hot_assert(is_owning_data());
+	hot_assert(pos.is_in_bounds(format));
+	sync_if_device_only();
 
-	host_data[pos.get_index(format)] = value;
+	host_data[get_flat_idx(pos)] = value;
 
 	set_host_as_last_updated();
 }
 
 void matrix::add_at_host(vector3 pos, float value)
 {
-	set_at_host(pos, get_at_host(pos) + value);
+	hot_assert(is_initialized());
+	hot_assert(is_owning_data());
+	hot_assert(pos.is_in_bounds(format));
+	sync_if_device_only();
+
+	host_data[get_flat_idx(pos)] += value;
+
+	set_host_as_last_updated();
 }
 
 float matrix::get_at_host(vector3 pos) const
 {
-	smart_assert(is_initialized());
-	smart_assert(pos.is_in_bounds(format));
+	hot_assert(is_initialized());
+	hot_assert(pos.is_in_bounds(format));
+	if_device_only_throw();
 
-	return host_data[pos.get_index(format)];
+	return host_data[get_flat_idx(pos)];
 }
 
 bool matrix::contains_non_zero_items() {
@@ -819,24 +1319,155 @@ void matrix::dot_product_flat(const matrix& a, const matrix& flat, matrix& resul
 		return;
 	}
 
-	for (int y = 0; y < a.get_height(); y++)
+	const size_t width = a.get_width();
+	for (size_t y = 0; y < a.get_height(); y++)
 	{
-		result_flat.set_at_flat_host(y, 0);
-		for (int x = 0; x < a.get_width(); x++)
-		{
-			result_flat.add_at_flat(y, a.get_at_host(vector3(x, y)) * flat.get_at_flat_host(x));
-		}
+		result_flat.host_data[y] = cpu_dot(a.host_data + y * width, flat.host_data, width);
 	}
 	result_flat.set_host_as_last_updated();
 }
 
-void matrix::add(const matrix& a, const matrix& b, matrix& result)
+void matrix::dot_product_bias_activate(
+	const matrix& a,
+	const matrix& flat,
+	const matrix& biases,
+	matrix& result_flat,
+	e_activation_t activation_fn)
 {
 	smart_assert(a.is_initialized());
-	smart_assert(b.is_initialized());
-	smart_assert(result.is_initialized());
-
-	smart_assert(a.get_width() == b.get_width());
+	smart_assert(flat.is_initialized());
+	smart_assert(biases.is_initialized());
+	smart_assert(result_flat.is_initialized());
+	smart_assert(result_flat.is_owning_data());
+	smart_assert(a.get_width() == flat.item_count());
+	smart_assert(a.get_height() == result_flat.item_count());
+	smart_assert(biases.item_count() == result_flat.item_count());
+	smart_assert(a.get_depth() == 1);
+
+	if (a.gpu_enabled &&
+		flat.gpu_enabled &&
+		biases.gpu_enabled &&
+		result_flat.gpu_enabled)
+	{
+		gpu_dot_product_bias_activation(a, flat, biases, result_flat, activation_fn);
+		result_flat.set_device_as_last_updated();
+		return;
+	}
+
+	const size_t width = a.get_width();
+	dispatch_activation(activation_fn, [&](auto traits) {
+		using traits_t = decltype(traits);
+		for (size_t y = 0; y < a.get_height(); y++)
+		{
+			result_flat.host_data[y] = traits_t::activate(
+				cpu_dot(a.host_data + y * width, flat.host_data, width) + biases.host_data[y]);
+		}
+	});
+	if (activation_fn == softmax_fn)
+	{
+		cpu_add_bias_softmax(result_flat.host_data, nullptr, result_flat.item_count(), result_flat.item_count());
+	}
+	result_flat.set_host_as_last_updated();
+}
+
+void matrix::dot_product_batch(const matrix& weights, const matrix& input_batch, matrix& result_batch)
+{
+	smart_assert(weights.is_initialized());
+	smart_assert(input_batch.is_initialized());
+	smart_assert(result_batch.is_initialized());
+	smart_assert(weights.get_width() == input_batch.get_width());
+	smart_assert(weights.get_height() == result_batch.get_width());
+	smart_assert(input_batch.get_height() == result_batch.get_height());
+	smart_assert(weights.get_depth() == 1);
+
+	if (weights.gpu_enabled &&
+		input_batch.gpu_enabled &&
+		result_batch.gpu_enabled)
+	{
+		gpu_dot_product_batch(weights, input_batch, result_batch);
+		result_batch.set_device_as_last_updated();
+		return;
+	}
+
+	const size_t input_size = weights.get_width();
+	const size_t neuron_count = weights.get_height();
+	const size_t batch_size = input_batch.get_height();
+
+	//the weight row is the same for every item in the batch
+	//so it is iterated in the outer loop and stays in the cache
+	for (size_t neuron_idx = 0; neuron_idx < neuron_count; neuron_idx++)
+	{
+		const float* weight_row = weights.host_data + neuron_idx * input_size;
+		for (size_t batch_idx = 0; batch_idx < batch_size; batch_idx++)
+		{
+			const float* input_row = input_batch.host_data + batch_idx * input_size;
+			result_batch.host_data[batch_idx * neuron_count + neuron_idx] = cpu_dot(weight_row, input_row, input_size);
+		}
+	}
+	result_batch.set_host_as_last_updated();
+}
+
+void matrix::dot_product_batch_bias_activate(
+	const matrix& weights,
+	const matrix& input_batch,
+	const matrix& biases,
+	matrix& result_batch,
+	e_activation_t activation_fn)
+{
+	smart_assert(weights.is_initialized());
+	smart_assert(input_batch.is_initialized());
+	smart_assert(biases.is_initialized());
+	smart_assert(result_batch.is_initialized());
+	smart_assert(result_batch.is_owning_data());
+	smart_assert(weights.get_width() == input_batch.get_width());
+	smart_assert(weights.get_height() == result_batch.get_width());
+	smart_assert(input_batch.get_height() == result_batch.get_height());
+	smart_assert(biases.item_count() == result_batch.get_width());
+	smart_assert(weights.get_depth() == 1);
+
+	if (weights.gpu_enabled &&
+		input_batch.gpu_enabled &&
+		biases.gpu_enabled &&
+		result_batch.gpu_enabled)
+	{
+		gpu_dot_product_batch_bias_activation(weights, input_batch, biases, result_batch, activation_fn);
+		result_batch.set_device_as_last_updated();
+		return;
+	}
+
+	const size_t input_size = weights.get_width();
+	const size_t neuron_count = weights.get_height();
+	const size_t batch_size = input_batch.get_height();
+
+	//the same loop order as dot_product_batch, the bias of the weight row is the same for every item
+	dispatch_activation(activation_fn, [&](auto traits) {
+		using traits_t = decltype(traits);
+		for (size_t neuron_idx = 0; neuron_idx < neuron_count; neuron_idx++)
+		{
+			const float* weight_row = weights.host_data + neuron_idx * input_size;
+			const float bias = biases.host_data[neuron_idx];
+			for (size_t batch_idx = 0; batch_idx < batch_size; batch_idx++)
+			{
+				const float* input_row = input_batch.host_data + batch_idx * input_size;
+				result_batch.host_data[batch_idx * neuron_count + neuron_idx] =
+					traits_t::activate(cpu_dot(weight_row, input_row, input_size) + bias);
+			}
+		}
+	});
+	if (activation_fn == softmax_fn)
+	{
+		cpu_add_bias_softmax(result_batch.host_data, nullptr, neuron_count, result_batch.item_count());
+	}
+	result_batch.set_host_as_last_updated();
+}
+
+void matrix::add(const matrix& a, const matrix& b, matrix& result)
+{
+	smart_assert(a.is_initialized());
+	smart_assert(b.is_initialized());
+	smart_assert(result.is_initialized());
+
+	smart_assert(a.get_width() == b.get_width());
 	smart_assert(a.get_height() == b.get_height());
 	smart_assert(a.get_depth() == b.get_depth());
 	
@@ -853,10 +1484,7 @@ void matrix::add(const matrix& a, const matrix& b, matrix& result)
 		return;
 	}
 
-	for (int i = 0; i < a.item_count(); i++)
-	{
-		result.host_data[i] = a.host_data[i] + b.host_data[i];
-	}
+	cpu_add(a.host_data, b.host_data, result.host_data, a.item_count());
 	result.set_host_as_last_updated();
 }
 
@@ -878,11 +1506,35 @@ void matrix::add_flat(const matrix& a, const matrix& b, matrix& result)
 		return;
 	}
 
-	for (int i = 0; i < a.item_count(); i++)
+	cpu_add(a.host_data, b.host_data, result.host_data, a.item_count());
+	result.set_host_as_last_updated();
+}
+
+void matrix::add_flat_batch(const matrix& batch, const matrix& flat, matrix& result_batch)
+{
+	smart_assert(batch.is_initialized());
+	smart_assert(flat.is_initialized());
+	smart_assert(result_batch.is_initialized());
+	smart_assert(result_batch.is_owning_data());
+	smart_assert(batch.get_width() == flat.item_count());
+	smart_assert(equal_format(batch, result_batch));
+
+	if (batch.gpu_enabled &&
+		flat.gpu_enabled &&
+		result_batch.gpu_enabled)
 	{
-		result.host_data[i] = a.host_data[i] + b.host_data[i];
+		gpu_add_flat_batch(batch, flat, result_batch);
+		result_batch.set_device_as_last_updated();
+		return;
 	}
-	result.set_host_as_last_updated();
+
+	const size_t row_size = flat.item_count();
+	for (size_t row_idx = 0; row_idx < batch.get_height(); row_idx++)
+	{
+		const size_t offset = row_idx * row_size;
+		cpu_add(batch.host_data + offset, flat.host_data, result_batch.host_data + offset, row_size);
+	}
+	result_batch.set_host_as_last_updated();
 }
 
 void matrix::subtract(const matrix& a, const matrix& b, matrix& result)
@@ -909,11 +1561,56 @@ void matrix::subtract(const matrix& a, const matrix& b, matrix& result)
 		return;
 	}
 
-	for (int i = 0; i < a.item_count(); i++)
+	cpu_subtract(a.host_data, b.host_data, result.host_data, a.item_count());
+	result.set_host_as_last_updated();
+}
+
+void matrix::cost_derivative(
+	const matrix& activations,
+	const matrix& expected,
+	matrix& error,
+	e_cost_function_t cost_fn,
+	matrix* cost)
+{
+	smart_assert(activations.is_initialized());
+	smart_assert(expected.is_initialized());
+	smart_assert(error.is_initialized());
+	smart_assert(error.is_owning_data());
+	smart_assert(equal_format(activations, expected));
+	smart_assert(equal_format(expected, error));
+	smart_assert(cost == nullptr || cost->is_in_gpu_mode() == error.is_in_gpu_mode());
+
+	if (activations.gpu_enabled &&
+		expected.gpu_enabled &&
+		error.gpu_enabled)
 	{
-		result.host_data[i] = a.host_data[i] - b.host_data[i];
+		gpu_cost_derivative(
+			activations.device_data,
+			expected.device_data,
+			error.device_data,
+			error.item_count(),
+			cost_fn,
+			cost == nullptr ? nullptr : cost->device_data);
+		error.set_device_as_last_updated();
+		if (cost != nullptr)
+		{
+			cost->set_device_as_last_updated();
+		}
+		return;
+	}
+
+	cpu_cost_derivative(
+		activations.host_data,
+		expected.host_data,
+		error.host_data,
+		error.item_count(),
+		cost_fn,
+		cost == nullptr ? nullptr : cost->host_data);
+	error.set_host_as_last_updated();
+	if (cost != nullptr)
+	{
+		cost->set_host_as_last_updated();
 	}
-	result.set_host_as_last_updated();
 }
 
 void matrix::pooling(
@@ -922,82 +1619,146 @@ void matrix::pooling(
 	size_t stride,
 	size_t kernel_size,
 	e_pooling_type_t pooling_type)
+{
+	pooling(input, output, stride, kernel_size, pooling_type, nullptr);
+}
+
+void matrix::pooling(
+	const matrix& input,
+	matrix& output,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	pooling_index_buffer* selected_indices)
+{
+	pooling(input, output, stride, kernel_size, pooling_type, selected_indices, generic_kernel);
+}
+void matrix::pooling(
+	const matrix& input,
+	matrix& output,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	pooling_index_buffer* selected_indices,
+	e_fixed_kernel_t fixed_kernel)
 {
 	smart_assert(input.is_initialized());
 	smart_assert(output.is_initialized());
 	smart_assert(output.is_owning_data());
 
 	smart_assert(input.get_depth() == output.get_depth());
+	smart_assert(input.layout == output.layout);
 	smart_assert(convolution_output_size(input.get_width(), kernel_size, stride) == output.get_width());
+	smart_assert(kernel_size * kernel_size <= POOLING_MAX_WINDOW_SIZE);
+	smart_assert(selected_indices == nullptr || selected_indices->item_count() == output.item_count());
+	smart_assert(fixed_kernel == generic_kernel || fixed_kernel == pooling_select_fixed_kernel(kernel_size, stride));
+
+	//the average pooling does not select a value
+	if (pooling_type == average_pooling)
+	{
+		selected_indices = nullptr;
+	}
 
 	if (input.gpu_enabled &&
 		output.gpu_enabled)
 	{
-		gpu_pooling(input, output, stride, kernel_size, pooling_type);
+		smart_assert(selected_indices == nullptr || selected_indices->is_in_gpu_mode());
+		gpu_pooling(input, output, stride, kernel_size, pooling_type, selected_indices, fixed_kernel);
 		output.set_device_as_last_updated();
 		return;
 	}
 
+	if (input.layout == hwc_layout)
+	{
+		cpu_pooling_interleaved(
+			input.host_data,
+			output.host_data,
+			selected_indices == nullptr ? nullptr : selected_indices->get_host_ptr(),
+			input.get_width(),
+			output.get_width(),
+			output.get_height(),
+			output.get_depth(),
+			kernel_size,
+			stride,
+			pooling_type);
+		output.set_host_as_last_updated();
+		return;
+	}
+
+	if (fixed_kernel == kernel_2x2_s2)
+	{
+		cpu_pooling_2x2_s2(
+			input.host_data,
+			output.host_data,
+			selected_indices == nullptr ? nullptr : selected_indices->get_host_ptr(),
+			input.get_width(),
+			input.get_height(),
+			output.get_width(),
+			output.get_height(),
+			output.get_depth(),
+			pooling_type);
+		output.set_host_as_last_updated();
+		return;
+	}
+
+	const size_t input_width = input.get_width();
+	const size_t input_plane = input_width * input.get_height();
+	const size_t output_width = output.get_width();
+	const size_t output_plane = output_width * output.get_height();
+	unsigned char* indices = selected_indices == nullptr ? nullptr : selected_indices->get_host_ptr();
+
 	//iterate over each depth
 	for (size_t d = 0; d < output.get_depth(); d++)
 	{
 		//iterate over each row of the output
 		for (size_t y = 0; y < output.get_height(); y++)
 		{
-			//calculate the start and end index of the filter on the y axis
-			const size_t start_idx_y = y * stride;
-			const size_t end_idx_y = start_idx_y + kernel_size;
-
-			for (size_t x = 0; x < output.get_width(); x++)
+			for (size_t x = 0; x < output_width; x++)
 			{
-				//calculate the start and end index of the filter on the x axis
-				const size_t start_idx_x = x * stride;
-				const size_t end_idx_x = start_idx_x + kernel_size;
+				//the window starts at the output position times the stride
+				const float* window = input.host_data + d * input_plane + y * stride * input_width + x * stride;
 
-				//calculating the max, min, and average values
-				//this could be improved by only calculating one of these values
-				float max = FLT_MIN;
+				float max = -FLT_MAX;
 				float min = FLT_MAX;
 				float sum = 0;
+				size_t max_idx = 0;
+				size_t min_idx = 0;
 
 				//iterate over the filter
-				for (size_t i = start_idx_y; i <= end_idx_y; i++)
+				for (size_t i = 0; i < kernel_size; i++)
 				{
-					if (i >= input.get_height())
-						break;
-
-					for (size_t j = start_idx_x; j <= end_idx_x; j++)
+					for (size_t j = 0; j < kernel_size; j++)
 					{
-						if (j >= input.get_width())
-							break;
-
-						//get the value of the input at the current index
-						const float curr_val = input.get_at_host(vector3(j, i, d));
-
-						//if the current value is greater than the max value
-						//set the max value to the current value
+						const float curr_val = window[i * input_width + j];
 						if (curr_val > max)
 						{
 							max = curr_val;
+							max_idx = i * kernel_size + j;
 						}
 						if (curr_val < min)
 						{
 							min = curr_val;
+							min_idx = i * kernel_size + j;
 						}
 						sum += curr_val;
 					}
 				}
 
+				const size_t output_idx = d * output_plane + y * output_width + x;
 				switch (pooling_type)
 				{
 				case max_pooling:
-					output.set_at_host(vector3(x, y, d), max);
+					output.host_data[output_idx] = max;
+					if (indices != nullptr)
+						indices[output_idx] = (unsigned char)max_idx;
 					break;
 				case min_pooling:
-					output.set_at_host(vector3(x, y, d), min);
+					output.host_data[output_idx] = min;
+					if (indices != nullptr)
+						indices[output_idx] = (unsigned char)min_idx;
 					break;
 				case average_pooling:
-					output.set_at_host(vector3(x, y, d), sum / (kernel_size * kernel_size));
+					output.host_data[output_idx] = sum / (kernel_size * kernel_size);
 					break;
 				default:
 					throw std::runtime_error("Invalid pooling type");
@@ -1009,6 +1770,99 @@ void matrix::pooling(
 	output.set_host_as_last_updated();
 }
 
+void matrix::pooling_backprop(
+	const matrix& error,
+	matrix& passing_error,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	const pooling_index_buffer* selected_indices)
+{
+	smart_assert(error.is_initialized());
+	smart_assert(passing_error.is_initialized());
+	smart_assert(passing_error.is_owning_data());
+
+	smart_assert(error.get_depth() == passing_error.get_depth());
+	smart_assert(error.layout == passing_error.layout);
+	smart_assert(convolution_output_size(passing_error.get_width(), kernel_size, stride) == error.get_width());
+
+	if (pooling_type != average_pooling &&
+		(selected_indices == nullptr || selected_indices->item_count() != error.item_count()))
+	{
+		throw std::invalid_argument("max and min pooling need the selected indices of the forward propagation");
+	}
+	if (pooling_type == average_pooling)
+	{
+		selected_indices = nullptr;
+	}
+
+	if (error.gpu_enabled &&
+		passing_error.gpu_enabled)
+	{
+		smart_assert(selected_indices == nullptr || selected_indices->is_in_gpu_mode());
+		gpu_pooling_backprop(error, passing_error, stride, kernel_size, pooling_type, selected_indices);
+		passing_error.set_device_as_last_updated();
+		return;
+	}
+
+	if (error.layout == hwc_layout)
+	{
+		cpu_pooling_backprop_interleaved(
+			error.host_data,
+			passing_error.host_data,
+			selected_indices == nullptr ? nullptr : selected_indices->get_host_ptr_readonly(),
+			passing_error.get_width(),
+			passing_error.get_height(),
+			error.get_width(),
+			error.get_height(),
+			error.get_depth(),
+			kernel_size,
+			stride);
+		passing_error.set_host_as_last_updated();
+		return;
+	}
+
+	const size_t input_width = passing_error.get_width();
+	const size_t input_plane = input_width * passing_error.get_height();
+	const size_t output_width = error.get_width();
+	const size_t output_plane = output_width * error.get_height();
+	const float average_factor = 1.0f / (float)(kernel_size * kernel_size);
+
+	//the windows can overlap, so the errors are added up
+	std::fill(passing_error.host_data, passing_error.host_data + passing_error.item_count(), 0.0f);
+
+	for (size_t d = 0; d < error.get_depth(); d++)
+	{
+		for (size_t y = 0; y < error.get_height(); y++)
+		{
+			for (size_t x = 0; x < output_width; x++)
+			{
+				const size_t output_idx = d * output_plane + y * output_width + x;
+				const float curr_error = error.host_data[output_idx];
+				float* window = passing_error.host_data + d * input_plane + y * stride * input_width + x * stride;
+
+				if (selected_indices != nullptr)
+				{
+					//only the selected value had an influence on the output
+					const size_t selected_idx = selected_indices->get_host_ptr_readonly()[output_idx];
+					window[(selected_idx / kernel_size) * input_width + selected_idx % kernel_size] += curr_error;
+					continue;
+				}
+
+				//every value of the window had the same influence
+				for (size_t i = 0; i < kernel_size; i++)
+				{
+					for (size_t j = 0; j < kernel_size; j++)
+					{
+						window[i * input_width + j] += curr_error * average_factor;
+					}
+				}
+			}
+		}
+	}
+	passing_error.set_host_as_last_updated();
+}
+
 void matrix::fully_connected_backprop(
 	const matrix& activations,
 	const matrix& weights,
@@ -1057,34 +1911,41 @@ void matrix::fully_connected_backprop(
 		return;
 	}
 
-	for (int neuron_idx = 0; neuron_idx < activations.item_count(); neuron_idx++)
-	{
-		float error_value = error.get_at_flat_host(neuron_idx);
+	const size_t input_count = input.item_count();
+	const size_t neuron_count = activations.item_count();
 
-		float unactivated_activation = INVERSE[activation_fn](activations.get_at_flat_host(neuron_idx));
-		float activation_derivative = DERIVATIVE[activation_fn](unactivated_activation);
+	//the error multiplied with the activation derivative
+	//it is needed for the weight gradient and the input gradient
+	std::vector<float> deltas(neuron_count);
 
-		//bias change
-		float bias_change = error_value * activation_derivative;
-		bias_deltas.add_at_flat(neuron_idx, bias_change);
+	cpu_multiply_activation_derivative(
+		activations.host_data, error.host_data, deltas.data(), neuron_count, activation_fn);
 
-		//iterate input layer
-		for (int input_idx = 0; input_idx < input.item_count(); input_idx++)
-		{
-			float input_value = input.get_at_flat_host(input_idx);
+	//weight gradient - the outer product of the deltas and the input
+	for (size_t neuron_idx = 0; neuron_idx < neuron_count; neuron_idx++)
+	{
+		const float delta = deltas[neuron_idx];
 
-			//this weight connects the current input node to the current neuron
-			float weight = weights.get_at_host(vector3(input_idx, neuron_idx));
+		//bias change
+		bias_deltas.host_data[neuron_idx] += delta;
 
-			weight_deltas.add_at_host(
-				vector3(input_idx, neuron_idx),
-				error_value * activation_derivative * input_value);
+		//the weights of this neuron are one row
+		float* weight_delta_row = weight_deltas.host_data + neuron_idx * input_count;
+		cpu_axpy(delta, input.host_data, weight_delta_row, input_count);
+	}
 
-			//passing error is null when this is the first layer
-			if (passing_error != nullptr)
-			{
-				passing_error->set_at_flat_host(input_idx, error_value * activation_derivative * weight);
-			}
+	//input gradient - the transposed weights multiplied with the deltas
+	//every input is connected to all neurons, so their errors are summed up
+	//passing error is null when this is the first layer
+	if (passing_error != nullptr)
+	{
+		float* passing_error_data = passing_error->host_data;
+		std::fill(passing_error_data, passing_error_data + input_count, 0.0f);
+
+		for (size_t neuron_idx = 0; neuron_idx < neuron_count; neuron_idx++)
+		{
+			const float* weight_row = weights.host_data + neuron_idx * input_count;
+			cpu_axpy(deltas[neuron_idx], weight_row, passing_error_data, input_count);
 		}
 	}
 
@@ -1096,6 +1957,105 @@ void matrix::fully_connected_backprop(
 	}
 }
 
+void matrix::fully_connected_backprop_batch(
+	const matrix& activations_batch,
+	const matrix& weights,
+	const matrix& input_batch,
+	matrix& error_batch,
+	matrix* passing_error_batch,
+	matrix& weight_deltas,
+	matrix& bias_deltas,
+	e_activation_t activation_fn)
+{
+	smart_assert(activations_batch.is_initialized());
+	smart_assert(weights.is_initialized());
+	smart_assert(input_batch.is_initialized());
+	smart_assert(error_batch.is_initialized());
+	smart_assert(weight_deltas.is_initialized());
+	smart_assert(bias_deltas.is_initialized());
+
+	smart_assert(error_batch.is_owning_data());
+	smart_assert(bias_deltas.is_owning_data());
+	smart_assert(weight_deltas.is_owning_data());
+	smart_assert(passing_error_batch == nullptr || passing_error_batch->is_initialized());
+	smart_assert(passing_error_batch == nullptr || equal_format(*passing_error_batch, input_batch));
+
+	smart_assert(matrix::equal_format(activations_batch, error_batch));
+	smart_assert(activations_batch.get_height() == input_batch.get_height());
+	smart_assert(weights.get_width() == input_batch.get_width());
+	smart_assert(weights.get_height() == activations_batch.get_width());
+
+	if (activations_batch.is_in_gpu_mode() &&
+		weights.is_in_gpu_mode() &&
+		input_batch.is_in_gpu_mode() &&
+		error_batch.is_in_gpu_mode() &&
+		weight_deltas.is_in_gpu_mode() &&
+		bias_deltas.is_in_gpu_mode())
+	{
+		gpu_fc_backprop_batch(
+			activations_batch,
+			weights,
+			input_batch,
+			error_batch,
+			passing_error_batch,
+			weight_deltas,
+			bias_deltas,
+			activation_fn
+		);
+
+		error_batch.set_device_as_last_updated();
+		weight_deltas.set_device_as_last_updated();
+		bias_deltas.set_device_as_last_updated();
+		if (passing_error_batch != nullptr)
+			passing_error_batch->set_device_as_last_updated();
+		return;
+	}
+
+	const size_t input_size = weights.get_width();
+	const size_t neuron_count = weights.get_height();
+	const size_t batch_size = input_batch.get_height();
+
+	//the error is multiplied with the activation derivative only once per item
+	//the result is used for the bias, the weight and the passing error
+	cpu_multiply_activation_derivative(
+		activations_batch.host_data, error_batch.host_data, error_batch.host_data, error_batch.item_count(), activation_fn);
+
+	for (size_t neuron_idx = 0; neuron_idx < neuron_count; neuron_idx++)
+	{
+		float* weight_delta_row = weight_deltas.host_data + neuron_idx * input_size;
+		for (size_t batch_idx = 0; batch_idx < batch_size; batch_idx++)
+		{
+			const float delta = error_batch.host_data[batch_idx * neuron_count + neuron_idx];
+			const float* input_row = input_batch.host_data + batch_idx * input_size;
+
+			bias_deltas.host_data[neuron_idx] += delta;
+			cpu_axpy(delta, input_row, weight_delta_row, input_size);
+		}
+	}
+
+	//passing error is null when this is the first layer
+	if (passing_error_batch != nullptr)
+	{
+		for (size_t batch_idx = 0; batch_idx < batch_size; batch_idx++)
+		{
+			float* passing_error_row = passing_error_batch->host_data + batch_idx * input_size;
+			const float* delta_row = error_batch.host_data + batch_idx * neuron_count;
+
+			std::fill(passing_error_row, passing_error_row + input_size, 0.0f);
+			for (size_t neuron_idx = 0; neuron_idx < neuron_count; neuron_idx++)
+			{
+				const float* weight_row = weights.host_data + neuron_idx * input_size;
+				cpu_axpy(delta_row[neuron_idx], weight_row, passing_error_row, input_size);
+			}
+		}
+		passing_error_batch->set_host_as_last_updated();
+	}
+
+	error_batch.set_host_as_last_updated();
+	weight_deltas.set_host_as_last_updated();
+	bias_deltas.set_host_as_last_updated();
+}
+
 bool matrix::are_equal(const matrix& a, const matrix& b)
 {
 	return are_equal(a, b, FLOAT_TOLERANCE);
@@ -1111,9 +2071,30 @@ bool matrix::are_equal(const matrix& a, const matrix& b, float tolerance)
 		return false;
 	}
 
+	//device only matrices are compared with a copy of their device values
+	std::vector<float> a_copy;
+	std::vector<float> b_copy;
+	const float* a_values = a.host_values_or_copy(a_copy);
+	const float* b_host_values = b.host_values_or_copy(b_copy);
+
+	if (a.layout != b.layout)
+	{
+		//the values are compared at the same positions
+		std::vector<float> b_values(b.item_count());
+		cpu_convert_layout(b_host_values, b_values.data(), b.get_width(), b.get_height(), b.get_depth(), b.layout, a.layout);
+		for (size_t i = 0; i < a.item_count(); i++)
+		{
+			if (std::abs(a_values[i] - b_values[i]) > tolerance)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
 	for (int i = 0; i < a.item_count(); i++)
 	{
-		if (std::abs(a.host_data[i] - b.host_data[i]) > tolerance)
+		if (std::abs(a_values[i] - b_host_values[i]) > tolerance)
 		{
 			return false;
 		}
@@ -1121,22 +2102,84 @@ bool matrix::are_equal(const matrix& a, const matrix& b, float tolerance)
 	return true;
 }
 
+void matrix::convert_layout(const matrix& source, matrix& destination)
+{
+	smart_assert(source.is_initialized());
+	smart_assert(destination.is_initialized());
+	smart_assert(equal_format(source, destination));
+
+	if (source.gpu_enabled &&
+		destination.gpu_enabled)
+	{
+		gpu_convert_layout(
+			source.device_data,
+			destination.device_data,
+			source.get_width(),
+			source.get_height(),
+			source.get_depth(),
+			source.layout,
+			destination.layout);
+		destination.set_device_as_last_updated();
+		return;
+	}
+
+	cpu_convert_layout(
+		source.host_data,
+		destination.host_data,
+		source.get_width(),
+		source.get_height(),
+		source.get_depth(),
+		source.layout,
+		destination.layout);
+	destination.set_host_as_last_updated();
+}
+
 bool matrix::equal_format(const matrix& a, const matrix& b)
 {
 	return vector3::are_equal(a.format, b.format);
 }
 
+conv_shape matrix::get_conv_shape(
+	const matrix& input,
+	const matrix& kernel,
+	size_t kernel_count,
+	size_t stride,
+	const matrix& output)
+{
+	conv_shape shape;
+	shape.input_width = input.get_width();
+	shape.input_height = input.get_height();
+	shape.input_depth = input.get_depth();
+	shape.kernel_size = kernel.get_width();
+	shape.kernel_count = kernel_count;
+	shape.stride = stride;
+	shape.output_width = output.get_width();
+	shape.output_height = output.get_height();
+	return shape;
+}
+
 void matrix::cross_correlation(
 	const matrix& input,
 	const std::vector<matrix>& kernels,
 	matrix& output,
 	size_t stride)
+{
+	cross_correlation(input, kernels, output, stride, generic_kernel);
+}
+
+void matrix::cross_correlation(
+	const matrix& input,
+	const std::vector<matrix>& kernels,
+	matrix& output,
+	size_t stride,
+	e_fixed_kernel_t fixed_kernel)
 {
 	smart_assert(input.is_initialized());
 	smart_assert(output.is_initialized());
 	smart_assert(output.is_owning_data());
 
 	smart_assert(kernels.size() > 0);	
+	smart_assert(input.layout == output.layout);
 
 	bool use_gpu = true;
 	use_gpu = use_gpu && input.gpu_enabled;
@@ -1154,7 +2197,7 @@ void matrix::cross_correlation(
 		stride,
 		output.get_format()));
 
-	output.set_all(0);
+	//every strategy overwrites the output, so it does not have to be cleared
 
 	if (use_gpu)
 	{
@@ -1167,62 +2210,247 @@ void matrix::cross_correlation(
 			kernels[0].get_width(),
 			kernels.size(),
 			stride,
-			output.get_width());
+			output.get_width(),
+			fixed_kernel);
 
 		output.set_device_as_last_updated();
 		return;
 	}
 
-	size_t kernel_size = kernels[0].get_width();
+	std::vector<const float*> kernel_data(kernels.size());
+	for (size_t i = 0; i < kernels.size(); i++)
+	{
+		kernel_data[i] = kernels[i].host_data;
+	}
 
-	//iterate over each
-	for (size_t z = 0; z < output.get_depth(); z++)
+	if (input.layout == hwc_layout)
 	{
-		for (size_t y = 0; y < output.get_height(); y++)
-		{
-			for (size_t x = 0; x < output.get_width(); x++)
-			{
-				//iterate over the kernel and input.
-				//the overlaying values are multiplied and added to the output
-				//input		kernel
-				//+--+--+	+--+--+	  +--+--+
-				//|1 |2 |	|2 |3 |	  |2 |6 |
-				//+--+--+ * +--+--+ = +--+--+ = 2 + 6 + 12 + 20 = 40 
-				//|3 |4 |	|4 |5 |	  |12|20|
-				//+--+--+	+--+--+	  +--+--+
-				//
-				//40 is the sum
+		conv_forward_interleaved(
+			get_conv_shape(input, kernels[0], kernels.size(), stride, output),
+			input.host_data,
+			kernel_data.data(),
+			output.host_data);
+		output.set_host_as_last_updated();
+		return;
+	}
 
-				float sum = 0;
-				for (size_t curr_depth = 0; curr_depth < kernels[0].get_depth(); curr_depth++)
-				{
-					for (size_t i = 0; i < kernel_size; i++)
-					{
-						for (size_t j = 0; j < kernel_size; j++)
-						{
-							sum +=
-								input.get_at_host(
-									vector3(
-										x * stride + i,
-										y * stride + j,
-										curr_depth)) *
-								kernels[z].get_at_host(
-									vector3(
-										i,
-										j,
-										curr_depth));
-						}
-					}
-				}
-				//if we do this, the output of all depths will be added together
-				output.add_at_host(vector3(x, y, z), sum);
-			}
-		}
+	//the engine chooses the algorithm by the shape of the convolution if there is no fixed kernel
+	conv_forward_fixed(
+		get_conv_shape(input, kernels[0], kernels.size(), stride, output),
+		fixed_kernel,
+		input.host_data,
+		kernel_data.data(),
+		output.host_data);
+
+	output.set_host_as_last_updated();
+}
+
+void matrix::cross_correlation_bias_activate(
+	const matrix& input,
+	const std::vector<matrix>& kernels,
+	const matrix& biases,
+	matrix& output,
+	size_t stride,
+	e_fixed_kernel_t fixed_kernel,
+	e_activation_t activation_fn)
+{
+	smart_assert(input.is_initialized());
+	smart_assert(biases.is_initialized());
+	smart_assert(output.is_initialized());
+	smart_assert(output.is_owning_data());
+
+	smart_assert(kernels.size() > 0);
+	smart_assert(input.layout == output.layout);
+	smart_assert(biases.layout == output.layout);
+	smart_assert(biases.item_count() == output.item_count());
+
+	bool use_gpu = true;
+	use_gpu = use_gpu && input.gpu_enabled;
+	use_gpu = use_gpu && biases.gpu_enabled;
+	use_gpu = use_gpu && output.gpu_enabled;
+
+	for (const auto& curr_kernel : kernels)
+	{
+		smart_assert(curr_kernel.is_initialized());
+		use_gpu = use_gpu && curr_kernel.gpu_enabled;
+	}
+
+	smart_assert(convolution_format_valid(
+		input.get_format(),
+		kernels[0].get_format(),
+		stride,
+		output.get_format()));
+
+	if (use_gpu)
+	{
+		gpu_valid_cross_correlation_bias_activation(
+			input,
+			kernels,
+			biases,
+			output,
+			input.get_width(),
+			input.get_depth(),
+			kernels[0].get_width(),
+			kernels.size(),
+			stride,
+			output.get_width(),
+			fixed_kernel,
+			activation_fn);
+
+		output.set_device_as_last_updated();
+		return;
+	}
+
+	std::vector<const float*> kernel_data(kernels.size());
+	for (size_t i = 0; i < kernels.size(); i++)
+	{
+		kernel_data[i] = kernels[i].host_data;
+	}
+
+	const conv_shape shape = get_conv_shape(input, kernels[0], kernels.size(), stride, output);
+	if (input.layout == hwc_layout)
+	{
+		conv_forward_interleaved(
+			shape,
+			input.host_data,
+			kernel_data.data(),
+			biases.host_data,
+			activation_fn,
+			output.host_data);
+	}
+	else
+	{
+		conv_forward_fixed(
+			shape,
+			fixed_kernel,
+			input.host_data,
+			kernel_data.data(),
+			biases.host_data,
+			activation_fn,
+			output.host_data);
 	}
 
 	output.set_host_as_last_updated();
 }
 
+void matrix::convolution_backprop(
+	const matrix& input,
+	const std::vector<matrix>& kernels,
+	const matrix& activations,
+	matrix& error,
+	matrix* passing_error,
+	std::vector<matrix>& kernel_deltas,
+	matrix& bias_deltas,
+	size_t stride,
+	e_activation_t activation_fn)
+{
+	smart_assert(input.is_initialized());
+	smart_assert(activations.is_initialized());
+	smart_assert(error.is_initialized());
+	smart_assert(error.is_owning_data());
+	smart_assert(bias_deltas.is_initialized());
+	smart_assert(bias_deltas.is_owning_data());
+	smart_assert(passing_error == nullptr || passing_error->is_initialized());
+	smart_assert(passing_error == nullptr || equal_format(*passing_error, input));
+
+	smart_assert(kernels.size() > 0);
+	smart_assert(kernels.size() == kernel_deltas.size());
+	smart_assert(kernels.size() == activations.get_depth());
+	smart_assert(equal_format(activations, error));
+	smart_assert(equal_format(activations, bias_deltas));
+	smart_assert(input.layout == chw_layout);
+	smart_assert(activations.layout == chw_layout);
+	smart_assert(error.layout == chw_layout);
+	smart_assert(bias_deltas.layout == chw_layout);
+	smart_assert(passing_error == nullptr || passing_error->layout == chw_layout);
+
+	bool use_gpu = true;
+	use_gpu = use_gpu && input.gpu_enabled;
+	use_gpu = use_gpu && activations.gpu_enabled;
+	use_gpu = use_gpu && error.gpu_enabled;
+	use_gpu = use_gpu && bias_deltas.gpu_enabled;
+	use_gpu = use_gpu && (passing_error == nullptr || passing_error->gpu_enabled);
+
+	for (size_t i = 0; i < kernels.size(); i++)
+	{
+		smart_assert(kernels[i].is_initialized());
+		smart_assert(kernel_deltas[i].is_owning_data());
+		smart_assert(equal_format(kernels[i], kernel_deltas[i]));
+		use_gpu = use_gpu && kernels[i].gpu_enabled;
+		use_gpu = use_gpu && kernel_deltas[i].gpu_enabled;
+	}
+
+	smart_assert(convolution_format_valid(
+		input.get_format(),
+		kernels[0].get_format(),
+		stride,
+		activations.get_format()));
+
+	if (use_gpu)
+	{
+		gpu_convolution_backprop(
+			input,
+			kernels,
+			activations,
+			error,
+			passing_error,
+			kernel_deltas,
+			bias_deltas,
+			input.get_width(),
+			input.get_depth(),
+			kernels[0].get_width(),
+			kernels.size(),
+			stride,
+			activations.get_width(),
+			activation_fn);
+
+		error.set_device_as_last_updated();
+		bias_deltas.set_device_as_last_updated();
+		for (matrix& curr_deltas : kernel_deltas)
+		{
+			curr_deltas.set_device_as_last_updated();
+		}
+		if (passing_error != nullptr)
+		{
+			passing_error->set_device_as_last_updated();
+		}
+		return;
+	}
+
+	//the error multiplied with the activation derivative
+	//the biases are not shared, so every output has its own bias
+	cpu_multiply_activation_derivative(
+		activations.host_data, error.host_data, error.host_data, error.item_count(), activation_fn);
+	cpu_add(bias_deltas.host_data, error.host_data, bias_deltas.host_data, error.item_count());
+
+	std::vector<const float*> kernel_data(kernels.size());
+	std::vector<float*> kernel_delta_data(kernels.size());
+	for (size_t i = 0; i < kernels.size(); i++)
+	{
+		kernel_data[i] = kernels[i].host_data;
+		kernel_delta_data[i] = kernel_deltas[i].host_data;
+	}
+
+	conv_backward(
+		get_conv_shape(input, kernels[0], kernels.size(), stride, activations),
+		input.host_data,
+		kernel_data.data(),
+		error.host_data,
+		kernel_delta_data.data(),
+		passing_error == nullptr ? nullptr : passing_error->host_data);
+
+	error.set_host_as_last_updated();
+	bias_deltas.set_host_as_last_updated();
+	for (matrix& curr_deltas : kernel_deltas)
+	{
+		curr_deltas.set_host_as_last_updated();
+	}
+	if (passing_error != nullptr)
+	{
+		passing_error->set_host_as_last_updated();
+	}
+}
+
 void matrix::apply_deltas(
 	matrix& delta,
 	matrix& momentum,
@@ -1256,16 +2484,15 @@ void matrix::apply_deltas(
 		delta.set_device_as_last_updated();
 		return;
 	}
-	for (int i = 0; i < item_count(); i++)
-	{
-		float beta = 0.9f;
-		//the delta variable holds the sum of all desired changes. dividing it by the data count will return the average
-		float curr_delta = delta.host_data[i] / (float)training_data_count;
-		//gradient decent with momentum
-		momentum.host_data[i] = beta * momentum.host_data[i] + (1 - beta) * curr_delta;
-		host_data[i] -= (momentum.host_data[i] * learning_rate);
-		delta.host_data[i] = 0;
-	}
+	//the delta variable holds the sum of all desired changes. dividing it by the data count will return the average
+	cpu_apply_deltas(
+		host_data,
+		delta.host_data,
+		momentum.host_data,
+		item_count(),
+		1.0f / (float)training_data_count,
+		learning_rate,
+		0.9f);
 	set_host_as_last_updated();
 	delta.set_host_as_last_updated();
 }
@@ -1305,11 +2532,47 @@ void matrix::apply_activation_function(e_activation_t activation_fn)
 		return;
 	}
 
-	for (int i = 0; i < item_count(); i++)
+	cpu_activate(host_data, nullptr, 0, item_count(), activation_fn);
+	set_host_as_last_updated();
+}
+
+void matrix::add_bias_and_activate(matrix& activations, const matrix& biases, e_activation_t activation_fn)
+{
+	smart_assert(activations.is_initialized());
+	smart_assert(biases.is_initialized());
+	smart_assert(activations.is_owning_data());
+	smart_assert(activations.item_count() == biases.item_count());
+	smart_assert(activations.layout == biases.layout);
+
+	if (activations.gpu_enabled &&
+		biases.gpu_enabled)
 	{
-		host_data[i] = ACTIVATION[activation_fn](host_data[i]);
+		gpu_add_bias_activation(activations, biases, activation_fn);
+		activations.set_device_as_last_updated();
+		return;
 	}
-	set_host_as_last_updated();
+
+	cpu_activate(activations.host_data, biases.host_data, biases.item_count(), activations.item_count(), activation_fn);
+	activations.set_host_as_last_updated();
+}
+
+void matrix::add_bias_and_activate_batch(matrix& activations_batch, const matrix& biases, e_activation_t activation_fn)
+{
+	smart_assert(activations_batch.is_initialized());
+	smart_assert(biases.is_initialized());
+	smart_assert(activations_batch.is_owning_data());
+	smart_assert(activations_batch.get_width() == biases.item_count());
+
+	if (activations_batch.gpu_enabled &&
+		biases.gpu_enabled)
+	{
+		gpu_add_bias_activation(activations_batch, biases, activation_fn);
+		activations_batch.set_device_as_last_updated();
+		return;
+	}
+
+	cpu_activate(activations_batch.host_data, biases.host_data, biases.item_count(), activations_batch.item_count(), activation_fn);
+	activations_batch.set_host_as_last_updated();
 }
 
 std::string matrix::get_string() const
@@ -1,5 +1,6 @@
 #pragma once
 #include <vector>
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include "util.hpp"
@@ -8,16 +9,26 @@
 #include "gpu_math.cuh"
 #include "enum_space.hpp"
 #include "assert_throw.hpp"
+#include "conv_engine.hpp"
+#include "pooling_index_buffer.hpp"
+#include "memory_pool.hpp"
+#include "int8_matrix.hpp"
+#include "sparse_matrix.hpp"
+#include "model_file.hpp"
 
 class matrix {
 private:
 	vector3 format;
+	//the order of the values in memory, the format is the same for every layout
+	e_tensor_layout_t layout = chw_layout;
 
 	bool owning_data;
 	bool gpu_enabled = false;
 
 	float* host_data;
 	float* device_data;
+	//the allocator the data was allocated with, it is also used to free it
+	matrix_allocator* allocator = nullptr;
 
 	float* last_updated_data = nullptr;
 
@@ -26,6 +37,9 @@ private:
 
 	void if_not_initialized_throw() const;
 	void if_not_owning_throw() const;
+	//the host accessors can not read a device only matrix, the writing ones sync it first
+	void if_device_only_throw() const;
+	void sync_if_device_only();
 
 	void if_gpu_not_allocated_throw() const;
 	void allocate_device_mem();
@@ -36,6 +50,12 @@ private:
 
 	bool format_is_valid() const;
 	void allocate_host_mem();
+	//allocates the host data again after set_device_only freed it, the values are not set
+	void ensure_host_mem();
+	//allocates only device data and copies the source into it (see set_device_only)
+	void allocate_device_only_from(const matrix& source, bool copy_values);
+	//the host data, or a copy of the device values if there is no host data
+	const float* host_values_or_copy(std::vector<float>& copy) const;
 
 	void copy_host2host_from(const matrix& src);
 	void copy_device2device_from(const matrix& src);
@@ -46,6 +66,10 @@ private:
 	float* get_ptr_layer(float* given_ptr, size_t depth_idx);
 	float* get_ptr_row(float* given_ptr, size_t height_idx, size_t depth_idx);
 	float* get_ptr_item(float* given_ptr, size_t width_idx, size_t height_idx, size_t depth_idx);
+
+	//the flat index of a position in the host or device data
+	//the bounds are only checked if CNN_UNCHECKED_ACCESS is not defined
+	size_t get_flat_idx(const vector3& pos) const;
 public:
 	matrix();
 	matrix(vector3 given_format);
@@ -55,6 +79,8 @@ public:
 	matrix(const matrix& source, bool copy_values);
 	matrix(const matrix& source);
 	matrix(std::ifstream& file);
+	//uses the mapped tensor as host data instead of copying it
+	matrix(model_reader& reader);
 
 	matrix& operator=(const matrix& other);
 
@@ -73,15 +99,40 @@ public:
 	bool is_in_gpu_mode() const;
 	bool is_owning_data() const;
 
+	//moves the host and device data into memory of the given allocator
+	//the values are kept, afterwards the host and device are synced
+	void move_to_allocator(matrix_allocator& target);
+	//the allocator the data was allocated with, nullptr if nothing is allocated
+	matrix_allocator* get_allocator() const;
+
+	//device only matrices free their host data, the device keeps the only copy of the values
+	//(the host data is null and the device is always the last updated side)
+	//syncing allocates the host data again, it is kept until device only is set again
+	//only for owning matrices in gpu mode. the matrices of an allocator that does not
+	//release host memory (arenas, mapped files) keep their host data
+	//setting it to false copies the values back into new host data
+	void set_device_only(bool device_only);
+	bool is_device_only() const;
+	bool has_host_data() const;
+
 	void set_data_from_src(const matrix& src);
+	//in gpu mode the values are set on the device without an upload
+	//the host gets the same values if it is updated, so both stay synced
 	void set_all(float value);
 	void apply_noise(float range);
 	void apply_noise(float min, float max);
 	void mutate(float range);
 
 	void write_to_ofstream(std::ofstream& file) const;
+	void write_to_model(model_writer& writer) const;
 
 	vector3 get_format() const;
+	//setting a different layout reorders the values on the side that was updated last
+	//the positions of the values (get_at_host) stay the same.
+	//every matrix a kernel works on has to have the same layout (apart from convert_layout)
+	//and the files always keep the planar layout
+	void set_layout(e_tensor_layout_t new_layout);
+	e_tensor_layout_t get_layout() const;
 	size_t get_width() const;
 	size_t get_height() const;
 	size_t get_depth() const;
@@ -94,10 +145,23 @@ public:
 	float percentile(float percentage) const;
 	std::string analyse_string() const;
 
+	//a device only matrix gets its host data back before a host write,
+	//reading it on the host throws until it was synced
 	float get_at_flat_host(size_t idx) const;
 	void set_at_flat_host(size_t idx, float value);
 	void add_at_flat(size_t idx, float value);
 
+	//raw views of the data for iterating it in inner loops
+	//the writable spans mark their data as the last updated one
+	//the host span is only valid if the host data is updated
+	data_span<float> host_span();
+	data_span<const float> host_span_readonly() const;
+	data_span<float> device_span();
+	data_span<const float> device_span_readonly() const;
+	//copies the updated values into a host array without changing the matrix
+	//waits for the current stream if they are only updated on the device
+	void copy_values_to_host(float* destination) const;
+
 	float* get_device_ptr();
 	const float* get_device_ptr_readonly() const;
 	float* get_device_ptr_layer(size_t depth_idx);
@@ -110,9 +174,29 @@ public:
 	//the current matrix must have the same amount of elements as this row from the given item index on
 	//the current matrix will not own the data of the other matrix
 	void observe_row(matrix& m, size_t row_idx, size_t item_idx);
+	//the current matrix gets the host and device data of the given matrix
+	//the current matrix will not own the data and must not change it
+	//(the instances of a network read the parameters of their source this way)
+	void observe(const matrix& m);
 
 	void set_row_from_matrix(const matrix& m, size_t row_idx);
 	void set_row_from_matrix(const matrix& m, size_t row_idx, size_t item_idx);
+	//copies item_count items of a row of the given matrix into a row of the current matrix
+	//both rows are at depth 0
+	void set_row_from_matrix_row(
+		const matrix& m,
+		size_t src_row_idx,
+		size_t src_item_idx,
+		size_t row_idx,
+		size_t item_count);
+	//row i of the current matrix = item_count items of the row src_row_indices[i] of the given matrix
+	//all rows of the current matrix are written (at depth 0)
+	//the indices are a device array in gpu mode and a host array otherwise
+	void set_rows_from_matrix_rows(
+		const matrix& m,
+		const uint32_t* src_row_indices,
+		size_t src_item_idx,
+		size_t item_count);
 
 	//setter
 	void set_at_host(vector3 position, float value);
@@ -125,18 +209,80 @@ public:
 	bool contains_non_zero_items();
 
 	static void dot_product_flat(const matrix& a, const matrix& flat, matrix& result_flat);
+	//result_flat = activation_fn(a * flat + biases) in one pass over the result
+	//(the softmax normalizes the result in a second pass)
+	static void dot_product_bias_activate(
+		const matrix& a,
+		const matrix& flat,
+		const matrix& biases,
+		matrix& result_flat,
+		e_activation_t activation_fn);
+	//every row of the input batch is one flat input
+	//every row of the result batch is the dot product of the weights and the corresponding input row
+	//(result_batch = input_batch * weights^T)
+	static void dot_product_batch(const matrix& weights, const matrix& input_batch, matrix& result_batch);
+	//result_batch = activation_fn(input_batch * weights^T + biases) in one pass over the result batch
+	//the biases are added to every row (the softmax normalizes every row in a second pass)
+	static void dot_product_batch_bias_activate(
+		const matrix& weights,
+		const matrix& input_batch,
+		const matrix& biases,
+		matrix& result_batch,
+		e_activation_t activation_fn);
 
 	static void add(const matrix& a, const matrix& b, matrix& result);
 	static void add_flat(const matrix& a, const matrix& b, matrix& result);
+	//adds the flat matrix to every row of the batch
+	static void add_flat_batch(const matrix& batch, const matrix& flat, matrix& result_batch);
 
 	static void subtract(const matrix& a, const matrix& b, matrix& result);
 
+	//error = the derivative of the cost at the activations (see cpu_cost_derivative) in one pass
+	//the summed cost is added to the first item of the cost matrix if it is not null,
+	//so it stays on the device in gpu mode
+	static void cost_derivative(
+		const matrix& activations,
+		const matrix& expected,
+		matrix& error,
+		e_cost_function_t cost_fn,
+		matrix* cost);
+
 	static void pooling(
 		const matrix& input,
 		matrix& output,
 		size_t stride,
 		size_t kernel_size,
 		e_pooling_type_t pooling_type);
+	//the position of the selected value in every window of a max or min pooling
+	//is written into the selected indices if they are not null
+	//the input and the output have the same layout
+	static void pooling(
+		const matrix& input,
+		matrix& output,
+		size_t stride,
+		size_t kernel_size,
+		e_pooling_type_t pooling_type,
+		pooling_index_buffer* selected_indices);
+	//the fixed kernel is selected once by the pooling layer (see pooling_select_fixed_kernel)
+	//it is only used for planar values, generic_kernel uses the loops over the window
+	static void pooling(
+		const matrix& input,
+		matrix& output,
+		size_t stride,
+		size_t kernel_size,
+		e_pooling_type_t pooling_type,
+		pooling_index_buffer* selected_indices,
+		e_fixed_kernel_t fixed_kernel);
+	//the error is passed to the selected values (max and min pooling)
+	//or split evenly over the window (average pooling)
+	//max and min pooling need the selected indices of the forward propagation
+	static void pooling_backprop(
+		const matrix& error,
+		matrix& passing_error,
+		size_t stride,
+		size_t kernel_size,
+		e_pooling_type_t pooling_type,
+		const pooling_index_buffer* selected_indices);
 
 	static void fully_connected_backprop(
 		const matrix& activations,
@@ -149,16 +295,75 @@ public:
 		e_activation_t activation_fn
 	);
 
+	//same as fully_connected_backprop, but every row of the batches is one item
+	//the deltas of all items are summed up
+	//the error batch gets overwritten with the error multiplied by the activation derivative
+	static void fully_connected_backprop_batch(
+		const matrix& activations_batch,
+		const matrix& weights,
+		const matrix& input_batch,
+		matrix& error_batch,
+		matrix* passing_error_batch,
+		matrix& weight_deltas,
+		matrix& bias_deltas,
+		e_activation_t activation_fn
+	);
+
+	//the destination gets the values of the source in the layout of the destination
+	//both have the same format, the conversion runs on the gpu if both are in gpu mode
+	static void convert_layout(const matrix& source, matrix& destination);
+
 	static bool are_equal(const matrix& a, const matrix& b);
 	static bool are_equal(const matrix& a, const matrix& b, float tolerance);
 	static bool equal_format(const matrix& a, const matrix& b);
 
 
+	static conv_shape get_conv_shape(
+		const matrix& input,
+		const matrix& kernel,
+		size_t kernel_count,
+		size_t stride,
+		const matrix& output);
+
+	//the input and the output have the same layout, the kernels are always planar
 	static void cross_correlation(
 		const matrix& input,
 		const std::vector<matrix>& kernels,
 		matrix& output,
 		size_t stride);
+	//the fixed kernel is selected once by the convolutional layer (see conv_select_fixed_kernel)
+	//it is only used for planar values, generic_kernel uses the strategy of the shape
+	static void cross_correlation(
+		const matrix& input,
+		const std::vector<matrix>& kernels,
+		matrix& output,
+		size_t stride,
+		e_fixed_kernel_t fixed_kernel);
+	//output = activation_fn(cross correlation + biases), every strategy applies it when it writes an output
+	//the biases have the format and layout of the output
+	static void cross_correlation_bias_activate(
+		const matrix& input,
+		const std::vector<matrix>& kernels,
+		const matrix& biases,
+		matrix& output,
+		size_t stride,
+		e_fixed_kernel_t fixed_kernel,
+		e_activation_t activation_fn);
+	//the error gets overwritten with the error multiplied by the activation derivative
+	//the kernel and bias deltas are summed up
+	//the passing error is the full convolution of the error with the flipped kernels
+	//passing error is null when this is the first layer
+	//only for planar matrices, the convolutional layer converts interleaved ones around it
+	static void convolution_backprop(
+		const matrix& input,
+		const std::vector<matrix>& kernels,
+		const matrix& activations,
+		matrix& error,
+		matrix* passing_error,
+		std::vector<matrix>& kernel_deltas,
+		matrix& bias_deltas,
+		size_t stride,
+		e_activation_t activation_fn);
 	//static void valid_convolution(const matrix& input, const matrix& kernel, matrix& output);
 	//static void full_cross_correlation(const matrix& input, const matrix& kernel, matrix& output, int stride);
 	
@@ -170,12 +375,47 @@ public:
 
 	void scalar_multiplication(float a);
 	void apply_activation_function(e_activation_t activation_fn);
+	//activations = activation_fn(activations + biases) in one pass
+	//the biases have the same item count as the activations
+	static void add_bias_and_activate(matrix& activations, const matrix& biases, e_activation_t activation_fn);
+	//same as above, but the biases are added to every row of the batch
+	static void add_bias_and_activate_batch(matrix& activations_batch, const matrix& biases, e_activation_t activation_fn);
 
 	std::string get_string() const;
 };
 
 //GPU SECTION
 
+//all gpu functions and device copies are enqueued on the current stream of the calling thread
+//they do not block the host. the host is only synchronized when data is copied back to it
+void gpu_set_current_stream(cudaStream_t stream);
+cudaStream_t gpu_get_current_stream();
+//blocks until all work on the current stream is done
+//and throws if an error occurred while executing it
+void gpu_sync_current_stream();
+
+//the backend decides if the cuda libraries or the kernels of this project are used
+//the backend has to be compiled in (CNN_USE_CUBLAS, CNN_USE_CUDNN)
+//setting a backend that is not available throws
+void gpu_set_current_backend(e_gpu_backend_t backend);
+e_gpu_backend_t gpu_get_current_backend();
+bool gpu_backend_available(e_gpu_backend_t backend);
+
+//sets the current stream (and backend) while in scope
+//the previous ones are restored afterwards
+class gpu_stream_guard {
+private:
+	cudaStream_t previous_stream;
+	e_gpu_backend_t previous_backend;
+public:
+	gpu_stream_guard(cudaStream_t stream);
+	gpu_stream_guard(cudaStream_t stream, e_gpu_backend_t backend);
+	~gpu_stream_guard();
+
+	gpu_stream_guard(const gpu_stream_guard&) = delete;
+	gpu_stream_guard& operator=(const gpu_stream_guard&) = delete;
+};
+
 //OUTDATED COMMENTS - NEEDS TO BE UPDATED (data types have changed)
 
 /// <summary>
@@ -194,6 +434,36 @@ void gpu_dot_product(
 	const matrix& gpu_input,
 	matrix& gpu_activations);
 
+//activations = activation_fn(weights * input + biases)
+//the biases and the activation are applied by the dot product kernel before it writes the result.
+//the softmax needs the whole row, it is normalized in a second kernel.
+//with cublas the gemv is followed by gpu_add_bias_activation
+void gpu_dot_product_bias_activation(
+	const matrix& gpu_weights,
+	const matrix& gpu_input,
+	const matrix& gpu_biases,
+	matrix& gpu_activations,
+	e_activation_t activation_idx);
+
+//every row of the input batch is multiplied with the weights
+//the result batch has one row per input row
+void gpu_dot_product_batch(
+	const matrix& gpu_weights,
+	const matrix& gpu_input_batch,
+	matrix& gpu_activations_batch);
+//the tiled kernel adds the bias and applies the activation before it writes a result
+void gpu_dot_product_batch_bias_activation(
+	const matrix& gpu_weights,
+	const matrix& gpu_input_batch,
+	const matrix& gpu_biases,
+	matrix& gpu_activations_batch,
+	e_activation_t activation_idx);
+
+void gpu_add_flat_batch(
+	const matrix& gpu_batch,
+	const matrix& gpu_flat,
+	matrix& gpu_result_batch);
+
 /// <summary>
 /// adds the values of two gpu memory objects
 /// these will be stored in the result object
@@ -233,13 +503,73 @@ void gpu_valid_cross_correlation(
 	size_t kernel_count,
 	size_t stride,
 	size_t output_width);
+//the fixed kernel has its own direct kernel with the loops over the window unrolled
+void gpu_valid_cross_correlation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width,
+	e_fixed_kernel_t fixed_kernel);
+//the biases have the format of the activations, every kernel applies them with the activation
+//before it writes an output (the cudnn path does it in a second pass)
+void gpu_valid_cross_correlation_bias_activation(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const matrix& gpu_biases,
+	matrix& gpu_activations,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width,
+	e_fixed_kernel_t fixed_kernel,
+	e_activation_t activation_idx);
+
+void gpu_convolution_backprop(
+	const matrix& gpu_input,
+	const std::vector<matrix>& gpu_kernel_weights,
+	const matrix& gpu_activations,
+	matrix& gpu_error,
+	matrix* gpu_passing_error,
+	std::vector<matrix>& gpu_kernel_deltas,
+	matrix& gpu_bias_deltas,
+	size_t input_width,
+	size_t input_depth,
+	size_t kernel_width,
+	size_t kernel_count,
+	size_t stride,
+	size_t output_width,
+	e_activation_t activation_fn);
 
 void gpu_pooling(
 	const matrix& input,
 	matrix& output,
 	size_t stride,
 	size_t kernel_size,
-	e_pooling_type_t pooling_type);
+	e_pooling_type_t pooling_type,
+	pooling_index_buffer* selected_indices);
+void gpu_pooling(
+	const matrix& input,
+	matrix& output,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	pooling_index_buffer* selected_indices,
+	e_fixed_kernel_t fixed_kernel);
+
+void gpu_pooling_backprop(
+	const matrix& error,
+	matrix& passing_error,
+	size_t stride,
+	size_t kernel_size,
+	e_pooling_type_t pooling_type,
+	const pooling_index_buffer* selected_indices);
 
 void gpu_fc_backprop(
 	const matrix& activations,
@@ -251,16 +581,181 @@ void gpu_fc_backprop(
 	matrix& bias_deltas,
 	e_activation_t activation_fn);
 
+void gpu_fc_backprop_batch(
+	const matrix& activations_batch,
+	const matrix& weights,
+	const matrix& input_batch,
+	matrix& error_batch,
+	matrix* passing_error_batch,
+	matrix& weight_deltas,
+	matrix& bias_deltas,
+	e_activation_t activation_fn);
+
 void gpu_apply_deltas(
 	matrix& a,
 	matrix& delta,
 	matrix& momentum,
 	size_t training_data_count,
 	float learning_rate);
+//same as above on raw device arrays with count items
+//used for the flat parameter buffer of a network
+void gpu_apply_deltas(
+	float* params,
+	float* deltas,
+	float* momentum,
+	size_t count,
+	size_t training_data_count,
+	float learning_rate);
+
+//one fused pass of the optimizer over count parameters on the device
+//the same as cpu_optimizer_step
+void gpu_optimizer_step(
+	e_optimizer_t optimizer_type,
+	const optimizer_step_settings& settings,
+	float* params,
+	float* deltas,
+	float* first_moment,
+	float* second_moment,
+	size_t count);
+
+//initialization
+//sets count values of a device array to the value
+void gpu_set_all(float* data, size_t count, float value);
+//adds counter_uniform(seed, 0, i, min, max) to the i-th value of a device array
+//a host loop over counter_uniform gets the same values (see matrix::apply_noise)
+void gpu_apply_noise(float* data, size_t count, float min, float max, uint64_t seed);
+
+//16 bit storage (see compact_buffer)
+//decodes count fp16 or bf16 values into a float array, both are device arrays
+void gpu_decode_precision(
+	const uint16_t* compact,
+	float* values,
+	size_t count,
+	e_precision_t precision);
+
+//evaluation
+//the same as cpu_evaluate_rows, all arrays are device arrays
+void gpu_evaluate_rows(
+	const float* outputs,
+	const float* labels,
+	size_t row_count,
+	size_t row_width,
+	e_cost_function_t cost_fn,
+	float* totals);
+
+//tensor layouts
+//destination = the values of the source (width, height, depth) in the destination layout
+//one thread per destination value, source and destination can not be the same array
+void gpu_convert_layout(
+	const float* source,
+	float* destination,
+	size_t width,
+	size_t height,
+	size_t depth,
+	e_tensor_layout_t source_layout,
+	e_tensor_layout_t destination_layout);
+
+//data
+//row i of the destination = count values of the source row row_indices[i] from source_offset on
+//all arrays are device arrays, row_indices has row_count indices
+void gpu_gather_rows(
+	const float* source,
+	size_t source_width,
+	size_t source_offset,
+	const uint32_t* row_indices,
+	size_t row_count,
+	size_t count,
+	float* destination,
+	size_t destination_width);
+//result[row] = 1.0f if one of the first count values of the row is not zero, otherwise 0.0f
+//one thread per row, all arrays are device arrays
+void gpu_non_zero_rows(
+	const float* table,
+	size_t row_count,
+	size_t row_width,
+	size_t count,
+	float* result);
+
+//data augmentation
+//the same as cpu_augment_rows in one kernel, source and destination are different device arrays
+void gpu_augment_rows(
+	const float* source,
+	float* destination,
+	size_t row_count,
+	size_t width,
+	size_t height,
+	size_t depth,
+	const augmentation_settings& settings);
+
+//neuroevolution
+//the same as cpu_evolve_rows for all genomes, all arrays are device arrays
+void gpu_evolve_rows(
+	const float* genomes,
+	const float* fitness,
+	size_t genome_count,
+	size_t genome_width,
+	const evolution_settings& settings,
+	float* next_genomes);
+
+//multi gpu
+//copies count values from a device array on one device into a device array on another device
+//the copy is direct if peer access is enabled (see gpu_enable_peer_access), otherwise it goes over the host
+void gpu_copy_peer(
+	float* destination,
+	int destination_device,
+	const float* source,
+	int source_device,
+	size_t count);
+//lets the device access the memory of the peer device directly
+//does nothing if the devices can not access each other
+void gpu_enable_peer_access(int device, int peer_device);
+
+//int8 inference (dp4a)
+//the input is quantized with the input scale, the results are the dequantized dot products
+//the biases and the activation function are applied afterwards
+void gpu_int8_dot_product(
+	const int8_matrix& weights,
+	const matrix& gpu_input,
+	float input_scale,
+	matrix& gpu_activations);
+//every row of the kernels is one flat kernel (kernel_size x kernel_size x input depth)
+void gpu_int8_valid_cross_correlation(
+	const int8_matrix& kernels,
+	const matrix& gpu_input,
+	float input_scale,
+	matrix& gpu_activations,
+	size_t kernel_size,
+	size_t stride);
+
+//sparse inference (csr)
+//gpu_activations[row] = the sum of the nonzero weights of the row times the input
+//the biases and the activation function are applied afterwards
+void gpu_sparse_dot_product(
+	const sparse_matrix& weights,
+	const matrix& gpu_input,
+	matrix& gpu_activations);
 
 /*
 	activation functions
 	performs a function that has one input and one output
 	for example relu where x = max(0, x)
 */
-void gpu_activation_fn(matrix& gpu_memory, e_activation_t activation_idx);
\ No newline at end of file
+void gpu_activation_fn(matrix& gpu_memory, e_activation_t activation_idx);
+
+//adds the biases and applies the activation function in one kernel
+//the biases are repeated if the activations have more items (one row per batch item)
+//the softmax normalizes every row, one warp works on one row
+void gpu_add_bias_activation(
+	matrix& gpu_activations,
+	const matrix& gpu_biases,
+	e_activation_t activation_idx);
+
+//the same as cpu_cost_derivative, all arrays are device arrays
+//the cost is reduced per warp before it is added
+void gpu_cost_derivative(
+	const float* activations,
+	const float* expected,
+	float* error,
+	size_t count,
+	e_cost_function_t cost_fn,
+	float* cost);
\ No newline at end of file
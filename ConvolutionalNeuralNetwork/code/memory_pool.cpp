@@ -0,0 +1,536 @@
+#include "memory_pool.hpp"
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include "cuda_runtime.h"
+
+constexpr size_t SMALL_BLOCK_LIMIT = 1 << 20;
+constexpr size_t SMALL_BLOCK_ROUNDING = 512;
+constexpr size_t LARGE_BLOCK_ROUNDING = 2 << 20;
+constexpr size_t DEFAULT_MAX_CACHED_BYTES = (size_t)512 << 20;
+
+static size_t round_up(size_t value, size_t multiple)
+{
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+size_t memory_pool::round_size(size_t byte_count)
+{
+	if (byte_count <= SMALL_BLOCK_LIMIT)
+	{
+		return round_up(byte_count, SMALL_BLOCK_ROUNDING);
+	}
+	return round_up(byte_count, LARGE_BLOCK_ROUNDING);
+}
+
+memory_pool::memory_pool(raw_allocate_fn raw_allocate, raw_free_fn raw_free, size_t max_cached_bytes)
+	:raw_allocate(raw_allocate),
+	raw_free(raw_free),
+	max_cached_bytes(max_cached_bytes)
+{}
+
+memory_pool::~memory_pool()
+{
+	release_cached();
+}
+
+void memory_pool::release_cached_locked()
+{
+	for (auto& curr : free_blocks)
+	{
+		for (void* ptr : curr.second)
+		{
+			raw_free(ptr);
+		}
+	}
+	free_blocks.clear();
+	cached_bytes = 0;
+}
+
+void* memory_pool::allocate(size_t byte_count)
+{
+	const size_t size = round_size(byte_count == 0 ? 1 : byte_count);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	void* ptr = nullptr;
+	auto cached = free_blocks.find(size);
+	if (cached != free_blocks.end() && !cached->second.empty())
+	{
+		ptr = cached->second.back();
+		cached->second.pop_back();
+		cached_bytes -= size;
+	}
+	else
+	{
+		ptr = raw_allocate(size);
+		if (ptr == nullptr)
+		{
+			//the memory might be held by blocks of other sizes
+			release_cached_locked();
+			ptr = raw_allocate(size);
+		}
+		if (ptr == nullptr)
+		{
+			throw std::runtime_error("memory pool could not allocate " + std::to_string(size) + " bytes");
+		}
+	}
+
+	used_blocks[ptr] = size;
+	used_bytes += size;
+	return ptr;
+}
+
+void memory_pool::free(void* ptr)
+{
+	if (ptr == nullptr)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto used = used_blocks.find(ptr);
+	if (used == used_blocks.end())
+	{
+		throw std::invalid_argument("pointer was not allocated by this memory pool");
+	}
+	const size_t size = used->second;
+	used_blocks.erase(used);
+	used_bytes -= size;
+
+	if (cached_bytes + size > max_cached_bytes)
+	{
+		raw_free(ptr);
+		return;
+	}
+	free_blocks[size].push_back(ptr);
+	cached_bytes += size;
+}
+
+void memory_pool::release_cached()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	release_cached_locked();
+}
+
+void memory_pool::set_max_cached_bytes(size_t byte_count)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	max_cached_bytes = byte_count;
+	if (cached_bytes > max_cached_bytes)
+	{
+		release_cached_locked();
+	}
+}
+
+bool memory_pool::contains(void* ptr) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return used_blocks.find(ptr) != used_blocks.end();
+}
+
+size_t memory_pool::get_cached_bytes() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return cached_bytes;
+}
+
+size_t memory_pool::get_used_bytes() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return used_bytes;
+}
+
+static void* raw_host_allocate(size_t byte_count)
+{
+	return ::operator new(byte_count, std::nothrow);
+}
+
+static void raw_host_free(void* ptr)
+{
+	::operator delete(ptr);
+}
+
+static void* raw_device_allocate(size_t byte_count)
+{
+	void* ptr = nullptr;
+	if (cudaMalloc(&ptr, byte_count) != cudaSuccess)
+	{
+		//clears the error, so the next cuda call does not report it
+		cudaGetLastError();
+		return nullptr;
+	}
+	return ptr;
+}
+
+static void raw_device_free(void* ptr)
+{
+	//this can be called after the cuda context is destroyed, so the error is ignored
+	cudaFree(ptr);
+}
+
+static void* raw_pinned_allocate(size_t byte_count)
+{
+	void* ptr = nullptr;
+	if (cudaHostAlloc(&ptr, byte_count, cudaHostAllocDefault) != cudaSuccess)
+	{
+		cudaGetLastError();
+		return nullptr;
+	}
+	return ptr;
+}
+
+static void raw_pinned_free(void* ptr)
+{
+	cudaFreeHost(ptr);
+}
+
+float* direct_matrix_allocator::allocate_host(size_t item_count)
+{
+	return new float[item_count];
+}
+
+void direct_matrix_allocator::free_host(float* ptr)
+{
+	delete[] ptr;
+}
+
+float* direct_matrix_allocator::allocate_device(size_t item_count)
+{
+	float* ptr = nullptr;
+	cudaError_t error = cudaMalloc(&ptr, item_count * sizeof(float));
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("cuda error: " + std::string(cudaGetErrorString(error)));
+	}
+	return ptr;
+}
+
+void direct_matrix_allocator::free_device(float* ptr)
+{
+	cudaFree(ptr);
+}
+
+caching_matrix_allocator::caching_matrix_allocator()
+	:host_pool(raw_host_allocate, raw_host_free, DEFAULT_MAX_CACHED_BYTES)
+{}
+
+memory_pool& caching_matrix_allocator::get_device_pool(int device)
+{
+	std::lock_guard<std::mutex> lock(device_pools_mutex);
+	if ((size_t)device >= device_pools.size())
+	{
+		device_pools.resize((size_t)device + 1);
+	}
+	if (device_pools[device] == nullptr)
+	{
+		device_pools[device] = std::make_unique<memory_pool>(raw_device_allocate, raw_device_free, DEFAULT_MAX_CACHED_BYTES);
+	}
+	return *device_pools[device];
+}
+
+int caching_matrix_allocator::owning_device(void* ptr, int current_device) const
+{
+	std::lock_guard<std::mutex> lock(device_pools_mutex);
+	if ((size_t)current_device < device_pools.size() &&
+		device_pools[current_device] != nullptr &&
+		device_pools[current_device]->contains(ptr))
+	{
+		return current_device;
+	}
+	for (size_t i = 0; i < device_pools.size(); i++)
+	{
+		if (device_pools[i] != nullptr && device_pools[i]->contains(ptr))
+		{
+			return (int)i;
+		}
+	}
+	return current_device;
+}
+
+float* caching_matrix_allocator::allocate_host(size_t item_count)
+{
+	return (float*)host_pool.allocate(item_count * sizeof(float));
+}
+
+void caching_matrix_allocator::free_host(float* ptr)
+{
+	host_pool.free(ptr);
+}
+
+float* caching_matrix_allocator::allocate_device(size_t item_count)
+{
+	int device = 0;
+	cudaGetDevice(&device);
+	return (float*)get_device_pool(device).allocate(item_count * sizeof(float));
+}
+
+void caching_matrix_allocator::free_device(float* ptr)
+{
+	int current_device = 0;
+	cudaGetDevice(&current_device);
+	const int device = owning_device(ptr, current_device);
+
+	//kernels on any stream of the gpu might still use the block
+	//cudaFree would synchronize as well, so this keeps the old behaviour
+	if (device != current_device)
+	{
+		cudaSetDevice(device);
+		cudaDeviceSynchronize();
+		cudaSetDevice(current_device);
+	}
+	else
+	{
+		cudaDeviceSynchronize();
+	}
+	get_device_pool(device).free(ptr);
+}
+
+memory_pool& caching_matrix_allocator::get_host_pool()
+{
+	return host_pool;
+}
+
+memory_pool& caching_matrix_allocator::get_device_pool()
+{
+	int device = 0;
+	cudaGetDevice(&device);
+	return get_device_pool(device);
+}
+
+pinned_matrix_allocator::pinned_matrix_allocator()
+	:host_pool(raw_pinned_allocate, raw_pinned_free, DEFAULT_MAX_CACHED_BYTES)
+{}
+
+float* pinned_matrix_allocator::allocate_host(size_t item_count)
+{
+	return (float*)host_pool.allocate(item_count * sizeof(float));
+}
+
+void pinned_matrix_allocator::free_host(float* ptr)
+{
+	host_pool.free(ptr);
+}
+
+float* pinned_matrix_allocator::allocate_device(size_t item_count)
+{
+	return get_default_matrix_allocator().allocate_device(item_count);
+}
+
+void pinned_matrix_allocator::free_device(float* ptr)
+{
+	get_default_matrix_allocator().free_device(ptr);
+}
+
+memory_pool& pinned_matrix_allocator::get_host_pool()
+{
+	return host_pool;
+}
+
+size_t arena_matrix_allocator::aligned_item_count(size_t item_count)
+{
+	return round_up(item_count, ITEM_ALIGNMENT);
+}
+
+arena_matrix_allocator::arena_matrix_allocator(size_t item_capacity, bool with_device)
+	:item_capacity(item_capacity),
+	host_block(item_capacity + ITEM_ALIGNMENT, 0.0f)
+{
+	if (with_device)
+	{
+		const size_t byte_count = item_capacity * sizeof(float);
+		cudaError_t error = cudaMalloc(&device_block, byte_count);
+		if (error == cudaSuccess)
+		{
+			error = cudaMemset(device_block, 0, byte_count);
+		}
+		if (error != cudaSuccess)
+		{
+			cudaFree(device_block);
+			device_block = nullptr;
+			throw std::runtime_error("cuda error: " + std::string(cudaGetErrorString(error)));
+		}
+	}
+}
+
+arena_matrix_allocator::~arena_matrix_allocator()
+{
+	if (device_block != nullptr)
+	{
+		cudaFree(device_block);
+	}
+}
+
+float* arena_matrix_allocator::allocate_from(float* block, size_t& item_offset, size_t item_count)
+{
+	const size_t aligned_count = aligned_item_count(item_count);
+	if (item_offset + aligned_count > item_capacity)
+	{
+		throw std::runtime_error("arena is full");
+	}
+	float* ptr = block + item_offset;
+	item_offset += aligned_count;
+	return ptr;
+}
+
+float* arena_matrix_allocator::allocate_host(size_t item_count)
+{
+	return allocate_from(get_host_block(), host_item_offset, item_count);
+}
+
+void arena_matrix_allocator::free_host(float* ptr)
+{}
+
+float* arena_matrix_allocator::allocate_device(size_t item_count)
+{
+	if (device_block == nullptr)
+	{
+		throw std::runtime_error("arena has no device block");
+	}
+	return allocate_from(device_block, device_item_offset, item_count);
+}
+
+void arena_matrix_allocator::free_device(float* ptr)
+{}
+
+bool arena_matrix_allocator::releases_host_memory() const
+{
+	return false;
+}
+
+size_t arena_matrix_allocator::get_item_capacity() const
+{
+	return item_capacity;
+}
+
+//the host block has one alignment more than needed, so its start can be aligned
+float* arena_matrix_allocator::get_host_block()
+{
+	const size_t alignment = ITEM_ALIGNMENT * sizeof(float);
+	const size_t address = (size_t)host_block.data();
+	return (float*)((address + alignment - 1) / alignment * alignment);
+}
+
+const float* arena_matrix_allocator::get_host_block_readonly() const
+{
+	return const_cast<arena_matrix_allocator*>(this)->get_host_block();
+}
+
+float* arena_matrix_allocator::get_device_block()
+{
+	return device_block;
+}
+
+const float* arena_matrix_allocator::get_device_block_readonly() const
+{
+	return device_block;
+}
+
+shared_block_matrix_allocator::shared_block_matrix_allocator(size_t item_capacity)
+	:item_capacity(item_capacity)
+{}
+
+shared_block_matrix_allocator::~shared_block_matrix_allocator()
+{
+	if (device_block != nullptr)
+	{
+		cudaFree(device_block);
+	}
+}
+
+void shared_block_matrix_allocator::if_too_big_throw(size_t item_count) const
+{
+	if (item_count > item_capacity)
+	{
+		throw std::runtime_error("the allocation does not fit into the shared block");
+	}
+}
+
+float* shared_block_matrix_allocator::allocate_host(size_t item_count)
+{
+	if_too_big_throw(item_count);
+	//aligned like the blocks of the arena
+	const size_t alignment_items = arena_matrix_allocator::ITEM_ALIGNMENT;
+	if (host_block.empty())
+	{
+		host_block.resize(item_capacity + alignment_items, 0.0f);
+	}
+	const size_t alignment = alignment_items * sizeof(float);
+	const size_t address = (size_t)host_block.data();
+	return (float*)((address + alignment - 1) / alignment * alignment);
+}
+
+void shared_block_matrix_allocator::free_host(float* ptr)
+{}
+
+float* shared_block_matrix_allocator::allocate_device(size_t item_count)
+{
+	if_too_big_throw(item_count);
+	if (device_block == nullptr)
+	{
+		const size_t byte_count = item_capacity * sizeof(float);
+		cudaError_t error = cudaMalloc(&device_block, byte_count);
+		if (error == cudaSuccess)
+		{
+			error = cudaMemset(device_block, 0, byte_count);
+		}
+		if (error != cudaSuccess)
+		{
+			cudaFree(device_block);
+			device_block = nullptr;
+			throw std::runtime_error("cuda error: " + std::string(cudaGetErrorString(error)));
+		}
+	}
+	return device_block;
+}
+
+void shared_block_matrix_allocator::free_device(float* ptr)
+{}
+
+bool shared_block_matrix_allocator::releases_host_memory() const
+{
+	return false;
+}
+
+size_t shared_block_matrix_allocator::get_item_capacity() const
+{
+	return item_capacity;
+}
+
+bool shared_block_matrix_allocator::has_device_block() const
+{
+	return device_block != nullptr;
+}
+
+static std::atomic<matrix_allocator*> current_allocator{ nullptr };
+
+caching_matrix_allocator& get_default_matrix_allocator()
+{
+	//intentionally leaked
+	static caching_matrix_allocator* default_allocator = new caching_matrix_allocator();
+	return *default_allocator;
+}
+
+pinned_matrix_allocator& get_pinned_matrix_allocator()
+{
+	//intentionally leaked
+	static pinned_matrix_allocator* pinned_allocator = new pinned_matrix_allocator();
+	return *pinned_allocator;
+}
+
+matrix_allocator& get_matrix_allocator()
+{
+	matrix_allocator* allocator = current_allocator.load();
+	if (allocator == nullptr)
+	{
+		return get_default_matrix_allocator();
+	}
+	return *allocator;
+}
+
+void set_matrix_allocator(matrix_allocator* allocator)
+{
+	current_allocator.store(allocator);
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+	caching allocators for the host and device buffers of the matrix class
+
+	freed blocks are not returned to the system, they are kept in a free list
+	and handed out again for the next request of the same (rounded) size.
+	copying a network, creating label matrices or allocating scratch matrices
+	in a loop therefore only hits new/cudaMalloc the first time
+*/
+
+//a free list of raw memory blocks, grouped by their rounded size
+//thread safe
+class memory_pool {
+public:
+	using raw_allocate_fn = void* (*)(size_t byte_count);
+	using raw_free_fn = void (*)(void* ptr);
+private:
+	raw_allocate_fn raw_allocate;
+	raw_free_fn raw_free;
+
+	mutable std::mutex mutex;
+	//rounded size -> cached blocks of that size
+	std::unordered_map<size_t, std::vector<void*>> free_blocks;
+	//block -> rounded size
+	std::unordered_map<void*, size_t> used_blocks;
+
+	size_t cached_bytes = 0;
+	size_t used_bytes = 0;
+	size_t max_cached_bytes;
+
+	void release_cached_locked();
+public:
+	//blocks up to 1 MB are rounded to 512 bytes, bigger ones to 2 MB
+	static size_t round_size(size_t byte_count);
+
+	memory_pool(raw_allocate_fn raw_allocate, raw_free_fn raw_free, size_t max_cached_bytes);
+	~memory_pool();
+
+	memory_pool(const memory_pool&) = delete;
+	memory_pool& operator=(const memory_pool&) = delete;
+
+	//if the raw allocation fails the cached blocks are released and it is tried again
+	void* allocate(size_t byte_count);
+	//ptr must come from this pool
+	void free(void* ptr);
+
+	//returns all cached blocks to the system
+	void release_cached();
+
+	//a freed block that does not fit into the cache anymore is returned to the system
+	void set_max_cached_bytes(size_t byte_count);
+
+	//true if the block was allocated by this pool and is not freed yet
+	bool contains(void* ptr) const;
+
+	size_t get_cached_bytes() const;
+	size_t get_used_bytes() const;
+};
+
+//the interface the matrix class allocates its host and device data with
+class matrix_allocator {
+public:
+	virtual ~matrix_allocator() = default;
+
+	virtual float* allocate_host(size_t item_count) = 0;
+	virtual void free_host(float* ptr) = 0;
+	virtual float* allocate_device(size_t item_count) = 0;
+	virtual void free_device(float* ptr) = 0;
+
+	//false if freeing the host data does not give the memory back (arenas, mapped files)
+	//the matrices of such an allocator keep their host data (see matrix::set_device_only)
+	virtual bool releases_host_memory() const { return true; }
+};
+
+//every allocation goes straight to new / cudaMalloc
+class direct_matrix_allocator : public matrix_allocator {
+public:
+	float* allocate_host(size_t item_count) override;
+	void free_host(float* ptr) override;
+	float* allocate_device(size_t item_count) override;
+	void free_device(float* ptr) override;
+};
+
+//keeps freed blocks for the next allocation (default)
+class caching_matrix_allocator : public matrix_allocator {
+private:
+	memory_pool host_pool;
+	//a block of one gpu can not be used on another, so every gpu has its own pool
+	//(indexed by the device id, created when the gpu allocates the first time)
+	mutable std::mutex device_pools_mutex;
+	std::vector<std::unique_ptr<memory_pool>> device_pools;
+
+	memory_pool& get_device_pool(int device);
+	//the gpu whose pool handed out the block, the current gpu if none did
+	int owning_device(void* ptr, int current_device) const;
+public:
+	caching_matrix_allocator();
+
+	float* allocate_host(size_t item_count) override;
+	void free_host(float* ptr) override;
+	float* allocate_device(size_t item_count) override;
+	void free_device(float* ptr) override;
+
+	memory_pool& get_host_pool();
+	//the pool of the current gpu
+	memory_pool& get_device_pool();
+};
+
+//the host data is page locked (cudaHostAlloc), so copies to the device can run asynchronously
+//the blocks are cached like in the caching allocator, the device data comes from the default allocator
+class pinned_matrix_allocator : public matrix_allocator {
+private:
+	memory_pool host_pool;
+public:
+	pinned_matrix_allocator();
+
+	float* allocate_host(size_t item_count) override;
+	void free_host(float* ptr) override;
+	float* allocate_device(size_t item_count) override;
+	void free_device(float* ptr) override;
+
+	memory_pool& get_host_pool();
+};
+
+//hands out consecutive parts of one host block and one device block
+//freeing does nothing, all memory is released when the arena is destroyed
+//the arena has to outlive all matrices that are allocated with it
+//the host and device allocations are independent, both start at offset 0
+class arena_matrix_allocator : public matrix_allocator {
+private:
+	size_t item_capacity;
+	std::vector<float> host_block;
+	float* device_block = nullptr;
+
+	size_t host_item_offset = 0;
+	size_t device_item_offset = 0;
+
+	float* allocate_from(float* block, size_t& item_offset, size_t item_count);
+public:
+	//every allocation starts at a multiple of this (64 bytes), so simd loads are aligned
+	static constexpr size_t ITEM_ALIGNMENT = 16;
+	static size_t aligned_item_count(size_t item_count);
+
+	//all items are zero, the device block is only allocated if with_device is true
+	arena_matrix_allocator(size_t item_capacity, bool with_device);
+	~arena_matrix_allocator();
+
+	arena_matrix_allocator(const arena_matrix_allocator&) = delete;
+	arena_matrix_allocator& operator=(const arena_matrix_allocator&) = delete;
+
+	float* allocate_host(size_t item_count) override;
+	void free_host(float* ptr) override;
+	float* allocate_device(size_t item_count) override;
+	void free_device(float* ptr) override;
+	bool releases_host_memory() const override;
+
+	size_t get_item_capacity() const;
+	float* get_host_block();
+	const float* get_host_block_readonly() const;
+	//nullptr if the arena has no device block
+	float* get_device_block();
+	const float* get_device_block_readonly() const;
+};
+
+//every allocation gets the start of the same host block and device block
+//so all matrices allocated with it alias each other, only one of them may hold values at a time
+//(the activations of every second layer share one block, see neural_network::compile_inference_plan)
+//freeing does nothing, the allocator has to outlive all matrices that are allocated with it
+//the blocks are allocated on the first request, a request bigger than the capacity throws
+class shared_block_matrix_allocator : public matrix_allocator {
+private:
+	size_t item_capacity;
+	std::vector<float> host_block;
+	float* device_block = nullptr;
+
+	void if_too_big_throw(size_t item_count) const;
+public:
+	shared_block_matrix_allocator(size_t item_capacity);
+	~shared_block_matrix_allocator();
+
+	shared_block_matrix_allocator(const shared_block_matrix_allocator&) = delete;
+	shared_block_matrix_allocator& operator=(const shared_block_matrix_allocator&) = delete;
+
+	float* allocate_host(size_t item_count) override;
+	void free_host(float* ptr) override;
+	float* allocate_device(size_t item_count) override;
+	void free_device(float* ptr) override;
+	bool releases_host_memory() const override;
+
+	size_t get_item_capacity() const;
+	//false until the first device request
+	bool has_device_block() const;
+};
+
+//the allocator that new matrices use
+//a matrix frees its data with the allocator it was allocated with
+matrix_allocator& get_matrix_allocator();
+//the allocator has to outlive all matrices that are allocated with it
+//nullptr sets the default caching allocator
+void set_matrix_allocator(matrix_allocator* allocator);
+//the default allocator, it is never destroyed so matrices with static lifetime can still free their data
+caching_matrix_allocator& get_default_matrix_allocator();
+//the allocator of the staging buffers for uploads, it is never destroyed either
+pinned_matrix_allocator& get_pinned_matrix_allocator();
@@ -0,0 +1,467 @@
+#include "model_file.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "matrix.hpp"
+#include "profiler.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t align_offset(uint64_t offset)
+{
+	return (offset + MODEL_FILE_ALIGNMENT - 1) / MODEL_FILE_ALIGNMENT * MODEL_FILE_ALIGNMENT;
+}
+
+size_t tensor_type_byte_size(e_tensor_type_t type)
+{
+	switch (type)
+	{
+	case float32_tensor:
+		return sizeof(float);
+	case int8_tensor:
+		return sizeof(int8_t);
+	case uint32_tensor:
+		return sizeof(uint32_t);
+	default:
+		throw std::invalid_argument("unknown tensor type");
+	}
+}
+
+void model_writer::write_bytes(const void* data, size_t byte_count)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	structure.insert(structure.end(), bytes, bytes + byte_count);
+}
+
+void model_writer::write_u32(uint32_t value)
+{
+	write_bytes(&value, sizeof(value));
+}
+
+void model_writer::write_u64(uint64_t value)
+{
+	write_bytes(&value, sizeof(value));
+}
+
+void model_writer::write_f32(float value)
+{
+	write_bytes(&value, sizeof(value));
+}
+
+void model_writer::write_vector3(const vector3& value)
+{
+	write_u64(value.x);
+	write_u64(value.y);
+	write_u64(value.z);
+}
+
+model_writer::model_writer()
+{}
+
+model_writer::model_writer(bool snapshot)
+	:snapshot(snapshot)
+{}
+
+model_writer::pending_tensor model_writer::create_tensor(
+	e_tensor_type_t type,
+	const vector3& format,
+	const void* data) const
+{
+	if (data == nullptr && format.item_count() != 0)
+	{
+		throw std::invalid_argument("tensor data is missing");
+	}
+
+	pending_tensor tensor{};
+	tensor.entry.type = type;
+	tensor.entry.width = format.x;
+	tensor.entry.height = format.y;
+	tensor.entry.depth = format.z;
+	tensor.entry.byte_size = format.item_count() * tensor_type_byte_size(type);
+	tensor.data = data;
+	return tensor;
+}
+
+void model_writer::add_tensor(e_tensor_type_t type, const vector3& format, const void* data)
+{
+	if (snapshot)
+	{
+		add_tensor_copy(type, format, data);
+		return;
+	}
+	tensors.push_back(create_tensor(type, format, data));
+}
+
+void model_writer::add_tensor_copy(e_tensor_type_t type, const vector3& format, const void* data)
+{
+	pending_tensor tensor = create_tensor(type, format, data);
+	if (tensor.entry.byte_size != 0)
+	{
+		std::shared_ptr<uint8_t> copy(new uint8_t[tensor.entry.byte_size], std::default_delete<uint8_t[]>());
+		std::memcpy(copy.get(), data, tensor.entry.byte_size);
+		tensor.data = copy.get();
+		owned_data.push_back(copy);
+	}
+	tensors.push_back(tensor);
+}
+
+void model_writer::add_device_tensor(e_tensor_type_t type, const vector3& format, const void* device_data)
+{
+	if (!snapshot)
+	{
+		throw std::runtime_error("only a snapshot can copy device tensors");
+	}
+	pending_tensor tensor = create_tensor(type, format, device_data);
+	if (tensor.entry.byte_size != 0)
+	{
+		//the pinned allocator hands out floats, the byte size is rounded up
+		const size_t item_count = (tensor.entry.byte_size + sizeof(float) - 1) / sizeof(float);
+		std::shared_ptr<float> copy(
+			get_pinned_matrix_allocator().allocate_host(item_count),
+			[](float* ptr) { get_pinned_matrix_allocator().free_host(ptr); });
+		profiler_count_copy(false, tensor.entry.byte_size);
+		if (cudaMemcpyAsync(
+			copy.get(),
+			device_data,
+			tensor.entry.byte_size,
+			cudaMemcpyDeviceToHost,
+			gpu_get_current_stream()) != cudaSuccess)
+		{
+			throw std::runtime_error("could not copy a device tensor");
+		}
+		tensor.data = copy.get();
+		owned_data.push_back(copy);
+		has_device_copies = true;
+	}
+	tensors.push_back(tensor);
+}
+
+bool model_writer::is_snapshot() const
+{
+	return snapshot;
+}
+
+bool model_writer::has_device_tensors() const
+{
+	return has_device_copies;
+}
+
+size_t model_writer::get_tensor_count() const
+{
+	return tensors.size();
+}
+
+void model_writer::save(const std::string& file_path) const
+{
+	model_file_header header{};
+	std::memcpy(header.magic, MODEL_FILE_MAGIC, sizeof(header.magic));
+	header.version = MODEL_FILE_VERSION;
+	header.header_size = sizeof(model_file_header);
+	header.structure_offset = sizeof(model_file_header);
+	header.structure_size = structure.size();
+	header.tensor_table_offset = align_offset(header.structure_offset + header.structure_size);
+	header.tensor_count = tensors.size();
+
+	std::vector<model_tensor_entry> table;
+	uint64_t offset = align_offset(header.tensor_table_offset + tensors.size() * sizeof(model_tensor_entry));
+	for (const pending_tensor& tensor : tensors)
+	{
+		model_tensor_entry entry = tensor.entry;
+		entry.offset = offset;
+		offset = align_offset(offset + entry.byte_size);
+		table.push_back(entry);
+	}
+	header.file_size = offset;
+
+	std::ofstream out(file_path, std::ios::out | std::ios::binary);
+	if (!out.is_open())
+	{
+		throw std::runtime_error("Cannot open file " + file_path);
+	}
+
+	const char padding[MODEL_FILE_ALIGNMENT] = {};
+	auto pad_to = [&](uint64_t target) {
+		const uint64_t position = (uint64_t)out.tellp();
+		out.write(padding, target - position);
+	};
+
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)structure.data(), structure.size());
+	pad_to(header.tensor_table_offset);
+	out.write((const char*)table.data(), table.size() * sizeof(model_tensor_entry));
+	for (size_t i = 0; i < tensors.size(); i++)
+	{
+		pad_to(table[i].offset);
+		out.write((const char*)tensors[i].data, table[i].byte_size);
+	}
+	pad_to(header.file_size);
+
+	if (!out)
+	{
+		throw std::runtime_error("could not write " + file_path);
+	}
+}
+
+bool mapped_model_file::is_model_file(const std::string& file_path)
+{
+	std::ifstream file(file_path, std::ios::in | std::ios::binary);
+	char magic[sizeof(MODEL_FILE_MAGIC)] = {};
+	file.read(magic, sizeof(magic));
+	return file && std::memcmp(magic, MODEL_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+mapped_model_file::mapped_model_file(const std::string& file_path)
+{
+#ifdef _WIN32
+	file_handle = CreateFileA(
+		file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		throw std::runtime_error("Could not open file " + file_path);
+	}
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file_handle, &file_size);
+	size = (size_t)file_size.QuadPart;
+
+	//copy on write, so the parameters can still be changed after loading
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (mapping_handle != nullptr)
+	{
+		data = (uint8_t*)MapViewOfFile(mapping_handle, FILE_MAP_COPY, 0, 0, 0);
+	}
+#else
+	const int descriptor = open(file_path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+	{
+		throw std::runtime_error("Could not open file " + file_path);
+	}
+	struct stat file_stat;
+	if (fstat(descriptor, &file_stat) == 0 && file_stat.st_size > 0)
+	{
+		size = (size_t)file_stat.st_size;
+		//copy on write, so the parameters can still be changed after loading
+		void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+		data = mapping == MAP_FAILED ? nullptr : (uint8_t*)mapping;
+	}
+	//the mapping stays valid after the file is closed
+	close(descriptor);
+#endif
+
+	if (data == nullptr)
+	{
+		unmap();
+		throw std::runtime_error("Could not map file " + file_path);
+	}
+
+	try
+	{
+		validate();
+	}
+	catch (...)
+	{
+		unmap();
+		throw;
+	}
+}
+
+mapped_model_file::~mapped_model_file()
+{
+	unmap();
+}
+
+void mapped_model_file::unmap()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping_handle != nullptr)
+	{
+		CloseHandle(mapping_handle);
+		mapping_handle = nullptr;
+	}
+	if (file_handle != nullptr)
+	{
+		CloseHandle(file_handle);
+		file_handle = nullptr;
+	}
+#else
+	if (data != nullptr)
+	{
+		munmap(data, size);
+	}
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+const model_file_header& mapped_model_file::get_header() const
+{
+	return *(const model_file_header*)data;
+}
+
+void mapped_model_file::validate() const
+{
+	if (size < sizeof(model_file_header) ||
+		std::memcmp(get_header().magic, MODEL_FILE_MAGIC, sizeof(MODEL_FILE_MAGIC)) != 0)
+	{
+		throw std::runtime_error("file is invalid");
+	}
+
+	const model_file_header& header = get_header();
+	if (header.version != MODEL_FILE_VERSION)
+	{
+		throw std::runtime_error("unsupported model file version " + std::to_string(header.version));
+	}
+	if (header.file_size > size ||
+		header.structure_offset + header.structure_size > size ||
+		header.tensor_table_offset % MODEL_FILE_ALIGNMENT != 0 ||
+		header.tensor_table_offset + header.tensor_count * sizeof(model_tensor_entry) > size)
+	{
+		throw std::runtime_error("model file is truncated");
+	}
+
+	for (size_t i = 0; i < header.tensor_count; i++)
+	{
+		const model_tensor_entry& entry = get_tensor_entry(i);
+		const uint64_t item_count = entry.width * entry.height * entry.depth;
+		if (entry.offset % MODEL_FILE_ALIGNMENT != 0 ||
+			entry.offset + entry.byte_size > size ||
+			entry.byte_size != item_count * tensor_type_byte_size((e_tensor_type_t)entry.type))
+		{
+			throw std::runtime_error("invalid tensor in model file");
+		}
+	}
+}
+
+uint32_t mapped_model_file::get_version() const
+{
+	return get_header().version;
+}
+
+size_t mapped_model_file::get_byte_size() const
+{
+	return size;
+}
+
+size_t mapped_model_file::get_tensor_count() const
+{
+	return get_header().tensor_count;
+}
+
+const model_tensor_entry& mapped_model_file::get_tensor_entry(size_t idx) const
+{
+	if (idx >= get_tensor_count())
+	{
+		throw std::out_of_range("tensor index out of range");
+	}
+	const model_tensor_entry* table = (const model_tensor_entry*)(data + get_header().tensor_table_offset);
+	return table[idx];
+}
+
+uint8_t* mapped_model_file::get_tensor_data(size_t idx)
+{
+	return data + get_tensor_entry(idx).offset;
+}
+
+const uint8_t* mapped_model_file::get_structure() const
+{
+	return data + get_header().structure_offset;
+}
+
+size_t mapped_model_file::get_structure_size() const
+{
+	return get_header().structure_size;
+}
+
+float* mapped_model_file::allocate_host(size_t item_count)
+{
+	throw std::runtime_error("a mapped model file can not allocate host memory");
+}
+
+void mapped_model_file::free_host(float* ptr)
+{}
+
+float* mapped_model_file::allocate_device(size_t item_count)
+{
+	return get_default_matrix_allocator().allocate_device(item_count);
+}
+
+void mapped_model_file::free_device(float* ptr)
+{
+	get_default_matrix_allocator().free_device(ptr);
+}
+
+bool mapped_model_file::releases_host_memory() const
+{
+	return false;
+}
+
+model_reader::model_reader(mapped_model_file& file)
+	:file(file)
+{}
+
+void model_reader::read_bytes(void* target, size_t byte_count)
+{
+	if (structure_offset + byte_count > file.get_structure_size())
+	{
+		throw std::runtime_error("model structure is truncated");
+	}
+	std::memcpy(target, file.get_structure() + structure_offset, byte_count);
+	structure_offset += byte_count;
+}
+
+uint32_t model_reader::read_u32()
+{
+	uint32_t value;
+	read_bytes(&value, sizeof(value));
+	return value;
+}
+
+uint64_t model_reader::read_u64()
+{
+	uint64_t value;
+	read_bytes(&value, sizeof(value));
+	return value;
+}
+
+float model_reader::read_f32()
+{
+	float value;
+	read_bytes(&value, sizeof(value));
+	return value;
+}
+
+vector3 model_reader::read_vector3()
+{
+	const size_t x = (size_t)read_u64();
+	const size_t y = (size_t)read_u64();
+	const size_t z = (size_t)read_u64();
+	return vector3(x, y, z);
+}
+
+uint8_t* model_reader::next_tensor(e_tensor_type_t type, vector3& format)
+{
+	const model_tensor_entry& entry = file.get_tensor_entry(tensor_idx);
+	if (entry.type != (uint32_t)type)
+	{
+		throw std::runtime_error("unexpected tensor type in model file");
+	}
+	format = vector3((size_t)entry.width, (size_t)entry.height, (size_t)entry.depth);
+	return file.get_tensor_data(tensor_idx++);
+}
+
+mapped_model_file& model_reader::get_file()
+{
+	return file;
+}
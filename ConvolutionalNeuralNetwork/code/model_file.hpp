@@ -0,0 +1,166 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vector3.hpp"
+#include "enum_space.hpp"
+#include "memory_pool.hpp"
+
+/*
+	the versioned model file format
+
+	header         - model_file_header, 64 bytes
+	structure      - the description of the layers, written with fixed width fields (little endian)
+	tensor table   - one model_tensor_entry (64 bytes) per tensor
+	tensor data    - every tensor starts at a multiple of 64 bytes
+
+	the layers read their tensors in the same order they wrote them
+	the file is memory mapped when it is loaded and the matrices use the mapped pages directly
+	the pages are mapped copy on write, so they are shared between all processes
+	that load the same file until one of them changes a parameter
+*/
+constexpr char MODEL_FILE_MAGIC[8] = { 'C', 'N', 'N', 'M', 'O', 'D', 'E', 'L' };
+constexpr uint32_t MODEL_FILE_VERSION = 1;
+constexpr uint64_t MODEL_FILE_ALIGNMENT = 64;
+
+struct model_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t file_size;
+	uint64_t structure_offset;
+	uint64_t structure_size;
+	uint64_t tensor_table_offset;
+	uint64_t tensor_count;
+	uint64_t reserved;
+};
+static_assert(sizeof(model_file_header) == 64, "the model file header must be 64 bytes");
+
+struct model_tensor_entry {
+	uint64_t offset;
+	uint64_t byte_size;
+	uint64_t width;
+	uint64_t height;
+	uint64_t depth;
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t reserved_2[2];
+};
+static_assert(sizeof(model_tensor_entry) == 64, "a tensor entry must be 64 bytes");
+
+size_t tensor_type_byte_size(e_tensor_type_t type);
+
+//collects the structure and the tensors of a model and writes them into one file
+//the tensor data is not copied, it has to stay valid until save is called.
+//a snapshot writer copies the tensors instead, so the model can change before it is saved
+//(see checkpoint_writer)
+class model_writer {
+private:
+	std::vector<uint8_t> structure;
+
+	struct pending_tensor {
+		model_tensor_entry entry;
+		const void* data;
+	};
+	std::vector<pending_tensor> tensors;
+
+	bool snapshot = false;
+	bool has_device_copies = false;
+	//the copies of a snapshot, freed with the writer
+	std::vector<std::shared_ptr<void>> owned_data;
+
+	void write_bytes(const void* data, size_t byte_count);
+	pending_tensor create_tensor(e_tensor_type_t type, const vector3& format, const void* data) const;
+public:
+	model_writer();
+	//a snapshot writer copies every tensor when it is added
+	model_writer(bool snapshot);
+
+	void write_u32(uint32_t value);
+	void write_u64(uint64_t value);
+	void write_f32(float value);
+	void write_vector3(const vector3& value);
+
+	void add_tensor(e_tensor_type_t type, const vector3& format, const void* data);
+	//the data is copied, so it does not have to outlive the writer
+	void add_tensor_copy(e_tensor_type_t type, const vector3& format, const void* data);
+	//only for snapshot writers, the tensor is copied into pinned memory
+	//with an async copy on the current stream. it may only be saved after the stream reached it
+	void add_device_tensor(e_tensor_type_t type, const vector3& format, const void* device_data);
+
+	bool is_snapshot() const;
+	//true if a tensor is copied from the device
+	bool has_device_tensors() const;
+	size_t get_tensor_count() const;
+
+	void save(const std::string& file_path) const;
+};
+
+//a model file that is mapped into memory
+//it is also the allocator of the matrices that use the mapped tensors.
+//they do not free the host data, the device data is allocated with the default allocator
+//the file has to outlive all matrices that use it (the neural network keeps it alive)
+class mapped_model_file : public matrix_allocator {
+private:
+	uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+
+	const model_file_header& get_header() const;
+	void validate() const;
+	void unmap();
+public:
+	//true if the file starts with the magic of the model file format
+	static bool is_model_file(const std::string& file_path);
+
+	//throws if the file can not be mapped or is not a valid model file
+	mapped_model_file(const std::string& file_path);
+	~mapped_model_file();
+
+	mapped_model_file(const mapped_model_file&) = delete;
+	mapped_model_file& operator=(const mapped_model_file&) = delete;
+
+	uint32_t get_version() const;
+	size_t get_byte_size() const;
+	size_t get_tensor_count() const;
+	const model_tensor_entry& get_tensor_entry(size_t idx) const;
+	uint8_t* get_tensor_data(size_t idx);
+
+	const uint8_t* get_structure() const;
+	size_t get_structure_size() const;
+
+	//the host data is the mapped file, new host memory can not be allocated
+	float* allocate_host(size_t item_count) override;
+	void free_host(float* ptr) override;
+	float* allocate_device(size_t item_count) override;
+	void free_device(float* ptr) override;
+	bool releases_host_memory() const override;
+};
+
+//reads the structure and the tensors of a mapped model file in the order they were written
+class model_reader {
+private:
+	mapped_model_file& file;
+	size_t structure_offset = 0;
+	size_t tensor_idx = 0;
+
+	void read_bytes(void* target, size_t byte_count);
+public:
+	model_reader(mapped_model_file& file);
+
+	uint32_t read_u32();
+	uint64_t read_u64();
+	float read_f32();
+	vector3 read_vector3();
+
+	//the data of the next tensor, throws if it is not of this type
+	//the format of the tensor is written into format
+	uint8_t* next_tensor(e_tensor_type_t type, vector3& format);
+
+	mapped_model_file& get_file();
+};
@@ -1,9 +1,36 @@
 #include "neural_network.hpp"
 #include "util.hpp"
+#include "cpu_math.hpp"
+#include "precision.hpp"
 #include <fstream>
+#include <thread>
+#include <condition_variable>
 
 const float FILE_MAGIC_NUMBER = (float)0xfacade;
 
+void neural_network::create_stream()
+{
+	smart_assert(stream == nullptr);
+
+	//a blocking stream is used, so work on the legacy default stream
+	//(for example copying a data_space to the gpu) is still ordered with it
+	cudaError_t error = cudaStreamCreate(&stream);
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("could not create cuda stream: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+void neural_network::destroy_stream()
+{
+	if (stream != nullptr)
+	{
+		cudaStreamSynchronize(stream);
+		cudaStreamDestroy(stream);
+		stream = nullptr;
+	}
+}
+
 layer* neural_network::get_last_layer()
 {
 	//the last layer is the layer that was added last or nullptr 
@@ -11,10 +38,38 @@ layer* neural_network::get_last_layer()
 	return layers.empty() ? nullptr : layers.back().get();
 }
 
+void neural_network::if_instance_throw() const
+{
+	if (is_instance())
+	{
+		throw std::runtime_error("the parameters of an instance can only be changed through its parameter source");
+	}
+}
+
+void neural_network::if_inference_plan_throw() const
+{
+	if (inference_plan)
+	{
+		throw std::runtime_error("a compiled inference plan can not be trained or changed");
+	}
+}
+
 neural_network::neural_network()
 {}
+
+neural_network::~neural_network()
+{
+	destroy_stream();
+}
 neural_network::neural_network(const std::string& file)
 {
+	if (mapped_model_file::is_model_file(file))
+	{
+		load_model_file(file);
+		return;
+	}
+
+	//the format before the model file format
 	std::ifstream input(file, std::ios::binary | std::ios::in);
 	try
 	{
@@ -50,6 +105,16 @@ neural_network::neural_network(const std::string& file)
 			case e_layer_type_t::pooling:
 				layers.push_back(std::move(std::make_unique<pooling_layer>(input)));
 				break;
+			//quantized layers have no trainable parameters
+			case e_layer_type_t::quantized_fully_connected:
+			case e_layer_type_t::quantized_convolutional:
+				inference_only = true;
+				layers.push_back(std::move(std::make_unique<quantized_layer>(input, layer_type)));
+				break;
+			case e_layer_type_t::sparse_fully_connected:
+				inference_only = true;
+				layers.push_back(std::move(std::make_unique<sparse_layer>(input)));
+				break;
 
 			default:
 				throw std::runtime_error("Unknown layer type");
@@ -66,13 +131,57 @@ neural_network::neural_network(const std::string& file)
 	input.close();
 }
 
+void neural_network::load_model_file(const std::string& file)
+{
+	model_file = std::make_unique<mapped_model_file>(file);
+	model_reader reader(*model_file);
+
+	input_format = reader.read_vector3();
+	const size_t layer_count = (size_t)reader.read_u64();
+
+	for (size_t i = 0; i < layer_count; i++)
+	{
+		const e_layer_type_t layer_type = (e_layer_type_t)reader.read_u32();
+		switch (layer_type)
+		{
+		case e_layer_type_t::convolutional:
+			parameter_layer_indices.push_back(layers.size());
+			layers.push_back(std::make_unique<convolutional_layer>(reader));
+			break;
+		case e_layer_type_t::fully_connected:
+			parameter_layer_indices.push_back(layers.size());
+			layers.push_back(std::make_unique<fully_connected_layer>(reader));
+			break;
+		case e_layer_type_t::pooling:
+			layers.push_back(std::make_unique<pooling_layer>(reader));
+			break;
+		case e_layer_type_t::quantized_fully_connected:
+		case e_layer_type_t::quantized_convolutional:
+			inference_only = true;
+			layers.push_back(std::make_unique<quantized_layer>(reader, layer_type));
+			break;
+		case e_layer_type_t::sparse_fully_connected:
+			inference_only = true;
+			layers.push_back(std::make_unique<sparse_layer>(reader));
+			break;
+
+		default:
+			throw std::runtime_error("Unknown layer type");
+		}
+	}
+
+	gpu_enabled = false;
+}
+
 neural_network::neural_network(const neural_network& source)
 {
 	layers = std::vector<std::unique_ptr<layer>>();
 	//copy all layers
+	//the layers of an instance share the parameters of the same source
+	parameter_source = source.parameter_source;
 	for (const auto& curr : source.layers)
 	{
-		layers.push_back(std::move(curr->clone()));
+		layers.push_back(parameter_source ? curr->clone_instance() : curr->clone());
 	}
 
 	//copy the input format
@@ -80,29 +189,149 @@ neural_network::neural_network(const neural_network& source)
 
 	//copy the parameter layer indices
 	parameter_layer_indices = source.parameter_layer_indices;
+	inference_only = source.inference_only;
+	nn_profiler = source.nn_profiler;
+	graph_training = source.graph_training;
+	augmentation = source.augmentation;
+	augmentation_enabled = source.augmentation_enabled;
+	augmentation_batch_count = source.augmentation_batch_count;
+	//the cloned layers already have their layout
+	tensor_layout = source.tensor_layout;
 
 	//copy the gpu_enabled flag
 	gpu_enabled = source.gpu_enabled;
+	gpu_backend = source.gpu_backend;
+
+	//the copy gets its own stream, so it can run independently of the source
+	//the copied matrices are allocated on the current device
+	if (gpu_enabled)
+	{
+		cudaGetDevice(&gpu_device);
+		create_stream();
+	}
+
+	//the moments of the optimizer belong to the parameters of the source
+	nn_optimizer = source.nn_optimizer;
+
+	//the buffers are not copied, the copied layers are moved into new ones
+	flat_parameters = source.flat_parameters;
+	if (flat_parameters)
+	{
+		build_flat_parameters();
+	}
+
+	//the copied layers are compiled into their own blocks
+	if (source.inference_plan)
+	{
+		compile_inference_plan();
+	}
+}
+neural_network::neural_network(std::shared_ptr<const neural_network> given_parameter_source)
+	:parameter_source(given_parameter_source)
+{
+	if (parameter_source == nullptr)
+	{
+		throw std::invalid_argument("the parameter source is null");
+	}
+
+	for (const auto& curr : parameter_source->layers)
+	{
+		layers.push_back(curr->clone_instance());
+	}
+
+	input_format = parameter_source->input_format;
+	parameter_layer_indices = parameter_source->parameter_layer_indices;
+	inference_only = true;
+	tensor_layout = parameter_source->tensor_layout;
+
+	//the layers are already in the gpu mode of the source
+	gpu_enabled = parameter_source->gpu_enabled;
+	gpu_backend = parameter_source->gpu_backend;
+	gpu_device = parameter_source->gpu_device;
+	if (gpu_enabled)
+	{
+		create_stream();
+	}
+}
+
+neural_network::neural_network(const neural_network& source, share_parameters_t shared)
+{
+	smart_assert(shared.with_deltas);
+	smart_assert(!source.gpu_enabled);
+
+	for (const auto& curr : source.layers)
+	{
+		layers.push_back(curr->clone_workspace());
+	}
+
+	input_format = source.input_format;
+	parameter_layer_indices = source.parameter_layer_indices;
+	nn_profiler = source.nn_profiler;
+	tensor_layout = source.tensor_layout;
 }
+
 neural_network& neural_network::operator=(const neural_network& source)
 {
 	if (this != &source)
 	{
 		layers = std::vector<std::unique_ptr<layer>>();
+		//the old layers are destroyed first, they might observe the old source
+		parameter_source = source.parameter_source;
 		for (const auto& curr : source.layers)
 		{
-			layers.push_back(std::move(curr->clone()));
+			layers.push_back(parameter_source ? curr->clone_instance() : curr->clone());
 		}
+		//the cloned layers own their parameters
+		model_file.reset();
 
 		//copy the input format
 		input_format = source.input_format;
 
 		//copy the parameter layer indices
 		parameter_layer_indices = source.parameter_layer_indices;
+		inference_only = source.inference_only;
+		nn_profiler = source.nn_profiler;
+		graph_training = source.graph_training;
+		augmentation = source.augmentation;
+		augmentation_enabled = source.augmentation_enabled;
+		augmentation_batch_count = source.augmentation_batch_count;
+		tensor_layout = source.tensor_layout;
+		//the cost belongs to the items this network trained on
+		training_cost = matrix();
 
 		//copy the gpu_enabled flag
 		gpu_enabled = source.gpu_enabled;
+		gpu_backend = source.gpu_backend;
+
+		if (gpu_enabled && stream == nullptr)
+		{
+			cudaGetDevice(&gpu_device);
+			create_stream();
+		}
+
+		nn_optimizer = source.nn_optimizer;
+
+		//the old layers are destroyed, so the old buffers are not used anymore
+		flat_parameters = source.flat_parameters;
+		parameter_arena.reset();
+		delta_arena.reset();
+		momentum_arena.reset();
+		flat_item_count = 0;
+		if (flat_parameters)
+		{
+			build_flat_parameters();
+		}
 
+		inference_plan = false;
+		for (size_t i = 0; i < 2; i++)
+		{
+			activation_arenas[i].reset();
+			batch_activation_arenas[i].reset();
+		}
+		if (source.inference_plan)
+		{
+			compile_inference_plan();
+		}
 	}
 	return *this;
 }
@@ -131,6 +360,11 @@ void neural_network::set_input_format(vector3 given_input_format)
 	this->input_format = given_input_format;
 }
 
+vector3 neural_network::get_input_format() const
+{
+	return input_format;
+}
+
 const matrix& neural_network::get_output_readonly() const
 {
 	smart_assert(layers.empty() == false);
@@ -145,6 +379,13 @@ matrix& neural_network::get_output()
 
 void neural_network::add_layer(std::unique_ptr<layer>&& given_layer)
 {
+	if_instance_throw();
+	if_inference_plan_throw();
+	//the softmax normalizes the output of the network
+	if (!layers.empty() && get_cost_function() == cross_entropy_cost)
+	{
+		throw std::invalid_argument("no layer can be added after a softmax layer");
+	}
 	//add the index of the layer to the vector of parameter layers
 	//if the layer is not a pooling layer
 	//because pooling layers do not have parameters
@@ -153,6 +394,8 @@ void neural_network::add_layer(std::unique_ptr<layer>&& given_layer)
 		parameter_layer_indices.push_back((int)layers.size());
 	}
 
+	given_layer->set_inference_only(inference_only);
+
 	if (layers.empty())
 	{
 		//if there are no layers yet, the input format of the first layer
@@ -168,24 +411,44 @@ void neural_network::add_layer(std::unique_ptr<layer>&& given_layer)
 
 	//putting the new layer into the vector of layers
 	layers.push_back(std::move(given_layer));
+	//the layer before it is not the output layer anymore
+	apply_tensor_layout();
 }
 
 float neural_network::calculate_cost(const matrix& expected_output)
 {
 	smart_assert(matrix::equal_format(get_output_readonly(), expected_output));
 
+	data_span<const float> expected = expected_output.host_span_readonly();
+	data_span<const float> actual = get_output_readonly().host_span_readonly();
+
+	const bool cross_entropy = get_cost_function() == cross_entropy_cost;
 	float cost = 0.0f;
-	for (int i = 0; i < expected_output.item_count(); i++)
+	for (size_t i = 0; i < expected.size; i++)
 	{
-		float expected = expected_output.get_at_flat_host(i);
-		float actual = get_output_readonly().get_at_flat_host(i);
-		cost += ((actual - expected) * (actual - expected));
+		cost += cross_entropy ?
+			-expected[i] * logf(std::max(actual[i], CROSS_ENTROPY_EPSILON)) :
+			((actual[i] - expected[i]) * (actual[i] - expected[i]));
 	}
 	return cost;
 }
 
+matrix* neural_network::get_training_cost_p()
+{
+	if (!training_cost.is_initialized())
+	{
+		training_cost = matrix(vector3(1, 1, 1));
+	}
+	if (gpu_enabled && !training_cost.is_in_gpu_mode())
+	{
+		training_cost.enable_gpu_mode();
+	}
+	return &training_cost;
+}
+
 void neural_network::sync_device_and_host()
 {
+	gpu_stream_guard stream_guard(stream, gpu_backend);
 	if (gpu_enabled)
 	{
 		for (auto& l : parameter_layer_indices)
@@ -228,12 +491,19 @@ void neural_network::add_convolutional_layer(
 
 void neural_network::add_pooling_layer(size_t kernel_size, size_t stride, e_pooling_type_t pooling_type)
 {
-	//TODO
-	throw std::exception("not implemented");
+	std::unique_ptr<pooling_layer> new_layer =
+		std::make_unique<pooling_layer>(
+			kernel_size,
+			stride,
+			pooling_type);
+
+	add_layer(std::move(new_layer));
 }
 
 void neural_network::set_all_parameters(float value)
 {
+	if_instance_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
 	//for parameter layers
 	for (auto& l : parameter_layer_indices)
 	{
@@ -243,16 +513,20 @@ void neural_network::set_all_parameters(float value)
 
 void neural_network::apply_noise(float range)
 {
+	if_instance_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
 	//for parameter layers
 	for (auto& l : parameter_layer_indices)
 	{
 		layers[l]->apply_noise(range);
 	}
-	sync_device_and_host();
+	//the matrices keep the host in sync themselves, device only ones have no host data
 }
 
 void neural_network::mutate(float range)
 {
+	if_instance_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
 	smart_assert(parameter_layer_indices.empty() == false);
 
 	int layer_idx = parameter_layer_indices[random_idx((int)parameter_layer_indices.size())];
@@ -272,30 +546,38 @@ void neural_network::mutate(float range)
 
 void neural_network::forward_propagation(const matrix& input)
 {
+	gpu_stream_guard stream_guard(stream, gpu_backend);
 	smart_assert(input.is_in_gpu_mode() == is_in_gpu_mode());
 
+	profiler_guard profile_guard(nn_profiler);
+
 	matrix* last_layer = nullptr;
 	//std::vector<std::unique_ptr<layer>>::iterator::value_type
 	std::lock_guard<std::mutex> lock(forward_mutex);
-	for (auto& l : layers)
+	for (size_t i = 0; i < layers.size(); i++)
 	{
-		l->forward_propagation(
+		profile_scope scope(nn_profiler, (int)i, layers[i]->get_layer_type(), forward_phase, gpu_enabled);
+		layers[i]->forward_propagation(
 			last_layer == nullptr ?
 			input :
 			*last_layer
 		);
-		last_layer = l.get()->get_activations_p();
+		last_layer = layers[i]->get_activations_p();
 	}
 }
 
 void neural_network::back_propagation(const matrix& given_data, const matrix& given_label)
 {
+	if_instance_throw();
+	if_inference_plan_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	profiler_guard profile_guard(nn_profiler);
 	//feeding the data through
 	forward_propagation(given_data);
 
 	std::lock_guard<std::mutex> lock(back_mutex);
 	//calculating the cost derivative
-	get_last_layer()->set_error_for_last_layer(given_label);
+	get_last_layer()->set_error_for_last_layer(given_label, get_training_cost_p());
 
 	//we start from the last layer
 	for (int i = layers.size() - 1; i >= 0; i--)
@@ -310,197 +592,1949 @@ void neural_network::back_propagation(const matrix& given_data, const matrix& gi
 			nullptr :
 			layers[i - 1].get()->get_error_p();
 
+		profile_scope scope(nn_profiler, i, layers[i]->get_layer_type(), backward_phase, gpu_enabled);
 		layers[i].get()->back_propagation(input, passing_error);
 	}
 }
 
-void neural_network::learn_on_ds(
-	data_space& ds,
-	size_t epochs,
-	size_t batch_size,
-	float learning_rate,
-	bool input_zero_check)
+bool neural_network::supports_batch_propagation() const
 {
-	smart_assert(ds.is_in_gpu_mode() == is_in_gpu_mode());
-	smart_assert(vector3::are_equal(ds.get_data_format(), input_format));
-	smart_assert(vector3::are_equal(ds.get_label_format(), get_output_readonly().get_format()));
-	smart_assert(ds.get_item_count() > 0);
-
-	matrix input(ds.get_data_format());
-	matrix label(ds.get_label_format());
-	if (is_in_gpu_mode())
+	if (layers.empty())
 	{
-		input.enable_gpu_mode();
-		label.enable_gpu_mode();
+		return false;
 	}
-
-	for (size_t curr_epoch = 0; curr_epoch < epochs; curr_epoch++)
+	for (const auto& l : layers)
 	{
-		size_t batch_item = 0;
-		for (int i = 0; i < ds.get_item_count(); i++)
+		if (!l->supports_batch_propagation())
 		{
-			ds.observe_data_at_idx(input, i);
-			ds.observe_label_at_idx(label, i);
-
-			if (!input_zero_check || input.contains_non_zero_items())
-			{
-				batch_item++;
-				back_propagation(input, label);
-
-				if (batch_item >= batch_size)
-				{
-					apply_deltas(batch_size, learning_rate);
-					batch_item = 0;
-				}
-			}
-		}
-		//apply the remaining deltas, that were not applied in the loop
-		if (batch_item > 0)
-		{
-			apply_deltas(batch_item, learning_rate);
-			batch_item = 0;
+			return false;
 		}
-		ds.shuffle();
 	}
+	return true;
 }
 
-void neural_network::apply_deltas(size_t training_data_count, float learning_rate)
+void neural_network::set_batch_size(size_t batch_size)
 {
-	//iterate over all parameter layers
-	for (auto& l : parameter_layer_indices)
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	const bool batch_size_changed = !layers.empty() && layers[0]->get_batch_size() != batch_size;
+	for (auto& l : layers)
 	{
-		//update the parameters
-		layers[l]->apply_deltas(training_data_count, learning_rate);
+		l->set_batch_size(batch_size);
+	}
+	//the new batch activations are moved into blocks of the new size
+	if (inference_plan && batch_size_changed)
+	{
+		build_activation_arenas(true);
 	}
 }
-void neural_network::xavier_initialization()
+
+const matrix& neural_network::get_batch_output_readonly() const
 {
-	for (int i = 0; i < layers.size(); i++)
-	{
-		layers[i]->set_all_parameters(0.0f);
+	smart_assert(layers.empty() == false);
+	return layers.back().get()->get_batch_activations_readonly();
+}
 
-		size_t input_size = layers[i]->get_input_format().item_count();
-		size_t outputsize = layers[i]->get_activations_readonly().item_count();
+void neural_network::forward_propagation_batch(const matrix& input_batch)
+{
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	smart_assert(input_batch.is_in_gpu_mode() == is_in_gpu_mode());
 
-		float range = sqrtf(6.0f / ((float)input_size + (float)outputsize));
+	profiler_guard profile_guard(nn_profiler);
 
-		layers[i]->apply_noise(range);
+	const matrix* last_layer = nullptr;
+	std::lock_guard<std::mutex> lock(forward_mutex);
+	for (size_t i = 0; i < layers.size(); i++)
+	{
+		profile_scope scope(nn_profiler, (int)i, layers[i]->get_layer_type(), forward_phase, gpu_enabled);
+		layers[i]->forward_propagation_batch(
+			last_layer == nullptr ?
+			input_batch :
+			*last_layer
+		);
+		last_layer = &layers[i]->get_batch_activations_readonly();
 	}
 }
-void neural_network::enable_gpu_mode()
+
+void neural_network::back_propagation_batch(const matrix& data_batch, const matrix& label_batch)
 {
-	int device_count = 0;
-	cudaError_t error = cudaGetDeviceCount(&device_count);
+	if_instance_throw();
+	if_inference_plan_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	profiler_guard profile_guard(nn_profiler);
+	//feeding the data through
+	forward_propagation_batch(data_batch);
 
-	if (error != cudaSuccess)
-	{
-		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
-	}
+	std::lock_guard<std::mutex> lock(back_mutex);
+	//calculating the cost derivative for every item in the batch
+	get_last_layer()->set_error_for_last_layer_batch(label_batch, get_training_cost_p());
 
-	if (device_count == 0)
+	//we start from the last layer
+	for (int i = layers.size() - 1; i >= 0; i--)
 	{
-		throw std::runtime_error("No CUDA capable devices (GPUs) found.");
-	}
+		const matrix& input_batch =
+			i == 0 ?
+			data_batch :
+			layers[i - 1].get()->get_batch_activations_readonly();
 
-	cudaSetDevice(0);
+		matrix* passing_error_batch =
+			i == 0 ?
+			nullptr :
+			layers[i - 1].get()->get_batch_error_p();
 
-	for (auto& l : layers)
-	{
-		l->enable_gpu_mode();
+		profile_scope scope(nn_profiler, i, layers[i]->get_layer_type(), backward_phase, gpu_enabled);
+		layers[i].get()->back_propagation_batch(input_batch, passing_error_batch);
 	}
-
-	gpu_enabled = true;
-
-	sync_device_and_host();
 }
 
-bool neural_network::is_in_gpu_mode() const
+void neural_network::learn_full_batch(
+	const matrix& data_batch,
+	const matrix& label_batch,
+	size_t batch_size,
+	float learning_rate,
+	training_step_graph& step_graph)
 {
-	return gpu_enabled;
-}
+	if (!graph_training || !gpu_enabled || nn_profiler != nullptr || step_graph.failed)
+	{
+		back_propagation_batch(data_batch, label_batch);
+		apply_deltas(batch_size, learning_rate);
+		return;
+	}
 
-bool neural_network::nn_equal_format(const neural_network& other)
-{
-	if (layers.size() != other.layers.size())
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	if (!step_graph.warmed_up)
 	{
-		return false;
+		back_propagation_batch(data_batch, label_batch);
+		apply_deltas(batch_size, learning_rate);
+		step_graph.warmed_up = true;
+		return;
 	}
-	for (int i = 0; i < layers.size(); i++)
+
+	if (!step_graph.graph.is_captured())
 	{
-		if (!layers[i]->equal_format(*other.layers[i]))
+		//the moment corrections of adam change every step
+		const e_optimizer_t optimizer_type = nn_optimizer.get_type();
+		step_graph.contains_deltas =
+			optimizer_type != adam_optimizer &&
+			optimizer_type != adamw_optimizer;
+
+		//the capture only records the kernels, the step it counts in the optimizer is taken back
+		const optimizer optimizer_before_capture = nn_optimizer;
+		const bool captured = step_graph.graph.capture(stream, [&]() {
+			back_propagation_batch(data_batch, label_batch);
+			if (step_graph.contains_deltas)
+			{
+				apply_deltas(batch_size, learning_rate);
+			}
+		});
+		nn_optimizer = optimizer_before_capture;
+		if (!captured)
 		{
-			return false;
+			step_graph.failed = true;
+			back_propagation_batch(data_batch, label_batch);
+			apply_deltas(batch_size, learning_rate);
+			return;
 		}
 	}
-	return true;
-}
 
-bool neural_network::equal_parameter(const neural_network& other)
-{
-	if (layers.size() != other.layers.size())
+	//a replay does not run the host code, the step counters of the optimizer are advanced here
+	if (step_graph.contains_deltas)
 	{
-		return false;
+		nn_optimizer.begin_step();
 	}
-	for (int i = 0; i < layers.size(); i++)
+	step_graph.graph.launch(stream);
+	if (!step_graph.contains_deltas)
 	{
-		if (!layers[i]->equal_parameter(*other.layers[i]))
-		{
-			return false;
-		}
+		apply_deltas(batch_size, learning_rate);
 	}
-	return true;
 }
 
-void neural_network::set_parameters(const neural_network& other)
+void neural_network::learn_on_ds_batched(
+	data_space& ds,
+	size_t epochs,
+	size_t batch_size,
+	float learning_rate)
 {
-	smart_assert(nn_equal_format(other));
-	smart_assert(is_in_gpu_mode() == other.is_in_gpu_mode());
+	set_batch_size(batch_size);
 
-	for (auto& l : parameter_layer_indices)
+	matrix data_batch(vector3(ds.get_data_format().item_count(), batch_size, (size_t)1));
+	matrix label_batch(vector3(ds.get_label_format().item_count(), batch_size, (size_t)1));
+
+	//used for the items that do not fill a whole batch
+	matrix input(ds.get_data_format());
+	matrix label(ds.get_label_format());
+	if (is_in_gpu_mode())
 	{
-		layers[l]->set_parameters(*other.layers[l]);
+		data_batch.enable_gpu_mode();
+		label_batch.enable_gpu_mode();
+		input.enable_gpu_mode();
+		label.enable_gpu_mode();
 	}
-}
-
-std::string neural_network::parameter_analysis() const
-{
-	//all layers
-
-	std::string result = "Parameter analysis:\n";
-	for (auto& l : layers)
+	//the augmented items, only allocated with augmentation
+	matrix augmented_batch;
+	matrix augmented_input;
+	if (augmentation_enabled)
 	{
-		result += l->parameter_analysis();
+		augmented_batch = matrix(data_batch, false);
+		augmented_input = matrix(input, false);
 	}
 
-	return result;
-}
+	const size_t full_batch_count = ds.get_item_count() / batch_size;
+	//every batch is written into the same buffers
+	training_step_graph step_graph;
 
-void neural_network::save_to_file(const std::string& file_path)
-{
-	std::ofstream out(file_path, std::ios::out | std::ios::binary);
-	try
+	for (size_t curr_epoch = 0; curr_epoch < epochs; curr_epoch++)
 	{
-		if (!out.is_open())
-			throw std::runtime_error("Cannot open file " + file_path);
+		for (size_t batch_idx = 0; batch_idx < full_batch_count; batch_idx++)
+		{
+			ds.get_batch(data_batch, &label_batch, batch_idx * batch_size);
+			learn_full_batch(augment_batch(data_batch, augmented_batch), label_batch, batch_size, learning_rate, step_graph);
+		}
 
-		out.write((char*)&FILE_MAGIC_NUMBER, sizeof(float));
+		size_t remaining_items = 0;
+		for (size_t i = full_batch_count * batch_size; i < ds.get_item_count(); i++)
+		{
+			ds.observe_data_at_idx(input, i);
+			ds.observe_label_at_idx(label, i);
+			back_propagation(augment_batch(input, augmented_input), label);
+			remaining_items++;
+		}
+		if (remaining_items > 0)
+		{
+			apply_deltas(remaining_items, learning_rate);
+		}
+		ds.shuffle();
+	}
+}
+
+void neural_network::learn_on_ds_uploaded(
+	data_space& ds,
+	size_t epochs,
+	size_t batch_size,
+	float learning_rate)
+{
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	set_batch_size(batch_size);
+
+	batch_uploader uploader(ds.get_data_format(), ds.get_label_format(), batch_size);
+
+	//used for the items that do not fill a whole batch
+	matrix input(ds.get_data_format());
+	matrix label(ds.get_label_format());
+	matrix device_input(ds.get_data_format());
+	matrix device_label(ds.get_label_format());
+	device_input.enable_gpu_mode();
+	device_label.enable_gpu_mode();
+	//the augmented items, only allocated with augmentation
+	matrix augmented_batch;
+	matrix augmented_input;
+	if (augmentation_enabled)
+	{
+		augmented_batch = matrix(vector3(ds.get_data_format().item_count(), batch_size, (size_t)1));
+		augmented_batch.enable_gpu_mode();
+		augmented_input = matrix(device_input, false);
+	}
+
+	const size_t full_batch_count = ds.get_item_count() / batch_size;
+	//the batch buffers of every slot have a fixed address, so every slot gets its own graph
+	training_step_graph step_graphs[batch_uploader::SLOT_COUNT];
+
+	for (size_t curr_epoch = 0; curr_epoch < epochs; curr_epoch++)
+	{
+		if (full_batch_count > 0)
+		{
+			uploader.upload(ds, 0, 0);
+		}
+		for (size_t batch_idx = 0; batch_idx < full_batch_count; batch_idx++)
+		{
+			const size_t slot_idx = batch_idx % batch_uploader::SLOT_COUNT;
+			uploader.acquire(slot_idx);
+			learn_full_batch(
+				augment_batch(uploader.get_data_batch(slot_idx), augmented_batch),
+				uploader.get_label_batch(slot_idx),
+				batch_size,
+				learning_rate,
+				step_graphs[slot_idx]);
+			uploader.release(slot_idx);
+
+			//the host writes and copies the next batch while the gpu works on this one
+			if (batch_idx + 1 < full_batch_count)
+			{
+				uploader.upload(
+					ds,
+					(batch_idx + 1) * batch_size,
+					(batch_idx + 1) % batch_uploader::SLOT_COUNT);
+			}
+		}
+
+		size_t remaining_items = 0;
+		for (size_t i = full_batch_count * batch_size; i < ds.get_item_count(); i++)
+		{
+			ds.observe_data_at_idx(input, i);
+			ds.observe_label_at_idx(label, i);
+			std::copy(input.host_span_readonly().begin(), input.host_span_readonly().end(), device_input.host_span().data);
+			std::copy(label.host_span_readonly().begin(), label.host_span_readonly().end(), device_label.host_span().data);
+			device_input.sync_device_and_host();
+			device_label.sync_device_and_host();
+
+			back_propagation(augment_batch(device_input, augmented_input), device_label);
+			remaining_items++;
+		}
+		if (remaining_items > 0)
+		{
+			apply_deltas(remaining_items, learning_rate);
+		}
+		ds.shuffle();
+	}
+}
+
+void neural_network::learn_on_ds(
+	data_space& ds,
+	size_t epochs,
+	size_t batch_size,
+	float learning_rate,
+	bool input_zero_check)
+{
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	//the copies of the data space are counted as well
+	profiler_guard profile_guard(nn_profiler);
+	smart_assert(vector3::are_equal(ds.get_data_format(), input_format));
+	smart_assert(vector3::are_equal(ds.get_label_format(), get_output_readonly().get_format()));
+	smart_assert(ds.get_item_count() > 0);
+	smart_assert(batch_size > 0);
+
+	//the zero check has to look at every item on its own
+	//so the batched paths can only be used without it
+	if (!input_zero_check &&
+		supports_batch_propagation() &&
+		is_in_gpu_mode() &&
+		!ds.is_in_gpu_mode())
+	{
+		learn_on_ds_uploaded(ds, epochs, batch_size, learning_rate);
+		return;
+	}
+
+	smart_assert(ds.is_in_gpu_mode() == is_in_gpu_mode());
+	if (!input_zero_check && supports_batch_propagation())
+	{
+		learn_on_ds_batched(ds, epochs, batch_size, learning_rate);
+		return;
+	}
+
+	matrix input(ds.get_data_format());
+	matrix label(ds.get_label_format());
+	if (is_in_gpu_mode())
+	{
+		input.enable_gpu_mode();
+		label.enable_gpu_mode();
+	}
+	matrix augmented_input;
+	if (augmentation_enabled)
+	{
+		augmented_input = matrix(input, false);
+	}
+
+	for (size_t curr_epoch = 0; curr_epoch < epochs; curr_epoch++)
+	{
+		size_t batch_item = 0;
+		for (int i = 0; i < ds.get_item_count(); i++)
+		{
+			//the mask of the data space is read instead of copying every input back to the host
+			if (!input_zero_check || ds.item_has_non_zero_data(i))
+			{
+				ds.observe_data_at_idx(input, i);
+				ds.observe_label_at_idx(label, i);
+
+				batch_item++;
+				back_propagation(augment_batch(input, augmented_input), label);
+
+				if (batch_item >= batch_size)
+				{
+					apply_deltas(batch_size, learning_rate);
+					batch_item = 0;
+				}
+			}
+		}
+		//apply the remaining deltas, that were not applied in the loop
+		if (batch_item > 0)
+		{
+			apply_deltas(batch_item, learning_rate);
+			batch_item = 0;
+		}
+		ds.shuffle();
+	}
+}
+
+void neural_network::learn_on_ds_parallel(
+	data_space& ds,
+	size_t epochs,
+	size_t batch_size,
+	float learning_rate,
+	bool input_zero_check,
+	size_t thread_count)
+{
+	smart_assert(vector3::are_equal(ds.get_data_format(), input_format));
+	smart_assert(vector3::are_equal(ds.get_label_format(), get_output_readonly().get_format()));
+	smart_assert(ds.get_item_count() > 0);
+	smart_assert(batch_size > 0);
+
+	if (is_in_gpu_mode() || ds.is_in_gpu_mode())
+	{
+		throw std::runtime_error("parallel training is only supported on the cpu");
+	}
+
+	if (thread_count == 0)
+	{
+		thread_count = std::max((size_t)1, (size_t)std::thread::hardware_concurrency());
+	}
+	//more threads than items in a batch would have nothing to do
+	thread_count = std::min(thread_count, batch_size);
+
+	//the workers observe the parameters, so they must not be moved into new buffers while training
+	if (flat_parameters)
+	{
+		ensure_flat_parameters();
+	}
+
+	//every worker has its own activations, errors and deltas
+	//the parameters of this network are read by all of them, apply_deltas only runs between batches
+	std::vector<std::unique_ptr<neural_network>> workers;
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		workers.push_back(std::unique_ptr<neural_network>(new neural_network(*this, share_parameters_t{ true })));
+	}
+
+	//the workers wait for a new generation (a new batch)
+	//and report back when they are done with their slice
+	std::mutex sync_mutex;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+	size_t generation = 0;
+	size_t finished_workers = 0;
+	bool stop = false;
+
+	size_t batch_start = 0;
+	size_t batch_end = 0;
+	std::vector<size_t> processed_items(thread_count, 0);
+	std::exception_ptr worker_exception = nullptr;
+
+	auto worker_fn = [&](size_t worker_idx)
+	{
+		neural_network& worker = *workers[worker_idx];
+		matrix input(ds.get_data_format());
+		matrix label(ds.get_label_format());
+
+		size_t seen_generation = 0;
+		while (true)
+		{
+			size_t slice_start = 0;
+			size_t slice_end = 0;
+			{
+				std::unique_lock<std::mutex> lock(sync_mutex);
+				start_cv.wait(lock, [&]() { return stop || generation != seen_generation; });
+				if (stop)
+				{
+					return;
+				}
+				seen_generation = generation;
+
+				size_t slice_size = (batch_end - batch_start + thread_count - 1) / thread_count;
+				slice_start = std::min(batch_end, batch_start + worker_idx * slice_size);
+				slice_end = std::min(batch_end, slice_start + slice_size);
+			}
+
+			size_t count = 0;
+			try
+			{
+				for (size_t i = slice_start; i < slice_end; i++)
+				{
+					if (!input_zero_check || ds.item_has_non_zero_data(i))
+					{
+						ds.observe_data_at_idx(input, i);
+						ds.observe_label_at_idx(label, i);
+
+						worker.back_propagation(input, label);
+						count++;
+					}
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(sync_mutex);
+				worker_exception = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(sync_mutex);
+			processed_items[worker_idx] = count;
+			finished_workers++;
+			done_cv.notify_one();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back(worker_fn, i);
+	}
+
+	try
+	{
+		for (size_t curr_epoch = 0; curr_epoch < epochs; curr_epoch++)
+		{
+			for (size_t start = 0; start < ds.get_item_count(); start += batch_size)
+			{
+				{
+					std::lock_guard<std::mutex> lock(sync_mutex);
+					batch_start = start;
+					batch_end = std::min(ds.get_item_count(), start + batch_size);
+					finished_workers = 0;
+					generation++;
+				}
+				start_cv.notify_all();
+
+				{
+					std::unique_lock<std::mutex> lock(sync_mutex);
+					done_cv.wait(lock, [&]() { return finished_workers == thread_count; });
+					if (worker_exception != nullptr)
+					{
+						std::rethrow_exception(worker_exception);
+					}
+				}
+
+				//reduction - the deltas of all workers are summed up in this network
+				size_t batch_item_count = 0;
+				for (size_t w = 0; w < thread_count; w++)
+				{
+					for (auto& l : parameter_layer_indices)
+					{
+						layers[l]->accumulate_deltas(*workers[w]->layers[l]);
+					}
+					batch_item_count += processed_items[w];
+				}
+
+				if (batch_item_count > 0)
+				{
+					apply_deltas(batch_item_count, learning_rate);
+				}
+			}
+			ds.shuffle();
+		}
+	}
+	catch (...)
+	{
+		{
+			std::lock_guard<std::mutex> lock(sync_mutex);
+			stop = true;
+		}
+		start_cv.notify_all();
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+		throw;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sync_mutex);
+		stop = true;
+	}
+	start_cv.notify_all();
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+}
+
+void neural_network::learn_on_ds_multi_gpu(
+	data_space& ds,
+	size_t epochs,
+	size_t batch_size,
+	float learning_rate,
+	size_t device_count)
+{
+	smart_assert(vector3::are_equal(ds.get_data_format(), input_format));
+	smart_assert(vector3::are_equal(ds.get_label_format(), get_output_readonly().get_format()));
+	smart_assert(ds.get_item_count() > 0);
+	smart_assert(batch_size > 0);
+	if_instance_throw();
+
+	if (ds.is_in_gpu_mode())
+	{
+		throw std::runtime_error("multi gpu training needs the data space on the host");
+	}
+
+	int visible_device_count = 0;
+	if (cudaGetDeviceCount(&visible_device_count) != cudaSuccess || visible_device_count == 0)
+	{
+		throw std::runtime_error("No CUDA capable devices (GPUs) found.");
+	}
+	if (device_count == 0)
+	{
+		device_count = (size_t)visible_device_count;
+	}
+	if (device_count > (size_t)visible_device_count)
+	{
+		throw std::invalid_argument("there are not that many gpus");
+	}
+	//more gpus than items in a batch would have nothing to do
+	device_count = std::min(device_count, batch_size);
+
+	int previous_device = 0;
+	cudaGetDevice(&previous_device);
+
+	//the replicas are copied from the host values
+	{
+		gpu_stream_guard stream_guard(stream, gpu_backend);
+		sync_device_and_host();
+	}
+	for (size_t d = 1; d < device_count; d++)
+	{
+		gpu_enable_peer_access(0, (int)d);
+		gpu_enable_peer_access((int)d, 0);
+	}
+
+	//every replica is created, used and destroyed by the thread of its gpu
+	std::vector<std::unique_ptr<neural_network>> replicas(device_count);
+
+	std::mutex sync_mutex;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+	size_t generation = 0;
+	size_t finished_workers = 0;
+	bool stop = false;
+
+	size_t batch_start = 0;
+	size_t batch_end = 0;
+	std::vector<size_t> processed_items(device_count, 0);
+	std::exception_ptr worker_exception = nullptr;
+
+	auto worker_fn = [&](size_t device_idx)
+	{
+		cudaSetDevice((int)device_idx);
+
+		//the slice of a full batch always has the same size, so it is uploaded as one batch
+		const size_t full_slice_size =
+			((device_idx + 1) * batch_size) / device_count - (device_idx * batch_size) / device_count;
+		std::unique_ptr<batch_uploader> uploader;
+
+		//used for the slices of the last batch of an epoch
+		matrix input;
+		matrix label;
+		matrix device_input;
+		matrix device_label;
+
+		std::vector<matrix*> parameters;
+		std::vector<matrix*> deltas;
+		std::vector<matrix*> momentum;
+
+		try
+		{
+			replicas[device_idx] = std::make_unique<neural_network>(*this);
+			neural_network& replica = *replicas[device_idx];
+			if (!replica.is_in_gpu_mode())
+			{
+				replica.enable_gpu_mode((int)device_idx);
+			}
+
+			gpu_stream_guard stream_guard(replica.stream, replica.gpu_backend);
+			replica.collect_parameters(parameters, deltas, momentum);
+			if (replica.supports_batch_propagation())
+			{
+				replica.set_batch_size(full_slice_size);
+				uploader = std::make_unique<batch_uploader>(ds.get_data_format(), ds.get_label_format(), full_slice_size);
+			}
+			input = matrix(ds.get_data_format());
+			label = matrix(ds.get_label_format());
+			device_input = matrix(ds.get_data_format());
+			device_label = matrix(ds.get_label_format());
+			device_input.enable_gpu_mode();
+			device_label.enable_gpu_mode();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(sync_mutex);
+			worker_exception = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sync_mutex);
+			finished_workers++;
+			done_cv.notify_one();
+		}
+
+		size_t seen_generation = 0;
+		while (true)
+		{
+			size_t slice_start = 0;
+			size_t slice_end = 0;
+			{
+				std::unique_lock<std::mutex> lock(sync_mutex);
+				start_cv.wait(lock, [&]() { return stop || generation != seen_generation; });
+				if (stop)
+				{
+					break;
+				}
+				seen_generation = generation;
+
+				const size_t count = batch_end - batch_start;
+				slice_start = batch_start + (device_idx * count) / device_count;
+				slice_end = batch_start + ((device_idx + 1) * count) / device_count;
+			}
+
+			size_t processed = 0;
+			try
+			{
+				neural_network& replica = *replicas[device_idx];
+				gpu_stream_guard stream_guard(replica.stream, replica.gpu_backend);
+
+				//the deltas of the last batch were summed up on the first gpu
+				for (matrix* curr : deltas)
+				{
+					curr->set_all(0);
+				}
+
+				if (uploader != nullptr && slice_end - slice_start == full_slice_size)
+				{
+					uploader->upload(ds, slice_start, 0);
+					uploader->acquire(0);
+					replica.back_propagation_batch(uploader->get_data_batch(0), uploader->get_label_batch(0));
+					uploader->release(0);
+				}
+				else
+				{
+					for (size_t i = slice_start; i < slice_end; i++)
+					{
+						ds.observe_data_at_idx(input, i);
+						ds.observe_label_at_idx(label, i);
+						std::copy(input.host_span_readonly().begin(), input.host_span_readonly().end(), device_input.host_span().data);
+						std::copy(label.host_span_readonly().begin(), label.host_span_readonly().end(), device_label.host_span().data);
+						device_input.sync_device_and_host();
+						device_label.sync_device_and_host();
+
+						replica.back_propagation(device_input, device_label);
+					}
+				}
+				gpu_sync_current_stream();
+				processed = slice_end - slice_start;
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(sync_mutex);
+				worker_exception = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(sync_mutex);
+			processed_items[device_idx] = processed;
+			finished_workers++;
+			done_cv.notify_one();
+		}
+
+		//the gpu data is freed on the device it belongs to
+		uploader.reset();
+		device_input = matrix();
+		device_label = matrix();
+		replicas[device_idx].reset();
+	};
+
+	auto wait_for_workers = [&]()
+	{
+		std::unique_lock<std::mutex> lock(sync_mutex);
+		done_cv.wait(lock, [&]() { return finished_workers == device_count; });
+		if (worker_exception != nullptr)
+		{
+			std::rethrow_exception(worker_exception);
+		}
+	};
+	auto stop_workers = [&](std::vector<std::thread>& threads)
+	{
+		{
+			std::lock_guard<std::mutex> lock(sync_mutex);
+			stop = true;
+		}
+		start_cv.notify_all();
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+		cudaSetDevice(previous_device);
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < device_count; i++)
+	{
+		threads.emplace_back(worker_fn, i);
+	}
+
+	try
+	{
+		wait_for_workers();
+
+		//the first gpu sums up the deltas and applies them
+		cudaSetDevice(0);
+		neural_network& reducer = *replicas[0];
+		std::vector<std::vector<matrix*>> replica_parameters(device_count);
+		std::vector<std::vector<matrix*>> replica_deltas(device_count);
+		std::vector<matrix*> reducer_momentum;
+		std::vector<matrix*> unused;
+		reducer.collect_parameters(replica_parameters[0], replica_deltas[0], reducer_momentum);
+		for (size_t d = 1; d < device_count; d++)
+		{
+			replicas[d]->collect_parameters(replica_parameters[d], replica_deltas[d], unused);
+		}
+
+		gpu_stream_guard stream_guard(reducer.stream, reducer.gpu_backend);
+		//the deltas of the other gpus are copied into these before they are added
+		std::vector<matrix> received_deltas;
+		for (matrix* curr : replica_deltas[0])
+		{
+			received_deltas.emplace_back(curr->get_format());
+			received_deltas.back().enable_gpu_mode();
+		}
+
+		for (size_t curr_epoch = 0; curr_epoch < epochs; curr_epoch++)
+		{
+			for (size_t start = 0; start < ds.get_item_count(); start += batch_size)
+			{
+				{
+					std::lock_guard<std::mutex> lock(sync_mutex);
+					batch_start = start;
+					batch_end = std::min(ds.get_item_count(), start + batch_size);
+					finished_workers = 0;
+					generation++;
+				}
+				start_cv.notify_all();
+				wait_for_workers();
+
+				//all reduce - the deltas are summed up on the first gpu
+				size_t batch_item_count = processed_items[0];
+				for (size_t d = 1; d < device_count; d++)
+				{
+					for (size_t i = 0; i < received_deltas.size(); i++)
+					{
+						gpu_copy_peer(
+							received_deltas[i].device_span().data,
+							0,
+							replica_deltas[d][i]->device_span_readonly().data,
+							(int)d,
+							received_deltas[i].item_count());
+						matrix::add(*replica_deltas[0][i], received_deltas[i], *replica_deltas[0][i]);
+					}
+					batch_item_count += processed_items[d];
+				}
+
+				reducer.apply_deltas(batch_item_count, learning_rate);
+
+				//and the new parameters are copied back to the others
+				for (size_t d = 1; d < device_count; d++)
+				{
+					for (size_t i = 0; i < replica_parameters[0].size(); i++)
+					{
+						gpu_copy_peer(
+							replica_parameters[d][i]->device_span().data,
+							(int)d,
+							replica_parameters[0][i]->device_span_readonly().data,
+							0,
+							replica_parameters[0][i]->item_count());
+					}
+				}
+				//the copies run on the stream of the first gpu, the other replicas
+				//must not start the next batch before they are done
+				gpu_sync_current_stream();
+			}
+			ds.shuffle();
+		}
+
+		//the parameters and the momentum of the first gpu are the result
+		//(the second moments of adam stay with the optimizer of the replica)
+		reducer.sync_device_and_host();
+		std::vector<matrix*> result_parameters;
+		std::vector<matrix*> result_momentum;
+		collect_parameters(result_parameters, unused, result_momentum);
+		for (size_t i = 0; i < result_parameters.size(); i++)
+		{
+			data_span<const float> values = replica_parameters[0][i]->host_span_readonly();
+			std::copy(values.begin(), values.end(), result_parameters[i]->host_span().data);
+			data_span<const float> moments = reducer_momentum[i]->host_span_readonly();
+			std::copy(moments.begin(), moments.end(), result_momentum[i]->host_span().data);
+		}
+	}
+	catch (...)
+	{
+		stop_workers(threads);
+		throw;
+	}
+	stop_workers(threads);
+
+	//the result was written on the host
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	sync_device_and_host();
+}
+test_result neural_network::evaluate(data_space& ds, size_t batch_size)
+{
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	profiler_guard profile_guard(nn_profiler);
+	smart_assert(ds.is_in_gpu_mode() == is_in_gpu_mode());
+	smart_assert(vector3::are_equal(ds.get_data_format(), input_format));
+	smart_assert(vector3::are_equal(ds.get_label_format(), get_output_readonly().get_format()));
+	smart_assert(ds.get_item_count() > 0);
+	smart_assert(batch_size > 0);
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	//the number of correct items and the summed cost
+	matrix totals(vector3(2, 1, 1));
+	if (is_in_gpu_mode())
+	{
+		totals.enable_gpu_mode();
+	}
+	const e_cost_function_t cost_fn = get_cost_function();
+	auto evaluate_rows = [&](const matrix& outputs, const matrix& labels, size_t row_count) {
+		const size_t row_width = ds.get_label_format().item_count();
+		if (is_in_gpu_mode())
+		{
+			gpu_evaluate_rows(
+				outputs.device_span_readonly().data,
+				labels.device_span_readonly().data,
+				row_count,
+				row_width,
+				cost_fn,
+				totals.device_span().data);
+			return;
+		}
+		cpu_evaluate_rows(
+			outputs.host_span_readonly().data,
+			labels.host_span_readonly().data,
+			row_count,
+			row_width,
+			cost_fn,
+			totals.host_span().data);
+	};
+
+	if (supports_batch_propagation())
+	{
+		matrix data_batch;
+		matrix label_batch;
+		size_t start_idx = 0;
+		while (start_idx < ds.get_item_count())
+		{
+			//the last batch can be smaller
+			const size_t row_count = std::min(batch_size, ds.get_item_count() - start_idx);
+			if (!data_batch.is_initialized() || data_batch.get_height() != row_count)
+			{
+				set_batch_size(row_count);
+				data_batch = matrix(vector3(ds.get_data_format().item_count(), row_count, (size_t)1));
+				label_batch = matrix(vector3(ds.get_label_format().item_count(), row_count, (size_t)1));
+				if (is_in_gpu_mode())
+				{
+					data_batch.enable_gpu_mode();
+					label_batch.enable_gpu_mode();
+				}
+			}
+			ds.get_batch(data_batch, &label_batch, start_idx);
+			forward_propagation_batch(data_batch);
+			evaluate_rows(get_batch_output_readonly(), label_batch, row_count);
+			start_idx += row_count;
+		}
+	}
+	else
+	{
+		matrix input(ds.get_data_format());
+		matrix label(ds.get_label_format());
+		if (is_in_gpu_mode())
+		{
+			input.enable_gpu_mode();
+			label.enable_gpu_mode();
+		}
+		for (size_t i = 0; i < ds.get_item_count(); i++)
+		{
+			ds.observe_data_at_idx(input, i);
+			ds.observe_label_at_idx(label, i);
+			forward_propagation(input);
+			evaluate_rows(get_output_readonly(), label, 1);
+		}
+	}
+
+	//the only copy back to the host
+	totals.sync_device_and_host();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	test_result result;
+	result.data_count = ds.get_item_count();
+	result.time_in_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	result.accuracy = totals.get_at_flat_host(0) / (float)ds.get_item_count();
+	result.avg_cost = totals.get_at_flat_host(1) / (float)ds.get_item_count();
+	return result;
+}
+
+void neural_network::apply_deltas(size_t training_data_count, float learning_rate)
+{
+	if_instance_throw();
+	if_inference_plan_throw();
+	if (parameter_layer_indices.empty())
+	{
+		return;
+	}
+
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	optimizer_profile_scope profile(nn_profiler, gpu_enabled);
+
+	std::vector<matrix*> parameters;
+	std::vector<matrix*> deltas;
+	std::vector<matrix*> momentum;
+
+	nn_optimizer.begin_step();
+
+	if (flat_parameters)
+	{
+		ensure_flat_parameters();
+
+		//one update for all parameters of the network
+		//the padding between the matrices is zero and stays zero
+		nn_optimizer.update(
+			0,
+			gpu_enabled ? parameter_arena->get_device_block() : parameter_arena->get_host_block(),
+			gpu_enabled ? delta_arena->get_device_block() : delta_arena->get_host_block(),
+			gpu_enabled ? momentum_arena->get_device_block() : momentum_arena->get_host_block(),
+			flat_item_count,
+			gpu_enabled,
+			training_data_count,
+			learning_rate);
+
+		collect_parameters(parameters, deltas, momentum);
+		mark_flat_matrices_updated(parameters);
+		mark_flat_matrices_updated(deltas);
+		mark_flat_matrices_updated(momentum);
+		return;
+	}
+
+	//every parameter matrix is one slot of the optimizer
+	collect_parameters(parameters, deltas, momentum);
+	for (size_t i = 0; i < parameters.size(); i++)
+	{
+		nn_optimizer.update(
+			i,
+			gpu_enabled ? parameters[i]->device_span().data : parameters[i]->host_span().data,
+			gpu_enabled ? deltas[i]->device_span().data : deltas[i]->host_span().data,
+			gpu_enabled ? momentum[i]->device_span().data : momentum[i]->host_span().data,
+			parameters[i]->item_count(),
+			gpu_enabled,
+			training_data_count,
+			learning_rate);
+	}
+}
+
+void neural_network::set_optimizer(const optimizer& new_optimizer)
+{
+	nn_optimizer = new_optimizer;
+	nn_optimizer.reset();
+}
+
+const optimizer& neural_network::get_optimizer() const
+{
+	return nn_optimizer;
+}
+void neural_network::xavier_initialization()
+{
+	if_instance_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	//pooling layers do not have parameters
+	for (int i : parameter_layer_indices)
+	{
+		layers[i]->set_all_parameters(0.0f);
+
+		size_t input_size = layers[i]->get_input_format().item_count();
+		size_t outputsize = layers[i]->get_activations_readonly().item_count();
+
+		float range = sqrtf(6.0f / ((float)input_size + (float)outputsize));
+
+		layers[i]->apply_noise(range);
+	}
+}
+void neural_network::enable_gpu_mode()
+{
+	enable_gpu_mode(0);
+}
+
+void neural_network::enable_gpu_mode(int device)
+{
+	int device_count = 0;
+	cudaError_t error = cudaGetDeviceCount(&device_count);
+
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+
+	if (device_count == 0)
+	{
+		throw std::runtime_error("No CUDA capable devices (GPUs) found.");
+	}
+
+	if (device < 0 || device >= device_count)
+	{
+		throw std::invalid_argument("there is no gpu with this index");
+	}
+	if (stream != nullptr && device != gpu_device)
+	{
+		throw std::runtime_error("the network is already on a different gpu");
+	}
+	gpu_device = device;
+	cudaSetDevice(gpu_device);
+
+	//the parameters of an instance can not be moved to the gpu
+	if (is_instance() && !parameter_source->is_in_gpu_mode())
+	{
+		throw std::runtime_error("the parameter source of the instance is not in gpu mode");
+	}
+
+	if (stream == nullptr)
+	{
+		create_stream();
+	}
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+
+	//the buffers have no device memory yet
+	//so the matrices allocate their device data normally and are moved back afterwards
+	release_flat_parameters();
+
+	for (auto& l : layers)
+	{
+		l->enable_gpu_mode();
+	}
+
+	gpu_enabled = true;
+
+	sync_device_and_host();
+
+	if (flat_parameters)
+	{
+		build_flat_parameters();
+	}
+}
+
+void neural_network::collect_parameters(
+	std::vector<matrix*>& parameters,
+	std::vector<matrix*>& deltas,
+	std::vector<matrix*>& momentum) const
+{
+	for (int l : parameter_layer_indices)
+	{
+		layers[l]->collect_parameters(parameters, deltas, momentum);
+	}
+}
+
+bool neural_network::flat_parameters_valid() const
+{
+	if (parameter_arena == nullptr ||
+		(parameter_arena->get_device_block_readonly() != nullptr) != gpu_enabled)
+	{
+		return false;
+	}
+
+	std::vector<matrix*> parameters;
+	std::vector<matrix*> deltas;
+	std::vector<matrix*> momentum;
+	collect_parameters(parameters, deltas, momentum);
+
+	//the matrices are allocated in order, so the layout only changes
+	//if a matrix was reallocated (then it uses a different allocator) or a layer was added
+	size_t item_count = 0;
+	for (size_t i = 0; i < parameters.size(); i++)
+	{
+		if (parameters[i]->get_allocator() != parameter_arena.get() ||
+			deltas[i]->get_allocator() != delta_arena.get() ||
+			momentum[i]->get_allocator() != momentum_arena.get())
+		{
+			return false;
+		}
+		item_count += arena_matrix_allocator::aligned_item_count(parameters[i]->item_count());
+	}
+	return item_count == flat_item_count;
+}
+
+void neural_network::build_flat_parameters()
+{
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	optimizer_profile_scope profile(nn_profiler, gpu_enabled);
+
+	std::vector<matrix*> parameters;
+	std::vector<matrix*> deltas;
+	std::vector<matrix*> momentum;
+	collect_parameters(parameters, deltas, momentum);
+
+	size_t item_count = 0;
+	for (matrix* m : parameters)
+	{
+		item_count += arena_matrix_allocator::aligned_item_count(m->item_count());
+	}
+	if (item_count == 0)
+	{
+		return;
+	}
+
+	//the matrices are moved out of the old buffers before those are destroyed
+	auto new_parameter_arena = std::make_unique<arena_matrix_allocator>(item_count, gpu_enabled);
+	auto new_delta_arena = std::make_unique<arena_matrix_allocator>(item_count, gpu_enabled);
+	auto new_momentum_arena = std::make_unique<arena_matrix_allocator>(item_count, gpu_enabled);
+
+	//same order in all three buffers, so every parameter has the same offset as its delta and momentum
+	for (size_t i = 0; i < parameters.size(); i++)
+	{
+		parameters[i]->move_to_allocator(*new_parameter_arena);
+		deltas[i]->move_to_allocator(*new_delta_arena);
+		momentum[i]->move_to_allocator(*new_momentum_arena);
+	}
+
+	parameter_arena = std::move(new_parameter_arena);
+	delta_arena = std::move(new_delta_arena);
+	momentum_arena = std::move(new_momentum_arena);
+	flat_item_count = item_count;
+}
+
+void neural_network::release_flat_parameters()
+{
+	if (parameter_arena == nullptr)
+	{
+		return;
+	}
+
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	optimizer_profile_scope profile(nn_profiler, gpu_enabled);
+
+	std::vector<matrix*> parameters;
+	std::vector<matrix*> deltas;
+	std::vector<matrix*> momentum;
+	collect_parameters(parameters, deltas, momentum);
+
+	matrix_allocator& allocator = get_matrix_allocator();
+	for (size_t i = 0; i < parameters.size(); i++)
+	{
+		parameters[i]->move_to_allocator(allocator);
+		deltas[i]->move_to_allocator(allocator);
+		momentum[i]->move_to_allocator(allocator);
+	}
+
+	parameter_arena.reset();
+	delta_arena.reset();
+	momentum_arena.reset();
+	flat_item_count = 0;
+}
+
+void neural_network::ensure_flat_parameters()
+{
+	if (!flat_parameters_valid())
+	{
+		build_flat_parameters();
+	}
+}
+
+void neural_network::mark_flat_matrices_updated(const std::vector<matrix*>& matrices)
+{
+	for (matrix* m : matrices)
+	{
+		if (gpu_enabled)
+		{
+			m->device_span();
+		}
+		else
+		{
+			m->host_span();
+		}
+	}
+}
+
+void neural_network::use_flat_parameters(bool use_flat)
+{
+	if_instance_throw();
+	if_inference_plan_throw();
+	//the slots of the optimizer change
+	nn_optimizer.reset();
+	flat_parameters = use_flat;
+	if (flat_parameters)
+	{
+		build_flat_parameters();
+	}
+	else
+	{
+		release_flat_parameters();
+	}
+}
+
+bool neural_network::is_using_flat_parameters() const
+{
+	return flat_parameters;
+}
+
+size_t neural_network::get_flat_parameter_count() const
+{
+	return flat_parameters ? flat_item_count : 0;
+}
+
+void neural_network::set_flat_parameters(const float* values)
+{
+	if_instance_throw();
+	if (!flat_parameters)
+	{
+		throw std::runtime_error("the network does not use flat parameters");
+	}
+	if (parameter_layer_indices.empty())
+	{
+		return;
+	}
+
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	ensure_flat_parameters();
+
+	if (gpu_enabled)
+	{
+		cudaMemcpyAsync(
+			parameter_arena->get_device_block(),
+			values,
+			flat_item_count * sizeof(float),
+			cudaMemcpyDeviceToDevice,
+			stream);
+		gpu_sync_current_stream();
+	}
+	else
+	{
+		std::copy(values, values + flat_item_count, parameter_arena->get_host_block());
+	}
+
+	std::vector<matrix*> parameters;
+	std::vector<matrix*> deltas;
+	std::vector<matrix*> momentum;
+	collect_parameters(parameters, deltas, momentum);
+	mark_flat_matrices_updated(parameters);
+}
+
+void neural_network::copy_flat_parameters_to_host(float* destination)
+{
+	if (!flat_parameters)
+	{
+		throw std::runtime_error("the network does not use flat parameters");
+	}
+	if (parameter_layer_indices.empty())
+	{
+		return;
+	}
+
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	ensure_flat_parameters();
+	sync_device_and_host();
+
+	const float* source = parameter_arena->get_host_block_readonly();
+	std::copy(source, source + flat_item_count, destination);
+}
+
+const matrix& neural_network::augment_batch(const matrix& batch, matrix& buffer)
+{
+	if (!augmentation_enabled)
+	{
+		return batch;
+	}
+	smart_assert(matrix::equal_format(batch, buffer));
+	smart_assert(batch.is_in_gpu_mode() == buffer.is_in_gpu_mode());
+
+	//every batch gets new transforms, the items of a batch are the streams
+	augmentation_settings settings = augmentation;
+	settings.seed = augmentation.seed + augmentation_batch_count++;
+	const size_t row_count = batch.item_count() / input_format.item_count();
+	if (batch.is_in_gpu_mode())
+	{
+		gpu_augment_rows(
+			batch.device_span_readonly().data,
+			buffer.device_span().data,
+			row_count,
+			input_format.x,
+			input_format.y,
+			input_format.z,
+			settings);
+	}
+	else
+	{
+		cpu_augment_rows(
+			batch.host_span_readonly().data,
+			buffer.host_span().data,
+			row_count,
+			input_format.x,
+			input_format.y,
+			input_format.z,
+			settings);
+	}
+	return buffer;
+}
+
+static float max_absolute_value(const matrix& m)
+{
+	float result = 0;
+	for (float value : m.host_span_readonly())
+	{
+		result = std::max(result, std::abs(value));
+	}
+	return result;
+}
+
+neural_network neural_network::quantize(data_space& calibration_data, size_t sample_count)
+{
+	//the calibration reads the activations of every layer after the forward propagation
+	if_inference_plan_throw();
+	smart_assert(calibration_data.is_in_gpu_mode() == is_in_gpu_mode());
+	smart_assert(vector3::are_equal(calibration_data.get_data_format(), input_format));
+	if (sample_count == 0 || calibration_data.get_item_count() == 0)
+	{
+		throw std::invalid_argument("quantization needs at least one calibration item");
+	}
+	sample_count = std::min(sample_count, calibration_data.get_item_count());
+
+	//the largest absolute value each layer got as input
+	std::vector<float> max_input(layers.size(), 0.0f);
+
+	matrix input(input_format);
+	if (is_in_gpu_mode())
+	{
+		input.enable_gpu_mode();
+	}
+	for (size_t item = 0; item < sample_count; item++)
+	{
+		calibration_data.observe_data_at_idx(input, item);
+		forward_propagation(input);
+
+		gpu_stream_guard stream_guard(stream, gpu_backend);
+		input.sync_device_and_host();
+		for (auto& l : layers)
+		{
+			l->sync_device_and_host();
+		}
+
+		for (size_t layer_idx = 0; layer_idx < layers.size(); layer_idx++)
+		{
+			const matrix& layer_input =
+				layer_idx == 0 ?
+				input :
+				layers[layer_idx - 1]->get_activations_readonly();
+			max_input[layer_idx] = std::max(max_input[layer_idx], max_absolute_value(layer_input));
+		}
+	}
+
+	neural_network result;
+	result.input_format = input_format;
+	result.inference_only = true;
+	for (size_t layer_idx = 0; layer_idx < layers.size(); layer_idx++)
+	{
+		const layer& source = *layers[layer_idx];
+		const float input_scale = int8_scale_for(max_input[layer_idx]);
+
+		std::unique_ptr<layer> quantized;
+		switch (source.get_layer_type())
+		{
+		case e_layer_type_t::fully_connected:
+			quantized = std::make_unique<quantized_layer>(
+				dynamic_cast<const fully_connected_layer&>(source), input_scale);
+			break;
+		case e_layer_type_t::convolutional:
+			quantized = std::make_unique<quantized_layer>(
+				dynamic_cast<const convolutional_layer&>(source), input_scale);
+			break;
+		default:
+			quantized = source.clone();
+			break;
+		}
+		quantized->set_inference_only(true);
+		result.layers.push_back(std::move(quantized));
+	}
+
+	if (is_in_gpu_mode())
+	{
+		result.gpu_backend = gpu_backend;
+		result.enable_gpu_mode();
+	}
+	return result;
+}
+
+void neural_network::prune(float sparsity)
+{
+	if_instance_throw();
+	if_inference_plan_throw();
+	if (sparsity < 0.0f || sparsity > 1.0f)
+	{
+		throw std::invalid_argument("the sparsity has to be between 0 and 1");
+	}
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+
+	for (size_t layer_idx : parameter_layer_indices)
+	{
+		if (layers[layer_idx]->get_layer_type() != e_layer_type_t::fully_connected)
+		{
+			continue;
+		}
+
+		if (is_in_gpu_mode())
+		{
+			layers[layer_idx]->sync_device_and_host();
+		}
 
-		input_format.write_to_ofstream(out);
+		dynamic_cast<fully_connected_layer&>(*layers[layer_idx]).prune_weights(sparsity);
 
-		size_t layer_count = layers.size();
-		out.write((char*)&layer_count, sizeof(size_t));
+		if (is_in_gpu_mode())
+		{
+			layers[layer_idx]->sync_device_and_host();
+		}
+	}
+}
 
-		sync_device_and_host();
+neural_network neural_network::sparsify()
+{
+	if_inference_plan_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+
+	neural_network result;
+	result.input_format = input_format;
+	result.inference_only = true;
+	for (auto& source : layers)
+	{
+		std::unique_ptr<layer> sparse;
+		if (source->get_layer_type() == e_layer_type_t::fully_connected)
+		{
+			//the csr weights are built from the host values
+			if (is_in_gpu_mode())
+			{
+				source->sync_device_and_host();
+			}
+			sparse = std::make_unique<sparse_layer>(dynamic_cast<const fully_connected_layer&>(*source));
+		}
+		else
+		{
+			sparse = source->clone();
+		}
+		sparse->set_inference_only(true);
+		result.layers.push_back(std::move(sparse));
+	}
+
+	if (is_in_gpu_mode())
+	{
+		result.gpu_backend = gpu_backend;
+		result.enable_gpu_mode();
+	}
+	return result;
+}
+
+bool neural_network::is_in_gpu_mode() const
+{
+	return gpu_enabled;
+}
+
+int neural_network::get_gpu_device() const
+{
+	return gpu_device;
+}
+
+void neural_network::set_inference_only(bool given_inference_only)
+{
+	if (!given_inference_only)
+	{
+		if_instance_throw();
+		if_inference_plan_throw();
+	}
+	inference_only = given_inference_only;
+	for (auto& l : layers)
+	{
+		l->set_inference_only(inference_only);
+	}
+}
+
+bool neural_network::is_inference_only() const
+{
+	return inference_only;
+}
+
+void neural_network::build_activation_arenas(bool batch)
+{
+	if (layers.empty() || (batch && layers[0]->get_batch_size() == 0))
+	{
+		return;
+	}
+
+	size_t item_capacity[2] = { 0, 0 };
+	for (size_t i = 0; i < layers.size(); i++)
+	{
+		const matrix& activations = batch ?
+			layers[i]->get_batch_activations_readonly() :
+			layers[i]->get_activations_readonly();
+		item_capacity[i % 2] = std::max(item_capacity[i % 2], activations.item_count());
+	}
+
+	//the old blocks are kept until all activations are moved out of them
+	std::unique_ptr<shared_block_matrix_allocator> new_arenas[2];
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (item_capacity[i] != 0)
+		{
+			new_arenas[i] = std::make_unique<shared_block_matrix_allocator>(item_capacity[i]);
+		}
+	}
+	for (size_t i = 0; i < layers.size(); i++)
+	{
+		if (batch)
+		{
+			layers[i]->move_batch_activations_to(*new_arenas[i % 2]);
+		}
+		else
+		{
+			layers[i]->move_activations_to(*new_arenas[i % 2]);
+		}
+	}
+
+	std::unique_ptr<shared_block_matrix_allocator>* arenas = batch ? batch_activation_arenas : activation_arenas;
+	for (size_t i = 0; i < 2; i++)
+	{
+		arenas[i] = std::move(new_arenas[i]);
+	}
+}
+
+void neural_network::compile_inference_plan()
+{
+	if (layers.empty())
+	{
+		throw std::runtime_error("the network has no layers");
+	}
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+
+	//the deltas and momentum are freed, so they can not live in the flat buffers
+	if (flat_parameters)
+	{
+		release_flat_parameters();
+		flat_parameters = false;
+	}
+	nn_optimizer.reset();
+
+	set_inference_only(true);
+	for (auto& l : layers)
+	{
+		l->release_training_buffers();
+	}
+
+	inference_plan = true;
+	build_activation_arenas(false);
+	build_activation_arenas(true);
+}
+
+bool neural_network::has_inference_plan() const
+{
+	return inference_plan;
+}
+
+size_t neural_network::get_plan_activation_item_count() const
+{
+	size_t result = 0;
+	for (size_t i = 0; i < 2; i++)
+	{
+		result += activation_arenas[i] ? activation_arenas[i]->get_item_capacity() : 0;
+		result += batch_activation_arenas[i] ? batch_activation_arenas[i]->get_item_capacity() : 0;
+	}
+	return result;
+}
+
+cudaStream_t neural_network::get_stream() const
+{
+	return stream;
+}
+
+void neural_network::set_device_only(bool device_only)
+{
+	if_instance_throw();
+	if (!gpu_enabled)
+	{
+		throw std::runtime_error("only a network in gpu mode can be device only");
+	}
+
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	std::vector<matrix*> parameters;
+	std::vector<matrix*> deltas;
+	std::vector<matrix*> momentum;
+	collect_parameters(parameters, deltas, momentum);
+	for (const std::vector<matrix*>* group : { &parameters, &deltas, &momentum })
+	{
+		for (matrix* m : *group)
+		{
+			//inference only layers have no deltas and momentum
+			if (m != nullptr && m->is_initialized())
+			{
+				m->set_device_only(device_only);
+			}
+		}
+	}
+}
+
+e_cost_function_t neural_network::get_cost_function() const
+{
+	return layers.empty() ? squared_error_cost : layers.back()->get_cost_function();
+}
+
+float neural_network::get_training_cost()
+{
+	if (!training_cost.is_initialized())
+	{
+		return 0;
+	}
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	training_cost.sync_device_and_host();
+	return training_cost.get_at_flat_host(0);
+}
+
+void neural_network::reset_training_cost()
+{
+	if (training_cost.is_initialized())
+	{
+		gpu_stream_guard stream_guard(stream, gpu_backend);
+		training_cost.set_all(0);
+	}
+}
+
+void neural_network::set_gpu_backend(e_gpu_backend_t backend)
+{
+	if (!gpu_backend_available(backend))
+	{
+		throw std::invalid_argument("this gpu backend was not compiled in");
+	}
+	gpu_backend = backend;
+}
+
+e_gpu_backend_t neural_network::get_gpu_backend() const
+{
+	return gpu_backend;
+}
+
+void neural_network::set_graph_training(bool enabled)
+{
+	graph_training = enabled;
+}
+
+bool neural_network::is_graph_training() const
+{
+	return graph_training;
+}
+
+void neural_network::set_augmentation(const augmentation_settings& settings)
+{
+	if (settings.max_shift < 0 ||
+		settings.max_rotation < 0 ||
+		settings.elastic_amplitude < 0 ||
+		settings.noise < 0)
+	{
+		throw std::invalid_argument("the ranges of the augmentation can not be negative");
+	}
+	if (settings.elastic_amplitude > 0 && settings.elastic_frequency <= 0)
+	{
+		throw std::invalid_argument("the elastic distortion needs a positive frequency");
+	}
+
+	augmentation = settings;
+	augmentation_enabled =
+		settings.max_shift > 0 ||
+		settings.max_rotation > 0 ||
+		settings.elastic_amplitude > 0 ||
+		settings.noise > 0;
+	augmentation_batch_count = 0;
+}
+
+const augmentation_settings& neural_network::get_augmentation() const
+{
+	return augmentation;
+}
+
+void neural_network::apply_tensor_layout()
+{
+	//the activations of layers in gpu mode are converted on the device
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	for (size_t i = 0; i < layers.size(); i++)
+	{
+		const e_layer_type_t type = layers[i]->get_layer_type();
+		if (type != convolutional && type != pooling)
+		{
+			continue;
+		}
+		//the output is compared with planar labels
+		layers[i]->set_tensor_layout(i + 1 == layers.size() ? chw_layout : tensor_layout);
+	}
+}
+
+void neural_network::set_tensor_layout(e_tensor_layout_t layout)
+{
+	tensor_layout = layout;
+	apply_tensor_layout();
+}
+
+e_tensor_layout_t neural_network::get_tensor_layout() const
+{
+	return tensor_layout;
+}
+
+void neural_network::set_profiler(profiler* target)
+{
+	nn_profiler = target;
+}
+
+profiler* neural_network::get_profiler() const
+{
+	return nn_profiler;
+}
+
+bool neural_network::nn_equal_format(const neural_network& other)
+{
+	if (layers.size() != other.layers.size())
+	{
+		return false;
+	}
+	for (int i = 0; i < layers.size(); i++)
+	{
+		if (!layers[i]->equal_format(*other.layers[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool neural_network::equal_parameter(const neural_network& other)
+{
+	if (layers.size() != other.layers.size())
+	{
+		return false;
+	}
+	if (flat_parameters_valid() &&
+		other.flat_parameters_valid() &&
+		flat_item_count == other.flat_item_count &&
+		nn_equal_format(other))
+	{
+		const float* a = parameter_arena->get_host_block_readonly();
+		const float* b = other.parameter_arena->get_host_block_readonly();
+		for (size_t i = 0; i < flat_item_count; i++)
+		{
+			if (std::abs(a[i] - b[i]) > FLOAT_TOLERANCE)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	for (int i = 0; i < layers.size(); i++)
+	{
+		if (!layers[i]->equal_parameter(*other.layers[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void neural_network::set_parameters(const neural_network& other)
+{
+	if_instance_throw();
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	smart_assert(nn_equal_format(other));
+	smart_assert(is_in_gpu_mode() == other.is_in_gpu_mode());
+
+	if (flat_parameters &&
+		!parameter_layer_indices.empty() &&
+		other.flat_parameters_valid())
+	{
+		ensure_flat_parameters();
+		if (flat_item_count == other.flat_item_count)
+		{
+			//both networks have the same layout, so all parameters are copied at once
+			if (gpu_enabled)
+			{
+				cudaMemcpyAsync(
+					parameter_arena->get_device_block(),
+					other.parameter_arena->get_device_block_readonly(),
+					flat_item_count * sizeof(float),
+					cudaMemcpyDeviceToDevice,
+					stream);
+				gpu_sync_current_stream();
+			}
+			else
+			{
+				const float* source = other.parameter_arena->get_host_block_readonly();
+				std::copy(source, source + flat_item_count, parameter_arena->get_host_block());
+			}
+
+			std::vector<matrix*> parameters;
+			std::vector<matrix*> deltas;
+			std::vector<matrix*> momentum;
+			collect_parameters(parameters, deltas, momentum);
+			mark_flat_matrices_updated(parameters);
+			return;
+		}
+	}
+
+	for (auto& l : parameter_layer_indices)
+	{
+		layers[l]->set_parameters(*other.layers[l]);
+	}
+}
+
+std::string neural_network::parameter_analysis() const
+{
+	//all layers
+
+	std::string result = "Parameter analysis:\n";
+	for (auto& l : layers)
+	{
+		result += l->parameter_analysis();
+	}
+
+	return result;
+}
+
+bool neural_network::is_memory_mapped() const
+{
+	return model_file != nullptr;
+}
+
+bool neural_network::is_instance() const
+{
+	return parameter_source != nullptr;
+}
+
+void neural_network::save_to_file(const std::string& file_path)
+{
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+	sync_device_and_host();
 
+	//the target might be the file the parameters are mapped from
+	//so the layers get their own copy of the parameters before it is overwritten
+	if (model_file != nullptr)
+	{
 		for (auto& l : layers)
 		{
-			l->write_to_ofstream(out);
+			l = l->clone();
+		}
+		model_file.reset();
+		if (flat_parameters)
+		{
+			build_flat_parameters();
 		}
 	}
-	catch (const std::exception& e)
+
+	model_writer writer;
+	write_to_model(writer);
+	writer.save(file_path);
+}
+
+std::string neural_network::save_checkpoint(checkpoint_writer& writer) const
+{
+	gpu_stream_guard stream_guard(stream, gpu_backend);
+
+	model_writer snapshot(true);
+	write_to_model(snapshot);
+	return writer.submit(std::move(snapshot));
+}
+
+void neural_network::write_to_model(model_writer& writer) const
+{
+	writer.write_vector3(input_format);
+	writer.write_u64(layers.size());
+	for (const auto& l : layers)
 	{
-		out.close();
-		throw e;
+		l->write_to_model(writer);
 	}
-	out.close();
-}
\ No newline at end of file
+}
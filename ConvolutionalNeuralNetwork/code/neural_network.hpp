@@ -5,38 +5,192 @@
 #include "pooling_layer.hpp"
 #include "fully_connected_layer.hpp"
 #include "convolutional_layer.hpp"
+#include "quantized_layer.hpp"
+#include "sparse_layer.hpp"
 #include "test_result.hpp"
 
 #include "cuda_runtime.h"
 #include "device_launch_parameters.h"
 #include "data_space.hpp"
+#include "optimizer.hpp"
+#include "batch_uploader.hpp"
+#include "profiler.hpp"
+#include "gpu_graph.hpp"
+#include "checkpoint_writer.hpp"
 
 class neural_network {
 private:
 	vector3 input_format;
 
+	//the mapped file the parameters of a loaded network live in
+	//it is declared before the layers, so it is unmapped after them
+	std::unique_ptr<mapped_model_file> model_file;
+
+	//the parameters, deltas and momentum of all layers can live in three contiguous buffers
+	//the matrices of the layers are allocated inside of them (see use_flat_parameters)
+	//they are declared before the layers, so they are destroyed after them
+	bool flat_parameters = false;
+	std::unique_ptr<arena_matrix_allocator> parameter_arena;
+	std::unique_ptr<arena_matrix_allocator> delta_arena;
+	std::unique_ptr<arena_matrix_allocator> momentum_arena;
+	//the item count of each buffer (including the alignment padding)
+	size_t flat_item_count = 0;
+
+	//momentum with a beta of 0.9 by default
+	optimizer nn_optimizer;
+
+	//the network the parameters of an instance belong to (nullptr if it is not an instance)
+	//it is declared before the layers, so it is destroyed after them
+	std::shared_ptr<const neural_network> parameter_source;
+
+	//the activations of every second layer share one block (see compile_inference_plan)
+	//they are declared before the layers, so they are destroyed after them
+	bool inference_plan = false;
+	std::unique_ptr<shared_block_matrix_allocator> activation_arenas[2];
+	std::unique_ptr<shared_block_matrix_allocator> batch_activation_arenas[2];
+
 	std::vector<std::unique_ptr<layer>> layers;
 	//saves the indices of all layers tha have parameter
 	//convolutional and fully connected 
 	std::vector<int> parameter_layer_indices;
 
 	bool gpu_enabled = false;
+	//all gpu work of this network is enqueued on this stream
+	//it is created when the gpu mode is enabled
+	cudaStream_t stream = nullptr;
+	//the device the gpu data of this network is allocated on
+	int gpu_device = 0;
+	//decides which implementation is used for the gpu work of this network
+	e_gpu_backend_t gpu_backend = native_backend;
+
+	//layers do not keep data for the back propagation (for example the pooling indices)
+	bool inference_only = false;
+
+	//the summed cost of the back propagations since the last reset (see get_training_cost)
+	//it is accumulated on the device in gpu mode
+	matrix training_cost;
+
+	//records the work of the network if it is set (see set_profiler)
+	//copies of the network record into the same profiler
+	profiler* nn_profiler = nullptr;
+
+	//the training step of full batches is replayed from a cuda graph (see set_graph_training)
+	bool graph_training = false;
+
+	//the random transforms of the training items (see set_augmentation)
+	augmentation_settings augmentation;
+	bool augmentation_enabled = false;
+	//the batches augmented so far, a batch uses the seed of the settings plus this count
+	uint64_t augmentation_batch_count = 0;
+
+	//the layout of the convolutional and pooling layers (see set_tensor_layout)
+	e_tensor_layout_t tensor_layout = chw_layout;
+	//gives the layout to every convolutional and pooling layer except the output layer
+	void apply_tensor_layout();
+	//the captured step of one pair of batch buffers
+	struct training_step_graph {
+		gpu_graph graph;
+		//the first step runs normally, so the scratch buffers are allocated before the capture
+		bool warmed_up = false;
+		//the step could not be captured, it runs normally
+		bool failed = false;
+		//apply_deltas is only in the graph if its kernel arguments do not change between steps
+		bool contains_deltas = false;
+	};
 
 	std::mutex forward_mutex;
 	std::mutex back_mutex;
 
 	layer* get_last_layer();
 
+	//the parameters of an instance can only be changed through its parameter source
+	void if_instance_throw() const;
+
+	//a worker of learn_on_ds_parallel. its layers read the parameters of the source
+	//and only have their own activations, errors and deltas (see layer::clone_workspace)
+	//only for the cpu, the parameters of the source must not be moved while it is used
+	neural_network(const neural_network& source, share_parameters_t shared);
+
+	//a compiled inference plan has no errors and deltas anymore
+	void if_inference_plan_throw() const;
+	//moves the activations (or the batch activations) of layer i into the block i % 2
+	//the blocks are as big as the biggest activations that use them
+	void build_activation_arenas(bool batch);
+
 	void add_layer(std::unique_ptr<layer>&& given_layer);
 
 	float calculate_cost(const matrix& expected_output);
+	//allocated on the side the network is on
+	matrix* get_training_cost_p();
 
+	void load_model_file(const std::string& file);
+	//the structure and the parameters of the model file format
+	void write_to_model(model_writer& writer) const;
+
+	void create_stream();
+	void destroy_stream();
+
+	//waits for the gpu and copies the data to the host or device
 	void sync_device_and_host();
+
+	void collect_parameters(
+		std::vector<matrix*>& parameters,
+		std::vector<matrix*>& deltas,
+		std::vector<matrix*>& momentum) const;
+	//false if a layer matrix was reallocated or added since the buffers were built
+	bool flat_parameters_valid() const;
+	//moves all parameter matrices into new buffers
+	void build_flat_parameters();
+	//moves all parameter matrices back to the default allocator
+	void release_flat_parameters();
+	void ensure_flat_parameters();
+	//marks the matrices as changed on the side the flat buffers were updated on
+	void mark_flat_matrices_updated(const std::vector<matrix*>& matrices);
+
+	//the batch (every row is one item) if augmentation is off, otherwise its augmented copy in the buffer
+	//the buffer has the format and gpu mode of the batch
+	const matrix& augment_batch(const matrix& batch, matrix& buffer);
+
+	//back_propagation_batch and apply_deltas of a full batch
+	//with graph training the step is captured once per pair of batch buffers and replayed after that
+	void learn_full_batch(
+		const matrix& data_batch,
+		const matrix& label_batch,
+		size_t batch_size,
+		float learning_rate,
+		training_step_graph& step_graph);
+
+	//used by learn_on_ds if all layers support batch propagation
+	//whole batches are propagated at once, the rest is propagated item by item
+	void learn_on_ds_batched(
+		data_space& ds,
+		size_t epochs,
+		size_t batch_size,
+		float learning_rate
+	);
+	//used by learn_on_ds if the network is on the gpu and the data space is not
+	//the next batch is copied from page locked memory while the current one trains
+	void learn_on_ds_uploaded(
+		data_space& ds,
+		size_t epochs,
+		size_t batch_size,
+		float learning_rate
+	);
 public:
 
 	neural_network();
+	//loads the model file format (see model_file.hpp) or the old format
+	//model files are memory mapped, the parameters are not copied
 	neural_network(const std::string& file);
 	neural_network(const neural_network& source);
+	//an inference only instance that reads the parameters of the given network
+	//instead of copying them. only the activations belong to the instance,
+	//so many instances (for example one per thread) need the parameters only once.
+	//the instance is in gpu mode if the source is. it keeps the source alive,
+	//the parameters of the source must not change while instances use them.
+	//copies of an instance are instances of the same source
+	neural_network(std::shared_ptr<const neural_network> parameter_source);
+	~neural_network();
 
 	neural_network& operator=(const neural_network& source);
 
@@ -47,10 +201,13 @@ public:
 
 	//sets the input matrix to a certain format
 	void set_input_format(vector3 input_format);
+	vector3 get_input_format() const;
 
 	const matrix& get_output_readonly() const;
 	matrix& get_output();
 
+	//a layer with the softmax activation has to be the last layer,
+	//the network is then trained on the cross entropy instead of the squared error
 	void add_fully_connected_layer(size_t num_neurons, e_activation_t activation_fn);
 	void add_fully_connected_layer(vector3 neuron_format, e_activation_t activation_fn);
 	
@@ -73,6 +230,16 @@ public:
 	
 	void back_propagation(const matrix& given_data, const matrix& given_label);
 
+	//true if every layer can propagate a whole batch at once
+	bool supports_batch_propagation() const;
+	void set_batch_size(size_t batch_size);
+	const matrix& get_batch_output_readonly() const;
+	//every row of the batches is one item
+	void forward_propagation_batch(const matrix& input_batch);
+	void back_propagation_batch(const matrix& data_batch, const matrix& label_batch);
+
+	//a data space on the host can be used to train a network on the gpu
+	//if all layers support batch propagation and there is no zero check
 	void learn_on_ds(
 		data_space& ds, 
 		size_t epochs, 
@@ -81,14 +248,155 @@ public:
 		bool input_zero_check
 	);
 
+	//data parallel training on the cpu
+	//every thread has its own activations, errors and deltas and reads the parameters of this network.
+	//it processes a slice of every batch. the deltas of all threads are summed up
+	//before they are applied. a thread count of 0 uses all hardware threads
+	void learn_on_ds_parallel(
+		data_space& ds,
+		size_t epochs,
+		size_t batch_size,
+		float learning_rate,
+		bool input_zero_check,
+		size_t thread_count
+	);
+
+	//data parallel training on multiple gpus
+	//every gpu gets a copy of the network and trains on a slice of every batch in its own thread.
+	//the deltas are summed up on the first gpu (with peer to peer copies), the step is applied there
+	//and the new parameters are copied back to the other gpus.
+	//the result is copied into this network at the end.
+	//the data space has to be on the host, a device count of 0 uses all visible gpus
+	void learn_on_ds_multi_gpu(
+		data_space& ds,
+		size_t epochs,
+		size_t batch_size,
+		float learning_rate,
+		size_t device_count
+	);
+
+	//runs all items of the data space through the network in batches
+	//(item by item if a layer does not support batch propagation)
+	//an item is correct if the highest output and the highest label have the same index,
+	//the cost is the summed squared error. both are summed up on the device,
+	//only the totals are copied back at the end
+	test_result evaluate(data_space& ds, size_t batch_size);
+
 	//we need the training_data_count for 
 	//calculating the average of the deltas
 	void apply_deltas(size_t training_data_count, float learning_rate);
+
+	//the update rule apply_deltas uses, the state of the optimizer is reset
+	void set_optimizer(const optimizer& new_optimizer);
+	const optimizer& get_optimizer() const;
+
+	//all weights, biases, deltas and momentum are kept in three contiguous buffers
+	//apply_deltas is then a single update over the whole network
+	//and set_parameters between two networks of the same format is a single copy
+	//the buffers are rebuilt when layers are added or the gpu mode is enabled
+	void use_flat_parameters(bool use_flat);
+	bool is_using_flat_parameters() const;
+	//the item count of the parameter buffer (including the alignment padding)
+	//0 if the network does not use the flat parameters
+	size_t get_flat_parameter_count() const;
+	//copies all parameters from an array with the layout of the parameter buffer in one copy
+	//the array is a device array in gpu mode. throws if the flat parameters are not used
+	void set_flat_parameters(const float* values);
+	//copies the parameter buffer into a host array
+	void copy_flat_parameters_to_host(float* destination);
+
+	//post training int8 quantization
+	//returns an inference only copy where the fully connected and convolutional layers
+	//are replaced by quantized layers. the weights get one scale per neuron or kernel,
+	//the input scale of every layer is calibrated on the first sample_count items of the data
+	neural_network quantize(data_space& calibration_data, size_t sample_count);
+	//magnitude pruning of the fully connected layers
+	//the smallest share (sparsity, between 0 and 1) of the weights of every neuron is set to zero,
+	//so every neuron keeps the same number of weights. the network can be fine tuned afterwards,
+	//but the pruned weights are not kept at zero by the training
+	void prune(float sparsity);
+	//returns an inference only copy where the fully connected layers are replaced by
+	//sparse layers, that only store and compute the nonzero weights (see sparse_layer)
+	//the copy is saved and loaded in the sparse form
+	neural_network sparsify();
 	//uniform xavier initialization
 	void xavier_initialization();
 
+	//uses the first gpu
 	void enable_gpu_mode();
+	//the gpu work of the network has to be started from a thread whose current device is this device
+	//(cudaSetDevice), enable_gpu_mode sets it for the calling thread
+	//copies of a network in gpu mode are allocated on the current device of the calling thread
+	void enable_gpu_mode(int device);
 	bool is_in_gpu_mode() const;
+	int get_gpu_device() const;
+	cudaStream_t get_stream() const;
+	//frees the host data of the parameters, deltas and momentum (see matrix::set_device_only)
+	//reading them on the host (saving, analysing) allocates the host data again
+	//the parameters of a flat buffer or a mapped model file keep their host data
+	void set_device_only(bool device_only);
+
+	//frees the data that is only needed for training
+	//the back propagation of pooling layers throws in this mode
+	void set_inference_only(bool inference_only);
+	bool is_inference_only() const;
+
+	//compiles the network into a static inference plan
+	//the errors, deltas and momentum of all layers are freed, the optimizer state is reset.
+	//a layer only reads the activations of the layer before it, so the activations of layer i
+	//are dead as soon as layer i + 1 ran. the activations of the even layers
+	//therefore share one block and the ones of the odd layers another one (the same for the batches),
+	//instead of every layer owning its own buffer.
+	//only the output of the network stays valid after a forward propagation.
+	//a plan can not be trained, quantized or extended with layers. copies of a plan are plans
+	void compile_inference_plan();
+	bool has_inference_plan() const;
+	//the items of the shared activation blocks (single and batch), 0 without a plan
+	size_t get_plan_activation_item_count() const;
+
+	//the cost function of the output layer
+	//the cross entropy if the last layer has a softmax activation, otherwise the squared error
+	e_cost_function_t get_cost_function() const;
+	//the summed cost of all items this network back propagated since the last reset
+	//(the copies of the parallel training keep their own cost)
+	//it is summed up on the device, reading it waits for the gpu
+	float get_training_cost();
+	void reset_training_cost();
+
+	//throws if the backend was not compiled in
+	void set_gpu_backend(e_gpu_backend_t backend);
+	e_gpu_backend_t get_gpu_backend() const;
+
+	//every forward and backward pass of a layer and every apply_deltas is recorded
+	//and the kernel launches and matrix copies are counted while the network works
+	//the profiler is not owned and has to outlive the network, nullptr turns the profiling off
+	void set_profiler(profiler* target);
+	profiler* get_profiler() const;
+
+	//the kernels of a training step on a full batch (forward, error, backward and the optimizer step)
+	//are captured into a cuda graph on the second batch of learn_on_ds and replayed for the other ones,
+	//which removes most of the launch overhead of small networks.
+	//adam, adamw and loss scaling change the arguments of the optimizer step every batch,
+	//so then only the propagation is replayed. a new loss scale is captured again.
+	//the graph is not used while profiling or if the step can not be captured
+	void set_graph_training(bool enabled);
+	bool is_graph_training() const;
+
+	//learn_on_ds gives the items random shifts, rotations, elastic distortions and noise
+	//before the first layer (see augmentation_settings). every gathered batch is transformed
+	//into a separate buffer in one pass (one kernel in gpu mode), the data space is not changed.
+	//the items are planar images of the input format. all zero settings turn it off.
+	//the parallel and multi gpu trainings and evaluate do not augment
+	void set_augmentation(const augmentation_settings& settings);
+	const augmentation_settings& get_augmentation() const;
+
+	//the memory layout of the activations of the convolutional and pooling layers
+	//interleaved activations (hwc_layout) keep the values of all depths of a position together,
+	//which lets the convolution read its input contiguously. the layers convert their inputs of
+	//a different layout, the fully connected layers and the output layer always stay planar.
+	//the parameters and the model files are always planar
+	void set_tensor_layout(e_tensor_layout_t layout);
+	e_tensor_layout_t get_tensor_layout() const;
 
 	bool nn_equal_format(const neural_network& other);
 	bool equal_parameter(const neural_network& other);
@@ -96,6 +404,16 @@ public:
 
 	std::string parameter_analysis() const;
 
+	//true if the parameters are read from a memory mapped model file
+	bool is_memory_mapped() const;
+	//true if the parameters belong to a parameter source
+	bool is_instance() const;
+
+	//writes the model file format (see model_file.hpp)
 	//this is not const, because we need to sync the device and host memory before saving
 	void save_to_file(const std::string& file_path);
+	//takes a snapshot of the parameters and lets the writer save it on its background thread
+	//on the gpu the parameters are copied on the stream of the network, it is not synchronized
+	//returns the path the checkpoint will be written to
+	std::string save_checkpoint(checkpoint_writer& writer) const;
 };
\ No newline at end of file
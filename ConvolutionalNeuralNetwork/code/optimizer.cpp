@@ -0,0 +1,140 @@
+#include "optimizer.hpp"
+#include "cpu_math.hpp"
+#include <cmath>
+
+optimizer::optimizer()
+	:optimizer(momentum_optimizer, 0.9f, 0, 0, 0)
+{}
+
+optimizer::optimizer(
+	e_optimizer_t type,
+	float beta1,
+	float beta2,
+	float epsilon,
+	float weight_decay
+) :
+	type(type),
+	beta1(beta1),
+	beta2(beta2),
+	epsilon(epsilon),
+	weight_decay(weight_decay)
+{
+	if (beta1 < 0 || beta1 >= 1 || beta2 < 0 || beta2 >= 1)
+	{
+		throw std::invalid_argument("the betas must be in [0, 1)");
+	}
+	if (weight_decay < 0)
+	{
+		throw std::invalid_argument("the weight decay must not be negative");
+	}
+}
+
+optimizer optimizer::sgd(float weight_decay)
+{
+	return optimizer(sgd_optimizer, 0, 0, 0, weight_decay);
+}
+
+optimizer optimizer::momentum(float beta)
+{
+	return optimizer(momentum_optimizer, beta, 0, 0, 0);
+}
+
+optimizer optimizer::nesterov(float beta)
+{
+	return optimizer(nesterov_optimizer, beta, 0, 0, 0);
+}
+
+optimizer optimizer::adam(float beta1, float beta2, float epsilon)
+{
+	return optimizer(adam_optimizer, beta1, beta2, epsilon, 0);
+}
+
+optimizer optimizer::adamw(float weight_decay, float beta1, float beta2, float epsilon)
+{
+	return optimizer(adamw_optimizer, beta1, beta2, epsilon, weight_decay);
+}
+
+e_optimizer_t optimizer::get_type() const
+{
+	return type;
+}
+
+size_t optimizer::get_step_count() const
+{
+	return step_count;
+}
+
+void optimizer::reset()
+{
+	step_count = 0;
+	second_moments.clear();
+}
+
+void optimizer::begin_step()
+{
+	step_count++;
+}
+
+float* optimizer::get_second_moment(size_t slot, size_t count, bool on_gpu)
+{
+	if (type != adam_optimizer && type != adamw_optimizer)
+	{
+		return nullptr;
+	}
+
+	if (second_moments.size() <= slot)
+	{
+		second_moments.resize(slot + 1);
+	}
+
+	matrix& moment = second_moments[slot];
+	if (!moment.is_initialized() || moment.item_count() != count)
+	{
+		moment = matrix(vector3(count, 1, 1));
+	}
+
+	if (on_gpu)
+	{
+		//the second moment is never read on the host
+		moment.enable_gpu_mode();
+		moment.set_device_only(true);
+		return moment.device_span().data;
+	}
+	moment.sync_device_and_host();
+	return moment.host_span().data;
+}
+
+void optimizer::update(
+	size_t slot,
+	float* params,
+	float* deltas,
+	float* first_moment,
+	size_t count,
+	bool on_gpu,
+	size_t training_data_count,
+	float learning_rate)
+{
+	smart_assert(step_count > 0); //begin_step was not called
+	smart_assert(training_data_count > 0);
+
+	optimizer_step_settings settings{};
+	settings.learning_rate = learning_rate;
+	settings.delta_scale = 1.0f / (float)training_data_count;
+	settings.beta1 = beta1;
+	settings.beta2 = beta2;
+	settings.epsilon = epsilon;
+	settings.weight_decay = weight_decay;
+	settings.first_moment_correction = 1.0f - std::pow(beta1, (float)step_count);
+	settings.second_moment_correction = 1.0f - std::pow(beta2, (float)step_count);
+
+	float* second_moment = get_second_moment(slot, count, on_gpu);
+
+	if (on_gpu)
+	{
+		gpu_optimizer_step(type, settings, params, deltas, first_moment, second_moment, count);
+	}
+	else
+	{
+		cpu_optimizer_step(type, settings, params, deltas, first_moment, second_moment, count);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include "matrix.hpp"
+#include "enum_space.hpp"
+
+/*
+	the update rule that turns the summed deltas of a batch into new parameters
+
+	sgd      - param -= lr * gradient
+	momentum - exponential moving average of the gradients (the default, beta = 0.9)
+	nesterov - momentum that looks ahead along the updated average
+	adam     - bias corrected first and second moment
+	adamw    - adam with weight decay applied to the weights instead of the gradient
+
+	the first moment is the momentum matrix every parameter layer already has
+	the second moment is owned by the optimizer, one buffer per slot
+	(a slot is one parameter matrix, or the whole flat parameter buffer of a network)
+*/
+class optimizer {
+private:
+	e_optimizer_t type;
+	float beta1;
+	float beta2;
+	float epsilon;
+	float weight_decay;
+
+	size_t step_count = 0;
+
+	std::vector<matrix> second_moments;
+
+	//allocates the second moment of the slot if needed
+	float* get_second_moment(size_t slot, size_t count, bool on_gpu);
+public:
+	//momentum with a beta of 0.9
+	optimizer();
+	optimizer(
+		e_optimizer_t type,
+		float beta1,
+		float beta2,
+		float epsilon,
+		float weight_decay);
+
+	static optimizer sgd(float weight_decay = 0);
+	static optimizer momentum(float beta = 0.9f);
+	static optimizer nesterov(float beta = 0.9f);
+	static optimizer adam(float beta1 = 0.9f, float beta2 = 0.999f, float epsilon = 1e-8f);
+	static optimizer adamw(float weight_decay = 0.01f, float beta1 = 0.9f, float beta2 = 0.999f, float epsilon = 1e-8f);
+
+	e_optimizer_t get_type() const;
+	size_t get_step_count() const;
+
+	//forgets the step count and the second moments
+	void reset();
+
+	//has to be called once before the slots of one step are updated
+	void begin_step();
+	//updates count parameters with the deltas summed over training_data_count items
+	//the deltas are set to zero. all pointers are device pointers if on_gpu is true
+	void update(
+		size_t slot,
+		float* params,
+		float* deltas,
+		float* first_moment,
+		size_t count,
+		bool on_gpu,
+		size_t training_data_count,
+		float learning_rate);
+};
@@ -0,0 +1,117 @@
+#include "pooling_index_buffer.hpp"
+#include <stdexcept>
+#include <string>
+#include "cuda_runtime.h"
+
+void pooling_index_buffer::free_device_data()
+{
+	if (device_data != nullptr)
+	{
+		cudaFree(device_data);
+		device_data = nullptr;
+	}
+}
+
+pooling_index_buffer::pooling_index_buffer()
+{}
+
+pooling_index_buffer::pooling_index_buffer(const pooling_index_buffer& other)
+	:host_data(other.host_data.size())
+{
+	if (other.is_in_gpu_mode())
+	{
+		enable_gpu_mode();
+	}
+}
+
+pooling_index_buffer& pooling_index_buffer::operator=(const pooling_index_buffer& other)
+{
+	if (this != &other)
+	{
+		release();
+		resize(other.item_count());
+		if (other.is_in_gpu_mode())
+		{
+			enable_gpu_mode();
+		}
+	}
+	return *this;
+}
+
+pooling_index_buffer::~pooling_index_buffer()
+{
+	free_device_data();
+}
+
+void pooling_index_buffer::resize(size_t item_count)
+{
+	if (item_count == host_data.size())
+	{
+		return;
+	}
+
+	const bool gpu_mode = is_in_gpu_mode();
+	free_device_data();
+	host_data.resize(item_count);
+	if (gpu_mode)
+	{
+		enable_gpu_mode();
+	}
+}
+
+void pooling_index_buffer::release()
+{
+	free_device_data();
+	host_data.clear();
+	host_data.shrink_to_fit();
+}
+
+size_t pooling_index_buffer::item_count() const
+{
+	return host_data.size();
+}
+
+bool pooling_index_buffer::is_allocated() const
+{
+	return !host_data.empty();
+}
+
+void pooling_index_buffer::enable_gpu_mode()
+{
+	if (device_data != nullptr || host_data.empty())
+	{
+		return;
+	}
+
+	cudaError_t error = cudaMalloc(&device_data, host_data.size() * sizeof(unsigned char));
+	if (error != cudaSuccess)
+	{
+		device_data = nullptr;
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+bool pooling_index_buffer::is_in_gpu_mode() const
+{
+	return device_data != nullptr;
+}
+
+unsigned char* pooling_index_buffer::get_host_ptr()
+{
+	return host_data.data();
+}
+
+const unsigned char* pooling_index_buffer::get_host_ptr_readonly() const
+{
+	return host_data.data();
+}
+
+unsigned char* pooling_index_buffer::get_device_ptr()
+{
+	return device_data;
+}
+
+const unsigned char* pooling_index_buffer::get_device_ptr_readonly() const
+{
+	return device_data;
+}
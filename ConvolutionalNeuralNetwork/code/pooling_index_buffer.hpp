@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+//a window of a max or min pooling can have at most this many values
+//so the selected position fits into one byte
+constexpr size_t POOLING_MAX_WINDOW_SIZE = 256;
+
+//stores the position of the selected value inside of its window
+//for every output of a max or min pooling (one byte per output)
+//the forward propagation writes it and the back propagation reads it
+//on the gpu only the device data is used, on the cpu only the host data
+class pooling_index_buffer {
+private:
+	std::vector<unsigned char> host_data;
+	unsigned char* device_data = nullptr;
+
+	void free_device_data();
+public:
+	pooling_index_buffer();
+	//the indices are not copied, only the size and the gpu mode
+	//they are only valid between a forward and its back propagation
+	pooling_index_buffer(const pooling_index_buffer& other);
+	pooling_index_buffer& operator=(const pooling_index_buffer& other);
+	~pooling_index_buffer();
+
+	void resize(size_t item_count);
+	//frees all data
+	void release();
+
+	size_t item_count() const;
+	bool is_allocated() const;
+
+	void enable_gpu_mode();
+	bool is_in_gpu_mode() const;
+
+	unsigned char* get_host_ptr();
+	const unsigned char* get_host_ptr_readonly() const;
+	unsigned char* get_device_ptr();
+	const unsigned char* get_device_ptr_readonly() const;
+};
@@ -28,6 +28,20 @@ pooling_layer::pooling_layer(std::ifstream& file)
 	file.read((char*)&filter_size, sizeof(filter_size));
 	file.read((char*)&stride, sizeof(stride));
 	file.read((char*)&pooling_fn, sizeof(pooling_fn));
+	fixed_kernel = pooling_select_fixed_kernel(filter_size, stride);
+
+	allocate_selected_indices();
+}
+
+pooling_layer::pooling_layer(model_reader& reader)
+	:layer(reader, e_layer_type_t::pooling)
+{
+	filter_size = (size_t)reader.read_u64();
+	stride = (size_t)reader.read_u64();
+	pooling_fn = (e_pooling_type_t)reader.read_u32();
+	fixed_kernel = pooling_select_fixed_kernel(filter_size, stride);
+
+	allocate_selected_indices();
 }
 
 std::unique_ptr<layer> pooling_layer::clone() const
@@ -44,9 +58,26 @@ pooling_layer::pooling_layer(const pooling_layer& other)
 	:layer(other),
 	filter_size(other.filter_size),
 	stride(other.stride),
-	pooling_fn(other.pooling_fn)
+	pooling_fn(other.pooling_fn),
+	fixed_kernel(other.fixed_kernel),
+	selected_indices(other.selected_indices), // only copies the size
+	gpu_enabled(other.gpu_enabled)
 {}
 
+void pooling_layer::allocate_selected_indices()
+{
+	if (inference_only || pooling_fn == average_pooling)
+	{
+		selected_indices.release();
+		return;
+	}
+	selected_indices.resize(activations.item_count());
+	if (gpu_enabled)
+	{
+		selected_indices.enable_gpu_mode();
+	}
+}
+
 void pooling_layer::set_input_format(vector3 input_format)
 {
 	//does check if input_format has more than 0 on every dimension
@@ -59,6 +90,7 @@ void pooling_layer::set_input_format(vector3 input_format)
 
 	const size_t output_width = convolution_output_size(input_format.x, filter_size, stride);
 	const size_t output_height = convolution_output_size(input_format.y, filter_size, stride);
+	fixed_kernel = pooling_select_fixed_kernel(filter_size, stride);
 
 	activations = matrix(
 		vector3(
@@ -71,6 +103,14 @@ void pooling_layer::set_input_format(vector3 input_format)
 			output_width,
 			output_height,
 			input_format.z));
+
+	allocate_selected_indices();
+	set_activation_layout(tensor_layout);
+}
+
+void pooling_layer::set_tensor_layout(e_tensor_layout_t layout)
+{
+	set_activation_layout(layout);
 }
 
 size_t pooling_layer::get_filter_size() const
@@ -116,13 +156,40 @@ void pooling_layer::sync_device_and_host()
 void pooling_layer::forward_propagation(const matrix& input)
 {
 	layer::forward_propagation(input);
-	matrix::pooling(input, activations, filter_size, stride, pooling_fn);
+	matrix::pooling(
+		input_in_layout(input, tensor_layout),
+		activations,
+		stride,
+		filter_size,
+		pooling_fn,
+		selected_indices.is_allocated() ? &selected_indices : nullptr,
+		fixed_kernel);
 }
 
 void pooling_layer::back_propagation(const matrix& input, matrix* passing_error)
 {
 	layer::back_propagation(input, passing_error);
-	throw std::exception("not implemented");
+
+	if (inference_only)
+	{
+		throw std::runtime_error("the back propagation can not be used in inference only mode");
+	}
+
+	//there is nothing to pass the error to if this is the first layer
+	if (passing_error == nullptr)
+	{
+		return;
+	}
+
+	matrix* layout_error = passing_error_in_layout(passing_error, tensor_layout);
+	matrix::pooling_backprop(
+		error,
+		*layout_error,
+		stride,
+		filter_size,
+		pooling_fn,
+		&selected_indices);
+	write_passing_error(passing_error, layout_error);
 }
 
 void pooling_layer::apply_deltas(size_t training_data_count, float learning_rate)
@@ -134,6 +201,7 @@ void pooling_layer::enable_gpu_mode()
 {
 	layer::enable_gpu_mode();
 	gpu_enabled = true;
+	selected_indices.enable_gpu_mode();
 }
 
 void pooling_layer::disable_gpu()
@@ -142,6 +210,15 @@ void pooling_layer::disable_gpu()
 	gpu_enabled = false;
 }
 
+void pooling_layer::set_inference_only(bool given_inference_only)
+{
+	layer::set_inference_only(given_inference_only);
+	if (activations.is_initialized())
+	{
+		allocate_selected_indices();
+	}
+}
+
 bool pooling_layer::equal_format(const layer& other)
 {
 	if (layer::equal_format(other))
@@ -173,3 +250,11 @@ void pooling_layer::write_to_ofstream(std::ofstream& file) const
 	file.write((char*)&stride, sizeof(stride));
 	file.write((char*)&pooling_fn, sizeof(pooling_fn));
 }
+
+void pooling_layer::write_to_model(model_writer& writer) const
+{
+	layer::write_to_model(writer);
+	writer.write_u64(filter_size);
+	writer.write_u64(stride);
+	writer.write_u32(pooling_fn);
+}
@@ -8,7 +8,16 @@ private:
 	size_t stride;
 	e_pooling_type_t pooling_fn;
 
+	//the specialized kernel of the window size and stride, selected in set_input_format
+	e_fixed_kernel_t fixed_kernel = generic_kernel;
+
+	//the position of the selected value of every window (max and min pooling)
+	//it is not allocated in inference only mode
+	pooling_index_buffer selected_indices;
+
 	bool gpu_enabled = false;
+
+	void allocate_selected_indices();
 public:
 	//constructor
 	pooling_layer(
@@ -18,6 +27,7 @@ public:
 	);
 
 	pooling_layer(std::ifstream& file);
+	pooling_layer(model_reader& reader);
 
 	pooling_layer(const pooling_layer& other);
 
@@ -27,6 +37,7 @@ public:
 	size_t get_parameter_count() const override;
 
 	void set_input_format(vector3 input_format) override;
+	void set_tensor_layout(e_tensor_layout_t layout) override;
 
 	size_t get_filter_size() const;
 	size_t get_stride() const;
@@ -48,9 +59,12 @@ public:
 	void enable_gpu_mode() override;
 	void disable_gpu() override;
 
+	void set_inference_only(bool inference_only) override;
+
 	bool equal_format(const layer& other) override;
 	bool equal_parameter(const layer& other) override;
 	void set_parameters(const layer& other) override;
 	
 	void write_to_ofstream(std::ofstream& file) const override;
+	void write_to_model(model_writer& writer) const override;
 };
\ No newline at end of file
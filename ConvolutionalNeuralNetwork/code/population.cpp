@@ -0,0 +1,273 @@
+#include "population.hpp"
+#include "cpu_math.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+population::population(
+	const neural_network& model,
+	size_t genome_count,
+	float initial_noise,
+	size_t worker_count,
+	uint64_t seed
+) :
+	genome_count(genome_count),
+	genome_width(0),
+	gpu_enabled(model.is_in_gpu_mode()),
+	seed(seed)
+{
+	if (genome_count < 2)
+	{
+		throw std::invalid_argument("a population needs at least two genomes");
+	}
+	if (worker_count == 0)
+	{
+		worker_count = std::max((size_t)1, (size_t)std::thread::hardware_concurrency());
+	}
+	//more workers than genomes would have nothing to do
+	worker_count = std::min(worker_count, genome_count);
+
+	for (size_t i = 0; i < worker_count; i++)
+	{
+		workers.push_back(std::make_unique<neural_network>(model));
+		workers.back()->set_inference_only(true);
+		workers.back()->use_flat_parameters(true);
+	}
+	genome_width = workers[0]->get_flat_parameter_count();
+	if (genome_width == 0)
+	{
+		throw std::invalid_argument("the model has no parameters");
+	}
+
+	//the genomes are created on the host and copied to the gpu once
+	std::vector<float> model_parameters(genome_width);
+	workers[0]->copy_flat_parameters_to_host(model_parameters.data());
+
+	for (matrix& curr : genomes)
+	{
+		curr = matrix(vector3(genome_width, genome_count, (size_t)1));
+	}
+	float* values = genomes[current].host_span().data;
+	for (size_t genome = 0; genome < genome_count; genome++)
+	{
+		for (size_t i = 0; i < genome_width; i++)
+		{
+			//the evolution uses the seed up to seed + 2
+			const float noise = genome == 0 ? 0 : (counter_random(seed + 3, genome, i) * 2.0f - 1.0f) * initial_noise;
+			values[genome * genome_width + i] = model_parameters[i] + noise;
+		}
+	}
+
+	fitness = std::vector<float>(genome_count, 0.0f);
+	device_fitness = matrix(vector3(genome_count, (size_t)1, (size_t)1));
+	if (gpu_enabled)
+	{
+		genomes[0].enable_gpu_mode();
+		genomes[1].enable_gpu_mode();
+		device_fitness.enable_gpu_mode();
+	}
+}
+
+void population::if_genome_idx_invalid_throw(size_t genome_idx) const
+{
+	if (genome_idx >= genome_count)
+	{
+		throw std::out_of_range("genome index is out of range");
+	}
+}
+
+const float* population::get_genome_ptr(size_t genome_idx) const
+{
+	const matrix& curr = genomes[current];
+	const float* values = gpu_enabled ? curr.get_device_ptr_readonly() : curr.host_span_readonly().data;
+	return values + genome_idx * genome_width;
+}
+
+size_t population::get_genome_count() const
+{
+	return genome_count;
+}
+
+size_t population::get_generation() const
+{
+	return (size_t)generation;
+}
+
+void population::set_mutation(float rate, float range)
+{
+	if (rate < 0 || rate > 1)
+	{
+		throw std::invalid_argument("the mutation rate has to be between 0 and 1");
+	}
+	mutation_rate = rate;
+	mutation_range = range;
+}
+
+void population::set_tournament_size(size_t size)
+{
+	if (size == 0)
+	{
+		throw std::invalid_argument("the tournament size must be greater than 0");
+	}
+	tournament_size = size;
+}
+
+void population::evaluate(data_space& ds, size_t batch_size)
+{
+	if (ds.is_in_gpu_mode() != gpu_enabled)
+	{
+		throw std::invalid_argument("the data space has to be on the gpu if the population is");
+	}
+
+	//the workers take the next genome until all are evaluated
+	std::atomic<size_t> next_genome(0);
+	std::mutex exception_mutex;
+	std::exception_ptr worker_exception = nullptr;
+
+	auto worker_fn = [&](size_t worker_idx)
+	{
+		neural_network& worker = *workers[worker_idx];
+		try
+		{
+			for (size_t genome = next_genome++; genome < genome_count; genome = next_genome++)
+			{
+				worker.set_flat_parameters(get_genome_ptr(genome));
+				fitness[genome] = -worker.evaluate(ds, batch_size).avg_cost;
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(exception_mutex);
+			if (worker_exception == nullptr)
+			{
+				worker_exception = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		threads.emplace_back(worker_fn, i);
+	}
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	if (worker_exception != nullptr)
+	{
+		fitness_valid = false;
+		std::rethrow_exception(worker_exception);
+	}
+	fitness_valid = true;
+}
+
+void population::set_fitness(const std::vector<float>& values)
+{
+	if (values.size() != genome_count)
+	{
+		throw std::invalid_argument("there has to be one fitness value per genome");
+	}
+	fitness = values;
+	fitness_valid = true;
+}
+
+const std::vector<float>& population::get_fitness() const
+{
+	return fitness;
+}
+
+size_t population::get_fittest_genome_idx() const
+{
+	return (size_t)(std::max_element(fitness.begin(), fitness.end()) - fitness.begin());
+}
+
+void population::evolve()
+{
+	if (!fitness_valid)
+	{
+		throw std::runtime_error("the population has to be evaluated before it can evolve");
+	}
+
+	evolution_settings settings;
+	settings.seed = seed;
+	settings.generation = generation;
+	settings.elite_idx = (uint32_t)get_fittest_genome_idx();
+	settings.tournament_size = (uint32_t)tournament_size;
+	settings.mutation_rate = mutation_rate;
+	settings.mutation_range = mutation_range;
+
+	const size_t next = 1 - current;
+	if (gpu_enabled)
+	{
+		gpu_stream_guard stream_guard(workers[0]->get_stream(), workers[0]->get_gpu_backend());
+		//only the fitness is copied, the genomes stay on the gpu
+		std::copy(fitness.begin(), fitness.end(), device_fitness.host_span().data);
+		device_fitness.sync_device_and_host();
+
+		gpu_evolve_rows(
+			genomes[current].device_span_readonly().data,
+			device_fitness.device_span_readonly().data,
+			genome_count,
+			genome_width,
+			settings,
+			genomes[next].device_span().data);
+		//the workers read the new genomes on their own streams
+		gpu_sync_current_stream();
+	}
+	else
+	{
+		//every thread writes a range of genomes
+		const float* current_values = genomes[current].host_span_readonly().data;
+		float* next_values = genomes[next].host_span().data;
+		const size_t thread_count = workers.size();
+		const size_t genomes_per_thread = (genome_count + thread_count - 1) / thread_count;
+
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < thread_count; i++)
+		{
+			const size_t first_genome = std::min(genome_count, i * genomes_per_thread);
+			const size_t end_genome = std::min(genome_count, first_genome + genomes_per_thread);
+			threads.emplace_back([&, first_genome, end_genome]() {
+				cpu_evolve_rows(
+					current_values,
+					fitness.data(),
+					genome_count,
+					genome_width,
+					settings,
+					first_genome,
+					end_genome,
+					next_values);
+			});
+		}
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+	}
+
+	current = next;
+	generation++;
+	//the new genomes have not been evaluated yet
+	fitness_valid = false;
+}
+
+void population::copy_genome_to(size_t genome_idx, neural_network& target) const
+{
+	if_genome_idx_invalid_throw(genome_idx);
+	if (target.is_in_gpu_mode() != gpu_enabled)
+	{
+		throw std::invalid_argument("the network has to be on the gpu if the population is");
+	}
+
+	if (!target.is_using_flat_parameters())
+	{
+		target.use_flat_parameters(true);
+	}
+	if (target.get_flat_parameter_count() != genome_width)
+	{
+		throw std::invalid_argument("the network does not have the format of the genomes");
+	}
+	target.set_flat_parameters(get_genome_ptr(genome_idx));
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "neural_network.hpp"
+
+/*
+	a population of genomes for neuroevolution
+
+	every genome is one set of parameters of the same network and one row of a matrix
+	(structure of arrays, with the layout of the flat parameters, see use_flat_parameters).
+	the genomes are on the gpu if the given network is.
+
+	evaluate - the workers load the genomes one after another (one copy each)
+	           and run the data space through them in batches, every worker in its own thread
+	evolve   - the next generation is written from the current one in one pass:
+	           the fittest genome is kept, every other one is the uniform crossover
+	           of two parents picked by tournaments, and its parameters are mutated
+	           with the mutation rate. the random numbers of a genome only depend on the seed,
+	           the generation and its index, so no genome is copied to the host
+*/
+class population {
+private:
+	size_t genome_count;
+	size_t genome_width;
+	bool gpu_enabled;
+
+	//the current and the next generation, they are swapped after every evolve
+	matrix genomes[2];
+	size_t current = 0;
+
+	std::vector<float> fitness;
+	bool fitness_valid = false;
+	//the fitness on the gpu, it is uploaded once per generation
+	matrix device_fitness;
+
+	std::vector<std::unique_ptr<neural_network>> workers;
+
+	uint64_t seed;
+	uint64_t generation = 0;
+	size_t tournament_size = 3;
+	float mutation_rate = 0.05f;
+	float mutation_range = 0.1f;
+
+	void if_genome_idx_invalid_throw(size_t genome_idx) const;
+	//the genome in the array the networks read from (a device array in gpu mode)
+	const float* get_genome_ptr(size_t genome_idx) const;
+public:
+	//the first genome has the parameters of the model, the others get a uniform noise
+	//between -initial_noise and initial_noise on top of them
+	//a worker count of 0 uses all hardware threads
+	population(
+		const neural_network& model,
+		size_t genome_count,
+		float initial_noise,
+		size_t worker_count,
+		uint64_t seed);
+
+	population(const population&) = delete;
+	population& operator=(const population&) = delete;
+
+	size_t get_genome_count() const;
+	size_t get_generation() const;
+
+	//the probability that a parameter of a new genome is mutated
+	//and the range of the random value that is added to it
+	void set_mutation(float rate, float range);
+	//how many random genomes compete for being a parent
+	void set_tournament_size(size_t size);
+
+	//the fitness of a genome is its negative average cost on the data space (higher is better)
+	//the data space has to be on the gpu if the population is
+	void evaluate(data_space& ds, size_t batch_size);
+	//sets the fitness of every genome directly (for other objectives)
+	void set_fitness(const std::vector<float>& values);
+	const std::vector<float>& get_fitness() const;
+	size_t get_fittest_genome_idx() const;
+
+	//creates the next generation, the fitness has to be set before
+	void evolve();
+
+	//copies the parameters of the genome into a network with the format of the model
+	//the network uses flat parameters afterwards
+	void copy_genome_to(size_t genome_idx, neural_network& target) const;
+};
@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "math_functions.hpp"
+
+/*
+	conversions between float and the 16 bit storage formats
+	fp16 - ieee half precision, 5 exponent bits, 10 mantissa bits (max 65504)
+	bf16 - bfloat16, the upper half of a float (same range as float, 7 mantissa bits)
+
+	both round to the nearest even value
+	they are compiled for the cpu and the gpu, so the kernels can decode the stored values
+*/
+
+CNN_HOST_DEVICE inline uint32_t float_bits(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+CNN_HOST_DEVICE inline float bits_to_float(uint32_t bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+CNN_HOST_DEVICE inline uint16_t float_to_fp16(float value)
+{
+	const uint32_t bits = float_bits(value);
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t abs_bits = bits & 0x7fffffff;
+
+	//inf and nan (nan stays a quiet nan)
+	if (abs_bits >= 0x7f800000)
+	{
+		return (uint16_t)(sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x200 : 0));
+	}
+	//65520 and above round to inf
+	if (abs_bits >= 0x477ff000)
+	{
+		return (uint16_t)(sign | 0x7c00);
+	}
+
+	uint32_t result;
+	uint32_t remainder;
+	uint32_t halfway;
+	//below the smallest normal fp16 value (2^-14)
+	if (abs_bits < 0x38800000)
+	{
+		const uint32_t shift = 126 - (abs_bits >> 23);
+		if (shift > 24)
+		{
+			return (uint16_t)sign;
+		}
+		const uint32_t mantissa = (abs_bits & 0x7fffff) | 0x800000;
+		result = mantissa >> shift;
+		remainder = mantissa & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	}
+	else
+	{
+		//rebias the exponent from 127 to 15
+		result = (abs_bits - (112u << 23)) >> 13;
+		remainder = abs_bits & 0x1fff;
+		halfway = 0x1000;
+	}
+
+	//a carry into the exponent is the correct rounding as well
+	if (remainder > halfway || (remainder == halfway && (result & 1)))
+	{
+		result++;
+	}
+	return (uint16_t)(sign | result);
+}
+
+CNN_HOST_DEVICE inline float fp16_to_float(uint16_t value)
+{
+	const uint32_t sign = ((uint32_t)value & 0x8000) << 16;
+	const uint32_t exponent = (value >> 10) & 0x1f;
+	const uint32_t mantissa = value & 0x3ff;
+
+	if (exponent == 0x1f)
+	{
+		return bits_to_float(sign | 0x7f800000 | (mantissa << 13));
+	}
+	if (exponent == 0)
+	{
+		//zero or subnormal (mantissa * 2^-24)
+		const float magnitude = (float)mantissa * 5.9604644775390625e-8f;
+		return sign ? -magnitude : magnitude;
+	}
+	return bits_to_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+CNN_HOST_DEVICE inline uint16_t float_to_bf16(float value)
+{
+	const uint32_t bits = float_bits(value);
+	if ((bits & 0x7fffffff) > 0x7f800000)
+	{
+		return (uint16_t)((bits >> 16) | 0x40);
+	}
+	return (uint16_t)((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+CNN_HOST_DEVICE inline float bf16_to_float(uint16_t value)
+{
+	return bits_to_float((uint32_t)value << 16);
+}
+
+//fp32 can not be stored in 16 bits, it is only valid for round_to_precision
+CNN_HOST_DEVICE inline uint16_t encode_precision(e_precision_t precision, float value)
+{
+	return precision == bf16_precision ? float_to_bf16(value) : float_to_fp16(value);
+}
+
+CNN_HOST_DEVICE inline float decode_precision(e_precision_t precision, uint16_t value)
+{
+	return precision == bf16_precision ? bf16_to_float(value) : fp16_to_float(value);
+}
+
+//the closest value the precision can represent
+CNN_HOST_DEVICE inline float round_to_precision(e_precision_t precision, float value)
+{
+	if (precision == fp32_precision)
+	{
+		return value;
+	}
+	return decode_precision(precision, encode_precision(precision, value));
+}
+
+inline size_t precision_byte_size(e_precision_t precision)
+{
+	return precision == fp32_precision ? sizeof(float) : sizeof(uint16_t);
+}
+
+//symmetric int8 quantization, value = q * scale with q between -127 and 127
+constexpr float INT8_QUANTIZED_MAX = 127.0f;
+
+//the scale that maps values up to max_abs to the int8 range
+inline float int8_scale_for(float max_abs)
+{
+	return max_abs > 0 ? max_abs / INT8_QUANTIZED_MAX : 1.0f;
+}
+
+//values outside of the range are clamped, the rest is rounded to the nearest value
+CNN_HOST_DEVICE inline int8_t quantize_int8(float value, float inverse_scale)
+{
+	float q = value * inverse_scale;
+	q = q > INT8_QUANTIZED_MAX ? INT8_QUANTIZED_MAX : q;
+	q = q < -INT8_QUANTIZED_MAX ? -INT8_QUANTIZED_MAX : q;
+	return (int8_t)(q < 0 ? q - 0.5f : q + 0.5f);
+}
@@ -0,0 +1,381 @@
+#include "profiler.hpp"
+#include "matrix.hpp"
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#ifdef CNN_USE_NVTX
+#include <nvToolsExt.h>
+#endif
+
+//the profiler of the network that is working on this thread
+static thread_local profiler* current_profiler = nullptr;
+//everything the current profilers of this thread counted, the scopes take the difference
+static thread_local profile_counters thread_counters;
+
+static std::string layer_type_name(e_layer_type_t type)
+{
+	return
+		type == convolutional ? "convolutional" :
+		type == pooling ? "pooling" :
+		type == fully_connected ? "fully_connected" :
+		type == quantized_fully_connected ? "quantized_fully_connected" :
+		type == quantized_convolutional ? "quantized_convolutional" :
+		type == sparse_fully_connected ? "sparse_fully_connected" :
+		type == network_optimizer ? "network_optimizer" :
+		"invalid";
+}
+
+static std::string phase_name(e_profile_phase_t phase)
+{
+	return
+		phase == forward_phase ? "forward" :
+		phase == backward_phase ? "backward" :
+		phase == apply_deltas_phase ? "apply_deltas" :
+		"invalid";
+}
+
+profile_counters profile_counters::operator-(const profile_counters& other) const
+{
+	profile_counters result;
+	result.kernel_launches = kernel_launches - other.kernel_launches;
+	result.host2device_copies = host2device_copies - other.host2device_copies;
+	result.host2device_bytes = host2device_bytes - other.host2device_bytes;
+	result.device2host_copies = device2host_copies - other.device2host_copies;
+	result.device2host_bytes = device2host_bytes - other.device2host_bytes;
+	return result;
+}
+
+profile_counters& profile_counters::operator+=(const profile_counters& other)
+{
+	kernel_launches += other.kernel_launches;
+	host2device_copies += other.host2device_copies;
+	host2device_bytes += other.host2device_bytes;
+	device2host_copies += other.device2host_copies;
+	device2host_bytes += other.device2host_bytes;
+	return *this;
+}
+
+std::string profile_record::get_name() const
+{
+	const std::string owner = layer_idx < 0 ?
+		"network" :
+		"layer " + std::to_string(layer_idx) + " " + layer_type_name(layer_type);
+	return owner + " " + phase_name(phase);
+}
+
+profiler::profiler()
+	:origin(std::chrono::steady_clock::now()),
+	kernel_launches(0),
+	host2device_copies(0),
+	host2device_bytes(0),
+	device2host_copies(0),
+	device2host_bytes(0)
+{}
+
+profiler::~profiler()
+{
+	std::lock_guard<std::mutex> lock(records_mutex);
+	destroy_pending_locked();
+}
+
+void profiler::resolve_pending_locked() const
+{
+	for (const pending_events& curr : pending)
+	{
+		//the host time of the record stays if the events can not be read
+		float ms = 0;
+		if (cudaEventSynchronize(curr.end) == cudaSuccess &&
+			cudaEventElapsedTime(&ms, curr.start, curr.end) == cudaSuccess)
+		{
+			records[curr.record_idx].duration_us = (double)ms * 1000.0;
+		}
+	}
+	destroy_pending_locked();
+}
+
+void profiler::destroy_pending_locked() const
+{
+	for (const pending_events& curr : pending)
+	{
+		cudaEventDestroy(curr.start);
+		cudaEventDestroy(curr.end);
+	}
+	pending.clear();
+}
+
+void profiler::reset()
+{
+	std::lock_guard<std::mutex> lock(records_mutex);
+	destroy_pending_locked();
+	records.clear();
+	thread_ids.clear();
+	kernel_launches = 0;
+	host2device_copies = 0;
+	host2device_bytes = 0;
+	device2host_copies = 0;
+	device2host_bytes = 0;
+	origin = std::chrono::steady_clock::now();
+}
+
+double profiler::get_time_us() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void profiler::add_record(profile_record record)
+{
+	add_record(record, nullptr, nullptr);
+}
+
+void profiler::add_record(profile_record record, cudaEvent_t start_event, cudaEvent_t end_event)
+{
+	std::lock_guard<std::mutex> lock(records_mutex);
+
+	const std::thread::id id = std::this_thread::get_id();
+	record.thread_idx = thread_ids.size();
+	for (size_t i = 0; i < thread_ids.size(); i++)
+	{
+		if (thread_ids[i] == id)
+		{
+			record.thread_idx = i;
+			break;
+		}
+	}
+	if (record.thread_idx == thread_ids.size())
+	{
+		thread_ids.push_back(id);
+	}
+
+	if (start_event != nullptr && end_event != nullptr)
+	{
+		pending.push_back({ records.size(), start_event, end_event });
+	}
+	records.push_back(record);
+}
+
+void profiler::count_kernel_launch()
+{
+	kernel_launches++;
+}
+
+void profiler::count_copy(bool host2device, size_t byte_count)
+{
+	if (host2device)
+	{
+		host2device_copies++;
+		host2device_bytes += byte_count;
+	}
+	else
+	{
+		device2host_copies++;
+		device2host_bytes += byte_count;
+	}
+}
+
+profile_counters profiler::get_counters() const
+{
+	profile_counters result;
+	result.kernel_launches = kernel_launches;
+	result.host2device_copies = host2device_copies;
+	result.host2device_bytes = host2device_bytes;
+	result.device2host_copies = device2host_copies;
+	result.device2host_bytes = device2host_bytes;
+	return result;
+}
+
+std::vector<profile_record> profiler::get_records() const
+{
+	std::lock_guard<std::mutex> lock(records_mutex);
+	resolve_pending_locked();
+	return records;
+}
+
+std::string profiler::summary() const
+{
+	struct entry {
+		std::string name;
+		size_t calls = 0;
+		double total_us = 0;
+		profile_counters counters;
+	};
+	//ordered by layer and phase, the network records come first
+	std::map<std::pair<int, int>, entry> entries;
+	for (const profile_record& curr : get_records())
+	{
+		entry& e = entries[{ curr.layer_idx, (int)curr.phase }];
+		e.name = curr.get_name();
+		e.calls++;
+		e.total_us += curr.duration_us;
+		e.counters += curr.counters;
+	}
+
+	std::stringstream result;
+	for (const auto& curr : entries)
+	{
+		const entry& e = curr.second;
+		result
+			<< e.name << ": "
+			<< e.calls << " calls, "
+			<< e.total_us / 1000.0 << "ms total, "
+			<< e.total_us / 1000.0 / (double)e.calls << "ms mean, "
+			<< e.counters.kernel_launches << " kernel launches, "
+			<< e.counters.host2device_copies << " host2device copies (" << e.counters.host2device_bytes << " bytes), "
+			<< e.counters.device2host_copies << " device2host copies (" << e.counters.device2host_bytes << " bytes)\n";
+	}
+	const profile_counters totals = get_counters();
+	result
+		<< "total: "
+		<< totals.kernel_launches << " kernel launches, "
+		<< totals.host2device_copies << " host2device copies (" << totals.host2device_bytes << " bytes), "
+		<< totals.device2host_copies << " device2host copies (" << totals.device2host_bytes << " bytes)\n";
+	return result.str();
+}
+
+std::string profiler::to_chrome_trace() const
+{
+	const std::vector<profile_record> all_records = get_records();
+
+	std::stringstream trace;
+	trace << "{\"traceEvents\": [\n";
+	for (size_t i = 0; i < all_records.size(); i++)
+	{
+		const profile_record& curr = all_records[i];
+		trace
+			<< "{\"name\": \"" << curr.get_name() << "\", "
+			<< "\"cat\": \"" << phase_name(curr.phase) << "\", "
+			<< "\"ph\": \"X\", "
+			<< "\"ts\": " << curr.start_us << ", "
+			<< "\"dur\": " << curr.duration_us << ", "
+			<< "\"pid\": " << (curr.on_gpu ? 1 : 0) << ", "
+			<< "\"tid\": " << curr.thread_idx << ", "
+			<< "\"args\": {"
+			<< "\"kernel_launches\": " << curr.counters.kernel_launches << ", "
+			<< "\"host2device_copies\": " << curr.counters.host2device_copies << ", "
+			<< "\"host2device_bytes\": " << curr.counters.host2device_bytes << ", "
+			<< "\"device2host_copies\": " << curr.counters.device2host_copies << ", "
+			<< "\"device2host_bytes\": " << curr.counters.device2host_bytes
+			<< "}}" << (i + 1 < all_records.size() ? "," : "") << "\n";
+	}
+	trace << "], \"displayTimeUnit\": \"ms\"}\n";
+	return trace.str();
+}
+
+void profiler::write_chrome_trace(const std::string& file_path) const
+{
+	std::ofstream file(file_path, std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Could not open file " + file_path);
+	}
+	file << to_chrome_trace();
+}
+
+profiler* profiler_get_current()
+{
+	return current_profiler;
+}
+
+void profiler_count_kernel_launch()
+{
+	if (current_profiler != nullptr)
+	{
+		current_profiler->count_kernel_launch();
+		thread_counters.kernel_launches++;
+	}
+}
+
+void profiler_count_copy(bool host2device, size_t byte_count)
+{
+	if (current_profiler != nullptr)
+	{
+		current_profiler->count_copy(host2device, byte_count);
+		if (host2device)
+		{
+			thread_counters.host2device_copies++;
+			thread_counters.host2device_bytes += byte_count;
+		}
+		else
+		{
+			thread_counters.device2host_copies++;
+			thread_counters.device2host_bytes += byte_count;
+		}
+	}
+}
+
+profiler_guard::profiler_guard(profiler* target)
+	:previous(current_profiler)
+{
+	current_profiler = target;
+}
+
+profiler_guard::~profiler_guard()
+{
+	current_profiler = previous;
+}
+
+profile_scope::profile_scope(
+	profiler* target,
+	int layer_idx,
+	e_layer_type_t layer_type,
+	e_profile_phase_t phase,
+	bool on_gpu)
+	:target(target)
+{
+	if (target == nullptr)
+	{
+		return;
+	}
+
+	record.layer_idx = layer_idx;
+	record.layer_type = layer_type;
+	record.phase = phase;
+	record.on_gpu = on_gpu;
+	counters_at_start = thread_counters;
+
+#ifdef CNN_USE_NVTX
+	nvtxRangePushA(record.get_name().c_str());
+#endif
+
+	if (on_gpu &&
+		(cudaEventCreate(&start_event) != cudaSuccess ||
+		cudaEventCreate(&end_event) != cudaSuccess ||
+		cudaEventRecord(start_event, gpu_get_current_stream()) != cudaSuccess))
+	{
+		//the record keeps the host time
+		cudaEventDestroy(start_event);
+		cudaEventDestroy(end_event);
+		start_event = nullptr;
+		end_event = nullptr;
+	}
+	record.start_us = target->get_time_us();
+}
+
+optimizer_profile_scope::optimizer_profile_scope(profiler* target, bool on_gpu)
+	:guard(target),
+	scope(target, -1, network_optimizer, apply_deltas_phase, on_gpu)
+{}
+
+profile_scope::~profile_scope()
+{
+	if (target == nullptr)
+	{
+		return;
+	}
+
+	record.duration_us = target->get_time_us() - record.start_us;
+	record.counters = thread_counters - counters_at_start;
+	if (end_event != nullptr && cudaEventRecord(end_event, gpu_get_current_stream()) != cudaSuccess)
+	{
+		cudaEventDestroy(start_event);
+		cudaEventDestroy(end_event);
+		start_event = nullptr;
+		end_event = nullptr;
+	}
+
+#ifdef CNN_USE_NVTX
+	nvtxRangePop();
+#endif
+
+	target->add_record(record, start_event, end_event);
+}
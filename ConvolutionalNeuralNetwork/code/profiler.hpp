@@ -0,0 +1,158 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cuda_runtime.h"
+#include "enum_space.hpp"
+
+/*
+	opt in instrumentation of the work of a network (see neural_network::set_profiler)
+
+	every forward and backward pass of a layer and every step of the optimizer is one record.
+	on the cpu it is timed with the steady clock, on the gpu with two events on the current stream,
+	so the duration is the time the kernels ran. the events are only read when the records are
+	collected, so profiling does not add a synchronization per layer.
+
+	while a network works with a profiler, the kernel launches of gpu_math.cu and the copies of
+	matrix::copy_host2device / copy_device2host on that thread are counted, in total and per record.
+	this makes hidden copies visible (for example contains_non_zero_items copying every sample back).
+
+	the records can be printed as a summary per layer or exported as a chrome trace (chrome://tracing).
+	with CNN_USE_NVTX every record is also an nvtx range for nsight systems
+*/
+
+struct profile_counters {
+	size_t kernel_launches = 0;
+	size_t host2device_copies = 0;
+	size_t host2device_bytes = 0;
+	size_t device2host_copies = 0;
+	size_t device2host_bytes = 0;
+
+	profile_counters operator-(const profile_counters& other) const;
+	profile_counters& operator+=(const profile_counters& other);
+};
+
+struct profile_record {
+	//-1 if the record belongs to the whole network (for example the step of the optimizer)
+	int layer_idx = -1;
+	e_layer_type_t layer_type = fully_connected;
+	e_profile_phase_t phase = forward_phase;
+	bool on_gpu = false;
+	//a small index for every thread that added a record
+	size_t thread_idx = 0;
+	//host time since the profiler was created (or reset)
+	double start_us = 0;
+	double duration_us = 0;
+	//the launches and copies on this thread while the record was open
+	profile_counters counters;
+
+	//"layer 0 convolutional forward", "network apply_deltas"
+	std::string get_name() const;
+};
+
+class profiler {
+private:
+	std::chrono::steady_clock::time_point origin;
+
+	mutable std::mutex records_mutex;
+	mutable std::vector<profile_record> records;
+	//the event pair of every gpu record that has not been read yet (record index, start, end)
+	struct pending_events {
+		size_t record_idx;
+		cudaEvent_t start;
+		cudaEvent_t end;
+	};
+	mutable std::vector<pending_events> pending;
+	std::vector<std::thread::id> thread_ids;
+
+	std::atomic<size_t> kernel_launches;
+	std::atomic<size_t> host2device_copies;
+	std::atomic<size_t> host2device_bytes;
+	std::atomic<size_t> device2host_copies;
+	std::atomic<size_t> device2host_bytes;
+
+	//waits for the events and writes the gpu durations into the records
+	//records_mutex has to be locked
+	void resolve_pending_locked() const;
+	void destroy_pending_locked() const;
+public:
+	profiler();
+	~profiler();
+
+	profiler(const profiler&) = delete;
+	profiler& operator=(const profiler&) = delete;
+
+	//removes all records and counters, the time starts at 0 again
+	void reset();
+
+	//thread safe, used by the profile scopes and the counting functions below
+	double get_time_us() const;
+	void add_record(profile_record record);
+	void add_record(profile_record record, cudaEvent_t start_event, cudaEvent_t end_event);
+	void count_kernel_launch();
+	void count_copy(bool host2device, size_t byte_count);
+
+	//the totals of all threads, including the ones outside of any record
+	profile_counters get_counters() const;
+	//waits for the gpu records
+	std::vector<profile_record> get_records() const;
+
+	//one line per layer and phase with the call count, the time and the counters
+	std::string summary() const;
+	std::string to_chrome_trace() const;
+	void write_chrome_trace(const std::string& file_path) const;
+};
+
+//the profiler the launches and copies of the calling thread are counted by (nullptr if none)
+profiler* profiler_get_current();
+void profiler_count_kernel_launch();
+void profiler_count_copy(bool host2device, size_t byte_count);
+
+//sets the current profiler of the thread and restores the previous one when it is destroyed
+class profiler_guard {
+private:
+	profiler* previous;
+public:
+	profiler_guard(profiler* target);
+	~profiler_guard();
+
+	profiler_guard(const profiler_guard&) = delete;
+	profiler_guard& operator=(const profiler_guard&) = delete;
+};
+
+//adds one record to the target for the lifetime of the scope
+//does nothing if the target is null
+class profile_scope {
+private:
+	profiler* target;
+	profile_record record;
+	profile_counters counters_at_start;
+	cudaEvent_t start_event = nullptr;
+	cudaEvent_t end_event = nullptr;
+public:
+	profile_scope(
+		profiler* target,
+		int layer_idx,
+		e_layer_type_t layer_type,
+		e_profile_phase_t phase,
+		bool on_gpu);
+	~profile_scope();
+
+	profile_scope(const profile_scope&) = delete;
+	profile_scope& operator=(const profile_scope&) = delete;
+};
+
+//the optimizer updates all layers at once, so its work is one record of the whole network
+//the target is the current profiler of the thread while the scope is alive
+class optimizer_profile_scope {
+private:
+	//declared first, so the launches of the scope are already counted by the target
+	profiler_guard guard;
+	profile_scope scope;
+public:
+	optimizer_profile_scope(profiler* target, bool on_gpu);
+};
@@ -0,0 +1,369 @@
+#include "quantized_layer.hpp"
+#include "cpu_math.hpp"
+#include "precision.hpp"
+
+quantized_layer::quantized_layer(
+	const fully_connected_layer& source,
+	float input_scale
+) :
+	layer(source),
+	biases(source.get_biases()),
+	input_scale(input_scale)
+{
+	type = e_layer_type_t::quantized_fully_connected;
+	inference_only = true;
+
+	const matrix& source_weights = source.get_weights();
+	//one row of the weights belongs to one neuron
+	weights = int8_matrix::quantize_rows(
+		source_weights.host_span_readonly().data,
+		source_weights.get_height(),
+		source_weights.get_width());
+	activation_fn = source.get_activation_function();
+}
+
+quantized_layer::quantized_layer(
+	const convolutional_layer& source,
+	float input_scale
+) :
+	layer(source),
+	biases(source.get_kernel_biases_readonly()),
+	input_scale(input_scale),
+	kernel_size(source.get_kernel_size()),
+	stride(source.get_stride())
+{
+	type = e_layer_type_t::quantized_convolutional;
+	inference_only = true;
+	activation_fn = source.get_activation_function();
+	//the quantized kernels only compute planar activations
+	set_activation_layout(chw_layout);
+
+	//one row per kernel, in the flat order of the kernel matrices
+	const std::vector<matrix>& kernels = source.get_kernel_weights_readonly();
+	const size_t patch_size = kernels.empty() ? 0 : kernels[0].item_count();
+	std::vector<float> rows(kernels.size() * patch_size);
+	for (size_t i = 0; i < kernels.size(); i++)
+	{
+		const float* kernel = kernels[i].host_span_readonly().data;
+		std::copy(kernel, kernel + patch_size, rows.begin() + i * patch_size);
+	}
+	weights = int8_matrix::quantize_rows(rows.data(), kernels.size(), patch_size);
+}
+
+quantized_layer::quantized_layer(std::ifstream& file, e_layer_type_t type)
+	:layer(file, type)
+{
+	if (type != quantized_fully_connected && type != quantized_convolutional)
+	{
+		throw std::invalid_argument("not a quantized layer type");
+	}
+	inference_only = true;
+
+	file.read((char*)&activation_fn, sizeof(activation_fn));
+	file.read((char*)&input_scale, sizeof(input_scale));
+	if (type == quantized_convolutional)
+	{
+		file.read((char*)&kernel_size, sizeof(kernel_size));
+		file.read((char*)&stride, sizeof(stride));
+	}
+	weights = int8_matrix(file);
+	biases = matrix(file);
+}
+
+quantized_layer::quantized_layer(model_reader& reader, e_layer_type_t type)
+	:layer(reader, type)
+{
+	if (type != quantized_fully_connected && type != quantized_convolutional)
+	{
+		throw std::invalid_argument("not a quantized layer type");
+	}
+	inference_only = true;
+
+	activation_fn = (e_activation_t)reader.read_u32();
+	input_scale = reader.read_f32();
+	if (type == quantized_convolutional)
+	{
+		kernel_size = (size_t)reader.read_u64();
+		stride = (size_t)reader.read_u64();
+	}
+	weights = int8_matrix(reader);
+	biases = matrix(reader);
+}
+
+quantized_layer::quantized_layer(const quantized_layer& other)
+	:layer(other),
+	weights(other.weights),
+	biases(other.biases),
+	input_scale(other.input_scale),
+	activation_fn(other.activation_fn),
+	kernel_size(other.kernel_size),
+	stride(other.stride)
+{}
+
+std::unique_ptr<layer> quantized_layer::clone() const
+{
+	return std::make_unique<quantized_layer>(*this);
+}
+
+size_t quantized_layer::get_parameter_count() const
+{
+	return weights.get_row_count() * weights.get_column_count() + biases.item_count();
+}
+
+e_cost_function_t quantized_layer::get_cost_function() const
+{
+	return activation_fn == softmax_fn ? cross_entropy_cost : squared_error_cost;
+}
+
+size_t quantized_layer::get_quantized_byte_size() const
+{
+	return weights.byte_size() + biases.item_count() * sizeof(float);
+}
+
+const int8_matrix& quantized_layer::get_weights_readonly() const
+{
+	return weights;
+}
+
+const matrix& quantized_layer::get_biases_readonly() const
+{
+	return biases;
+}
+
+float quantized_layer::get_input_scale() const
+{
+	return input_scale;
+}
+
+void quantized_layer::set_all_parameters(float value)
+{
+	throw std::runtime_error("the parameters of a quantized layer can not be changed");
+}
+
+void quantized_layer::apply_noise(float range)
+{
+	throw std::runtime_error("the parameters of a quantized layer can not be changed");
+}
+
+void quantized_layer::mutate(float range)
+{
+	throw std::runtime_error("the parameters of a quantized layer can not be changed");
+}
+
+std::string quantized_layer::parameter_analysis() const
+{
+	std::string ret_val = layer::parameter_analysis();
+	ret_val += "input scale: " + std::to_string(input_scale) + "\n";
+	ret_val += "int8 weights: " + std::to_string(weights.get_row_count()) +
+		" x " + std::to_string(weights.get_column_count()) + "\n";
+	ret_val += "Biases: \n" + biases.analyse_string() + "\n";
+	return ret_val;
+}
+
+void quantized_layer::sync_device_and_host()
+{
+	layer::sync_device_and_host();
+	biases.sync_device_and_host();
+}
+
+void quantized_layer::quantize_input(const matrix& input)
+{
+	const float* values = input.host_span_readonly().data;
+	const float inverse_scale = 1.0f / input_scale;
+	quantized_input.resize(input.item_count());
+	for (size_t i = 0; i < input.item_count(); i++)
+	{
+		quantized_input[i] = quantize_int8(values[i], inverse_scale);
+	}
+}
+
+void quantized_layer::forward_fully_connected_cpu(const matrix& input)
+{
+	quantize_input(input);
+
+	float* result = activations.host_span().data;
+	const size_t column_count = weights.get_column_count();
+	for (size_t row = 0; row < weights.get_row_count(); row++)
+	{
+		const int32_t sum = cpu_dot_int8(weights.get_row_readonly(row), quantized_input.data(), column_count);
+		result[row] = (float)sum * input_scale * weights.get_scale(row);
+	}
+}
+
+void quantized_layer::forward_convolutional_cpu(const matrix& input)
+{
+	quantize_input(input);
+
+	const size_t input_width = input.get_width();
+	const size_t input_height = input.get_height();
+	const size_t output_width = activations.get_width();
+	const size_t positions = output_width * activations.get_height();
+	const size_t patch_size = weights.get_column_count();
+
+	//every window of the input is copied into one row (im2col)
+	//in the same order as the flat kernels, so every output is one int8 dot product
+	patches.resize(positions * patch_size);
+	for (size_t position = 0; position < positions; position++)
+	{
+		const size_t x_start = (position % output_width) * stride;
+		const size_t y_start = (position / output_width) * stride;
+		int8_t* patch = patches.data() + position * patch_size;
+		for (size_t z = 0; z < input.get_depth(); z++)
+		{
+			for (size_t y = 0; y < kernel_size; y++)
+			{
+				const int8_t* input_row =
+					quantized_input.data() + x_start + (y_start + y) * input_width + z * input_width * input_height;
+				std::copy(input_row, input_row + kernel_size, patch);
+				patch += kernel_size;
+			}
+		}
+	}
+
+	float* result = activations.host_span().data;
+	for (size_t kernel = 0; kernel < weights.get_row_count(); kernel++)
+	{
+		const int8_t* kernel_row = weights.get_row_readonly(kernel);
+		const float scale = input_scale * weights.get_scale(kernel);
+		for (size_t position = 0; position < positions; position++)
+		{
+			const int32_t sum = cpu_dot_int8(kernel_row, patches.data() + position * patch_size, patch_size);
+			result[kernel * positions + position] = (float)sum * scale;
+		}
+	}
+}
+
+void quantized_layer::forward_propagation(const matrix& input)
+{
+	layer::forward_propagation(input);
+
+	const matrix& planar_input = input_in_layout(input, chw_layout);
+	if (activations.is_in_gpu_mode() && planar_input.is_in_gpu_mode())
+	{
+		if (type == quantized_fully_connected)
+		{
+			gpu_int8_dot_product(weights, planar_input, input_scale, activations);
+		}
+		else
+		{
+			gpu_int8_valid_cross_correlation(weights, planar_input, input_scale, activations, kernel_size, stride);
+		}
+	}
+	else if (type == quantized_fully_connected)
+	{
+		forward_fully_connected_cpu(planar_input);
+	}
+	else
+	{
+		forward_convolutional_cpu(planar_input);
+	}
+
+	matrix::add_bias_and_activate(activations, biases, activation_fn);
+}
+
+void quantized_layer::back_propagation(const matrix& input, matrix* passing_error)
+{
+	throw std::runtime_error("quantized layers can only be used for inference");
+}
+
+void quantized_layer::apply_deltas(size_t training_data_count, float learning_rate)
+{
+	throw std::runtime_error("quantized layers can only be used for inference");
+}
+
+void quantized_layer::enable_gpu_mode()
+{
+	layer::enable_gpu_mode();
+
+	weights.enable_gpu_mode();
+	biases.enable_gpu_mode();
+}
+
+bool quantized_layer::equal_format(const layer& other)
+{
+	if (layer::equal_format(other))
+	{
+		const quantized_layer& other_casted = dynamic_cast<const quantized_layer&>(other);
+		return
+			weights.get_row_count() == other_casted.weights.get_row_count() &&
+			weights.get_column_count() == other_casted.weights.get_column_count() &&
+			kernel_size == other_casted.kernel_size &&
+			stride == other_casted.stride &&
+			activation_fn == other_casted.activation_fn;
+	}
+	return false;
+}
+
+bool quantized_layer::equal_parameter(const layer& other)
+{
+	if (!equal_format(other))
+	{
+		return false;
+	}
+
+	const quantized_layer& other_casted = dynamic_cast<const quantized_layer&>(other);
+	if (input_scale != other_casted.input_scale ||
+		!matrix::are_equal(biases, other_casted.biases))
+	{
+		return false;
+	}
+	for (size_t row = 0; row < weights.get_row_count(); row++)
+	{
+		if (weights.get_scale(row) != other_casted.weights.get_scale(row) ||
+			!std::equal(
+				weights.get_row_readonly(row),
+				weights.get_row_readonly(row) + weights.get_column_count(),
+				other_casted.weights.get_row_readonly(row)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void quantized_layer::set_parameters(const layer& other)
+{
+	if (!equal_format(other))
+	{
+		throw std::invalid_argument("the other layer does not have the same format");
+	}
+
+	const quantized_layer& other_casted = dynamic_cast<const quantized_layer&>(other);
+	const bool gpu_mode = biases.is_in_gpu_mode();
+	weights = other_casted.weights;
+	biases = other_casted.biases;
+	input_scale = other_casted.input_scale;
+	if (gpu_mode)
+	{
+		weights.enable_gpu_mode();
+		biases.enable_gpu_mode();
+	}
+}
+
+void quantized_layer::write_to_ofstream(std::ofstream& file) const
+{
+	layer::write_to_ofstream(file);
+	file.write((char*)&activation_fn, sizeof(activation_fn));
+	file.write((char*)&input_scale, sizeof(input_scale));
+	if (type == quantized_convolutional)
+	{
+		file.write((char*)&kernel_size, sizeof(kernel_size));
+		file.write((char*)&stride, sizeof(stride));
+	}
+	weights.write_to_ofstream(file);
+	biases.write_to_ofstream(file);
+}
+
+void quantized_layer::write_to_model(model_writer& writer) const
+{
+	layer::write_to_model(writer);
+	writer.write_u32(activation_fn);
+	writer.write_f32(input_scale);
+	if (type == quantized_convolutional)
+	{
+		writer.write_u64(kernel_size);
+		writer.write_u64(stride);
+	}
+	weights.write_to_model(writer);
+	biases.write_to_model(writer);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "matrix.hpp"
+#include "layer.hpp"
+#include "int8_matrix.hpp"
+#include "fully_connected_layer.hpp"
+#include "convolutional_layer.hpp"
+#include <vector>
+
+/*
+	post training int8 version of a fully connected or convolutional layer
+	it can only be used for the forward propagation
+
+	the weights are quantized per channel (one scale per neuron or kernel)
+	the input is quantized with one scale that is calibrated on sample data (see neural_network::quantize)
+	the dot products are computed in 32 bit integers (vnni on the cpu, dp4a on the gpu)
+	and dequantized before the biases and the activation are applied in float
+*/
+class quantized_layer : public layer {
+private:
+	//one row per neuron or kernel
+	int8_matrix weights;
+	matrix biases;
+	float input_scale = 1.0f;
+	e_activation_t activation_fn;
+
+	//only used by the convolutional version
+	size_t kernel_size = 0;
+	size_t stride = 0;
+
+	//the quantized input and the windows of it, reused between calls
+	std::vector<int8_t> quantized_input;
+	std::vector<int8_t> patches;
+
+	void quantize_input(const matrix& input);
+	void forward_fully_connected_cpu(const matrix& input);
+	void forward_convolutional_cpu(const matrix& input);
+public:
+	//input_scale is the scale of the values the layer gets as input
+	quantized_layer(const fully_connected_layer& source, float input_scale);
+	quantized_layer(const convolutional_layer& source, float input_scale);
+	//type is quantized_fully_connected or quantized_convolutional
+	quantized_layer(std::ifstream& file, e_layer_type_t type);
+	quantized_layer(model_reader& reader, e_layer_type_t type);
+
+	quantized_layer(const quantized_layer& other);
+
+	std::unique_ptr<layer> clone() const override;
+
+	size_t get_parameter_count() const override;
+	//the cross entropy for a softmax output (used by the evaluation)
+	e_cost_function_t get_cost_function() const override;
+	//the int8 weights, their scales and the float biases
+	size_t get_quantized_byte_size() const;
+
+	const int8_matrix& get_weights_readonly() const;
+	const matrix& get_biases_readonly() const;
+	float get_input_scale() const;
+
+	//the parameters of a quantized layer can not be changed
+	//these throw
+	void set_all_parameters(float value) override;
+	void apply_noise(float range) override;
+	void mutate(float range) override;
+
+	std::string parameter_analysis() const override;
+
+	void sync_device_and_host() override;
+
+	void forward_propagation(const matrix& input) override;
+	//throws
+	void back_propagation(const matrix& input, matrix* passing_error) override;
+	//throws
+	void apply_deltas(size_t training_data_count, float learning_rate) override;
+
+	void enable_gpu_mode() override;
+
+	bool equal_format(const layer& other) override;
+	bool equal_parameter(const layer& other) override;
+	void set_parameters(const layer& other) override;
+
+	void write_to_ofstream(std::ofstream& file) const override;
+	void write_to_model(model_writer& writer) const override;
+};
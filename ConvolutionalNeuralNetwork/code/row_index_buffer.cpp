@@ -0,0 +1,125 @@
+#include "row_index_buffer.hpp"
+#include <stdexcept>
+#include <string>
+#include "cuda_runtime.h"
+#include "matrix.hpp"
+
+void row_index_buffer::free_device_data()
+{
+	if (device_data != nullptr)
+	{
+		cudaFree(device_data);
+		device_data = nullptr;
+	}
+}
+
+void row_index_buffer::upload()
+{
+	//the host data is pageable, so the call returns as soon as it has been staged
+	cudaError_t error = cudaMemcpyAsync(
+		device_data,
+		host_data.data(),
+		host_data.size() * sizeof(uint32_t),
+		cudaMemcpyHostToDevice,
+		gpu_get_current_stream());
+	if (error != cudaSuccess)
+	{
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+row_index_buffer::row_index_buffer()
+{}
+
+row_index_buffer::row_index_buffer(const row_index_buffer& other)
+	:host_data(other.host_data)
+{
+	if (other.is_in_gpu_mode())
+	{
+		enable_gpu_mode();
+	}
+}
+
+row_index_buffer& row_index_buffer::operator=(const row_index_buffer& other)
+{
+	if (this != &other)
+	{
+		free_device_data();
+		host_data = other.host_data;
+		if (other.is_in_gpu_mode())
+		{
+			enable_gpu_mode();
+		}
+	}
+	return *this;
+}
+
+row_index_buffer::~row_index_buffer()
+{
+	free_device_data();
+}
+
+void row_index_buffer::set(const std::vector<size_t>& indices)
+{
+	const bool gpu_mode = is_in_gpu_mode();
+	if (indices.size() != host_data.size())
+	{
+		free_device_data();
+		host_data.resize(indices.size());
+	}
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (indices[i] > UINT32_MAX)
+		{
+			throw std::invalid_argument("row index does not fit into 32 bits");
+		}
+		host_data[i] = (uint32_t)indices[i];
+	}
+
+	if (is_in_gpu_mode())
+	{
+		upload();
+	}
+	else if (gpu_mode)
+	{
+		//uploads the indices as well
+		enable_gpu_mode();
+	}
+}
+
+size_t row_index_buffer::item_count() const
+{
+	return host_data.size();
+}
+
+void row_index_buffer::enable_gpu_mode()
+{
+	if (device_data != nullptr || host_data.empty())
+	{
+		return;
+	}
+
+	cudaError_t error = cudaMalloc(&device_data, host_data.size() * sizeof(uint32_t));
+	if (error != cudaSuccess)
+	{
+		device_data = nullptr;
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+	upload();
+}
+
+bool row_index_buffer::is_in_gpu_mode() const
+{
+	return device_data != nullptr;
+}
+
+const uint32_t* row_index_buffer::get_host_ptr_readonly() const
+{
+	return host_data.data();
+}
+
+const uint32_t* row_index_buffer::get_device_ptr_readonly() const
+{
+	return device_data;
+}
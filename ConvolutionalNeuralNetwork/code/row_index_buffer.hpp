@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+//a list of row indices that can be read by gpu kernels
+//the indices are always written on the host, in gpu mode they are uploaded
+//on the current stream right away, so reading them never changes the buffer
+class row_index_buffer {
+private:
+	std::vector<uint32_t> host_data;
+	uint32_t* device_data = nullptr;
+
+	void free_device_data();
+	void upload();
+public:
+	row_index_buffer();
+	row_index_buffer(const row_index_buffer& other);
+	row_index_buffer& operator=(const row_index_buffer& other);
+	~row_index_buffer();
+
+	//throws if an index does not fit into 32 bits
+	void set(const std::vector<size_t>& indices);
+
+	size_t item_count() const;
+
+	void enable_gpu_mode();
+	bool is_in_gpu_mode() const;
+
+	const uint32_t* get_host_ptr_readonly() const;
+	const uint32_t* get_device_ptr_readonly() const;
+};
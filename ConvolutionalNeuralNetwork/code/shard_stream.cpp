@@ -0,0 +1,166 @@
+#include "shard_stream.hpp"
+#include "model_file.hpp"
+#include <cstring>
+#include <stdexcept>
+
+static size_t read_shard_header(
+	model_reader& reader,
+	vector3& data_format,
+	vector3& label_format)
+{
+	const size_t item_count = (size_t)reader.read_u64();
+	data_format = reader.read_vector3();
+	label_format = reader.read_vector3();
+	return item_count;
+}
+
+shard_stream::shard_stream(const std::vector<std::string>& shard_paths)
+	:shard_paths(shard_paths),
+	prefetched_shard(NO_SHARD)
+{
+	if (shard_paths.empty())
+	{
+		throw std::invalid_argument("a shard stream needs at least one shard");
+	}
+
+	for (size_t i = 0; i < shard_paths.size(); i++)
+	{
+		mapped_model_file file(shard_paths[i]);
+		model_reader reader(file);
+
+		vector3 shard_data_format;
+		vector3 shard_label_format;
+		const size_t shard_item_count = read_shard_header(reader, shard_data_format, shard_label_format);
+		if (i == 0)
+		{
+			data_format = shard_data_format;
+			label_format = shard_label_format;
+		}
+		else if (shard_data_format != data_format || shard_label_format != label_format)
+		{
+			throw std::runtime_error("the shard " + shard_paths[i] + " has a different format");
+		}
+		if (shard_item_count == 0)
+		{
+			throw std::runtime_error("the shard " + shard_paths[i] + " is empty");
+		}
+
+		shard_item_counts.push_back(shard_item_count);
+		item_count += shard_item_count;
+	}
+}
+
+shard_stream::~shard_stream()
+{
+	if (prefetched.valid())
+	{
+		prefetched.wait();
+	}
+}
+
+std::vector<float> shard_stream::read_shard(size_t shard_idx) const
+{
+	mapped_model_file file(shard_paths[shard_idx]);
+	model_reader reader(file);
+
+	vector3 shard_data_format;
+	vector3 shard_label_format;
+	const size_t shard_item_count = read_shard_header(reader, shard_data_format, shard_label_format);
+
+	vector3 table_format;
+	const float* table = (const float*)reader.next_tensor(float32_tensor, table_format);
+	const size_t row_item_count = data_format.item_count() + label_format.item_count();
+	if (shard_item_count != shard_item_counts[shard_idx] ||
+		table_format.x != row_item_count ||
+		table_format.y != shard_item_count)
+	{
+		throw std::runtime_error("the shard " + shard_paths[shard_idx] + " changed");
+	}
+
+	//copied, so the pages of the file are only touched while it is mapped
+	return std::vector<float>(table, table + table_format.item_count());
+}
+
+const std::vector<std::string>& shard_stream::get_shard_paths() const
+{
+	return shard_paths;
+}
+
+size_t shard_stream::get_shard_count() const
+{
+	return shard_paths.size();
+}
+
+size_t shard_stream::get_shard_item_count(size_t shard_idx) const
+{
+	return shard_item_counts[shard_idx];
+}
+
+size_t shard_stream::get_item_count() const
+{
+	return item_count;
+}
+
+vector3 shard_stream::get_data_format() const
+{
+	return data_format;
+}
+
+vector3 shard_stream::get_label_format() const
+{
+	return label_format;
+}
+
+void shard_stream::prefetch(size_t shard_idx)
+{
+	if (shard_idx >= shard_paths.size())
+	{
+		throw std::out_of_range("shard index out of range");
+	}
+	if (prefetched_shard == shard_idx)
+	{
+		return;
+	}
+	if (prefetched.valid())
+	{
+		prefetched.wait();
+	}
+	prefetched_shard = shard_idx;
+	prefetched = std::async(std::launch::async, [this, shard_idx]() { return read_shard(shard_idx); });
+}
+
+size_t shard_stream::get_prefetched_shard() const
+{
+	return prefetched_shard;
+}
+
+std::vector<float> shard_stream::load(size_t shard_idx)
+{
+	if (shard_idx >= shard_paths.size())
+	{
+		throw std::out_of_range("shard index out of range");
+	}
+	if (prefetched_shard == shard_idx)
+	{
+		prefetched_shard = NO_SHARD;
+		return prefetched.get();
+	}
+	return read_shard(shard_idx);
+}
+
+void shard_stream::write_shard(
+	const std::string& path,
+	vector3 data_format,
+	vector3 label_format,
+	size_t item_count,
+	const float* values)
+{
+	const size_t row_item_count = data_format.item_count() + label_format.item_count();
+
+	model_writer writer;
+	writer.write_u64(item_count);
+	writer.write_vector3(data_format);
+	writer.write_vector3(label_format);
+	writer.add_tensor(float32_tensor, vector3(row_item_count, item_count, (size_t)1), values);
+	writer.save(path);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <future>
+#include <string>
+#include <vector>
+#include "vector3.hpp"
+
+/*
+	the shard files of a streaming data space (see data_space::save_shards)
+
+	a shard is a model file (see model_file.hpp) with the item count, the data format
+	and the label format in its structure and one tensor with a row per item (data, then label)
+
+	the next shard is read on a background thread while the current one is used
+*/
+class shard_stream {
+private:
+	std::vector<std::string> shard_paths;
+	std::vector<size_t> shard_item_counts;
+	vector3 data_format;
+	vector3 label_format;
+	size_t item_count = 0;
+
+	std::future<std::vector<float>> prefetched;
+	size_t prefetched_shard;
+
+	//the values of all items of the shard, one row per item
+	std::vector<float> read_shard(size_t shard_idx) const;
+public:
+	static constexpr size_t NO_SHARD = (size_t)-1;
+
+	//reads the headers of all shards, all of them need the same formats
+	shard_stream(const std::vector<std::string>& shard_paths);
+	//waits for the background read
+	~shard_stream();
+
+	shard_stream(const shard_stream&) = delete;
+	shard_stream& operator=(const shard_stream&) = delete;
+
+	const std::vector<std::string>& get_shard_paths() const;
+	size_t get_shard_count() const;
+	size_t get_shard_item_count(size_t shard_idx) const;
+	size_t get_item_count() const;
+	vector3 get_data_format() const;
+	vector3 get_label_format() const;
+
+	//starts reading the shard on the background thread
+	//a prefetch of another shard that was not loaded yet is discarded
+	void prefetch(size_t shard_idx);
+	size_t get_prefetched_shard() const;
+	//the values of the shard, waits for the background read if the shard is prefetched
+	//otherwise the shard is read on the calling thread
+	std::vector<float> load(size_t shard_idx);
+
+	static void write_shard(
+		const std::string& path,
+		vector3 data_format,
+		vector3 label_format,
+		size_t item_count,
+		const float* values);
+};
@@ -0,0 +1,221 @@
+#include "sparse_layer.hpp"
+#include "cpu_math.hpp"
+
+sparse_layer::sparse_layer(const fully_connected_layer& source)
+	:layer(source),
+	biases(source.get_biases())
+{
+	type = e_layer_type_t::sparse_fully_connected;
+	inference_only = true;
+
+	const matrix& source_weights = source.get_weights();
+	//one row of the weights belongs to one neuron
+	weights = sparse_matrix::from_dense(
+		source_weights.host_span_readonly().data,
+		source_weights.get_height(),
+		source_weights.get_width());
+	activation_fn = source.get_activation_function();
+}
+
+sparse_layer::sparse_layer(std::ifstream& file)
+	:layer(file, e_layer_type_t::sparse_fully_connected)
+{
+	inference_only = true;
+
+	file.read((char*)&activation_fn, sizeof(activation_fn));
+	weights = sparse_matrix(file);
+	biases = matrix(file);
+}
+
+sparse_layer::sparse_layer(model_reader& reader)
+	:layer(reader, e_layer_type_t::sparse_fully_connected)
+{
+	inference_only = true;
+
+	activation_fn = (e_activation_t)reader.read_u32();
+	weights = sparse_matrix(reader);
+	biases = matrix(reader);
+}
+
+sparse_layer::sparse_layer(const sparse_layer& other)
+	:layer(other),
+	weights(other.weights),
+	biases(other.biases),
+	activation_fn(other.activation_fn)
+{}
+
+std::unique_ptr<layer> sparse_layer::clone() const
+{
+	return std::make_unique<sparse_layer>(*this);
+}
+
+size_t sparse_layer::get_parameter_count() const
+{
+	return weights.get_nonzero_count() + biases.item_count();
+}
+
+e_cost_function_t sparse_layer::get_cost_function() const
+{
+	return activation_fn == softmax_fn ? cross_entropy_cost : squared_error_cost;
+}
+
+size_t sparse_layer::get_sparse_byte_size() const
+{
+	return weights.byte_size() + biases.item_count() * sizeof(float);
+}
+
+const sparse_matrix& sparse_layer::get_weights_readonly() const
+{
+	return weights;
+}
+
+const matrix& sparse_layer::get_biases_readonly() const
+{
+	return biases;
+}
+
+e_activation_t sparse_layer::get_activation_function() const
+{
+	return activation_fn;
+}
+
+void sparse_layer::set_all_parameters(float value)
+{
+	throw std::runtime_error("the parameters of a sparse layer can not be changed");
+}
+
+void sparse_layer::apply_noise(float range)
+{
+	throw std::runtime_error("the parameters of a sparse layer can not be changed");
+}
+
+void sparse_layer::mutate(float range)
+{
+	throw std::runtime_error("the parameters of a sparse layer can not be changed");
+}
+
+std::string sparse_layer::parameter_analysis() const
+{
+	std::string ret_val = layer::parameter_analysis();
+	ret_val += "sparse weights: " + std::to_string(weights.get_row_count()) +
+		" x " + std::to_string(weights.get_column_count()) +
+		" (" + std::to_string(weights.get_nonzero_count()) + " nonzero)\n";
+	ret_val += "Biases: \n" + biases.analyse_string() + "\n";
+	return ret_val;
+}
+
+void sparse_layer::sync_device_and_host()
+{
+	layer::sync_device_and_host();
+	biases.sync_device_and_host();
+}
+
+void sparse_layer::forward_propagation_cpu(const matrix& input)
+{
+	const float* input_values = input.host_span_readonly().data;
+	float* result = activations.host_span().data;
+	for (size_t row = 0; row < weights.get_row_count(); row++)
+	{
+		result[row] = cpu_sparse_dot(
+			weights.get_row_values_readonly(row),
+			weights.get_row_columns_readonly(row),
+			weights.get_row_nonzero_count(row),
+			input_values);
+	}
+}
+
+void sparse_layer::forward_propagation(const matrix& input)
+{
+	layer::forward_propagation(input);
+
+	//the columns belong to the planar order of the input
+	const matrix& planar_input = input_in_layout(input, chw_layout);
+	if (activations.is_in_gpu_mode() && planar_input.is_in_gpu_mode())
+	{
+		gpu_sparse_dot_product(weights, planar_input, activations);
+	}
+	else
+	{
+		forward_propagation_cpu(planar_input);
+	}
+
+	matrix::add_bias_and_activate(activations, biases, activation_fn);
+}
+
+void sparse_layer::back_propagation(const matrix& input, matrix* passing_error)
+{
+	throw std::runtime_error("sparse layers can only be used for inference");
+}
+
+void sparse_layer::apply_deltas(size_t training_data_count, float learning_rate)
+{
+	throw std::runtime_error("sparse layers can only be used for inference");
+}
+
+void sparse_layer::enable_gpu_mode()
+{
+	layer::enable_gpu_mode();
+
+	weights.enable_gpu_mode();
+	biases.enable_gpu_mode();
+}
+
+bool sparse_layer::equal_format(const layer& other)
+{
+	if (layer::equal_format(other))
+	{
+		const sparse_layer& other_casted = dynamic_cast<const sparse_layer&>(other);
+		return
+			weights.get_row_count() == other_casted.weights.get_row_count() &&
+			weights.get_column_count() == other_casted.weights.get_column_count() &&
+			activation_fn == other_casted.activation_fn;
+	}
+	return false;
+}
+
+bool sparse_layer::equal_parameter(const layer& other)
+{
+	if (!equal_format(other))
+	{
+		return false;
+	}
+
+	const sparse_layer& other_casted = dynamic_cast<const sparse_layer&>(other);
+	return
+		sparse_matrix::are_equal(weights, other_casted.weights) &&
+		matrix::are_equal(biases, other_casted.biases);
+}
+
+void sparse_layer::set_parameters(const layer& other)
+{
+	if (!equal_format(other))
+	{
+		throw std::invalid_argument("the other layer does not have the same format");
+	}
+
+	const sparse_layer& other_casted = dynamic_cast<const sparse_layer&>(other);
+	const bool gpu_mode = biases.is_in_gpu_mode();
+	weights = other_casted.weights;
+	biases = other_casted.biases;
+	if (gpu_mode)
+	{
+		weights.enable_gpu_mode();
+		biases.enable_gpu_mode();
+	}
+}
+
+void sparse_layer::write_to_ofstream(std::ofstream& file) const
+{
+	layer::write_to_ofstream(file);
+	file.write((char*)&activation_fn, sizeof(activation_fn));
+	weights.write_to_ofstream(file);
+	biases.write_to_ofstream(file);
+}
+
+void sparse_layer::write_to_model(model_writer& writer) const
+{
+	layer::write_to_model(writer);
+	writer.write_u32(activation_fn);
+	weights.write_to_model(writer);
+	biases.write_to_model(writer);
+}
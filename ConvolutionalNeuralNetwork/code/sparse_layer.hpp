@@ -0,0 +1,68 @@
+#pragma once
+#include "matrix.hpp"
+#include "layer.hpp"
+#include "sparse_matrix.hpp"
+#include "fully_connected_layer.hpp"
+
+/*
+	pruned version of a fully connected layer
+	it can only be used for the forward propagation
+
+	the weights are stored in the csr format (see sparse_matrix), only the nonzero weights
+	are read, so the forward propagation and the memory scale with the weights left after
+	the pruning (see neural_network::prune and neural_network::sparsify)
+*/
+class sparse_layer : public layer {
+private:
+	//one row per neuron
+	sparse_matrix weights;
+	matrix biases;
+	e_activation_t activation_fn;
+
+	void forward_propagation_cpu(const matrix& input);
+public:
+	//the zero weights of the source are dropped
+	sparse_layer(const fully_connected_layer& source);
+	sparse_layer(std::ifstream& file);
+	sparse_layer(model_reader& reader);
+
+	sparse_layer(const sparse_layer& other);
+
+	std::unique_ptr<layer> clone() const override;
+
+	//the nonzero weights and the biases
+	size_t get_parameter_count() const override;
+	//the cross entropy for a softmax output (used by the evaluation)
+	e_cost_function_t get_cost_function() const override;
+	//the csr weights and the float biases
+	size_t get_sparse_byte_size() const;
+
+	const sparse_matrix& get_weights_readonly() const;
+	const matrix& get_biases_readonly() const;
+	e_activation_t get_activation_function() const;
+
+	//the parameters of a sparse layer can not be changed
+	//these throw
+	void set_all_parameters(float value) override;
+	void apply_noise(float range) override;
+	void mutate(float range) override;
+
+	std::string parameter_analysis() const override;
+
+	void sync_device_and_host() override;
+
+	void forward_propagation(const matrix& input) override;
+	//throws
+	void back_propagation(const matrix& input, matrix* passing_error) override;
+	//throws
+	void apply_deltas(size_t training_data_count, float learning_rate) override;
+
+	void enable_gpu_mode() override;
+
+	bool equal_format(const layer& other) override;
+	bool equal_parameter(const layer& other) override;
+	void set_parameters(const layer& other) override;
+
+	void write_to_ofstream(std::ofstream& file) const override;
+	void write_to_model(model_writer& writer) const override;
+};
@@ -0,0 +1,287 @@
+#include "sparse_matrix.hpp"
+#include "assert_throw.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "cuda_runtime.h"
+
+void sparse_matrix::free_device_data()
+{
+	if (device_row_offsets != nullptr)
+	{
+		cudaFree(device_row_offsets);
+		device_row_offsets = nullptr;
+	}
+	if (device_column_indices != nullptr)
+	{
+		cudaFree(device_column_indices);
+		device_column_indices = nullptr;
+	}
+	if (device_values != nullptr)
+	{
+		cudaFree(device_values);
+		device_values = nullptr;
+	}
+}
+
+sparse_matrix::sparse_matrix()
+	:row_offsets(1, 0)
+{}
+
+sparse_matrix::sparse_matrix(std::ifstream& file)
+{
+	if (!file.is_open())
+	{
+		throw std::runtime_error("file is not open");
+	}
+
+	size_t nonzero_count;
+	file.read((char*)&row_count, sizeof(row_count));
+	file.read((char*)&column_count, sizeof(column_count));
+	file.read((char*)&nonzero_count, sizeof(nonzero_count));
+
+	row_offsets.resize(row_count + 1);
+	column_indices.resize(nonzero_count);
+	values.resize(nonzero_count);
+	file.read((char*)row_offsets.data(), row_offsets.size() * sizeof(uint32_t));
+	file.read((char*)column_indices.data(), column_indices.size() * sizeof(uint32_t));
+	file.read((char*)values.data(), values.size() * sizeof(float));
+	if (!file || row_offsets.back() != nonzero_count)
+	{
+		throw std::runtime_error("could not read sparse matrix");
+	}
+}
+
+sparse_matrix::sparse_matrix(model_reader& reader)
+{
+	column_count = (size_t)reader.read_u64();
+
+	vector3 offset_format;
+	const uint32_t* offsets = (const uint32_t*)reader.next_tensor(uint32_tensor, offset_format);
+	vector3 column_format;
+	const uint32_t* columns = (const uint32_t*)reader.next_tensor(uint32_tensor, column_format);
+	vector3 value_format;
+	const float* nonzero_values = (const float*)reader.next_tensor(float32_tensor, value_format);
+
+	if (offset_format.item_count() == 0 ||
+		column_format.item_count() != value_format.item_count() ||
+		offsets[offset_format.item_count() - 1] != value_format.item_count())
+	{
+		throw std::runtime_error("invalid sparse matrix in model file");
+	}
+	row_count = offset_format.item_count() - 1;
+	row_offsets.assign(offsets, offsets + row_count + 1);
+	column_indices.assign(columns, columns + column_format.item_count());
+	values.assign(nonzero_values, nonzero_values + value_format.item_count());
+}
+
+sparse_matrix::sparse_matrix(const sparse_matrix& other)
+	:row_count(other.row_count),
+	column_count(other.column_count),
+	row_offsets(other.row_offsets),
+	column_indices(other.column_indices),
+	values(other.values)
+{
+	if (other.is_in_gpu_mode())
+	{
+		enable_gpu_mode();
+	}
+}
+
+sparse_matrix& sparse_matrix::operator=(const sparse_matrix& other)
+{
+	if (this != &other)
+	{
+		free_device_data();
+		row_count = other.row_count;
+		column_count = other.column_count;
+		row_offsets = other.row_offsets;
+		column_indices = other.column_indices;
+		values = other.values;
+		if (other.is_in_gpu_mode())
+		{
+			enable_gpu_mode();
+		}
+	}
+	return *this;
+}
+
+sparse_matrix::~sparse_matrix()
+{
+	free_device_data();
+}
+
+sparse_matrix sparse_matrix::from_dense(const float* dense_values, size_t row_count, size_t column_count)
+{
+	if (row_count * column_count > std::numeric_limits<uint32_t>::max())
+	{
+		throw std::invalid_argument("the matrix is too large for 32 bit indices");
+	}
+
+	sparse_matrix result;
+	result.row_count = row_count;
+	result.column_count = column_count;
+	result.row_offsets.assign(row_count + 1, 0);
+	for (size_t row = 0; row < row_count; row++)
+	{
+		const float* row_values = dense_values + row * column_count;
+		for (size_t column = 0; column < column_count; column++)
+		{
+			if (row_values[column] != 0.0f)
+			{
+				result.column_indices.push_back((uint32_t)column);
+				result.values.push_back(row_values[column]);
+			}
+		}
+		result.row_offsets[row + 1] = (uint32_t)result.values.size();
+	}
+	return result;
+}
+
+size_t sparse_matrix::get_row_count() const
+{
+	return row_count;
+}
+
+size_t sparse_matrix::get_column_count() const
+{
+	return column_count;
+}
+
+size_t sparse_matrix::get_nonzero_count() const
+{
+	return values.size();
+}
+
+float sparse_matrix::get_sparsity() const
+{
+	const size_t dense_count = row_count * column_count;
+	return dense_count == 0 ? 0.0f : 1.0f - (float)values.size() / (float)dense_count;
+}
+
+size_t sparse_matrix::byte_size() const
+{
+	return
+		row_offsets.size() * sizeof(uint32_t) +
+		column_indices.size() * sizeof(uint32_t) +
+		values.size() * sizeof(float);
+}
+
+size_t sparse_matrix::get_row_nonzero_count(size_t row_idx) const
+{
+	smart_assert(row_idx < row_count);
+	return row_offsets[row_idx + 1] - row_offsets[row_idx];
+}
+
+const float* sparse_matrix::get_row_values_readonly(size_t row_idx) const
+{
+	smart_assert(row_idx < row_count);
+	return values.data() + row_offsets[row_idx];
+}
+
+const uint32_t* sparse_matrix::get_row_columns_readonly(size_t row_idx) const
+{
+	smart_assert(row_idx < row_count);
+	return column_indices.data() + row_offsets[row_idx];
+}
+
+float sparse_matrix::get_value(size_t row_idx, size_t column_idx) const
+{
+	smart_assert(column_idx < column_count);
+	const uint32_t* row_begin = get_row_columns_readonly(row_idx);
+	const uint32_t* row_end = row_begin + get_row_nonzero_count(row_idx);
+	//the columns of a row are sorted
+	const uint32_t* found = std::lower_bound(row_begin, row_end, (uint32_t)column_idx);
+	if (found == row_end || *found != column_idx)
+	{
+		return 0.0f;
+	}
+	return values[found - column_indices.data()];
+}
+
+void sparse_matrix::enable_gpu_mode()
+{
+	if (device_row_offsets != nullptr || row_count == 0)
+	{
+		return;
+	}
+
+	//at least one item, so an empty matrix still has device pointers
+	const size_t nonzero_count = std::max(values.size(), (size_t)1);
+	cudaError_t error = cudaMalloc(&device_row_offsets, row_offsets.size() * sizeof(uint32_t));
+	if (error == cudaSuccess)
+	{
+		error = cudaMalloc(&device_column_indices, nonzero_count * sizeof(uint32_t));
+	}
+	if (error == cudaSuccess)
+	{
+		error = cudaMalloc(&device_values, nonzero_count * sizeof(float));
+	}
+	if (error == cudaSuccess)
+	{
+		error = cudaMemcpy(device_row_offsets, row_offsets.data(), row_offsets.size() * sizeof(uint32_t), cudaMemcpyHostToDevice);
+	}
+	if (error == cudaSuccess)
+	{
+		error = cudaMemcpy(device_column_indices, column_indices.data(), column_indices.size() * sizeof(uint32_t), cudaMemcpyHostToDevice);
+	}
+	if (error == cudaSuccess)
+	{
+		error = cudaMemcpy(device_values, values.data(), values.size() * sizeof(float), cudaMemcpyHostToDevice);
+	}
+	if (error != cudaSuccess)
+	{
+		free_device_data();
+		throw std::runtime_error("CUDA error: " + std::string(cudaGetErrorString(error)));
+	}
+}
+
+bool sparse_matrix::is_in_gpu_mode() const
+{
+	return device_row_offsets != nullptr;
+}
+
+const uint32_t* sparse_matrix::get_device_row_offsets_readonly() const
+{
+	return device_row_offsets;
+}
+
+const uint32_t* sparse_matrix::get_device_column_indices_readonly() const
+{
+	return device_column_indices;
+}
+
+const float* sparse_matrix::get_device_values_readonly() const
+{
+	return device_values;
+}
+
+bool sparse_matrix::are_equal(const sparse_matrix& a, const sparse_matrix& b)
+{
+	return
+		a.row_count == b.row_count &&
+		a.column_count == b.column_count &&
+		a.row_offsets == b.row_offsets &&
+		a.column_indices == b.column_indices &&
+		a.values == b.values;
+}
+
+void sparse_matrix::write_to_ofstream(std::ofstream& file) const
+{
+	const size_t nonzero_count = values.size();
+	file.write((char*)&row_count, sizeof(row_count));
+	file.write((char*)&column_count, sizeof(column_count));
+	file.write((char*)&nonzero_count, sizeof(nonzero_count));
+	file.write((char*)row_offsets.data(), row_offsets.size() * sizeof(uint32_t));
+	file.write((char*)column_indices.data(), column_indices.size() * sizeof(uint32_t));
+	file.write((char*)values.data(), values.size() * sizeof(float));
+}
+
+void sparse_matrix::write_to_model(model_writer& writer) const
+{
+	writer.write_u64(column_count);
+	writer.add_tensor(uint32_tensor, vector3(row_offsets.size(), 1, 1), row_offsets.data());
+	writer.add_tensor(uint32_tensor, vector3(column_indices.size(), 1, 1), column_indices.data());
+	writer.add_tensor(float32_tensor, vector3(values.size(), 1, 1), values.data());
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include "model_file.hpp"
+
+//a row major matrix in the compressed sparse row format (csr)
+//only the nonzero values are stored, together with their column
+//the values of row r are values[row_offsets[r]] to values[row_offsets[r + 1] - 1]
+class sparse_matrix {
+private:
+	size_t row_count = 0;
+	size_t column_count = 0;
+
+	//row_count + 1 entries
+	std::vector<uint32_t> row_offsets;
+	std::vector<uint32_t> column_indices;
+	std::vector<float> values;
+
+	uint32_t* device_row_offsets = nullptr;
+	uint32_t* device_column_indices = nullptr;
+	float* device_values = nullptr;
+
+	void free_device_data();
+public:
+	sparse_matrix();
+	sparse_matrix(std::ifstream& file);
+	//the values are copied out of the mapped file
+	sparse_matrix(model_reader& reader);
+	sparse_matrix(const sparse_matrix& other);
+	sparse_matrix& operator=(const sparse_matrix& other);
+	~sparse_matrix();
+
+	//keeps every value that is not exactly zero
+	static sparse_matrix from_dense(const float* dense_values, size_t row_count, size_t column_count);
+
+	size_t get_row_count() const;
+	size_t get_column_count() const;
+	size_t get_nonzero_count() const;
+	//the share of the values that are zero
+	float get_sparsity() const;
+	size_t byte_size() const;
+
+	size_t get_row_nonzero_count(size_t row_idx) const;
+	const float* get_row_values_readonly(size_t row_idx) const;
+	const uint32_t* get_row_columns_readonly(size_t row_idx) const;
+	float get_value(size_t row_idx, size_t column_idx) const;
+
+	void enable_gpu_mode();
+	bool is_in_gpu_mode() const;
+	const uint32_t* get_device_row_offsets_readonly() const;
+	const uint32_t* get_device_column_indices_readonly() const;
+	const float* get_device_values_readonly() const;
+
+	static bool are_equal(const sparse_matrix& a, const sparse_matrix& b);
+
+	void write_to_ofstream(std::ofstream& file) const;
+	void write_to_model(model_writer& writer) const;
+};
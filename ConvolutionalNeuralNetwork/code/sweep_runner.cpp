@@ -0,0 +1,188 @@
+#include "sweep_runner.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+sweep_runner::sweep_runner(data_space& training_data, data_space* test_data)
+	:training_data(training_data),
+	test_data(test_data)
+{
+	if (!training_data.is_initialized() || training_data.get_item_count() == 0)
+	{
+		throw std::invalid_argument("the sweep needs training data");
+	}
+}
+
+size_t sweep_runner::add_configuration(const neural_network& model, const sweep_configuration& configuration)
+{
+	if (configuration.epochs == 0 || configuration.batch_size == 0)
+	{
+		throw std::invalid_argument("a configuration needs at least one epoch and a batch size");
+	}
+
+	networks.push_back(std::make_unique<neural_network>(model));
+	if (training_data.is_in_gpu_mode() && !networks.back()->is_in_gpu_mode())
+	{
+		networks.back()->enable_gpu_mode();
+	}
+
+	sweep_result result;
+	result.configuration = configuration;
+	results.push_back(result);
+	return networks.size() - 1;
+}
+
+size_t sweep_runner::get_configuration_count() const
+{
+	return networks.size();
+}
+
+void sweep_runner::set_test_batch_size(size_t batch_size)
+{
+	if (batch_size == 0)
+	{
+		throw std::invalid_argument("the test batch size has to be at least 1");
+	}
+	test_batch_size = batch_size;
+}
+
+void sweep_runner::run_epoch(size_t idx)
+{
+	neural_network& nn = *networks[idx];
+	sweep_result& result = results[idx];
+	if (nn.is_in_gpu_mode())
+	{
+		//the work of a network has to be started from its device
+		cudaSetDevice(nn.get_gpu_device());
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	nn.learn_on_ds(
+		training_data,
+		1,
+		result.configuration.batch_size,
+		result.configuration.learning_rate,
+		false);
+	auto end = std::chrono::high_resolution_clock::now();
+	result.training_time_in_ms += std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+	if (test_data != nullptr)
+	{
+		result.epoch_results.push_back(nn.evaluate(*test_data, test_batch_size));
+	}
+}
+
+void sweep_runner::run(size_t max_concurrent)
+{
+	if (max_concurrent == 0)
+	{
+		max_concurrent = networks.size();
+	}
+
+	size_t round_count = 0;
+	for (const sweep_result& curr : results)
+	{
+		round_count = std::max(round_count, curr.configuration.epochs);
+	}
+
+	//the order is only frozen while the trainings read it,
+	//a data space that was frozen before is not shuffled
+	const bool was_frozen = training_data.is_order_frozen();
+	for (size_t round = 0; round < round_count; round++)
+	{
+		//the configurations that train in this round
+		std::vector<size_t> active;
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			if (round < results[i].configuration.epochs)
+			{
+				active.push_back(i);
+			}
+		}
+
+		//the workers take the next configuration until all trained one epoch
+		std::atomic<size_t> next_active(0);
+		std::mutex exception_mutex;
+		std::exception_ptr worker_exception = nullptr;
+
+		auto worker_fn = [&]()
+		{
+			try
+			{
+				for (size_t i = next_active++; i < active.size(); i = next_active++)
+				{
+					run_epoch(active[i]);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(exception_mutex);
+				if (worker_exception == nullptr)
+				{
+					worker_exception = std::current_exception();
+				}
+			}
+		};
+
+		training_data.set_order_frozen(true);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < std::min(max_concurrent, active.size()); i++)
+		{
+			threads.emplace_back(worker_fn);
+		}
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+		training_data.set_order_frozen(was_frozen);
+
+		if (worker_exception != nullptr)
+		{
+			std::rethrow_exception(worker_exception);
+		}
+		training_data.shuffle();
+	}
+}
+
+const std::vector<sweep_result>& sweep_runner::get_results() const
+{
+	return results;
+}
+
+neural_network& sweep_runner::get_network(size_t idx)
+{
+	if (idx >= networks.size())
+	{
+		throw std::invalid_argument("configuration index out of range");
+	}
+	return *networks[idx];
+}
+
+size_t sweep_runner::get_best_idx() const
+{
+	if (test_data == nullptr)
+	{
+		throw std::runtime_error("the sweep has no test data");
+	}
+
+	size_t best_idx = results.size();
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		if (results[i].epoch_results.empty())
+		{
+			continue;
+		}
+		if (best_idx == results.size() ||
+			results[i].epoch_results.back().accuracy > results[best_idx].epoch_results.back().accuracy)
+		{
+			best_idx = i;
+		}
+	}
+	if (best_idx == results.size())
+	{
+		throw std::runtime_error("no configuration was trained yet");
+	}
+	return best_idx;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "neural_network.hpp"
+#include "data_space.hpp"
+#include "test_result.hpp"
+
+//the hyperparameters of one training of a sweep
+struct sweep_configuration {
+	std::string name;
+	size_t epochs = 1;
+	size_t batch_size = 1;
+	float learning_rate = 0.01f;
+};
+
+struct sweep_result {
+	sweep_configuration configuration;
+	//the result on the test data after every epoch, empty without test data
+	std::vector<test_result> epoch_results;
+	long long training_time_in_ms = 0;
+};
+
+/*
+	trains several networks at the same time on one data space (a hyperparameter sweep)
+
+	the data spaces are loaded (and copied to the gpu) once and shared by all trainings,
+	every network trains in its own thread on its own cuda stream (see neural_network::get_stream).
+	small networks that can not fill the gpu on their own run side by side this way.
+
+	the trainings run in rounds of one epoch. while a round runs the order of the training data
+	is frozen (see data_space::set_order_frozen), so the data space is only read and every training
+	sees each item once per epoch. the order is shuffled between the rounds.
+*/
+class sweep_runner {
+private:
+	data_space& training_data;
+	data_space* test_data;
+	size_t test_batch_size = 100;
+
+	std::vector<std::unique_ptr<neural_network>> networks;
+	std::vector<sweep_result> results;
+
+	//trains the network one epoch and tests it afterwards
+	void run_epoch(size_t idx);
+public:
+	//the data spaces have to stay valid while the runner is used
+	//the test data can be null, then the networks are only trained
+	sweep_runner(data_space& training_data, data_space* test_data);
+
+	sweep_runner(const sweep_runner&) = delete;
+	sweep_runner& operator=(const sweep_runner&) = delete;
+
+	//the network is copied, so every configuration can start from the same model
+	//it is moved to the gpu if the training data is on the gpu
+	//returns the index of the configuration
+	size_t add_configuration(const neural_network& model, const sweep_configuration& configuration);
+	size_t get_configuration_count() const;
+
+	void set_test_batch_size(size_t batch_size);
+
+	//trains all configurations, at most max_concurrent at the same time
+	//a max_concurrent of 0 trains all of them at the same time
+	//the first exception of a training is rethrown after all threads stopped
+	void run(size_t max_concurrent);
+
+	const std::vector<sweep_result>& get_results() const;
+	neural_network& get_network(size_t idx);
+	//the configuration with the highest accuracy after its last epoch
+	//throws if there is no test data or nothing ran yet
+	size_t get_best_idx() const;
+};
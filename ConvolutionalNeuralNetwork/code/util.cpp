@@ -51,6 +51,13 @@ float random_float_excl(float min, float max)
 	return ret_val;
 }
 
+uint64_t random_seed()
+{
+	static std::random_device rd;
+	static std::mt19937_64 gen(((uint64_t)rd() << 32) | rd());
+	return gen();
+}
+
 bool is_whole_number(float number)
 {
 	return number == (int)number;
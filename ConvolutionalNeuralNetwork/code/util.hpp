@@ -16,6 +16,9 @@ bool biased_coin_toss(float true_bias, float false_bias);
 
 float random_float_excl(float min, float max);
 
+//a new seed for the counter based random numbers (see counter_random)
+uint64_t random_seed();
+
 bool is_whole_number(float number);
 
 /// <summary>
@@ -34,6 +37,18 @@ T* sub_ptr(T* ptr, size_t elements, size_t index)
 	return ptr + index * elements;
 }
 
+//a non owning view of contiguous data
+//it does not check the bounds and can be iterated with a range based for loop
+template<typename T>
+struct data_span {
+	T* data;
+	size_t size;
+
+	T* begin() const { return data; }
+	T* end() const { return data + size; }
+	T& operator[](size_t idx) const { return data[idx]; }
+};
+
 int swap_endian(int value);
 //determins wether the system is little endian or big endian
 bool is_little_endian();
@@ -37,6 +37,18 @@ size_t vector3::get_index(const vector3& format) const
 	return x + y * format.x + z * format.x * format.y;
 }
 
+size_t vector3::get_index(const vector3& format, e_tensor_layout_t layout) const
+{
+	if (layout == chw_layout)
+		return get_index(format);
+
+	if (!this->is_in_bounds(format))
+		throw std::invalid_argument("vector3::get_index: format is not in bounds");
+
+	//z + x * depth + y * width * depth
+	return z + x * format.z + y * format.x * format.z;
+}
+
 size_t vector3::item_count() const
 {
 	return x * y * z;
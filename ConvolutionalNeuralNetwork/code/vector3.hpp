@@ -1,5 +1,6 @@
 #include <stdexcept>
 #include <string>
+#include "enum_space.hpp"
 
 #pragma once
 class vector3
@@ -18,6 +19,7 @@ public:
 
 	bool is_in_bounds(const vector3& format) const;
 	size_t get_index(const vector3& format) const;
+	size_t get_index(const vector3& format, e_tensor_layout_t layout) const;
 	size_t item_count() const;
 
 	void write_to_ofstream(std::ofstream& file) const;
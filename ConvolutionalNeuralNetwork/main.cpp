@@ -5,7 +5,7 @@ int main()
 {
 	mnist_digit_overlord overlord;
 	
-	overlord.train(150, 100, 1.0f);
+	overlord.train(150, 100, 0.001f);
 
 	std::cout << "start testing" << std::endl;
 	test_result t_result = overlord.test();
@@ -1,6 +1,7 @@
 #pragma once
 #include "../../ConvolutionalNeuralNetwork/code/data_space.hpp"
 #include "../../ConvolutionalNeuralNetwork/code/neural_network.hpp"
+#include "../../ConvolutionalNeuralNetwork/code/sweep_runner.hpp"
 class mnist_digit_overlord
 {
 private:
@@ -8,17 +9,12 @@ private:
 	data_space ds_test;
 	neural_network nn;
 
-	void label_to_matrix(unsigned char label, matrix& m) const;
-	float get_digit_cost(const matrix& output, const matrix& label) const;
 	void print_digit_image(const matrix& m) const;
 	void load_data(
 		data_space& ds, 
 		std::string data_path, 
 		std::string label_path);
 
-	//returns the flat index of the float with the highest value in the matrix
-	size_t idx_of_max(const matrix& m) const;
-
 	void enable_gpu();
 
 public:
@@ -33,4 +29,7 @@ public:
 
 	test_result test();
 	void train(size_t epochs, size_t batch_size, float learning_rate);
+	//trains the configurations at the same time on the loaded data, every one starts from the current network
+	//the data is not loaded or copied to the gpu again (see sweep_runner)
+	std::vector<sweep_result> sweep(const std::vector<sweep_configuration>& configurations, size_t max_concurrent);
 };
\ No newline at end of file